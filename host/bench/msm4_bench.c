@@ -0,0 +1,274 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+/// Скорость замены MSM7 на MSM4 на хосте: по кадрам каждого типа MSM7 (время на кадр,
+/// МБ/с, уменьшение размера) и потоком через rtcm3_msm4_stream_feed кусками как из UART,
+/// с долей процессора, которую замена заняла бы на заданных скоростях UART
+
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <protocol/rtcm3.h>
+
+#define BENCH_BAUDS_MAX 8
+#define BENCH_TYPES_MAX 16
+#define BENCH_UART_BUFFER_SIZE 1024             // как UART_BUFFER_SIZE в uart_task
+#define BENCH_SYNTHETIC_EPOCHS 2000
+
+typedef struct bench_input {
+    uint8_t *data;
+    size_t length;
+} bench_input_t;
+
+typedef struct bench_type {
+    uint16_t type;
+    uint32_t frames;
+    uint64_t bytes;
+    uint64_t converted;
+    uint64_t ns;
+} bench_type_t;
+
+static uint64_t bench_cpu_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Входные данные */
+
+static bool bench_input_load(bench_input_t *input, const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        perror(path);
+        return false;
+    }
+
+    fseek(file, 0, SEEK_END);
+    input->length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    input->data = malloc(input->length);
+    bool ok = input->data != NULL && fread(input->data, 1, input->length, file) == input->length;
+    fclose(file);
+
+    return ok;
+}
+
+/// Кадр MSM7 со случайными данными и согласованными масками
+static size_t bench_msm7(uint8_t *frame, uint16_t type, unsigned satellites, unsigned signals) {
+    uint8_t payload[RTCM3_PAYLOAD_MAX];
+    for (size_t i = 0; i < sizeof(payload); i++) payload[i] = rand();
+
+    uint64_t satellite_mask = 0;
+    while (__builtin_popcountll(satellite_mask) < satellites) satellite_mask |= 1ULL << (63 - rand() % 36);
+    uint32_t signal_mask = 0;
+    while (__builtin_popcount(signal_mask) < signals) signal_mask |= 1u << (31 - rand() % 24);
+    unsigned mask_bits = satellites * signals;
+    uint64_t cell_mask = mask_bits == 64 ? ~0ULL : (1ULL << mask_bits) - 1;
+    cell_mask &= ~(1ULL << (rand() % mask_bits));               // один сигнал не отслеживается
+
+    rtcm3_set_bits(payload, 0, 12, type);
+    rtcm3_set_bits(payload, 54, 1, type != 1127);               // Multiple Message до последней системы
+    rtcm3_set_bits(payload, 73, 64, satellite_mask);
+    rtcm3_set_bits(payload, 137, 32, signal_mask);
+    rtcm3_set_bits(payload, 169, mask_bits, cell_mask);
+
+    size_t bits = 169 + mask_bits + satellites * 36 + __builtin_popcountll(cell_mask) * 80;
+    return rtcm3_frame_build(frame, payload, (bits + 7) / 8);
+}
+
+/// Синтетическая эпоха базы: координаты станции, MSM7 четырёх систем и смещения ГЛОНАСС
+static bool bench_input_synthetic(bench_input_t *input) {
+    static const struct {
+        uint16_t type;
+        uint8_t satellites;
+        uint8_t signals;
+    } epoch[] = {{1077, 12, 3}, {1087, 8, 2}, {1097, 10, 3}, {1127, 14, 2}};
+
+    input->data = malloc(BENCH_SYNTHETIC_EPOCHS * (sizeof(epoch) / sizeof(epoch[0]) + 2) * RTCM3_FRAME_MAX);
+    if (input->data == NULL) return false;
+
+    uint8_t payload[RTCM3_PAYLOAD_MAX] = {0};
+    srand(1);
+    for (int i = 0; i < BENCH_SYNTHETIC_EPOCHS; i++) {
+        rtcm3_set_bits(payload, 0, 12, 1005);
+        input->length += rtcm3_frame_build(input->data + input->length, payload, 19);
+        for (size_t j = 0; j < sizeof(epoch) / sizeof(epoch[0]); j++) {
+            input->length += bench_msm7(input->data + input->length, epoch[j].type, epoch[j].satellites, epoch[j].signals);
+        }
+        rtcm3_set_bits(payload, 0, 12, 1230);
+        input->length += rtcm3_frame_build(input->data + input->length, payload, 8);
+    }
+
+    return true;
+}
+
+/* Замена по кадрам */
+
+typedef struct bench_frames {
+    bench_type_t types[BENCH_TYPES_MAX];
+    size_t type_count;
+    uint8_t out[RTCM3_FRAME_MAX];
+} bench_frames_t;
+
+static void bench_frame(void *ctx, const uint8_t *frame, size_t length) {
+    bench_frames_t *frames = ctx;
+    uint16_t type = length >= 5 ? rtcm3_message_type(frame) : 0;
+    if (type < 1071 || type > 1137 || type % 10 != 7) return;
+
+    bench_type_t *entry = NULL;
+    for (size_t i = 0; i < frames->type_count && entry == NULL; i++) {
+        if (frames->types[i].type == type) entry = &frames->types[i];
+    }
+    if (entry == NULL) {
+        if (frames->type_count == BENCH_TYPES_MAX) return;
+        entry = &frames->types[frames->type_count++];
+        entry->type = type;
+    }
+
+    // Повтор до заметного времени, чтобы не мерить сам clock_gettime
+    const int repeat = 64;
+    size_t converted = 0;
+    uint64_t start = bench_cpu_ns();
+    for (int i = 0; i < repeat; i++) converted = rtcm3_msm7_to_msm4(frame, length, frames->out);
+    entry->ns += bench_cpu_ns() - start;
+
+    entry->frames += repeat;
+    entry->bytes += (uint64_t) length * repeat;
+    entry->converted += (uint64_t) (converted > 0 ? converted : length) * repeat;
+}
+
+/* Поток */
+
+static int bench_null_write(void *ctx, const void *data, size_t length) {
+    *(uint64_t *) ctx += length;
+    return length;
+}
+
+static void bench_usage(const char *name) {
+    fprintf(stderr, "Usage: %s [options]\n"
+            "  -f, --file PATH       .rtcm capture (default: synthetic MSM7 epochs)\n"
+            "  -b, --baud LIST       comma separated UART baud rates for the CPU estimate (default: 115200,460800,921600)\n"
+            "  -s, --seconds N       time per measurement (default: 2)\n"
+            "  -k, --chunk N         UART read size in bytes, 1-%d (default: %d)\n",
+            name, BENCH_UART_BUFFER_SIZE, BENCH_UART_BUFFER_SIZE);
+}
+
+int main(int argc, char **argv) {
+    const char *file = NULL;
+    uint32_t bauds[BENCH_BAUDS_MAX] = {115200, 460800, 921600};
+    size_t baud_count = 3, chunk = BENCH_UART_BUFFER_SIZE;
+    uint32_t seconds = 2;
+
+    static const struct option long_options[] = {
+            {"file", required_argument, NULL, 'f'},
+            {"baud", required_argument, NULL, 'b'},
+            {"seconds", required_argument, NULL, 's'},
+            {"chunk", required_argument, NULL, 'k'},
+            {"help", no_argument, NULL, 'h'},
+            {NULL, 0, NULL, 0}
+    };
+
+    int option;
+    while ((option = getopt_long(argc, argv, "f:b:s:k:h", long_options, NULL)) != -1) {
+        switch (option) {
+            case 'f':
+                file = optarg;
+                break;
+            case 'b':
+                baud_count = 0;
+                for (char *item = strtok(optarg, ","); item != NULL && baud_count < BENCH_BAUDS_MAX; item = strtok(NULL, ",")) {
+                    bauds[baud_count++] = strtoul(item, NULL, 10);
+                }
+                break;
+            case 's':
+                seconds = strtoul(optarg, NULL, 10);
+                break;
+            case 'k':
+                chunk = strtoul(optarg, NULL, 10);
+                break;
+            default:
+                bench_usage(argv[0]);
+                return option == 'h' ? 0 : 2;
+        }
+    }
+    if (seconds == 0 || baud_count == 0 || chunk < 1 || chunk > BENCH_UART_BUFFER_SIZE) {
+        bench_usage(argv[0]);
+        return 2;
+    }
+
+    bench_input_t input = {0};
+    if (!(file != NULL ? bench_input_load(&input, file) : bench_input_synthetic(&input))) {
+        fprintf(stderr, "Could not read input\n");
+        return 1;
+    }
+
+    // По кадрам: проходы по записи, пока не наберётся заданное время
+    static bench_frames_t frames;
+    static rtcm3_framer_t framer;
+    uint64_t budget = (uint64_t) seconds * 1000000000, spent = 0;
+    while (spent < budget) {
+        rtcm3_framer_init(&framer, bench_frame, &frames);
+        uint64_t start = bench_cpu_ns();
+        rtcm3_framer_feed(&framer, input.data, input.length);
+        spent += bench_cpu_ns() - start;
+        if (frames.type_count == 0) break;
+    }
+    if (frames.type_count == 0) {
+        fprintf(stderr, "No MSM7 frames in input\n");
+        return 1;
+    }
+
+    printf("Input: %s, %zu bytes\n\n", file != NULL ? file : "synthetic", input.length);
+    printf("%6s %10s %8s %10s %8s %8s\n", "type", "frames", "ns", "MB/s", "bytes", "msm4");
+    printf("%6s %10s %8s %10s %8s %8s\n", "", "", "/frame", "msm7", "/frame", "%");
+    for (size_t i = 0; i < frames.type_count; i++) {
+        const bench_type_t *type = &frames.types[i];
+        printf("%6u %10u %8.0f %10.1f %8.0f %8.1f\n", type->type, type->frames, (double) type->ns / type->frames,
+                type->bytes * 1e3 / type->ns, (double) type->bytes / type->frames, 100.0 * type->converted / type->bytes);
+    }
+
+    // Поток кусками как из UART, вместе с поиском кадров и пропуском остальных сообщений
+    static rtcm3_msm4_stream_t stream;
+    rtcm3_msm4_stream_init(&stream);
+    uint64_t passes = 0, written = 0, ns = 0;
+    while (ns < budget) {
+        uint64_t start = bench_cpu_ns();
+        for (size_t offset = 0; offset < input.length; offset += chunk) {
+            size_t n = input.length - offset < chunk ? input.length - offset : chunk;
+            rtcm3_msm4_stream_feed(&stream, input.data + offset, n, bench_null_write, &written);
+        }
+        ns += bench_cpu_ns() - start;
+        passes++;
+    }
+
+    double throughput = passes * input.length * 1e9 / ns;
+    printf("\nStream: %.1f MB/s in, %.1f%% out, %u MSM7 frames per pass, %u CRC errors\n", throughput / 1e6,
+            100.0 * written / (passes * input.length), (unsigned) (stream.converted / passes), (unsigned) stream.crc_errors);
+    for (size_t i = 0; i < baud_count; i++) {
+        printf("  %7u baud: %.4f%% of this CPU\n", (unsigned) bauds[i], 100.0 * bauds[i] / 10 / throughput);
+    }
+
+    free(input.data);
+
+    return 0;
+}
@@ -0,0 +1,523 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/// Нагрузочный тест конвейера на хосте: воспроизведение .rtcm записи с заданной
+/// скоростью UART через кадрирование RTCM 3 в локальные NTRIP кастеры.
+/// Отчёт: пропускная способность, перцентили задержки и процессорное время по этапам
+
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <event_journal.h>
+#include <mock_caster.h>
+#include <net.h>
+#include <platform.h>
+#include <retry.h>
+#include <trace.h>
+#include <interface/ntrip_uplink.h>
+#include <protocol/rtcm3.h>
+
+#define BENCH_BAUDS_MAX 8
+#define BENCH_CASTERS_MAX 4
+#define BENCH_UART_BUFFER_SIZE 1024             // как UART_BUFFER_SIZE в uart_task
+#define BENCH_UART_TIMEOUT_US 50000             // тайм-аут uart_read_bytes в uart_task
+#define BENCH_SYNTHETIC_SIZE (1024 * 1024)
+#define BENCH_UNPACED_SIZE (16 * 1024 * 1024)
+#define BENCH_DRAIN_TIMEOUT_US 5000000
+
+#define BENCH_MOUNTPOINT "BENCH"
+#define BENCH_PASSWORD "bench"
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+typedef struct bench_options {
+    const char *file;
+    uint32_t bauds[BENCH_BAUDS_MAX];
+    size_t baud_count;
+    uint32_t seconds;
+    size_t casters;
+    size_t chunk;
+    const char *trace;
+} bench_options_t;
+
+typedef struct bench_input {
+    uint8_t *data;
+    size_t length;
+
+    // Смещение конца каждого кадра во входных данных
+    size_t *frame_ends;
+    size_t frame_count;
+} bench_input_t;
+
+typedef struct bench_run bench_run_t;
+
+typedef struct bench_caster {
+    bench_run_t *run;
+    mock_caster_handle_t caster;
+    int sock;
+
+    size_t frames;
+    uint32_t *pipeline_latency;
+    uint32_t *wire_latency;
+} bench_caster_t;
+
+struct bench_run {
+    const bench_input_t *input;
+    uint64_t total;             // байт к отправке
+    uint32_t rate;              // байт/с, 0 - без ограничения
+    uint64_t start;
+
+    size_t frame_total;
+    size_t frames;
+    uint64_t *dispatched;       // время передачи кадра на отправку
+
+    size_t caster_count;
+    bench_caster_t casters[BENCH_CASTERS_MAX];
+
+    uint64_t cpu_framing;
+    uint64_t cpu_send;
+    uint32_t send_errors;
+};
+
+static uint64_t bench_cpu_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void bench_sleep_until(uint64_t time_us) {
+    struct timespec ts = {
+            .tv_sec = time_us / 1000000,
+            .tv_nsec = (long) (time_us % 1000000) * 1000
+    };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+}
+
+static int bench_compare_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+    return x < y ? -1 : x > y;
+}
+
+/* Входные данные */
+
+static void bench_input_frame(void *ctx, const uint8_t *frame, size_t length) {
+    size_t *position = ctx;
+    *position = *position + 1;
+}
+
+/// Поиск границ кадров: побайтовая подача, чтобы знать, каким байтом завершился кадр
+static bool bench_input_index(bench_input_t *input) {
+    input->frame_ends = malloc((input->length / (RTCM3_HEADER_SIZE + RTCM3_CRC_SIZE) + 1) * sizeof(size_t));
+    if (input->frame_ends == NULL) return false;
+
+    size_t completed = 0;
+    rtcm3_framer_t framer;
+    rtcm3_framer_init(&framer, bench_input_frame, &completed);
+    for (size_t i = 0; i < input->length; i++) {
+        rtcm3_framer_feed(&framer, input->data + i, 1);
+        if (completed > input->frame_count) input->frame_ends[input->frame_count++] = i + 1;
+    }
+
+    return input->frame_count > 0;
+}
+
+static bool bench_input_load(bench_input_t *input, const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        perror(path);
+        return false;
+    }
+
+    fseek(file, 0, SEEK_END);
+    input->length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    input->data = malloc(input->length);
+    bool ok = input->data != NULL && fread(input->data, 1, input->length, file) == input->length;
+    fclose(file);
+
+    return ok && bench_input_index(input);
+}
+
+/// Синтетическая эпоха базы: координаты станции, MSM7 четырёх систем и смещения ГЛОНАСС
+static bool bench_input_synthetic(bench_input_t *input) {
+    static const struct {
+        uint16_t type;
+        uint16_t length;
+    } epoch[] = {{1005, 19}, {1077, 420}, {1087, 310}, {1097, 380}, {1127, 350}, {1230, 8}};
+
+    input->data = malloc(BENCH_SYNTHETIC_SIZE + RTCM3_FRAME_MAX);
+    if (input->data == NULL) return false;
+
+    uint8_t payload[RTCM3_PAYLOAD_MAX];
+    srand(1);
+    while (input->length < BENCH_SYNTHETIC_SIZE) {
+        for (size_t i = 0; i < sizeof(epoch) / sizeof(epoch[0]); i++) {
+            for (size_t j = 0; j < epoch[i].length; j++) payload[j] = rand();
+            payload[0] = epoch[i].type >> 4;
+            payload[1] = (epoch[i].type << 4) | (payload[1] & 0x0F);
+            input->length += rtcm3_frame_build(input->data + input->length, payload, epoch[i].length);
+        }
+    }
+
+    return bench_input_index(input);
+}
+
+/// Смещение конца кадра k в зацикленном потоке
+static uint64_t bench_frame_end(const bench_input_t *input, size_t k) {
+    return (uint64_t) (k / input->frame_count) * input->length + input->frame_ends[k % input->frame_count];
+}
+
+/* Кастеры */
+
+static void bench_caster_frame(void *ctx, const uint8_t *frame, size_t length) {
+    bench_caster_t *caster = ctx;
+    bench_run_t *run = caster->run;
+
+    size_t k = caster->frames++;
+    if (k >= run->frame_total) return;
+
+    uint64_t now = platform_time_us();
+    uint64_t dispatched = __atomic_load_n(&run->dispatched[k], __ATOMIC_ACQUIRE);
+    caster->pipeline_latency[k] = dispatched > 0 ? now - dispatched : 0;
+
+    // Задержка от прихода последнего байта кадра по UART
+    if (run->rate > 0) {
+        uint64_t wire = run->start + bench_frame_end(run->input, k) * 1000000 / run->rate;
+        caster->wire_latency[k] = now > wire ? now - wire : 0;
+    }
+}
+
+static bool bench_caster_connect(bench_caster_t *caster) {
+    ntrip_uplink_config_t config = {
+            .host = "127.0.0.1",
+            .port = mock_caster_port(caster->caster),
+            .mountpoint = BENCH_MOUNTPOINT,
+            .password = BENCH_PASSWORD,
+            .version = "host"
+    };
+
+    retry_delay_handle_t retry = retry_init(true, 3, 100, 1000);
+    int16_t reason;
+    for (int attempt = 0; attempt < 5; attempt++) {
+        retry_delay(retry);
+        caster->sock = ntrip_uplink_connect(&config, &reason);
+        if (caster->sock >= 0) break;
+    }
+    free(retry);
+
+    return caster->sock >= 0;
+}
+
+/* Воспроизведение */
+
+static void bench_reader_frame(void *ctx, const uint8_t *frame, size_t length) {
+    bench_run_t *run = ctx;
+    if (run->frames < run->frame_total) __atomic_store_n(&run->dispatched[run->frames], platform_time_us(), __ATOMIC_RELEASE);
+    run->frames++;
+}
+
+/// Поток чтения повторяет uart_task: кусками до BENCH_UART_BUFFER_SIZE байт или по
+/// тайм-ауту, затем кадрирование и рассылка во все кастеры
+static void bench_replay(bench_run_t *run, size_t chunk) {
+    const bench_input_t *input = run->input;
+    uint8_t buffer[BENCH_UART_BUFFER_SIZE];
+    if (chunk > sizeof(buffer)) chunk = sizeof(buffer);
+
+    rtcm3_framer_t framer;
+    rtcm3_framer_init(&framer, bench_reader_frame, run);
+
+    uint64_t delivered = 0, last = run->start = platform_time_us();
+    while (delivered < run->total) {
+        size_t want = MIN(chunk, run->total - delivered);
+
+        TRACE_BEGIN(read_start);
+        if (run->rate > 0) {
+            uint64_t full_at = run->start + (delivered + want) * 1000000 / run->rate;
+            bench_sleep_until(MIN(full_at, last + BENCH_UART_TIMEOUT_US));
+
+            uint64_t now = last = platform_time_us();
+            uint64_t available = (now - run->start) * run->rate / 1000000;
+            if (available <= delivered) continue;
+            want = MIN(want, available - delivered);
+        }
+
+        for (size_t copied = 0; copied < want;) {
+            size_t offset = (delivered + copied) % input->length;
+            size_t n = MIN(want - copied, input->length - offset);
+            memcpy(buffer + copied, input->data + offset, n);
+            copied += n;
+        }
+        TRACE_END(TRACE_UART_READ, read_start, want);
+
+        uint64_t cpu = bench_cpu_us();
+        TRACE_BEGIN(framing_start);
+        rtcm3_framer_feed(&framer, buffer, want);
+        TRACE_END(TRACE_RTCM3_FRAMING, framing_start, want);
+        uint64_t cpu_framed = bench_cpu_us();
+        run->cpu_framing += cpu_framed - cpu;
+
+        for (size_t i = 0; i < run->caster_count; i++) {
+            bench_caster_t *caster = &run->casters[i];
+            if (caster->sock < 0) continue;
+
+            TRACE_BEGIN(send_start);
+            int sent = ntrip_uplink_send(caster->sock, buffer, want);
+            TRACE_END(i == 0 ? TRACE_NTRIP_SERVER_SEND : TRACE_NTRIP_SERVER_2_SEND, send_start, sent);
+            if (sent < 0) {
+                run->send_errors++;
+                destroy_socket(&caster->sock);
+            }
+        }
+        run->cpu_send += bench_cpu_us() - cpu_framed;
+
+        delivered += want;
+    }
+}
+
+static void bench_percentiles(uint32_t *values, size_t count, uint32_t out[4]) {
+    memset(out, 0, 4 * sizeof(uint32_t));
+    if (count == 0) return;
+
+    qsort(values, count, sizeof(uint32_t), bench_compare_u32);
+    out[0] = values[count * 50 / 100];
+    out[1] = values[count * 90 / 100];
+    out[2] = values[count * 99 / 100];
+    out[3] = values[count - 1];
+}
+
+static bool bench_run(const bench_input_t *input, uint32_t baud, const bench_options_t *options) {
+    bench_run_t *run = calloc(1, sizeof(bench_run_t));
+    if (run == NULL) return false;
+
+    // 10 бит на байт: старт, 8 данных, стоп
+    run->input = input;
+    run->rate = baud / 10;
+    run->total = run->rate > 0 ? (uint64_t) run->rate * options->seconds
+            : (options->file != NULL ? input->length : BENCH_UNPACED_SIZE);
+
+    size_t passes = run->total / input->length + 1;
+    run->frame_total = passes * input->frame_count;
+    run->dispatched = calloc(run->frame_total, sizeof(uint64_t));
+    run->caster_count = options->casters;
+
+    bool ok = run->dispatched != NULL;
+    for (size_t i = 0; i < run->caster_count && ok; i++) {
+        bench_caster_t *caster = &run->casters[i];
+        caster->run = run;
+        caster->sock = -1;
+        caster->pipeline_latency = calloc(run->frame_total, sizeof(uint32_t));
+        caster->wire_latency = calloc(run->frame_total, sizeof(uint32_t));
+        caster->caster = mock_caster_start(BENCH_MOUNTPOINT, BENCH_PASSWORD, bench_caster_frame, caster);
+        ok = caster->pipeline_latency != NULL && caster->wire_latency != NULL && caster->caster != NULL
+                && bench_caster_connect(caster);
+    }
+
+    if (ok) {
+        bench_replay(run, options->chunk);
+
+        // Ожидание, пока кастеры примут всё отправленное
+        uint64_t deadline = platform_time_us() + BENCH_DRAIN_TIMEOUT_US;
+        for (size_t i = 0; i < run->caster_count; i++) {
+            mock_caster_stats_t stats;
+            do {
+                mock_caster_stats(run->casters[i].caster, &stats);
+                if (stats.bytes >= run->total) break;
+                platform_sleep_ms(1);
+            } while (platform_time_us() < deadline);
+        }
+    }
+    uint64_t wall = platform_time_us() - run->start;
+
+    // Закрытие отправителей до остановки кастеров, затем сбор статистики
+    uint64_t received = 0, cpu_caster = 0;
+    size_t latency_count = 0;
+    uint32_t *pipeline_latency = malloc(run->frame_total * run->caster_count * sizeof(uint32_t));
+    uint32_t *wire_latency = malloc(run->frame_total * run->caster_count * sizeof(uint32_t));
+    ok = ok && pipeline_latency != NULL && wire_latency != NULL;
+    for (size_t i = 0; i < run->caster_count; i++) {
+        bench_caster_t *caster = &run->casters[i];
+        destroy_socket(&caster->sock);
+        if (caster->caster == NULL) continue;
+
+        mock_caster_stats_t stats;
+        mock_caster_stats(caster->caster, &stats);
+        mock_caster_stop(caster->caster);
+        received += stats.bytes;
+        cpu_caster += stats.cpu_us;
+
+        if (!ok) continue;
+        size_t frames = MIN(caster->frames, run->frame_total);
+        memcpy(pipeline_latency + latency_count, caster->pipeline_latency, frames * sizeof(uint32_t));
+        memcpy(wire_latency + latency_count, caster->wire_latency, frames * sizeof(uint32_t));
+        latency_count += frames;
+    }
+
+    if (ok) {
+        uint32_t pipeline[4], wire[4];
+        bench_percentiles(pipeline_latency, latency_count, pipeline);
+        bench_percentiles(wire_latency, latency_count, wire);
+
+        double seconds = wall / 1e6;
+        printf("%8lu %10.0f %10.0f %8zu %7u %7u %7u %7u %8.1f %8.1f %7.2f %7.2f %7.2f %6u\n",
+                (unsigned long) baud, run->total / seconds, received / run->caster_count / seconds, latency_count,
+                pipeline[0], pipeline[1], pipeline[2], pipeline[3],
+                run->rate > 0 ? wire[0] / 1000.0 : 0, run->rate > 0 ? wire[2] / 1000.0 : 0,
+                100.0 * run->cpu_framing / wall, 100.0 * run->cpu_send / wall, 100.0 * cpu_caster / wall,
+                run->send_errors);
+    } else {
+        fprintf(stderr, "Benchmark at %lu baud failed to start\n", (unsigned long) baud);
+    }
+
+    free(pipeline_latency);
+    free(wire_latency);
+    for (size_t i = 0; i < run->caster_count; i++) {
+        free(run->casters[i].pipeline_latency);
+        free(run->casters[i].wire_latency);
+    }
+    free(run->dispatched);
+    free(run);
+
+    return ok;
+}
+
+/* Параметры запуска */
+
+static void bench_usage(const char *name) {
+    fprintf(stderr, "Usage: %s [options]\n"
+            "  -f, --file PATH       .rtcm capture to replay (default: synthetic MSM7 epochs)\n"
+            "  -b, --baud LIST       comma separated UART baud rates, 0 = unpaced (default: 115200,460800,921600,0)\n"
+            "  -s, --seconds N       replay time per paced run (default: 10)\n"
+            "  -c, --casters N       number of mock casters fed in parallel, 1-%d (default: 2)\n"
+            "  -k, --chunk N         UART read size in bytes, 1-%d (default: %d)\n"
+            "  -t, --trace PATH      write a Chrome trace of the last run\n",
+            name, BENCH_CASTERS_MAX, BENCH_UART_BUFFER_SIZE, BENCH_UART_BUFFER_SIZE);
+}
+
+static bool bench_parse_bauds(bench_options_t *options, char *list) {
+    options->baud_count = 0;
+    for (char *item = strtok(list, ","); item != NULL; item = strtok(NULL, ",")) {
+        if (options->baud_count == BENCH_BAUDS_MAX) return false;
+        options->bauds[options->baud_count++] = strtoul(item, NULL, 10);
+    }
+
+    return options->baud_count > 0;
+}
+
+static int bench_trace_writer(void *ctx, const char *data, size_t length) {
+    return fwrite(data, 1, length, ctx) == length ? (int) length : -1;
+}
+
+int main(int argc, char **argv) {
+    bench_options_t options = {
+            .bauds = {115200, 460800, 921600, 0},
+            .baud_count = 4,
+            .seconds = 10,
+            .casters = 2,
+            .chunk = BENCH_UART_BUFFER_SIZE
+    };
+
+    static const struct option long_options[] = {
+            {"file", required_argument, NULL, 'f'},
+            {"baud", required_argument, NULL, 'b'},
+            {"seconds", required_argument, NULL, 's'},
+            {"casters", required_argument, NULL, 'c'},
+            {"chunk", required_argument, NULL, 'k'},
+            {"trace", required_argument, NULL, 't'},
+            {"help", no_argument, NULL, 'h'},
+            {NULL, 0, NULL, 0}
+    };
+
+    int option;
+    while ((option = getopt_long(argc, argv, "f:b:s:c:k:t:h", long_options, NULL)) != -1) {
+        switch (option) {
+            case 'f':
+                options.file = optarg;
+                break;
+            case 'b':
+                if (!bench_parse_bauds(&options, optarg)) {
+                    bench_usage(argv[0]);
+                    return 2;
+                }
+                break;
+            case 's':
+                options.seconds = strtoul(optarg, NULL, 10);
+                break;
+            case 'c':
+                options.casters = strtoul(optarg, NULL, 10);
+                break;
+            case 'k':
+                options.chunk = strtoul(optarg, NULL, 10);
+                break;
+            case 't':
+                options.trace = optarg;
+                break;
+            default:
+                bench_usage(argv[0]);
+                return option == 'h' ? 0 : 2;
+        }
+    }
+    if (options.seconds == 0 || options.casters < 1 || options.casters > BENCH_CASTERS_MAX
+            || options.chunk < 1 || options.chunk > BENCH_UART_BUFFER_SIZE) {
+        bench_usage(argv[0]);
+        return 2;
+    }
+
+    // Обрыв соединения кастером должен приводить к ошибке отправки, а не к завершению
+    signal(SIGPIPE, SIG_IGN);
+
+    bench_input_t input = {0};
+    if (!(options.file != NULL ? bench_input_load(&input, options.file) : bench_input_synthetic(&input))) {
+        fprintf(stderr, "No RTCM 3 frames in input\n");
+        return 1;
+    }
+
+    printf("Input: %s, %zu bytes, %zu frames; %zu casters, %zu byte reads\n\n",
+            options.file != NULL ? options.file : "synthetic", input.length, input.frame_count,
+            options.casters, options.chunk);
+    printf("%8s %10s %10s %8s %7s %7s %7s %7s %8s %8s %7s %7s %7s %6s\n",
+            "baud", "offered", "received", "frames", "p50", "p90", "p99", "max", "wire50", "wire99",
+            "frame%", "send%", "caster%", "errors");
+    printf("%8s %10s %10s %8s %7s %7s %7s %7s %8s %8s %7s %7s %7s %6s\n",
+            "", "B/s", "B/s", "", "us", "us", "us", "us", "ms", "ms", "cpu", "cpu", "cpu", "");
+
+    int failed = 0;
+    for (size_t i = 0; i < options.baud_count; i++) {
+        if (!bench_run(&input, options.bauds[i], &options)) failed++;
+    }
+
+    if (options.trace != NULL) {
+        FILE *file = fopen(options.trace, "w");
+        if (file == NULL || trace_dump(bench_trace_writer, file) < 0) {
+            fprintf(stderr, "Could not write trace to %s\n", options.trace);
+            failed++;
+        }
+        if (file != NULL) fclose(file);
+    }
+
+    free(input.data);
+    free(input.frame_ends);
+
+    return failed > 0;
+}
@@ -0,0 +1,220 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+/// Воспроизведение записи RTCM/NMEA во входной конвейер на хосте для длительных
+/// прогонов: темп по меткам времени записи (или в N раз быстрее), кадрирование
+/// RTCM 3 и рассылка в локальные NTRIP кастеры. Раз в секунду - строка состояния
+
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mock_caster.h>
+#include <net.h>
+#include <platform.h>
+#include <replay.h>
+#include <interface/ntrip_uplink.h>
+#include <protocol/rtcm3.h>
+
+#define INJECT_CASTERS_MAX 4
+#define INJECT_MOUNTPOINT "REPLAY"
+#define INJECT_PASSWORD "replay"
+
+typedef struct inject_caster {
+    mock_caster_handle_t caster;
+    ntrip_uplink_config_t config;
+    int sock;
+    uint32_t send_errors;
+} inject_caster_t;
+
+typedef struct inject {
+    replay_config_t config;
+    replay_stats_t stats;
+    volatile bool stop;
+    volatile bool done;
+    int error;
+
+    rtcm3_framer_t framer;
+    size_t caster_count;
+    inject_caster_t casters[INJECT_CASTERS_MAX];
+} inject_t;
+
+static volatile bool interrupted = false;
+
+static void inject_interrupt(int signal) {
+    interrupted = true;
+}
+
+/// Приёмник воспроизведения повторяет обработчики UART_EVENT_READ: кадрирование и отправка
+static void inject_sink(void *ctx, const uint8_t *data, size_t length) {
+    inject_t *inject = ctx;
+    rtcm3_framer_feed(&inject->framer, data, length);
+
+    for (size_t i = 0; i < inject->caster_count; i++) {
+        inject_caster_t *caster = &inject->casters[i];
+        if (caster->sock < 0) {
+            int16_t reason;
+            caster->sock = ntrip_uplink_connect(&caster->config, &reason);
+            if (caster->sock < 0) continue;
+        }
+
+        if (ntrip_uplink_send(caster->sock, data, length) < 0) {
+            caster->send_errors++;
+            destroy_socket(&caster->sock);
+        }
+    }
+}
+
+static void *inject_task(void *ctx) {
+    inject_t *inject = ctx;
+    if (replay_run(&inject->config, inject_sink, inject, &inject->stop, &inject->stats) < 0) inject->error = errno;
+    inject->done = true;
+    return NULL;
+}
+
+static void inject_usage(const char *name) {
+    fprintf(stderr, "Usage: %s --file PATH [options]\n"
+            "  -f, --file PATH       RTCM 3 / NMEA capture to replay\n"
+            "  -x, --speed N         replay N times faster than recorded, 0 = no pacing (default: 1)\n"
+            "  -l, --loop            restart from the beginning until stopped\n"
+            "  -b, --baud N          UART baud rate limiting bytes within an epoch, 0 = none (default: 115200)\n"
+            "  -c, --casters N       number of mock casters, 0-%d (default: 1)\n"
+            "  -s, --seconds N       stop after N seconds, 0 = at end of file or Ctrl-C (default: 0)\n",
+            name, INJECT_CASTERS_MAX);
+}
+
+int main(int argc, char **argv) {
+    inject_t *inject = calloc(1, sizeof(inject_t));
+    inject->config = (replay_config_t) {.speed = 1, .baud = 115200};
+    inject->caster_count = 1;
+    uint32_t seconds = 0;
+
+    static const struct option long_options[] = {
+            {"file", required_argument, NULL, 'f'},
+            {"speed", required_argument, NULL, 'x'},
+            {"loop", no_argument, NULL, 'l'},
+            {"baud", required_argument, NULL, 'b'},
+            {"casters", required_argument, NULL, 'c'},
+            {"seconds", required_argument, NULL, 's'},
+            {"help", no_argument, NULL, 'h'},
+            {NULL, 0, NULL, 0}
+    };
+
+    int option;
+    while ((option = getopt_long(argc, argv, "f:x:lb:c:s:h", long_options, NULL)) != -1) {
+        switch (option) {
+            case 'f':
+                inject->config.path = optarg;
+                break;
+            case 'x':
+                inject->config.speed = strtoul(optarg, NULL, 10);
+                break;
+            case 'l':
+                inject->config.loop = true;
+                break;
+            case 'b':
+                inject->config.baud = strtoul(optarg, NULL, 10);
+                break;
+            case 'c':
+                inject->caster_count = strtoul(optarg, NULL, 10);
+                break;
+            case 's':
+                seconds = strtoul(optarg, NULL, 10);
+                break;
+            default:
+                inject_usage(argv[0]);
+                return option == 'h' ? 0 : 2;
+        }
+    }
+    if (inject->config.path == NULL || inject->caster_count > INJECT_CASTERS_MAX) {
+        inject_usage(argv[0]);
+        return 2;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, inject_interrupt);
+
+    rtcm3_framer_init(&inject->framer, NULL, NULL);
+    for (size_t i = 0; i < inject->caster_count; i++) {
+        inject_caster_t *caster = &inject->casters[i];
+        caster->sock = -1;
+        caster->caster = mock_caster_start(INJECT_MOUNTPOINT, INJECT_PASSWORD, NULL, NULL);
+        if (caster->caster == NULL) return 1;
+        caster->config = (ntrip_uplink_config_t) {
+                .host = "127.0.0.1",
+                .port = mock_caster_port(caster->caster),
+                .mountpoint = INJECT_MOUNTPOINT,
+                .password = INJECT_PASSWORD,
+                .version = "replay"
+        };
+    }
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, inject_task, inject);
+
+    printf("%8s %12s %10s %8s %8s %6s %8s %12s %8s %6s\n",
+            "time s", "bytes", "B/s", "frames", "epochs", "loops", "lag ms", "caster B", "crc err", "errors");
+
+    uint64_t start = platform_time_us(), last_bytes = 0;
+    bool finished = false;
+    while (!finished) {
+        for (int i = 0; i < 10 && !inject->done && !interrupted; i++) platform_sleep_ms(100);
+        finished = inject->done;
+
+        uint64_t elapsed = platform_time_us() - start;
+        if (interrupted || (seconds > 0 && elapsed >= (uint64_t) seconds * 1000000)) inject->stop = true;
+
+        uint64_t caster_bytes = 0;
+        uint32_t crc_errors = 0, send_errors = 0;
+        for (size_t i = 0; i < inject->caster_count; i++) {
+            mock_caster_stats_t stats;
+            mock_caster_stats(inject->casters[i].caster, &stats);
+            caster_bytes += stats.bytes;
+            crc_errors += stats.crc_errors;
+            send_errors += inject->casters[i].send_errors;
+        }
+
+        replay_stats_t stats = inject->stats;
+        printf("%8.1f %12llu %10llu %8u %8u %6u %8u %12llu %8u %6u\n",
+                elapsed / 1e6, (unsigned long long) stats.bytes, (unsigned long long) (stats.bytes - last_bytes),
+                inject->framer.frames, stats.epochs, stats.loops, stats.lag_max_ms,
+                (unsigned long long) caster_bytes, crc_errors, send_errors);
+        fflush(stdout);
+        last_bytes = stats.bytes;
+    }
+    pthread_join(thread, NULL);
+
+    for (size_t i = 0; i < inject->caster_count; i++) {
+        destroy_socket(&inject->casters[i].sock);
+        mock_caster_stop(inject->casters[i].caster);
+    }
+
+    if (inject->error != 0) {
+        fprintf(stderr, "%s: %s\n", inject->config.path, strerror(inject->error));
+        return 1;
+    }
+    if (!inject->stats.timed) printf("No epoch timestamps in capture, paced by baud rate only\n");
+
+    free(inject);
+    return 0;
+}
@@ -0,0 +1,39 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#ifndef ESP32_XBEE_HOST_FUZZ_H
+#define ESP32_XBEE_HOST_FUZZ_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/// Точка входа цели фаззинга, общая для libFuzzer, AFL и fuzz_main.c
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+/// Нарушенный инвариант разбора: аварийное завершение, чтобы движок сохранил вход
+#define FUZZ_CHECK(condition) do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: invariant failed: %s\n", __FILE__, __LINE__, #condition); \
+            abort(); \
+        } \
+    } while (0)
+
+#endif //ESP32_XBEE_HOST_FUZZ_H
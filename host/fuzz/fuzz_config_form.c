@@ -0,0 +1,90 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+/// Тело POST /config: разбор JSON и config_form_value для каждого ключа схемы,
+/// а также каждого значения входа как элемента каждого типа
+
+#include <string.h>
+
+// Значения по умолчанию из драйверов ESP-IDF в схеме настроек
+#define DEFAULT_UART_TX_PIN 1
+#define DEFAULT_UART_RX_PIN 3
+#define DEFAULT_UART_RTS_PIN 14
+#define DEFAULT_UART_CTS_PIN 33
+#define UART_NUM_0 0
+#define UART_DATA_8_BITS 3
+#define UART_PARITY_DISABLE 0
+#define UART_STOP_BITS_1 1
+#define WIFI_AUTH_OPEN 0
+#define esp_netif_ip4_makeu32(a, b, c, d) ((uint32_t) (a) << 24 | (uint32_t) (b) << 16 | (uint32_t) (c) << 8 | (uint32_t) (d))
+#define esp_netif_htonl(x) __builtin_bswap32(x)
+
+#include <config_form.h>
+#include "fuzz.h"
+
+static const config_item_t ITEMS[] = {
+#define CONFIG_ITEM_ENTRY(_key, _group, _type, _secret, _field, _def) \
+        { \
+                .key = _key, \
+                .group = CONFIG_GROUP_##_group, \
+                .type = CONFIG_ITEM_TYPE_##_type, \
+                .secret = _secret, \
+                .def._field = _def \
+        },
+        CONFIG_ITEMS_SCHEMA(CONFIG_ITEM_ENTRY)
+#undef CONFIG_ITEM_ENTRY
+};
+
+static void fuzz_value(const config_item_t *item, const cJSON *entry) {
+    config_item_value_t value;
+    esp_err_t err = config_form_value(item, entry, &value);
+    FUZZ_CHECK(err == ESP_OK || err == ESP_ERR_NOT_FOUND || err == ESP_ERR_INVALID_ARG);
+    if (err != ESP_OK) return;
+
+    if (item->type == CONFIG_ITEM_TYPE_STRING) {
+        FUZZ_CHECK(value.str == entry->valuestring);
+    } else if (item->type == CONFIG_ITEM_TYPE_BLOB) {
+        FUZZ_CHECK(value.blob.data == (uint8_t *) entry->valuestring && value.blob.length == strlen(entry->valuestring));
+    } else if (item->type == CONFIG_ITEM_TYPE_IP) {
+        FUZZ_CHECK(cJSON_IsArray(entry) && cJSON_GetArraySize(entry) == 4);
+    } else {
+        FUZZ_CHECK(cJSON_IsString(entry) && entry->valuestring[0] != '\0');
+    }
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    cJSON *root = cJSON_ParseWithLength((const char *) data, size);
+    if (root == NULL) return 0;
+
+    for (size_t i = 0; i < sizeof(ITEMS) / sizeof(ITEMS[0]); i++) {
+        const cJSON *entry = cJSON_GetObjectItem(root, ITEMS[i].key);
+        if (entry != NULL) fuzz_value(&ITEMS[i], entry);
+    }
+
+    const cJSON *entry;
+    cJSON_ArrayForEach(entry, root) {
+        for (config_item_type_t type = 0; type < CONFIG_ITEM_TYPE_MAX; type++) {
+            config_item_t item = {.key = "fuzz", .type = type};
+            fuzz_value(&item, entry);
+        }
+    }
+
+    cJSON_Delete(root);
+    return 0;
+}
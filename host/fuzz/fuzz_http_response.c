@@ -0,0 +1,66 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+/// Ответы кастера: extract_http_header и проверки строки статуса NTRIP.
+/// Первая строка входа - искомый ключ, остальное - ответ
+
+#include <ctype.h>
+#include <string.h>
+#include <net.h>
+#include <interface/ntrip.h>
+#include "fuzz.h"
+
+static const char *KEYS[] = {"", "Content-Type:", "Server:", "Transfer-Encoding:", "Ntrip-Version:"};
+
+static void fuzz_header(const char *response, const char *key) {
+    char *value = extract_http_header(response, key);
+    if (value == NULL) return;
+
+    size_t length = strlen(value);
+    FUZZ_CHECK(length > 0);
+    FUZZ_CHECK(strstr(response, value) != NULL);
+    FUZZ_CHECK(strstr(value, "\r\n") == NULL);
+    FUZZ_CHECK(!isspace((unsigned char) value[0]) && !isspace((unsigned char) value[length - 1]));
+    free(value);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    char *buffer = malloc(size + 1);
+    if (buffer == NULL) return 0;
+    memcpy(buffer, data, size);
+    buffer[size] = '\0';
+
+    const char *key = "";
+    char *response = buffer;
+    char *newline = memchr(buffer, '\n', size);
+    if (newline != NULL) {
+        *newline = '\0';
+        key = buffer;
+        response = newline + 1;
+    }
+
+    fuzz_header(response, key);
+    for (size_t i = 0; i < sizeof(KEYS) / sizeof(KEYS[0]); i++) fuzz_header(response, KEYS[i]);
+
+    ntrip_response_ok(response);
+    ntrip_response_sourcetable_ok(response);
+
+    free(buffer);
+    return 0;
+}
@@ -0,0 +1,245 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+/// Драйвер целей фаззинга без libFuzzer (gcc, AFL): прогон корпуса и случайные мутации.
+/// Аргументы совместимы с libFuzzer, поэтому ctest запускает цели одинаково с обоими движками
+///
+///   fuzz_<цель> [-runs=N] [-seed=N] [-max_len=N] [файл или каталог]...
+///
+/// Без -runs только прогон корпуса (воспроизведение crash-файла). Вход, на котором цель
+/// упала, сохраняется в crash-<номер прогона> текущего каталога
+
+#include <dirent.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "fuzz.h"
+
+#define FUZZ_INPUTS_MAX 4096
+#define FUZZ_MAX_LEN_DEFAULT 4096
+
+typedef struct fuzz_input {
+    uint8_t *data;
+    size_t size;
+} fuzz_input_t;
+
+static fuzz_input_t inputs[FUZZ_INPUTS_MAX];
+static int input_count = 0;
+
+static const uint8_t *current_data = NULL;
+static size_t current_size = 0;
+static unsigned long current_run = 0;
+
+static uint64_t random_state = 1;
+
+// Есть только в сборке с санитайзерами
+void __sanitizer_set_death_callback(void (*callback)(void)) __attribute__((weak));
+
+static uint64_t fuzz_random() {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return random_state;
+}
+
+static void fuzz_save_crash() {
+    if (current_data == NULL) return;
+
+    char path[32];
+    snprintf(path, sizeof(path), "crash-%lu", current_run);
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) return;
+    fwrite(current_data, 1, current_size, file);
+    fclose(file);
+    fprintf(stderr, "fuzz: input of %zu bytes saved to %s\n", current_size, path);
+}
+
+static void fuzz_signal(int signal) {
+    fuzz_save_crash();
+    current_data = NULL;
+
+    sigaction(signal, &(struct sigaction) {.sa_handler = SIG_DFL}, NULL);
+    raise(signal);
+}
+
+static void fuzz_load_file(const char *path) {
+    if (input_count == FUZZ_INPUTS_MAX) return;
+
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "fuzz: cannot open %s\n", path);
+        exit(2);
+    }
+
+    fuzz_input_t *input = &inputs[input_count];
+    fseek(file, 0, SEEK_END);
+    input->size = ftell(file);
+    rewind(file);
+    input->data = malloc(input->size > 0 ? input->size : 1);
+    if (input->data == NULL || fread(input->data, 1, input->size, file) != input->size) {
+        fprintf(stderr, "fuzz: cannot read %s\n", path);
+        exit(2);
+    }
+    fclose(file);
+
+    input_count++;
+}
+
+static void fuzz_load(const char *path) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        fprintf(stderr, "fuzz: no such file %s\n", path);
+        exit(2);
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        fuzz_load_file(path);
+        return;
+    }
+
+    // Порядок readdir не задан: сортировка для воспроизводимости с одним -seed
+    struct dirent **entries;
+    int count = scandir(path, &entries, NULL, alphasort);
+    for (int i = 0; i < count; i++) {
+        char child[1024];
+        snprintf(child, sizeof(child), "%s/%s", path, entries[i]->d_name);
+        if (entries[i]->d_name[0] != '.' && stat(child, &st) == 0 && S_ISREG(st.st_mode)) fuzz_load_file(child);
+        free(entries[i]);
+    }
+    free(entries);
+}
+
+static void fuzz_run(const uint8_t *data, size_t size) {
+    // Копия точного размера: чтение за концом входа видно санитайзеру
+    uint8_t *copy = malloc(size > 0 ? size : 1);
+    memcpy(copy, data, size);
+
+    current_data = copy;
+    current_size = size;
+    LLVMFuzzerTestOneInput(copy, size);
+    current_data = NULL;
+
+    free(copy);
+}
+
+/// Несколько случайных правок: биты, байты-разделители протоколов, вставка, удаление,
+/// повтор участка и склейка с другим входом корпуса
+static size_t fuzz_mutate(uint8_t *data, size_t size, size_t max_len) {
+    static const uint8_t interesting[] = {0x00, 0xff, 0x7f, 0x80, 0xd3, '$', '*', ',', ';', '.', '-', '\r', '\n', '"', '\\', '#'};
+
+    int count = 1 + fuzz_random() % 4;
+    for (int i = 0; i < count; i++) {
+        size_t position = size > 0 ? fuzz_random() % size : 0;
+
+        switch (fuzz_random() % 7) {
+            case 0:
+                if (size > 0) data[position] ^= 1 << (fuzz_random() % 8);
+                break;
+            case 1:
+                if (size > 0) data[position] = fuzz_random();
+                break;
+            case 2:
+                if (size > 0) data[position] = interesting[fuzz_random() % sizeof(interesting)];
+                break;
+            case 3:
+                if (size < max_len) {
+                    memmove(data + position + 1, data + position, size - position);
+                    data[position] = fuzz_random() % 2 ? fuzz_random() : interesting[fuzz_random() % sizeof(interesting)];
+                    size++;
+                }
+                break;
+            case 4: {
+                size_t length = size > position ? 1 + fuzz_random() % MIN(size - position, 16) : 0;
+                memmove(data + position, data + position + length, size - position - length);
+                size -= length;
+                break;
+            }
+            case 5: {
+                size_t length = size > position ? 1 + fuzz_random() % MIN(size - position, 64) : 0;
+                if (size + length > max_len) break;
+                memmove(data + position + length, data + position, size - position);
+                size += length;
+                break;
+            }
+            case 6: {
+                if (input_count == 0) break;
+                const fuzz_input_t *other = &inputs[fuzz_random() % input_count];
+                size_t from = other->size > 0 ? fuzz_random() % other->size : 0;
+                size_t length = MIN(other->size - from, max_len - position);
+                memcpy(data + position, other->data + from, length);
+                size = position + length;
+                break;
+            }
+        }
+    }
+
+    return size;
+}
+
+int main(int argc, char **argv) {
+    unsigned long runs = 0;
+    size_t max_len = FUZZ_MAX_LEN_DEFAULT;
+    random_state = (uint64_t) time(NULL) | 1;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "-runs=", 6) == 0) runs = strtoul(argv[i] + 6, NULL, 10);
+        else if (strncmp(argv[i], "-seed=", 6) == 0) random_state = strtoull(argv[i] + 6, NULL, 10) | 1;
+        else if (strncmp(argv[i], "-max_len=", 9) == 0) max_len = strtoul(argv[i] + 9, NULL, 10);
+        else if (argv[i][0] == '-') continue;   // прочие параметры libFuzzer
+        else fuzz_load(argv[i]);
+    }
+    if (max_len == 0) max_len = FUZZ_MAX_LEN_DEFAULT;
+
+    // Санитайзер сам обрабатывает сигналы и сообщает о смерти через callback
+    if (__sanitizer_set_death_callback != NULL) {
+        __sanitizer_set_death_callback(fuzz_save_crash);
+    } else {
+        signal(SIGSEGV, fuzz_signal);
+        signal(SIGBUS, fuzz_signal);
+        signal(SIGFPE, fuzz_signal);
+    }
+    signal(SIGABRT, fuzz_signal);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (int i = 0; i < input_count; i++) fuzz_run(inputs[i].data, inputs[i].size);
+
+    uint8_t *data = malloc(max_len);
+    for (current_run = 1; current_run <= runs; current_run++) {
+        size_t size = 0;
+        if (input_count > 0) {
+            const fuzz_input_t *input = &inputs[fuzz_random() % input_count];
+            size = MIN(input->size, max_len);
+            memcpy(data, input->data, size);
+        }
+
+        size = fuzz_mutate(data, size, max_len);
+        fuzz_run(data, size);
+    }
+    free(data);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("fuzz: %d corpus inputs, %lu mutated runs in %.1f s\n", input_count, runs,
+            (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+    return 0;
+}
@@ -0,0 +1,101 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/// Замена MSM7 на MSM4: кадры с любыми масками и длинами не выводят за буфер,
+/// результат - кадры с верной CRC не длиннее исходных, преобразование на месте
+/// совпадает с преобразованием в другой буфер, поток не зависит от разбиения на куски.
+/// Первый байт входа задаёт разбиение, остальное - поток
+
+#include <string.h>
+#include <protocol/rtcm3.h>
+#include "fuzz.h"
+
+typedef struct fuzz_output {
+    uint8_t data[64 * 1024];
+    size_t length;
+    uint32_t hash;
+} fuzz_output_t;
+
+static int fuzz_write(void *ctx, const void *data, size_t length) {
+    fuzz_output_t *output = ctx;
+    const uint8_t *bytes = data;
+
+    // FNV-1a по всему выводу, начало сохраняется для сравнения
+    for (size_t i = 0; i < length; i++) output->hash = (output->hash ^ bytes[i]) * 16777619u;
+    size_t keep = length < sizeof(output->data) - output->length ? length : sizeof(output->data) - output->length;
+    memcpy(output->data + output->length, data, keep);
+    output->length += keep;
+
+    return length;
+}
+
+static void fuzz_frame(void *ctx, const uint8_t *frame, size_t length) {
+    static uint8_t separate[RTCM3_FRAME_MAX], inplace[RTCM3_FRAME_MAX];
+
+    size_t converted = rtcm3_msm7_to_msm4(frame, length, separate);
+    memcpy(inplace, frame, length);
+    FUZZ_CHECK(rtcm3_msm7_to_msm4(inplace, length, inplace) == converted);
+    if (converted == 0) return;
+
+    FUZZ_CHECK(converted <= length);
+    FUZZ_CHECK(memcmp(separate, inplace, converted) == 0);
+    FUZZ_CHECK(RTCM3_HEADER_SIZE + ((separate[1] & 0x03) << 8 | separate[2]) + RTCM3_CRC_SIZE == converted);
+    uint32_t crc = (uint32_t) separate[converted - 3] << 16 | (uint32_t) separate[converted - 2] << 8 | separate[converted - 1];
+    FUZZ_CHECK(rtcm3_crc24q(separate, converted - RTCM3_CRC_SIZE) == crc);
+    FUZZ_CHECK(rtcm3_message_type(separate) == rtcm3_message_type(frame) - 3);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    if (size == 0) return 0;
+    uint8_t split = data[0];
+    data++;
+    size--;
+
+    // Каждый кадр с верной CRC - как из потока
+    static rtcm3_framer_t framer;
+    rtcm3_framer_init(&framer, fuzz_frame, NULL);
+    rtcm3_framer_feed(&framer, data, size);
+
+    static rtcm3_msm4_stream_t whole_stream, chunked_stream;
+    static fuzz_output_t whole, chunked;
+    whole.length = chunked.length = 0;
+    whole.hash = chunked.hash = 2166136261u;
+
+    rtcm3_msm4_stream_init(&whole_stream);
+    int written = rtcm3_msm4_stream_feed(&whole_stream, data, size, fuzz_write, &whole);
+    FUZZ_CHECK(written >= 0 && (size_t) written <= size);
+
+    rtcm3_msm4_stream_init(&chunked_stream);
+    size_t chunked_written = 0;
+    for (size_t offset = 0, i = 0; offset < size; i++) {
+        size_t n = 1 + (split * (i + 1)) % 97;
+        if (n > size - offset) n = size - offset;
+        int result = rtcm3_msm4_stream_feed(&chunked_stream, data + offset, n, fuzz_write, &chunked);
+        FUZZ_CHECK(result >= 0);
+        chunked_written += result;
+        offset += n;
+    }
+
+    // Неоконченный кадр в конце остаётся в буфере, у обоих одинаковый
+    FUZZ_CHECK(whole_stream.used == chunked_stream.used);
+    FUZZ_CHECK((size_t) written == chunked_written && whole.hash == chunked.hash);
+    FUZZ_CHECK(whole_stream.converted == chunked_stream.converted && whole_stream.saved == chunked_stream.saved);
+    FUZZ_CHECK((size_t) written + whole_stream.saved + whole_stream.used == size);
+
+    return 0;
+}
@@ -0,0 +1,117 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/// Разбор NMEA: предложения и поля решения в допустимых пределах, результат не зависит
+/// от разбиения потока на куски, разбор отдельной строки не выходит за её границы,
+/// сборка $PESP с произвольным полем даёт целое предложение.
+/// Первый байт входа задаёт разбиение, остальное - поток
+
+#include <stdlib.h>
+#include <string.h>
+#include <protocol/nmea.h>
+#include "fuzz.h"
+
+typedef struct fuzz_sentences {
+    uint32_t count;
+    uint32_t hash;
+} fuzz_sentences_t;
+
+static void fuzz_fix(const nmea_fix_t *fix) {
+    if (fix->position_valid) {
+        FUZZ_CHECK(fix->latitude >= -900000000 && fix->latitude <= 900000000);
+        FUZZ_CHECK(fix->longitude >= -1800000000 && fix->longitude <= 1800000000);
+    }
+    if (fix->time_valid) {
+        FUZZ_CHECK(fix->hour < 24 && fix->minute < 60 && fix->second <= 60 && fix->millisecond < 1000);
+    }
+    if (fix->date_valid) {
+        FUZZ_CHECK(fix->day >= 1 && fix->day <= 31 && fix->month >= 1 && fix->month <= 12);
+    }
+    FUZZ_CHECK(fix->quality <= 9 && fix->mode <= 3);
+
+    uint32_t in_view = 0;
+    for (int i = 0; i < NMEA_SYSTEM_COUNT; i++) in_view += fix->in_view[i];
+    FUZZ_CHECK(fix->satellites_in_view == (in_view > UINT8_MAX ? UINT8_MAX : in_view));
+}
+
+static void fuzz_sentence(void *ctx, nmea_sentence_t type, const char *sentence, size_t length) {
+    fuzz_sentences_t *sentences = ctx;
+
+    FUZZ_CHECK(length >= 4 && length <= NMEA_SENTENCE_MAX);
+    FUZZ_CHECK(sentence[0] == '$' && sentence[length - 3] == '*' && sentence[length] == '\0');
+    FUZZ_CHECK(strlen(sentence) == length);
+    FUZZ_CHECK(type <= NMEA_SENTENCE_GSV);
+
+    // FNV-1a по всем предложениям
+    for (size_t i = 0; i < length; i++) sentences->hash = (sentences->hash ^ (uint8_t) sentence[i]) * 16777619u;
+    sentences->hash = (sentences->hash ^ type) * 16777619u;
+    sentences->count++;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    if (size == 0) return 0;
+    uint8_t split = data[0];
+    data++;
+    size--;
+
+    static nmea_parser_t whole, chunked;
+    fuzz_sentences_t whole_sentences = {0, 2166136261u}, chunked_sentences = {0, 2166136261u};
+
+    nmea_parser_init(&whole, fuzz_sentence, &whole_sentences);
+    nmea_parser_feed(&whole, data, size);
+    fuzz_fix(&whole.fix);
+
+    nmea_parser_init(&chunked, fuzz_sentence, &chunked_sentences);
+    for (size_t offset = 0, i = 0; offset < size; i++) {
+        size_t n = 1 + (split * (i + 1)) % 97;
+        if (n > size - offset) n = size - offset;
+        nmea_parser_feed(&chunked, data + offset, n);
+        offset += n;
+    }
+
+    FUZZ_CHECK(whole.sentences == whole_sentences.count);
+    FUZZ_CHECK(whole_sentences.count == chunked_sentences.count && whole_sentences.hash == chunked_sentences.hash);
+    FUZZ_CHECK(whole.checksum_errors == chunked.checksum_errors && whole.overflows == chunked.overflows);
+    FUZZ_CHECK(memcmp(&whole.fix, &chunked.fix, sizeof(nmea_fix_t)) == 0);
+
+    // Вход как одна строка без проверки суммы: копия точной длины, чтобы ASan видел выход за границу
+    if (size > 0 && data[0] == '$') {
+        char *sentence = malloc(size);
+        memcpy(sentence, data, size);
+        nmea_fix_t fix = {0};
+        nmea_parse_sentence(&fix, sentence, size);
+        fuzz_fix(&fix);
+        free(sentence);
+    }
+
+    // Вход как поле $PESP: предложение остаётся целым и с верной суммой
+    char *field = strndup((const char *) data, size);
+    char out[NMEA_EMIT_MAX];
+    int length = nmea_pesp(out, sizeof(out), split % NMEA_PESP_COUNT, "F,%s,%d", field, (int) size);
+    free(field);
+
+    FUZZ_CHECK(length >= 6 && length < NMEA_EMIT_MAX && (size_t) length == strlen(out));
+    uint8_t checksum = 0;
+    for (int i = 1; i < length - 5; i++) {
+        FUZZ_CHECK(out[i] != '*' && out[i] != '$' && out[i] >= 0x20 && out[i] <= 0x7E);
+        checksum ^= (uint8_t) out[i];
+    }
+    FUZZ_CHECK(out[length - 5] == '*' && strtoul(out + length - 4, NULL, 16) == checksum);
+    FUZZ_CHECK(out[length - 2] == '\r' && out[length - 1] == '\n');
+
+    return 0;
+}
@@ -0,0 +1,67 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+/// Разбор записи RTCM 3 / NMEA при воспроизведении (кадры, контрольные суммы NMEA,
+/// метки времени эпох): без темпа поток должен выйти без изменений кусками не длиннее 1 КБ
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <replay.h>
+#include "fuzz.h"
+
+#define FUZZ_REPLAY_CHUNK_MAX 1024
+
+typedef struct fuzz_replay {
+    const uint8_t *data;
+    size_t size;
+    size_t offset;
+} fuzz_replay_t;
+
+static void fuzz_sink(void *ctx, const uint8_t *data, size_t length) {
+    fuzz_replay_t *replay = ctx;
+
+    FUZZ_CHECK(length > 0 && length <= FUZZ_REPLAY_CHUNK_MAX);
+    FUZZ_CHECK(replay->offset + length <= replay->size);
+    FUZZ_CHECK(memcmp(replay->data + replay->offset, data, length) == 0);
+    replay->offset += length;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    static int fd = -1;
+    if (fd < 0) fd = memfd_create("fuzz_replay", 0);
+    FUZZ_CHECK(fd >= 0);
+
+    FUZZ_CHECK(ftruncate(fd, 0) == 0);
+    FUZZ_CHECK(pwrite(fd, data, size, 0) == (ssize_t) size);
+
+    char path[32];
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+
+    fuzz_replay_t replay = {data, size, 0};
+    replay_config_t config = {.path = path, .speed = 0, .loop = false, .baud = 0};
+    replay_stats_t stats = {0};
+    volatile bool stop = false;
+
+    FUZZ_CHECK(replay_run(&config, fuzz_sink, &replay, &stop, &stats) == 0);
+    FUZZ_CHECK(replay.offset == size && stats.bytes == size);
+    FUZZ_CHECK(stats.epochs <= stats.frames + stats.sentences);
+
+    return 0;
+}
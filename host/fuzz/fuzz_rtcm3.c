@@ -0,0 +1,89 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+/// Кадрирование RTCM 3: кадры корректны, результат не зависит от разбиения потока на куски,
+/// собранный rtcm3_frame_build кадр находится без изменений.
+/// Первый байт входа задаёт разбиение, остальное - поток
+
+#include <string.h>
+#include <protocol/rtcm3.h>
+#include "fuzz.h"
+
+typedef struct fuzz_frames {
+    uint32_t count;
+    uint32_t hash;
+    uint8_t last[RTCM3_FRAME_MAX];
+    size_t last_length;
+} fuzz_frames_t;
+
+static void fuzz_frame(void *ctx, const uint8_t *frame, size_t length) {
+    fuzz_frames_t *frames = ctx;
+
+    FUZZ_CHECK(length >= RTCM3_HEADER_SIZE + RTCM3_CRC_SIZE && length <= RTCM3_FRAME_MAX);
+    FUZZ_CHECK(frame[0] == RTCM3_PREAMBLE);
+    FUZZ_CHECK(RTCM3_HEADER_SIZE + ((frame[1] & 0x03) << 8 | frame[2]) + RTCM3_CRC_SIZE == length);
+
+    uint32_t crc = (uint32_t) frame[length - 3] << 16 | (uint32_t) frame[length - 2] << 8 | frame[length - 1];
+    FUZZ_CHECK(rtcm3_crc24q(frame, length - RTCM3_CRC_SIZE) == crc);
+    if (length >= 5) rtcm3_message_type(frame);
+
+    // FNV-1a по всем кадрам
+    for (size_t i = 0; i < length; i++) frames->hash = (frames->hash ^ frame[i]) * 16777619u;
+    frames->count++;
+    memcpy(frames->last, frame, length);
+    frames->last_length = length;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    if (size == 0) return 0;
+    uint8_t split = data[0];
+    data++;
+    size--;
+
+    static rtcm3_framer_t whole, chunked;
+    fuzz_frames_t whole_frames = {0, 2166136261u}, chunked_frames = {0, 2166136261u};
+
+    rtcm3_framer_init(&whole, fuzz_frame, &whole_frames);
+    rtcm3_framer_feed(&whole, data, size);
+
+    rtcm3_framer_init(&chunked, fuzz_frame, &chunked_frames);
+    for (size_t offset = 0, i = 0; offset < size; i++) {
+        size_t n = 1 + (split * (i + 1)) % 97;
+        if (n > size - offset) n = size - offset;
+        rtcm3_framer_feed(&chunked, data + offset, n);
+        offset += n;
+    }
+
+    FUZZ_CHECK(whole.frames == whole_frames.count);
+    FUZZ_CHECK(whole_frames.count == chunked_frames.count && whole_frames.hash == chunked_frames.hash);
+    FUZZ_CHECK(whole.crc_errors == chunked.crc_errors && whole.skipped == chunked.skipped);
+
+    // Кадр из начала входа как данные сообщения
+    static uint8_t frame[RTCM3_FRAME_MAX];
+    size_t payload = size < RTCM3_PAYLOAD_MAX ? size : RTCM3_PAYLOAD_MAX;
+    size_t length = rtcm3_frame_build(frame, data, payload);
+    FUZZ_CHECK(length == payload + RTCM3_HEADER_SIZE + RTCM3_CRC_SIZE);
+
+    fuzz_frames_t built = {0, 2166136261u};
+    rtcm3_framer_init(&whole, fuzz_frame, &built);
+    rtcm3_framer_feed(&whole, frame, length);
+    FUZZ_CHECK(built.count == 1 && built.last_length == length && memcmp(built.last, frame, length) == 0);
+
+    return 0;
+}
@@ -0,0 +1,56 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+/// Таблица источников NTRIP: ntrip_sourcetable_next на данных без завершающего нуля
+
+#include <string.h>
+#include <interface/ntrip.h>
+#include "fuzz.h"
+
+static void fuzz_field(const ntrip_field_t *field, const char *start, const char *end) {
+    if (field->length == 0) return;
+
+    FUZZ_CHECK(field->data >= start && field->data + field->length <= end);
+    FUZZ_CHECK(memchr(field->data, '\n', field->length) == NULL);
+    FUZZ_CHECK(memchr(field->data, ';', field->length) == NULL);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    const char *start = (const char *) data, *end = start + size;
+    const char *cursor = start;
+    ntrip_sourcetable_stream_t stream;
+    size_t records = 0;
+
+    while (ntrip_sourcetable_next(&cursor, end, &stream)) {
+        FUZZ_CHECK(cursor <= end);
+        FUZZ_CHECK(++records <= size);
+
+        FUZZ_CHECK(stream.mountpoint.length > 0);
+        fuzz_field(&stream.mountpoint, start, end);
+        fuzz_field(&stream.identifier, start, end);
+        fuzz_field(&stream.format, start, end);
+        fuzz_field(&stream.format_details, start, end);
+        fuzz_field(&stream.nav_system, start, end);
+        fuzz_field(&stream.network, start, end);
+        fuzz_field(&stream.country, start, end);
+    }
+
+    FUZZ_CHECK(cursor == end);
+    return 0;
+}
@@ -0,0 +1,116 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+/// Кадрирование и разбор UBX: кадры корректны, результат не зависит от разбиения потока,
+/// декодеры NAV-PVT/NAV-SVIN/MON-HW и разбор ответа CFG-VALGET не выходят за данные.
+/// Первый байт входа задаёт разбиение, остальное - поток
+
+#include <string.h>
+#include <protocol/ubx.h>
+#include "fuzz.h"
+
+typedef struct fuzz_frames {
+    uint32_t count;
+    uint32_t hash;
+} fuzz_frames_t;
+
+static void fuzz_frame(void *ctx, uint8_t class, uint8_t id, const uint8_t *payload, size_t length) {
+    fuzz_frames_t *frames = ctx;
+    FUZZ_CHECK(length <= UBX_PAYLOAD_MAX);
+
+    // Декодеры получают каждый кадр, независимо от класса
+    ubx_nav_pvt_t pvt;
+    ubx_nav_svin_t svin;
+    ubx_mon_hw_t hw;
+    ubx_nav_pvt_decode(payload, length, &pvt);
+    ubx_nav_svin_decode(payload, length, &svin);
+    ubx_mon_hw_decode(payload, length, &hw);
+    ubx_ack_matches(payload, length, class, id);
+
+    if (length >= 4) {
+        const uint8_t *cursor = payload + 4, *end = payload + length;
+        uint32_t key;
+        uint64_t value;
+        while (ubx_valget_next(&cursor, end, &key, &value)) FUZZ_CHECK(cursor <= end);
+        FUZZ_CHECK(cursor <= end);
+    }
+
+    // FNV-1a по классу, идентификатору и данным
+    frames->hash = (frames->hash ^ class) * 16777619u;
+    frames->hash = (frames->hash ^ id) * 16777619u;
+    for (size_t i = 0; i < length; i++) frames->hash = (frames->hash ^ payload[i]) * 16777619u;
+    frames->count++;
+}
+
+static void fuzz_rebuilt(void *ctx, uint8_t class, uint8_t id, const uint8_t *payload, size_t length) {
+    fuzz_frames_t *frames = ctx;
+    frames->hash = (frames->hash ^ class) * 16777619u;
+    frames->hash = (frames->hash ^ id) * 16777619u;
+    for (size_t i = 0; i < length; i++) frames->hash = (frames->hash ^ payload[i]) * 16777619u;
+    frames->count++;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    if (size == 0) return 0;
+    uint8_t split = data[0];
+    data++;
+    size--;
+
+    static ubx_framer_t whole, chunked;
+    fuzz_frames_t whole_frames = {0, 2166136261u}, chunked_frames = {0, 2166136261u};
+
+    ubx_framer_init(&whole, fuzz_frame, &whole_frames);
+    ubx_framer_feed(&whole, data, size);
+
+    ubx_framer_init(&chunked, fuzz_frame, &chunked_frames);
+    for (size_t offset = 0, i = 0; offset < size; i++) {
+        size_t n = 1 + (split * (i + 1)) % 97;
+        if (n > size - offset) n = size - offset;
+        ubx_framer_feed(&chunked, data + offset, n);
+        offset += n;
+    }
+
+    FUZZ_CHECK(whole.frames == whole_frames.count);
+    FUZZ_CHECK(whole_frames.count == chunked_frames.count && whole_frames.hash == chunked_frames.hash);
+    FUZZ_CHECK(whole.checksum_errors == chunked.checksum_errors && whole.oversized == chunked.oversized);
+
+    // Кадр из начала входа как данные сообщения находится без изменений
+    static uint8_t frame[UBX_FRAME_MAX];
+    size_t payload = size < UBX_PAYLOAD_MAX ? size : UBX_PAYLOAD_MAX;
+    size_t length = ubx_frame_build(frame, sizeof(frame), split, split ^ 0x5A, data, payload);
+    FUZZ_CHECK(length == UBX_HEADER_SIZE + payload + UBX_CHECKSUM_SIZE);
+
+    static ubx_framer_t rebuilt;
+    fuzz_frames_t rebuilt_frames = {0, 2166136261u}, expected = {0, 2166136261u};
+    ubx_framer_init(&rebuilt, fuzz_rebuilt, &rebuilt_frames);
+    ubx_framer_feed(&rebuilt, frame, length);
+    fuzz_rebuilt(&expected, split, split ^ 0x5A, data, payload);
+    FUZZ_CHECK(rebuilt_frames.count == 1 && rebuilt_frames.hash == expected.hash);
+
+    // Набор ключей из входа: CFG-VALSET не переполняет буфер
+    ubx_valset_t set;
+    ubx_valset_init(&set, split);
+    for (size_t offset = 0; offset + 4 <= size; offset += 4) {
+        uint32_t key;
+        memcpy(&key, data + offset, sizeof(key));
+        ubx_valset_add(&set, key, key * 2654435761u);
+        FUZZ_CHECK(set.length <= sizeof(set.payload) && set.count <= UBX_VALSET_KEYS_MAX);
+    }
+    return 0;
+}
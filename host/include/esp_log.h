@@ -0,0 +1,31 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef ESP32_XBEE_HOST_ESP_LOG_H
+#define ESP32_XBEE_HOST_ESP_LOG_H
+
+#include <stdio.h>
+
+/// Журнал ESP-IDF для сборки на хосте: ошибки и предупреждения в stderr, остальное отбрасывается
+#define ESP_LOGE(tag, format, ...) fprintf(stderr, "E %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) fprintf(stderr, "W %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) do { if (0) fprintf(stderr, format, ##__VA_ARGS__); } while (0)
+#define ESP_LOGD(tag, format, ...) do { if (0) fprintf(stderr, format, ##__VA_ARGS__); } while (0)
+#define ESP_LOGV(tag, format, ...) do { if (0) fprintf(stderr, format, ##__VA_ARGS__); } while (0)
+
+#endif //ESP32_XBEE_HOST_ESP_LOG_H
@@ -0,0 +1,82 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#ifndef ESP32_XBEE_MOCK_CASTER_H
+#define ESP32_XBEE_MOCK_CASTER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// Локальный NTRIP кастер для сборки на хосте на 127.0.0.1.
+/// Источники: SOURCE (NTRIP 1.0) и POST с Basic авторизацией (NTRIP 2.0), поток
+/// разбирается на кадры RTCM 3. Клиенты: GET / (таблица источников) и GET /<точка>
+/// (1.0 - ICY 200 OK, 2.0 - HTTP/1.1 с chunked), получают данные всех источников.
+/// Неисправности для проверки переподключения задаются через mock_caster_inject
+
+#define MOCK_CASTER_RESPONSE_MAX 256
+
+typedef struct mock_caster *mock_caster_handle_t;
+
+/// Вызывается в потоке кастера для каждого принятого кадра
+typedef void (*mock_caster_frame_handler_t)(void *ctx, const uint8_t *frame, size_t length);
+
+typedef enum {
+    MOCK_CASTER_FAULT_NONE = 0,
+    MOCK_CASTER_FAULT_REFUSE,           // порт закрыт param мс (ECONNREFUSED), счётчик подключений не используется
+    MOCK_CASTER_FAULT_SLOW_ACCEPT,      // ответ на запрос через param мс
+    MOCK_CASTER_FAULT_HALF_OPEN,        // запрос принят, ответа нет, данные не читаются
+    MOCK_CASTER_FAULT_RESET,            // RST после приёма param байт потока
+    MOCK_CASTER_FAULT_SLOW_READER,      // маленькое окно приёма и чтение param байт/с (0 - не читать)
+    MOCK_CASTER_FAULT_RESPONSE,         // вместо обычного ответа response, разбитый на два сегмента по param (0 - целиком)
+} mock_caster_fault_type_t;
+
+typedef struct mock_caster_fault {
+    mock_caster_fault_type_t type;
+    uint32_t param;
+    char response[MOCK_CASTER_RESPONSE_MAX];
+} mock_caster_fault_t;
+
+typedef struct mock_caster_stats {
+    uint32_t connections;   // принятые источники
+    uint32_t rejected;
+    uint32_t faults;        // подключения, к которым применена неисправность
+    uint32_t clients;
+    uint64_t bytes;
+    uint32_t frames;
+    uint32_t crc_errors;
+    uint64_t cpu_us;        // процессорное время потоков кастера
+    uint64_t connected_us;  // platform_time_us последнего принятого источника
+} mock_caster_stats_t;
+
+mock_caster_handle_t mock_caster_start(const char *mountpoint, const char *password,
+        mock_caster_frame_handler_t handler, void *ctx);
+uint16_t mock_caster_port(mock_caster_handle_t caster);
+void mock_caster_stats(mock_caster_handle_t caster, mock_caster_stats_t *stats);
+
+/// Неисправность для следующих count подключений источников (предыдущая заменяется).
+/// MOCK_CASTER_FAULT_NONE отменяет неисправность
+void mock_caster_inject(mock_caster_handle_t caster, const mock_caster_fault_t *fault, uint32_t count);
+
+/// Разрыв всех текущих подключений (RST)
+void mock_caster_drop(mock_caster_handle_t caster);
+
+void mock_caster_stop(mock_caster_handle_t caster);
+
+#endif //ESP32_XBEE_MOCK_CASTER_H
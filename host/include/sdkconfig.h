@@ -0,0 +1,26 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef ESP32_XBEE_HOST_SDKCONFIG_H
+#define ESP32_XBEE_HOST_SDKCONFIG_H
+
+// Конфигурация для сборки на хосте вместо сгенерированной ESP-IDF
+#define CONFIG_PIPELINE_TRACE 1
+#define CONFIG_PIPELINE_TRACE_EVENTS 16384
+
+#endif //ESP32_XBEE_HOST_SDKCONFIG_H
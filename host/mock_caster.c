@@ -0,0 +1,593 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <mock_caster.h>
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <net.h>
+#include <platform.h>
+#include <protocol/rtcm3.h>
+
+#define MOCK_CASTER_REQUEST_MAX 1024
+#define MOCK_CASTER_BUFFER_SIZE 4096
+#define MOCK_CASTER_POLL_MS 100
+#define MOCK_CASTER_CONNECTIONS_MAX 16
+#define MOCK_CASTER_SLOW_READER_BUFFER 4096
+#define MOCK_CASTER_SPLIT_DELAY_MS 50
+
+#define MOCK_CASTER_SERVER "Server: NTRIP MockCaster/1.0\r\n"
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+typedef enum {
+    MOCK_CASTER_REQUEST_INVALID,
+    MOCK_CASTER_REQUEST_SOURCE,
+    MOCK_CASTER_REQUEST_CLIENT,
+    MOCK_CASTER_REQUEST_SOURCETABLE,
+} mock_caster_request_t;
+
+typedef struct mock_caster_connection {
+    mock_caster_handle_t caster;
+    int sock;
+    pthread_t thread;
+    bool used;
+    volatile bool done;
+
+    bool client;            // получатель потока от источников
+    bool chunked;           // NTRIP 2.0: Transfer-Encoding: chunked
+    uint64_t cpu_us;        // учтённое процессорное время потока
+} mock_caster_connection_t;
+
+struct mock_caster {
+    char mountpoint[64];
+    char password[64];
+
+    int listen_sock;
+    uint16_t port;
+    pthread_t thread;
+    volatile bool running;
+
+    mock_caster_frame_handler_t handler;
+    void *ctx;
+
+    pthread_mutex_t lock;
+    mock_caster_stats_t stats;
+
+    mock_caster_fault_t fault;
+    uint32_t fault_count;
+    uint32_t refuse_ms;
+
+    mock_caster_connection_t connections[MOCK_CASTER_CONNECTIONS_MAX];
+};
+
+static uint64_t mock_caster_cpu_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/// Пауза с проверкой остановки кастера
+static void mock_caster_sleep(mock_caster_handle_t caster, uint32_t ms) {
+    uint64_t end = platform_time_us() + (uint64_t) ms * 1000;
+    while (caster->running) {
+        uint64_t now = platform_time_us();
+        if (now >= end) return;
+        platform_sleep_ms(MIN(MOCK_CASTER_POLL_MS, (end - now + 999) / 1000));
+    }
+}
+
+/// Ожидание данных с периодической проверкой остановки
+static bool mock_caster_wait(mock_caster_handle_t caster, int sock) {
+    struct pollfd fd = {.fd = sock, .events = POLLIN};
+    while (caster->running) {
+        int n = poll(&fd, 1, MOCK_CASTER_POLL_MS);
+        if (n > 0) return true;
+        if (n < 0 && errno != EINTR) return false;
+    }
+
+    return false;
+}
+
+/// Ожидание закрытия соединения другой стороной без чтения данных
+static void mock_caster_wait_hangup(mock_caster_handle_t caster, int sock) {
+    struct pollfd fd = {.fd = sock, .events = POLLRDHUP};
+    while (caster->running) {
+        int n = poll(&fd, 1, MOCK_CASTER_POLL_MS);
+        if (n > 0 && (fd.revents & (POLLRDHUP | POLLHUP | POLLERR))) return;
+        if (n < 0 && errno != EINTR) return;
+    }
+}
+
+static int mock_caster_send(int sock, const char *data) {
+    return send(sock, data, strlen(data), MSG_NOSIGNAL);
+}
+
+static int mock_caster_listen(mock_caster_handle_t caster) {
+    // Порт выбирает система, чтобы параллельные запуски не конфликтовали,
+    // после REFUSE слушается тот же порт
+    struct sockaddr_in addr = {
+            .sin_family = AF_INET,
+            .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+            .sin_port = htons(caster->port)
+    };
+    socklen_t addr_length = sizeof(addr);
+    int reuse = 1;
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0
+            || setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0
+            || bind(sock, (struct sockaddr *) &addr, sizeof(addr)) != 0
+            || listen(sock, 4) != 0
+            || getsockname(sock, (struct sockaddr *) &addr, &addr_length) != 0) {
+        perror("mock caster");
+        if (sock >= 0) close(sock);
+        return -1;
+    }
+
+    caster->port = ntohs(addr.sin_port);
+    return sock;
+}
+
+static int mock_caster_base64_value(char c) {
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == '+') return 62;
+    if (c == '/') return 63;
+    return -1;
+}
+
+/// Проверка пароля из "Authorization: Basic base64(user:password)", имя пользователя не проверяется
+static bool mock_caster_basic_auth_ok(mock_caster_handle_t caster, const char *request) {
+    char *authorization = extract_http_header(request, "Authorization:");
+    if (authorization == NULL) return false;
+
+    char decoded[192];
+    size_t length = 0;
+    uint32_t bits = 0;
+    int bit_count = 0;
+    const char *encoded = strncasecmp(authorization, "Basic ", 6) == 0 ? authorization + 6 : "";
+    for (const char *c = encoded; *c != '\0' && *c != '=' && length < sizeof(decoded) - 1; c++) {
+        int value = mock_caster_base64_value(*c);
+        if (value < 0) continue;
+        bits = (bits << 6) | value;
+        bit_count += 6;
+        if (bit_count >= 8) {
+            bit_count -= 8;
+            decoded[length++] = (char) (bits >> bit_count);
+        }
+    }
+    decoded[length] = '\0';
+    free(authorization);
+
+    char *password = strchr(decoded, ':');
+    return password != NULL && strcmp(password + 1, caster->password) == 0;
+}
+
+/// Чтение запроса до пустой строки
+static bool mock_caster_read_request(mock_caster_handle_t caster, int sock, char *request, size_t size) {
+    size_t used = 0;
+    request[0] = '\0';
+    while (strstr(request, "\r\n\r\n") == NULL) {
+        if (used == size - 1 || !mock_caster_wait(caster, sock)) return false;
+        int n = recv(sock, request + used, size - 1 - used, 0);
+        if (n <= 0) return false;
+        used += n;
+        request[used] = '\0';
+    }
+
+    return true;
+}
+
+/// Разбор строки запроса: SOURCE (1.0), POST (2.0), GET / и GET /<точка>
+static mock_caster_request_t mock_caster_parse(mock_caster_handle_t caster, const char *request,
+        bool *ntrip2, bool *authorized) {
+    char path[80];
+    int path_offset;
+    *ntrip2 = strstr(request, "Ntrip-Version: Ntrip/2.0") != NULL;
+    *authorized = false;
+
+    if (strncmp(request, "SOURCE ", 7) == 0) {
+        char password[64];
+        if (sscanf(request, "SOURCE %63s %79s", password, path) != 2) return MOCK_CASTER_REQUEST_INVALID;
+        *ntrip2 = false;
+        *authorized = strcmp(password, caster->password) == 0 && path[0] == '/'
+                && strcmp(path + 1, caster->mountpoint) == 0;
+        return MOCK_CASTER_REQUEST_SOURCE;
+    }
+
+    if (strncmp(request, "POST ", 5) == 0) path_offset = 5;
+    else if (strncmp(request, "GET ", 4) == 0) path_offset = 4;
+    else return MOCK_CASTER_REQUEST_INVALID;
+
+    if (sscanf(request + path_offset, "%79s", path) != 1 || path[0] != '/') return MOCK_CASTER_REQUEST_INVALID;
+    bool mountpoint = strcmp(path + 1, caster->mountpoint) == 0;
+
+    if (path_offset == 5) {
+        *ntrip2 = true;
+        *authorized = mountpoint && mock_caster_basic_auth_ok(caster, request);
+        return MOCK_CASTER_REQUEST_SOURCE;
+    }
+
+    if (path[1] == '\0') return MOCK_CASTER_REQUEST_SOURCETABLE;
+    return mountpoint ? MOCK_CASTER_REQUEST_CLIENT : MOCK_CASTER_REQUEST_INVALID;
+}
+
+static void mock_caster_sourcetable(mock_caster_handle_t caster, int sock, bool ntrip2) {
+    char table[256], response[512];
+    int length = snprintf(table, sizeof(table), "STR;%s;%s;RTCM 3.2;;2;GPS+GLO+GAL+BDS;MOCK;XXX;0.00;0.00;0;0;"
+            "MockCaster;none;B;N;0;\r\nENDSOURCETABLE\r\n", caster->mountpoint, caster->mountpoint);
+    snprintf(response, sizeof(response), "%s" MOCK_CASTER_SERVER
+            "Content-Type: %s\r\nContent-Length: %d\r\n\r\n%s",
+            ntrip2 ? "HTTP/1.1 200 OK\r\nNtrip-Version: Ntrip/2.0\r\n" : "SOURCETABLE 200 OK\r\n",
+            ntrip2 ? "gnss/sourcetable" : "text/plain", length, table);
+    mock_caster_send(sock, response);
+}
+
+/// Ответ неисправности RESPONSE, при param > 0 двумя сегментами
+static void mock_caster_fault_response(mock_caster_handle_t caster, int sock, const mock_caster_fault_t *fault) {
+    size_t length = strnlen(fault->response, sizeof(fault->response));
+    size_t split = fault->param > 0 && fault->param < length ? fault->param : length;
+    send(sock, fault->response, split, MSG_NOSIGNAL);
+    if (split == length) return;
+
+    mock_caster_sleep(caster, MOCK_CASTER_SPLIT_DELAY_MS);
+    send(sock, fault->response + split, length - split, MSG_NOSIGNAL);
+}
+
+static void mock_caster_frame(void *ctx, const uint8_t *frame, size_t length) {
+    mock_caster_handle_t caster = ctx;
+    if (caster->handler != NULL) caster->handler(caster->ctx, frame, length);
+}
+
+/// Пересылка данных источника всем клиентам без ожидания, медленный клиент отключается
+static void mock_caster_relay(mock_caster_handle_t caster, const uint8_t *data, size_t length) {
+    char chunk[16];
+    int chunk_length = snprintf(chunk, sizeof(chunk), "%zx\r\n", length);
+
+    for (int i = 0; i < MOCK_CASTER_CONNECTIONS_MAX; i++) {
+        mock_caster_connection_t *connection = &caster->connections[i];
+        if (!connection->used || !connection->client || connection->sock < 0) continue;
+
+        bool ok = true;
+        if (connection->chunked) ok = send(connection->sock, chunk, chunk_length, MSG_DONTWAIT | MSG_NOSIGNAL) == chunk_length;
+        ok = ok && send(connection->sock, data, length, MSG_DONTWAIT | MSG_NOSIGNAL) == (ssize_t) length;
+        if (connection->chunked) ok = ok && send(connection->sock, "\r\n", 2, MSG_DONTWAIT | MSG_NOSIGNAL) == 2;
+        if (!ok) shutdown(connection->sock, SHUT_RDWR);
+    }
+}
+
+/// Учёт принятых данных источника: кадрирование, статистика и пересылка клиентам
+static void mock_caster_receive(mock_caster_connection_t *connection, rtcm3_framer_t *framer,
+        const uint8_t *data, size_t length) {
+    mock_caster_handle_t caster = connection->caster;
+
+    uint32_t frames = framer->frames, crc_errors = framer->crc_errors;
+    rtcm3_framer_feed(framer, data, length);
+
+    uint64_t cpu = mock_caster_cpu_us();
+
+    pthread_mutex_lock(&caster->lock);
+    caster->stats.bytes += length;
+    caster->stats.frames += framer->frames - frames;
+    caster->stats.crc_errors += framer->crc_errors - crc_errors;
+    caster->stats.cpu_us += cpu - connection->cpu_us;
+    mock_caster_relay(caster, data, length);
+    pthread_mutex_unlock(&caster->lock);
+
+    connection->cpu_us = cpu;
+}
+
+/// Поток источника после принятия запроса, с учётом неисправности
+static void mock_caster_source(mock_caster_connection_t *connection, const mock_caster_fault_t *fault) {
+    mock_caster_handle_t caster = connection->caster;
+    int sock = connection->sock;
+    uint8_t buffer[MOCK_CASTER_BUFFER_SIZE];
+    uint64_t received = 0;
+
+    rtcm3_framer_t *framer = malloc(sizeof(rtcm3_framer_t));
+    if (framer == NULL) return;
+    rtcm3_framer_init(framer, mock_caster_frame, caster);
+
+    if (fault->type == MOCK_CASTER_FAULT_SLOW_READER) {
+        int size = MOCK_CASTER_SLOW_READER_BUFFER;
+        setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+        if (fault->param == 0) {
+            mock_caster_wait_hangup(caster, sock);
+            free(framer);
+            return;
+        }
+
+        // Десять чтений в секунду
+        size_t chunk = fault->param / 10 > 0 ? fault->param / 10 : 1;
+        while (caster->running) {
+            mock_caster_sleep(caster, 1000 / 10);
+            int n = recv(sock, buffer, MIN(chunk, sizeof(buffer)), MSG_DONTWAIT);
+            if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) break;
+            if (n > 0) mock_caster_receive(connection, framer, buffer, n);
+        }
+
+        free(framer);
+        return;
+    }
+
+    while (true) {
+        size_t size = sizeof(buffer);
+        if (fault->type == MOCK_CASTER_FAULT_RESET) {
+            if (received >= fault->param) {
+                // Закрытие с нулевым SO_LINGER отправляет RST
+                struct linger linger = {.l_onoff = 1, .l_linger = 0};
+                setsockopt(sock, SOL_SOCKET, SO_LINGER, &linger, sizeof(linger));
+                break;
+            }
+            size = MIN(size, fault->param - received);
+        }
+
+        if (!mock_caster_wait(caster, sock)) break;
+        int n = recv(sock, buffer, size, 0);
+        if (n <= 0) break;
+        received += n;
+        mock_caster_receive(connection, framer, buffer, n);
+    }
+
+    free(framer);
+}
+
+static void mock_caster_client(mock_caster_connection_t *connection, bool ntrip2) {
+    mock_caster_handle_t caster = connection->caster;
+    int sock = connection->sock;
+
+    const char *response = ntrip2
+            ? "HTTP/1.1 200 OK\r\nNtrip-Version: Ntrip/2.0\r\n" MOCK_CASTER_SERVER
+              "Content-Type: gnss/data\r\nTransfer-Encoding: chunked\r\nCache-Control: no-store\r\n\r\n"
+            : "ICY 200 OK\r\n\r\n";
+    if (mock_caster_send(sock, response) <= 0) return;
+
+    // Данные клиенту отправляют потоки источников, здесь только ожидание отключения
+    pthread_mutex_lock(&caster->lock);
+    connection->chunked = ntrip2;
+    connection->client = true;
+    caster->stats.clients++;
+    pthread_mutex_unlock(&caster->lock);
+
+    uint8_t buffer[256];
+    while (mock_caster_wait(caster, sock)) {
+        if (recv(sock, buffer, sizeof(buffer), 0) <= 0) break;
+    }
+}
+
+static void *mock_caster_connection_task(void *ctx) {
+    mock_caster_connection_t *connection = ctx;
+    mock_caster_handle_t caster = connection->caster;
+    int sock = connection->sock;
+    char request[MOCK_CASTER_REQUEST_MAX];
+    bool ntrip2, authorized;
+
+    connection->cpu_us = mock_caster_cpu_us();
+
+    mock_caster_request_t type = MOCK_CASTER_REQUEST_INVALID;
+    if (mock_caster_read_request(caster, sock, request, sizeof(request))) {
+        type = mock_caster_parse(caster, request, &ntrip2, &authorized);
+    }
+
+    mock_caster_fault_t fault = {.type = MOCK_CASTER_FAULT_NONE};
+    if (type == MOCK_CASTER_REQUEST_SOURCE) {
+        pthread_mutex_lock(&caster->lock);
+        if (caster->fault_count > 0) {
+            fault = caster->fault;
+            caster->fault_count--;
+            caster->stats.faults++;
+        }
+        pthread_mutex_unlock(&caster->lock);
+    }
+
+    if (fault.type == MOCK_CASTER_FAULT_SLOW_ACCEPT) mock_caster_sleep(caster, fault.param);
+
+    bool accepted = false;
+    switch (type) {
+        case MOCK_CASTER_REQUEST_SOURCE:
+            if (fault.type == MOCK_CASTER_FAULT_HALF_OPEN) {
+                mock_caster_wait_hangup(caster, sock);
+            } else if (fault.type == MOCK_CASTER_FAULT_RESPONSE) {
+                mock_caster_fault_response(caster, sock, &fault);
+                mock_caster_source(connection, &fault);
+            } else if (!authorized) {
+                mock_caster_send(sock, ntrip2 ? "HTTP/1.1 401 Unauthorized\r\n" MOCK_CASTER_SERVER "\r\n"
+                        : "ERROR - Bad Password\r\n");
+            } else {
+                accepted = mock_caster_send(sock, ntrip2 ? "HTTP/1.1 200 OK\r\nNtrip-Version: Ntrip/2.0\r\n"
+                        MOCK_CASTER_SERVER "Connection: close\r\n\r\n" : "ICY 200 OK\r\n\r\n") > 0;
+                if (accepted) {
+                    pthread_mutex_lock(&caster->lock);
+                    caster->stats.connections++;
+                    caster->stats.connected_us = platform_time_us();
+                    pthread_mutex_unlock(&caster->lock);
+
+                    mock_caster_source(connection, &fault);
+                }
+            }
+            break;
+        case MOCK_CASTER_REQUEST_CLIENT:
+            accepted = true;
+            mock_caster_client(connection, ntrip2);
+            break;
+        case MOCK_CASTER_REQUEST_SOURCETABLE:
+            accepted = true;
+            mock_caster_sourcetable(caster, sock, ntrip2);
+            break;
+        default:
+            mock_caster_send(sock, "HTTP/1.1 404 Not Found\r\n" MOCK_CASTER_SERVER "\r\n");
+            break;
+    }
+
+    pthread_mutex_lock(&caster->lock);
+    if (!accepted && fault.type == MOCK_CASTER_FAULT_NONE) caster->stats.rejected++;
+    caster->stats.cpu_us += mock_caster_cpu_us() - connection->cpu_us;
+    close(sock);
+    connection->sock = -1;
+    connection->done = true;
+    pthread_mutex_unlock(&caster->lock);
+
+    return NULL;
+}
+
+/// Свободная ячейка подключения, завершённые потоки присоединяются
+static mock_caster_connection_t *mock_caster_connection_slot(mock_caster_handle_t caster) {
+    mock_caster_connection_t *free_slot = NULL;
+    for (int i = 0; i < MOCK_CASTER_CONNECTIONS_MAX; i++) {
+        mock_caster_connection_t *connection = &caster->connections[i];
+        if (connection->used && connection->done) {
+            pthread_join(connection->thread, NULL);
+            connection->used = false;
+        }
+        if (!connection->used && free_slot == NULL) free_slot = connection;
+    }
+
+    return free_slot;
+}
+
+static void *mock_caster_task(void *ctx) {
+    mock_caster_handle_t caster = ctx;
+
+    while (caster->running) {
+        pthread_mutex_lock(&caster->lock);
+        uint32_t refuse_ms = caster->refuse_ms;
+        caster->refuse_ms = 0;
+        pthread_mutex_unlock(&caster->lock);
+
+        // Закрытый порт: подключения отклоняются системой
+        if (refuse_ms > 0) {
+            close(caster->listen_sock);
+            caster->listen_sock = -1;
+            mock_caster_sleep(caster, refuse_ms);
+            caster->listen_sock = mock_caster_listen(caster);
+            if (caster->listen_sock < 0) break;
+        }
+
+        struct pollfd fd = {.fd = caster->listen_sock, .events = POLLIN};
+        if (poll(&fd, 1, MOCK_CASTER_POLL_MS) <= 0) continue;
+
+        int sock = accept(caster->listen_sock, NULL, NULL);
+        if (sock < 0) continue;
+
+        pthread_mutex_lock(&caster->lock);
+        mock_caster_connection_t *connection = mock_caster_connection_slot(caster);
+        if (connection != NULL) {
+            *connection = (mock_caster_connection_t) {
+                    .caster = caster,
+                    .sock = sock,
+                    .used = true
+            };
+            if (pthread_create(&connection->thread, NULL, mock_caster_connection_task, connection) != 0) {
+                connection->used = false;
+                connection = NULL;
+            }
+        }
+        if (connection == NULL) caster->stats.rejected++;
+        pthread_mutex_unlock(&caster->lock);
+
+        if (connection == NULL) close(sock);
+    }
+
+    return NULL;
+}
+
+mock_caster_handle_t mock_caster_start(const char *mountpoint, const char *password,
+        mock_caster_frame_handler_t handler, void *ctx) {
+    mock_caster_handle_t caster = calloc(1, sizeof(struct mock_caster));
+    if (caster == NULL) return NULL;
+
+    snprintf(caster->mountpoint, sizeof(caster->mountpoint), "%s", mountpoint);
+    snprintf(caster->password, sizeof(caster->password), "%s", password);
+    caster->handler = handler;
+    caster->ctx = ctx;
+    pthread_mutex_init(&caster->lock, NULL);
+
+    caster->listen_sock = mock_caster_listen(caster);
+    if (caster->listen_sock < 0) {
+        free(caster);
+        return NULL;
+    }
+
+    caster->running = true;
+    if (pthread_create(&caster->thread, NULL, mock_caster_task, caster) != 0) {
+        close(caster->listen_sock);
+        free(caster);
+        return NULL;
+    }
+
+    return caster;
+}
+
+uint16_t mock_caster_port(mock_caster_handle_t caster) {
+    return caster->port;
+}
+
+void mock_caster_stats(mock_caster_handle_t caster, mock_caster_stats_t *stats) {
+    pthread_mutex_lock(&caster->lock);
+    *stats = caster->stats;
+    pthread_mutex_unlock(&caster->lock);
+}
+
+void mock_caster_inject(mock_caster_handle_t caster, const mock_caster_fault_t *fault, uint32_t count) {
+    pthread_mutex_lock(&caster->lock);
+    if (fault->type == MOCK_CASTER_FAULT_REFUSE) {
+        caster->refuse_ms = fault->param;
+    } else {
+        caster->fault = *fault;
+        caster->fault_count = fault->type == MOCK_CASTER_FAULT_NONE ? 0 : count;
+    }
+    pthread_mutex_unlock(&caster->lock);
+}
+
+void mock_caster_drop(mock_caster_handle_t caster) {
+    struct linger linger = {.l_onoff = 1, .l_linger = 0};
+
+    pthread_mutex_lock(&caster->lock);
+    for (int i = 0; i < MOCK_CASTER_CONNECTIONS_MAX; i++) {
+        mock_caster_connection_t *connection = &caster->connections[i];
+        if (!connection->used || connection->sock < 0) continue;
+        setsockopt(connection->sock, SOL_SOCKET, SO_LINGER, &linger, sizeof(linger));
+        shutdown(connection->sock, SHUT_RDWR);
+    }
+    pthread_mutex_unlock(&caster->lock);
+}
+
+void mock_caster_stop(mock_caster_handle_t caster) {
+    caster->running = false;
+    pthread_join(caster->thread, NULL);
+    if (caster->listen_sock >= 0) close(caster->listen_sock);
+
+    for (int i = 0; i < MOCK_CASTER_CONNECTIONS_MAX; i++) {
+        if (caster->connections[i].used) pthread_join(caster->connections[i].thread, NULL);
+    }
+
+    pthread_mutex_destroy(&caster->lock);
+    free(caster);
+}
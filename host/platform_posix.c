@@ -0,0 +1,44 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <platform.h>
+
+#include <errno.h>
+#include <time.h>
+
+uint64_t platform_time_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void platform_sleep_ms(uint32_t ms) {
+    struct timespec ts = {
+            .tv_sec = ms / 1000,
+            .tv_nsec = (long) (ms % 1000) * 1000000
+    };
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR);
+}
+
+// Потоки нумеруются по первому обращению
+uint16_t platform_task_id() {
+    static _Thread_local uint16_t task = 0;
+    static uint16_t task_next = 1;
+    if (task == 0) task = __atomic_fetch_add(&task_next, 1, __ATOMIC_RELAXED);
+    return task;
+}
@@ -0,0 +1,336 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+/// Проверка разбора NMEA: поля GGA/RMC/GSA/GSV в фиксированной точке, контрольные
+/// суммы, поток кусками с двоичными данными между предложениями и скорость разбора.
+/// Сборка предложений $PESP: суммы префиксов, форматы, обрезка
+///
+///   nmea_parser [проверка]   без аргумента - все проверки
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <platform.h>
+#include <protocol/nmea.h>
+#include <protocol/rtcm3.h>
+
+// Разбор должен многократно опережать UART на 921600 бод (~92 КБ/с)
+#define PARSER_RATE_MIN (1024 * 1024)
+#define PARSER_RATE_BYTES (8 * 1024 * 1024)
+
+#define CHECK(condition, ...) do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s: ", __FILE__, __LINE__, #condition); \
+            fprintf(stderr, __VA_ARGS__); \
+            fputc('\n', stderr); \
+            return false; \
+        } \
+    } while (0)
+
+typedef struct parser_result {
+    uint32_t types[NMEA_SENTENCE_GSV + 1];
+} parser_result_t;
+
+/// Предложение с контрольной суммой и CRLF из тела без '$'
+static size_t parser_sentence(char *out, size_t size, const char *body) {
+    uint8_t checksum = 0;
+    for (const char *p = body; *p; p++) checksum ^= (uint8_t) *p;
+
+    return snprintf(out, size, "$%s*%02X\r\n", body, checksum);
+}
+
+static void parser_count(void *ctx, nmea_sentence_t type, const char *sentence, size_t length) {
+    parser_result_t *result = ctx;
+    result->types[type]++;
+}
+
+static void parser_feed(nmea_parser_t *parser, const char *body) {
+    char sentence[NMEA_SENTENCE_MAX + 8];
+    size_t length = parser_sentence(sentence, sizeof(sentence), body);
+    nmea_parser_feed(parser, (uint8_t *) sentence, length);
+}
+
+static bool parser_gga() {
+    nmea_parser_t parser;
+    nmea_parser_init(&parser, NULL, NULL);
+
+    parser_feed(&parser, "GPGGA,123519.50,4807.0380123,N,01131.0004567,E,4,12,0.90,545.412,M,46.900,M,1.0,0000");
+    nmea_fix_t *fix = &parser.fix;
+    CHECK(parser.sentences == 1, "%u sentences", parser.sentences);
+    CHECK(fix->position_valid, "no position");
+    CHECK(fix->latitude == 481173002, "latitude %d", fix->latitude);
+    CHECK(fix->longitude == 115166743, "longitude %d", fix->longitude);
+    CHECK(fix->quality == 4 && fix->satellites_used == 12 && fix->hdop == 90,
+            "quality %u satellites %u hdop %u", fix->quality, fix->satellites_used, fix->hdop);
+    CHECK(fix->altitude == 545412 && fix->geoid_separation == 46900,
+            "altitude %d separation %d", fix->altitude, fix->geoid_separation);
+    CHECK(fix->time_valid && fix->hour == 12 && fix->minute == 35 && fix->second == 19 && fix->millisecond == 500,
+            "time %02u:%02u:%02u.%03u", fix->hour, fix->minute, fix->second, fix->millisecond);
+
+    parser_feed(&parser, "GNGGA,000001,3351.1234,S,15112.5000,W,1,05,2.5,-12.5,M,,M,,");
+    CHECK(fix->latitude == -338520567 && fix->longitude == -1512083333,
+            "latitude %d longitude %d", fix->latitude, fix->longitude);
+    CHECK(fix->altitude == -12500, "altitude %d", fix->altitude);
+
+    // Без решения координаты сохраняются, но помечаются недействительными
+    parser_feed(&parser, "GPGGA,000002.00,,,,,0,00,99.99,,,,,,");
+    CHECK(!fix->position_valid && fix->quality == 0, "position valid without fix");
+    CHECK(fix->latitude == -338520567, "latitude overwritten %d", fix->latitude);
+    return true;
+}
+
+static bool parser_rmc() {
+    nmea_parser_t parser;
+    nmea_parser_init(&parser, NULL, NULL);
+
+    parser_feed(&parser, "GNRMC,225446.00,A,4916.45,N,12311.12,W,000.5,054.7,191124,020.3,E,A,V");
+    nmea_fix_t *fix = &parser.fix;
+    CHECK(fix->position_valid, "no position");
+    CHECK(fix->latitude == 492741667 && fix->longitude == -1231853333,
+            "latitude %d longitude %d", fix->latitude, fix->longitude);
+    CHECK(fix->speed == 257 && fix->course == 5470, "speed %u course %u", fix->speed, fix->course);
+    CHECK(fix->date_valid && fix->day == 19 && fix->month == 11 && fix->year == 2024,
+            "date %02u.%02u.%u", fix->day, fix->month, fix->year);
+
+    parser_feed(&parser, "GNRMC,225447.00,V,,,,,,,191124,,,N,V");
+    CHECK(!fix->position_valid, "position valid with status V");
+    CHECK(fix->second == 47, "time not updated");
+    return true;
+}
+
+static bool parser_gsa_gsv() {
+    parser_result_t result = {0};
+    nmea_parser_t parser;
+    nmea_parser_init(&parser, parser_count, &result);
+
+    parser_feed(&parser, "GNGSA,A,3,01,02,03,04,05,06,07,08,,,,,1.50,0.80,1.27,1");
+    parser_feed(&parser, "GPGSV,3,1,10,01,40,083,46,02,17,308,41,12,07,344,39,14,22,228,45,1");
+    parser_feed(&parser, "GLGSV,2,1,07,65,40,083,46,66,17,308,41,72,07,344,39,81,22,228,45,1");
+    // Вторая серия GPS по другому сигналу не должна удваивать число спутников
+    parser_feed(&parser, "GPGSV,3,1,10,01,40,083,46,02,17,308,41,12,07,344,39,14,22,228,45,6");
+    parser_feed(&parser, "PUBX,00,123519.00,4807.038,N,01131.000,E");
+
+    nmea_fix_t *fix = &parser.fix;
+    CHECK(fix->mode == 3 && fix->pdop == 150 && fix->hdop == 80 && fix->vdop == 127,
+            "mode %u pdop %u hdop %u vdop %u", fix->mode, fix->pdop, fix->hdop, fix->vdop);
+    CHECK(fix->in_view[NMEA_SYSTEM_GPS] == 10 && fix->in_view[NMEA_SYSTEM_GLONASS] == 7,
+            "in view GPS %u GLONASS %u", fix->in_view[NMEA_SYSTEM_GPS], fix->in_view[NMEA_SYSTEM_GLONASS]);
+    CHECK(fix->satellites_in_view == 17, "in view %u", fix->satellites_in_view);
+    CHECK(result.types[NMEA_SENTENCE_GSA] == 1 && result.types[NMEA_SENTENCE_GSV] == 3
+            && result.types[NMEA_SENTENCE_OTHER] == 1,
+            "GSA %u GSV %u other %u", result.types[NMEA_SENTENCE_GSA], result.types[NMEA_SENTENCE_GSV],
+            result.types[NMEA_SENTENCE_OTHER]);
+    CHECK(!fix->position_valid, "proprietary sentence parsed as position");
+    return true;
+}
+
+static bool parser_checksum() {
+    nmea_parser_t parser;
+    nmea_parser_init(&parser, NULL, NULL);
+
+    const char *bad = "$GPGGA,123519,4807.038,N,01131.000,E,1,08,0.9,545.4,M,46.9,M,,*48\r\n";
+    const char *missing = "$GPGGA,123519,4807.038,N,01131.000,E,1,08,0.9,545.4,M,46.9,M,,\r\n";
+    const char *short_sum = "$GPGGA,123519,4807.038,N,01131.000,E,1,08,0.9,545.4,M,46.9,M,,*4\r\n";
+    nmea_parser_feed(&parser, (uint8_t *) bad, strlen(bad));
+    nmea_parser_feed(&parser, (uint8_t *) missing, strlen(missing));
+    nmea_parser_feed(&parser, (uint8_t *) short_sum, strlen(short_sum));
+    CHECK(parser.sentences == 0 && parser.checksum_errors == 3,
+            "%u sentences, %u checksum errors", parser.sentences, parser.checksum_errors);
+    CHECK(!parser.fix.position_valid && !parser.fix.time_valid, "fix updated from a bad sentence");
+
+    // Та же строка с верной суммой принимается
+    const char *good = "$GPGGA,123519,4807.038,N,01131.000,E,1,08,0.9,545.4,M,46.9,M,,*47\r\n";
+    nmea_parser_feed(&parser, (uint8_t *) good, strlen(good));
+    CHECK(parser.sentences == 1 && parser.fix.position_valid, "%u sentences", parser.sentences);
+
+    char overlong[NMEA_SENTENCE_MAX + 16] = "GPTXT,";
+    memset(overlong + 6, 'A', NMEA_SENTENCE_MAX);
+    overlong[NMEA_SENTENCE_MAX] = '\0';
+    parser_feed(&parser, overlong);
+    CHECK(parser.overflows == 1 && parser.sentences == 1, "%u overflows", parser.overflows);
+    return true;
+}
+
+static bool parser_stream() {
+    // Смесь NMEA, кадров RTCM 3 и оборванной строки
+    uint8_t stream[4096];
+    size_t length = 0;
+    const char *bodies[] = {
+            "GNGGA,101010.00,5530.1234567,N,03730.7654321,E,5,20,0.60,150.000,M,14.000,M,1.0,0001",
+            "GNRMC,101010.00,A,5530.1234567,N,03730.7654321,E,0.010,,010125,,,R,V",
+            "GNGSA,A,3,05,07,13,,,,,,,,,,1.10,0.60,0.90,1",
+            "GAGSV,2,1,08,02,40,083,46,07,17,308,41,,,,,,,,,7",
+    };
+    for (int round = 0; round < 4; round++) {
+        for (size_t i = 0; i < sizeof(bodies) / sizeof(bodies[0]); i++) {
+            length += parser_sentence((char *) stream + length, sizeof(stream) - length, bodies[i]);
+
+            uint8_t payload[40];
+            for (size_t j = 0; j < sizeof(payload); j++) payload[j] = (uint8_t) ('$' + j * 7);
+            payload[0] = 0x3E;
+            payload[1] = 0xD0;
+            length += rtcm3_frame_build(stream + length, payload, sizeof(payload));
+        }
+        const char *truncated = "$GNGGA,101011.00,5530.12";
+        memcpy(stream + length, truncated, strlen(truncated));
+        length += strlen(truncated);
+    }
+
+    nmea_parser_t whole, bytes;
+    nmea_parser_init(&whole, NULL, NULL);
+    nmea_parser_feed(&whole, stream, length);
+    nmea_parser_init(&bytes, NULL, NULL);
+    for (size_t i = 0; i < length; i++) nmea_parser_feed(&bytes, stream + i, 1);
+
+    CHECK(whole.sentences == 16, "%u sentences", whole.sentences);
+    CHECK(bytes.sentences == whole.sentences && bytes.checksum_errors == whole.checksum_errors,
+            "byte feed %u/%u, whole %u/%u", bytes.sentences, bytes.checksum_errors, whole.sentences, whole.checksum_errors);
+    CHECK(memcmp(&bytes.fix, &whole.fix, sizeof(nmea_fix_t)) == 0, "fix differs between feeds");
+    CHECK(whole.fix.quality == 5 && whole.fix.latitude == 555020576 && whole.fix.longitude == 375127572,
+            "quality %u latitude %d longitude %d", whole.fix.quality, whole.fix.latitude, whole.fix.longitude);
+    CHECK(whole.fix.in_view[NMEA_SYSTEM_GALILEO] == 8, "Galileo in view %u", whole.fix.in_view[NMEA_SYSTEM_GALILEO]);
+    return true;
+}
+
+static bool parser_rate() {
+    uint8_t *stream = malloc(PARSER_RATE_BYTES);
+    size_t length = 0;
+    for (uint32_t i = 0; length + 256 < PARSER_RATE_BYTES; i++) {
+        char body[NMEA_SENTENCE_MAX];
+        snprintf(body, sizeof(body), "GNGGA,%02u%02u%02u.00,5530.%07u,N,03730.%07u,E,4,24,0.55,151.%03u,M,14.000,M,1.0,0001",
+                i / 3600 % 24, i / 60 % 60, i % 60, i % 10000000, (i * 7) % 10000000, i % 1000);
+        length += parser_sentence((char *) stream + length, PARSER_RATE_BYTES - length, body);
+        length += parser_sentence((char *) stream + length, PARSER_RATE_BYTES - length,
+                "GPGSV,3,1,10,01,40,083,46,02,17,308,41,12,07,344,39,14,22,228,45,1");
+    }
+
+    nmea_parser_t parser;
+    nmea_parser_init(&parser, NULL, NULL);
+    uint64_t start = platform_time_us();
+    for (size_t offset = 0; offset < length; offset += 1024) {
+        nmea_parser_feed(&parser, stream + offset, length - offset < 1024 ? length - offset : 1024);
+    }
+    uint64_t elapsed = platform_time_us() - start;
+    free(stream);
+
+    double rate = (double) length / (elapsed > 0 ? elapsed : 1) * 1000000;
+    printf("    %zu bytes, %u sentences in %llu us: %.1f MB/s\n", length, parser.sentences,
+            (unsigned long long) elapsed, rate / 1e6);
+    CHECK(parser.checksum_errors == 0, "%u checksum errors", parser.checksum_errors);
+    CHECK(rate >= PARSER_RATE_MIN, "%.0f bytes/s", rate);
+    return true;
+}
+
+/// Сумма и CRLF собранного предложения
+static bool parser_accepts(const char *sentence, int length) {
+    if (length < 6 || length != (int) strlen(sentence) || sentence[0] != '$') return false;
+
+    uint8_t checksum = 0;
+    for (int i = 1; i < length - 5; i++) checksum ^= (uint8_t) sentence[i];
+    char suffix[6];
+    snprintf(suffix, sizeof(suffix), "*%02X\r\n", checksum);
+    return memcmp(sentence + length - 5, suffix, 5) == 0 && memchr(sentence + 1, '*', length - 6) == NULL;
+}
+
+static bool parser_emit() {
+    char out[NMEA_EMIT_MAX], expected[NMEA_EMIT_MAX + 8];
+
+    // Сумма каждого префикса совпадает с посчитанной по тексту
+    for (int family = 0; family < NMEA_PESP_COUNT; family++) {
+        int length = nmea_pesp(out, sizeof(out), family, "X");
+        CHECK(parser_accepts(out, length), "family %d: %s", family, out);
+        CHECK(strncmp(out, "$PESP,", 6) == 0, "family %d: %s", family, out);
+    }
+
+    int length = nmea_pesp(out, sizeof(out), NMEA_PESP_NTRIP_SRV2, "CONNECTED,%s:%d,%s", "caster.example.com", 2101, "MOUNT");
+    parser_sentence(expected, sizeof(expected), "PESP,NTRIP,SRV2,CONNECTED,caster.example.com:2101,MOUNT");
+    CHECK(strcmp(out, expected) == 0, "%s", out);
+
+    // Разбор принимает собранное предложение
+    nmea_parser_t parser;
+    nmea_parser_init(&parser, NULL, NULL);
+    nmea_parser_feed(&parser, (uint8_t *) out, length);
+    CHECK(parser.sentences == 1, "not parsed: %s", out);
+
+    // Форматы, которыми пользуется прошивка, совпадают с printf
+    const uint8_t mac[6] = {0x24, 0x0a, 0xc4, 0xff, 0x00, 0x9B};
+    length = nmea_format(out, sizeof(out), "$PESP,FMT,%02x:%02x:%02x:%02x:%02x:%02x,%d.%d.%d.%d/%d,%.*s,%c,%d%%,%u,%X,%5d,%-4d|,%03d,%ld,%zu,%lld",
+            mac[0], mac[1], mac[2], mac[3], mac[4], mac[5], 192, 168, 4, 1, 24, 4, "ssid-long", 'O', 42,
+            4000000000u, 0xBEEF, -12, 7, -5, -123456789L, (size_t) 65536, -9000000000LL);
+    char body[NMEA_EMIT_MAX];
+    snprintf(body, sizeof(body), "PESP,FMT,%02x:%02x:%02x:%02x:%02x:%02x,%d.%d.%d.%d/%d,%.*s,%c,%d%%,%u,%X,%5d,%-4d|,%03d,%ld,%zu,%lld",
+            mac[0], mac[1], mac[2], mac[3], mac[4], mac[5], 192, 168, 4, 1, 24, 4, "ssid-long", 'O', 42,
+            4000000000u, 0xBEEF, -12, 7, -5, -123456789L, (size_t) 65536, -9000000000LL);
+    parser_sentence(expected, sizeof(expected), body);
+    CHECK(strcmp(out, expected) == 0, "%s != %s", out, expected);
+
+    // Символы кадра в аргументах не ломают предложение
+    length = nmea_pesp(out, sizeof(out), NMEA_PESP_WIFI_STA, "CONNECTED,%s", "bad*ssid$\r\n");
+    CHECK(strncmp(out, "$PESP,WIFI,STA,CONNECTED,bad_ssid___*", 37) == 0, "%s", out);
+    CHECK(parser_accepts(out, length), "%s", out);
+
+    // Длинные поля обрезаются, сумма и CRLF остаются
+    char host[300];
+    memset(host, 'h', sizeof(host) - 1);
+    host[sizeof(host) - 1] = '\0';
+    length = nmea_pesp(out, sizeof(out), NMEA_PESP_NTRIP_SRV, "CONNECTING,%s:%d,%s", host, 2101, "MOUNT");
+    CHECK(length == NMEA_EMIT_MAX - 1, "length %d", length);
+    CHECK(parser_accepts(out, length), "%s", out);
+
+    char tiny[8];
+    CHECK(nmea_pesp(tiny, sizeof(tiny), NMEA_PESP_CFG, "UPDATED") == 0 && tiny[0] == '\0', "tiny buffer");
+    return true;
+}
+
+static const struct {
+    const char *name;
+    bool (*run)();
+} checks[] = {
+        {"gga", parser_gga},
+        {"rmc", parser_rmc},
+        {"gsa_gsv", parser_gsa_gsv},
+        {"checksum", parser_checksum},
+        {"stream", parser_stream},
+        {"rate", parser_rate},
+        {"emit", parser_emit},
+};
+
+int main(int argc, char **argv) {
+    int run = 0, failed = 0;
+
+    for (int i = 0; i < sizeof(checks) / sizeof(checks[0]); i++) {
+        if (argc > 1 && strcmp(argv[1], checks[i].name) != 0) continue;
+
+        printf("%s\n", checks[i].name);
+        bool ok = checks[i].run();
+        printf("%s: %s\n", checks[i].name, ok ? "PASS" : "FAIL");
+        fflush(stdout);
+
+        run++;
+        if (!ok) failed++;
+    }
+
+    if (run == 0) {
+        fprintf(stderr, "Unknown check %s\n", argv[1]);
+        return 2;
+    }
+
+    return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,362 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+/// Проверка темпа воспроизведения записей: эпохи RTCM 3 и NMEA в исходном и
+/// ускоренном темпе, переход недели GPS, повтор с начала, ограничение скоростью UART
+///
+///   replay_timing [проверка]   без аргумента - все проверки
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <platform.h>
+#include <replay.h>
+#include <protocol/rtcm3.h>
+
+#define TIMING_EPOCHS 20
+#define TIMING_INTERVAL_MS 1000
+#define TIMING_SPEED 10
+#define TIMING_TOLERANCE_MS 30
+#define TIMING_MSM_LENGTH 300
+#define TIMING_CHUNK_MAX 1024
+#define TIMING_ARRIVALS_MAX 256
+
+#define CHECK(condition, ...) do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s: ", __FILE__, __LINE__, #condition); \
+            fprintf(stderr, __VA_ARGS__); \
+            fputc('\n', stderr); \
+            return false; \
+        } \
+    } while (0)
+
+typedef struct timing_capture {
+    uint8_t *data;
+    size_t length;
+    size_t capacity;
+} timing_capture_t;
+
+/// Результат воспроизведения: время прихода каждой эпохи и переданные байты
+typedef struct timing_result {
+    uint64_t start_us;
+    uint64_t arrivals[TIMING_ARRIVALS_MAX];
+    size_t arrival_count;
+    uint32_t last_time;
+    bool last_valid;
+
+    rtcm3_framer_t framer;
+    uint8_t nmea[128];
+    size_t nmea_used;
+
+    uint8_t *data;
+    size_t length;
+    size_t capacity;
+    size_t chunk_max;
+
+    size_t stop_after;          // остановка после стольких байт, 0 - нет
+    volatile bool stop;
+} timing_result_t;
+
+static void timing_append(timing_capture_t *capture, const void *data, size_t length) {
+    if (capture->length + length > capture->capacity) {
+        capture->capacity = (capture->length + length) * 2;
+        capture->data = realloc(capture->data, capture->capacity);
+    }
+    memcpy(capture->data + capture->length, data, length);
+    capture->length += length;
+}
+
+static void timing_set_bits(uint8_t *data, size_t position, size_t length, uint32_t value) {
+    for (size_t i = 0; i < length; i++) {
+        size_t bit = position + i;
+        if ((value >> (length - 1 - i)) & 1) data[bit / 8] |= 0x80 >> (bit % 8);
+        else data[bit / 8] &= ~(0x80 >> (bit % 8));
+    }
+}
+
+/// Эпоха: MSM7 GPS (1077) и GLONASS (1087) с меткой времени и кадр 1005 без неё
+static void timing_rtcm3_epoch(timing_capture_t *capture, uint32_t tow_ms) {
+    uint8_t payload[TIMING_MSM_LENGTH] = {0}, frame[RTCM3_FRAME_MAX];
+
+    timing_set_bits(payload, 0, 12, 1077);
+    timing_set_bits(payload, 24, 30, tow_ms);
+    timing_append(capture, frame, rtcm3_frame_build(frame, payload, sizeof(payload)));
+
+    // Время ГЛОНАСС другой шкалы не должно влиять на темп
+    memset(payload, 0, sizeof(payload));
+    timing_set_bits(payload, 0, 12, 1087);
+    timing_set_bits(payload, 27, 27, (tow_ms + 10800000 - 18000) % 86400000);
+    timing_append(capture, frame, rtcm3_frame_build(frame, payload, sizeof(payload)));
+
+    memset(payload, 0, 19);
+    timing_set_bits(payload, 0, 12, 1005);
+    timing_append(capture, frame, rtcm3_frame_build(frame, payload, 19));
+}
+
+static void timing_nmea_sentence(timing_capture_t *capture, const char *body) {
+    char sentence[128];
+    uint8_t checksum = 0;
+    for (const char *c = body; *c; c++) checksum ^= *c;
+    int length = snprintf(sentence, sizeof(sentence), "$%s*%02X\r\n", body, checksum);
+    timing_append(capture, sentence, length);
+}
+
+static void timing_nmea_epoch(timing_capture_t *capture, uint32_t time_ms) {
+    char body[96];
+    uint32_t seconds = time_ms / 1000;
+    snprintf(body, sizeof(body), "GPGGA,%02u%02u%02u.%02u,5320.0000,N,00615.0000,W,4,12,0.8,50.0,M,55.0,M,1.0,0000",
+            seconds / 3600 % 24, seconds / 60 % 60, seconds % 60, time_ms % 1000 / 10);
+    timing_nmea_sentence(capture, body);
+
+    // Строка без времени и оборванная строка перед следующей эпохой
+    timing_nmea_sentence(capture, "GPGSA,A,3,01,02,03,04,,,,,,,,,1.5,0.8,1.2");
+    timing_append(capture, "$GPGSV,3,1,12,01,40", 19);
+}
+
+static bool timing_write(const timing_capture_t *capture, char *path) {
+    strcpy(path, "/tmp/replay_timing_XXXXXX");
+    int fd = mkstemp(path);
+    if (fd < 0) return false;
+
+    bool ok = write(fd, capture->data, capture->length) == (ssize_t) capture->length;
+    close(fd);
+    return ok;
+}
+
+static void timing_arrival(timing_result_t *result, uint32_t time) {
+    if (result->last_valid && time == result->last_time) return;
+    result->last_valid = true;
+    result->last_time = time;
+    if (result->arrival_count < TIMING_ARRIVALS_MAX) result->arrivals[result->arrival_count++] = platform_time_us();
+}
+
+static void timing_frame(void *ctx, const uint8_t *frame, size_t length) {
+    timing_result_t *result = ctx;
+    const uint8_t *payload = frame + RTCM3_HEADER_SIZE;
+    if (rtcm3_message_type(frame) != 1077) return;
+    timing_arrival(result, (uint32_t) payload[3] << 24 | (uint32_t) payload[4] << 16 | payload[5] << 8 | payload[6]);
+}
+
+static void timing_sink(void *ctx, const uint8_t *data, size_t length) {
+    timing_result_t *result = ctx;
+
+    if (result->length + length > result->capacity) {
+        result->capacity = (result->length + length) * 2;
+        result->data = realloc(result->data, result->capacity);
+    }
+    memcpy(result->data + result->length, data, length);
+    result->length += length;
+    if (length > result->chunk_max) result->chunk_max = length;
+
+    rtcm3_framer_feed(&result->framer, data, length);
+    for (size_t i = 0; i < length; i++) {
+        if (data[i] == '$') result->nmea_used = 0;
+        if (result->nmea_used < sizeof(result->nmea)) result->nmea[result->nmea_used++] = data[i];
+        if (data[i] == '\n' && result->nmea_used > 14 && memcmp(result->nmea + 3, "GGA", 3) == 0) {
+            uint32_t time = 0;
+            for (int k = 7; k < 16; k++) if (result->nmea[k] != '.') time = time * 10 + result->nmea[k] - '0';
+            timing_arrival(result, time);
+        }
+    }
+
+    if (result->stop_after > 0 && result->length >= result->stop_after) result->stop = true;
+}
+
+static bool timing_replay(const timing_capture_t *capture, replay_config_t *config, timing_result_t *result,
+        replay_stats_t *stats) {
+    char path[32];
+    CHECK(timing_write(capture, path), "write capture");
+
+    rtcm3_framer_init(&result->framer, timing_frame, result);
+    memset(stats, 0, sizeof(*stats));
+    config->path = path;
+    result->start_us = platform_time_us();
+    int err = replay_run(config, timing_sink, result, &result->stop, stats);
+    unlink(path);
+
+    CHECK(err == 0, "replay_run");
+    CHECK(result->chunk_max <= TIMING_CHUNK_MAX, "chunk of %zu bytes", result->chunk_max);
+    return true;
+}
+
+/// Эпохи приходят с интервалом записи, делённым на скорость
+static bool timing_check_arrivals(const timing_result_t *result, size_t expected, uint32_t interval_ms) {
+    printf("    %zu epochs:", result->arrival_count);
+    for (size_t i = 0; i < result->arrival_count; i++) {
+        printf(" %lld", (long long) (result->arrivals[i] - result->start_us) / 1000);
+    }
+    printf(" ms\n");
+
+    CHECK(result->arrival_count == expected, "%zu epochs, expected %zu", result->arrival_count, expected);
+    for (size_t i = 0; i < result->arrival_count; i++) {
+        int64_t offset = (int64_t) (result->arrivals[i] - result->start_us) / 1000 - (int64_t) (i * interval_ms);
+        CHECK(offset >= -1 && offset <= TIMING_TOLERANCE_MS, "epoch %zu off by %lld ms", i, (long long) offset);
+    }
+
+    return true;
+}
+
+/* Проверки */
+
+/// RTCM 3 с переходом недели GPS посередине записи
+static bool timing_rtcm3() {
+    timing_capture_t capture = {0};
+    uint32_t week_end = 604800000;
+    for (int i = 0; i < TIMING_EPOCHS; i++) {
+        timing_rtcm3_epoch(&capture, (week_end - 10 * TIMING_INTERVAL_MS + i * TIMING_INTERVAL_MS) % week_end);
+    }
+
+    timing_result_t *result = calloc(1, sizeof(timing_result_t));
+    replay_config_t config = {.speed = TIMING_SPEED, .baud = 921600};
+    replay_stats_t stats;
+    CHECK(timing_replay(&capture, &config, result, &stats), "replay");
+
+    CHECK(stats.timed && stats.epochs == TIMING_EPOCHS, "timed %d, epochs %u", stats.timed, stats.epochs);
+    CHECK(stats.frames == 3 * TIMING_EPOCHS, "%u frames", stats.frames);
+    CHECK(result->length == capture.length && memcmp(result->data, capture.data, capture.length) == 0, "stream changed");
+    bool ok = timing_check_arrivals(result, TIMING_EPOCHS, TIMING_INTERVAL_MS / TIMING_SPEED);
+
+    free(result->data);
+    free(result);
+    free(capture.data);
+    return ok;
+}
+
+/// NMEA с переходом суток, 5 Гц
+static bool timing_nmea() {
+    timing_capture_t capture = {0};
+    for (int i = 0; i < TIMING_EPOCHS; i++) timing_nmea_epoch(&capture, (86400000 - 2000 + i * 200) % 86400000);
+
+    timing_result_t *result = calloc(1, sizeof(timing_result_t));
+    replay_config_t config = {.speed = 2, .baud = 115200};
+    replay_stats_t stats;
+    CHECK(timing_replay(&capture, &config, result, &stats), "replay");
+
+    CHECK(stats.timed && stats.epochs == TIMING_EPOCHS, "timed %d, epochs %u", stats.timed, stats.epochs);
+    CHECK(stats.sentences == 2 * TIMING_EPOCHS, "%u sentences", stats.sentences);
+    bool ok = timing_check_arrivals(result, TIMING_EPOCHS, 200 / 2);
+
+    free(result->data);
+    free(result);
+    free(capture.data);
+    return ok;
+}
+
+/// Без пауз: весь файл сразу и без изменений
+static bool timing_unpaced() {
+    timing_capture_t capture = {0};
+    for (int i = 0; i < 200; i++) timing_rtcm3_epoch(&capture, i * TIMING_INTERVAL_MS);
+
+    timing_result_t *result = calloc(1, sizeof(timing_result_t));
+    replay_config_t config = {.speed = 0, .baud = 115200};
+    replay_stats_t stats;
+    CHECK(timing_replay(&capture, &config, result, &stats), "replay");
+
+    int64_t elapsed_ms = (int64_t) (platform_time_us() - result->start_us) / 1000;
+    printf("    %zu bytes in %lld ms\n", result->length, (long long) elapsed_ms);
+    CHECK(elapsed_ms < 500, "unpaced replay took %lld ms", (long long) elapsed_ms);
+    CHECK(result->length == capture.length && memcmp(result->data, capture.data, capture.length) == 0, "stream changed");
+    CHECK(stats.epochs == 200 && stats.lag_max_ms == 0, "epochs %u, lag %u", stats.epochs, stats.lag_max_ms);
+
+    free(result->data);
+    free(result);
+    free(capture.data);
+    return true;
+}
+
+/// Повтор с начала: время записи отскакивает назад, интервал эпох сохраняется
+static bool timing_loop() {
+    timing_capture_t capture = {0};
+    for (int i = 0; i < 5; i++) timing_rtcm3_epoch(&capture, 100000 + i * TIMING_INTERVAL_MS);
+
+    timing_result_t *result = calloc(1, sizeof(timing_result_t));
+    result->stop_after = capture.length * 3;
+    replay_config_t config = {.speed = TIMING_SPEED, .loop = true, .baud = 921600};
+    replay_stats_t stats;
+    CHECK(timing_replay(&capture, &config, result, &stats), "replay");
+
+    CHECK(stats.loops == 2, "%u loops", stats.loops);
+    CHECK(result->length == capture.length * 3, "%zu bytes", result->length);
+    bool ok = timing_check_arrivals(result, 15, TIMING_INTERVAL_MS / TIMING_SPEED);
+
+    free(result->data);
+    free(result);
+    free(capture.data);
+    return ok;
+}
+
+/// Запись без меток времени: только ограничение скоростью UART
+static bool timing_baud() {
+    timing_capture_t capture = {0};
+    uint8_t block[64];
+    for (size_t i = 0; i < sizeof(block); i++) block[i] = 0x40 + i % 32;
+    for (int i = 0; i < 180; i++) timing_append(&capture, block, sizeof(block));
+
+    timing_result_t *result = calloc(1, sizeof(timing_result_t));
+    replay_config_t config = {.speed = 1, .baud = 115200};
+    replay_stats_t stats;
+    CHECK(timing_replay(&capture, &config, result, &stats), "replay");
+
+    int64_t elapsed_ms = (int64_t) (platform_time_us() - result->start_us) / 1000;
+    int64_t expected_ms = (int64_t) capture.length * 10 * 1000 / 115200;
+    printf("    %zu bytes in %lld ms (expected %lld ms)\n", result->length, (long long) elapsed_ms, (long long) expected_ms);
+    CHECK(!stats.timed && stats.epochs == 0, "timed %d, epochs %u", stats.timed, stats.epochs);
+    CHECK(elapsed_ms >= expected_ms - 5 && elapsed_ms <= expected_ms + TIMING_TOLERANCE_MS, "took %lld ms", (long long) elapsed_ms);
+
+    free(result->data);
+    free(result);
+    free(capture.data);
+    return true;
+}
+
+static const struct {
+    const char *name;
+    bool (*run)();
+} checks[] = {
+        {"rtcm3", timing_rtcm3},
+        {"nmea", timing_nmea},
+        {"unpaced", timing_unpaced},
+        {"loop", timing_loop},
+        {"baud", timing_baud},
+};
+
+int main(int argc, char **argv) {
+    int run = 0, failed = 0;
+
+    for (int i = 0; i < sizeof(checks) / sizeof(checks[0]); i++) {
+        if (argc > 1 && strcmp(argv[1], checks[i].name) != 0) continue;
+
+        printf("%s\n", checks[i].name);
+        bool ok = checks[i].run();
+        printf("%s: %s\n", checks[i].name, ok ? "PASS" : "FAIL");
+        fflush(stdout);
+
+        run++;
+        if (!ok) failed++;
+    }
+
+    if (run == 0) {
+        fprintf(stderr, "Unknown check %s\n", argv[1]);
+        return 2;
+    }
+
+    return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,474 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+
+/// Проверка замены MSM7 на MSM4: поля спутников и сигналов после изменения разрядности,
+/// время захвата DF407 -> DF402, недостоверные и предельные значения, преобразование
+/// на месте, поток с другими сообщениями и NMEA при любом разбиении на куски
+///
+///   rtcm3_msm4 [проверка]   без аргумента - все проверки
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <protocol/rtcm3.h>
+
+#define CHECK(condition, ...) do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s: ", __FILE__, __LINE__, #condition); \
+            fprintf(stderr, __VA_ARGS__); \
+            fputc('\n', stderr); \
+            return false; \
+        } \
+    } while (0)
+
+#define MSM_CELLS_MAX 64
+
+/// Поля MSM7 одного кадра
+typedef struct msm7 {
+    uint16_t type;
+    uint64_t satellite_mask;
+    uint32_t signal_mask;
+    uint64_t cell_mask;
+    bool multiple;
+
+    uint8_t rough_ms[64];
+    uint8_t extended[64];
+    uint16_t rough_mod[64];
+    int16_t rough_rate[64];
+
+    int32_t pseudorange[MSM_CELLS_MAX];
+    int32_t phase[MSM_CELLS_MAX];
+    uint16_t lock[MSM_CELLS_MAX];
+    bool half_cycle[MSM_CELLS_MAX];
+    uint16_t cnr[MSM_CELLS_MAX];
+    int16_t rate[MSM_CELLS_MAX];
+} msm7_t;
+
+static unsigned msm_satellites(const msm7_t *msm) {
+    return __builtin_popcountll(msm->satellite_mask);
+}
+
+static unsigned msm_mask_bits(const msm7_t *msm) {
+    return msm_satellites(msm) * __builtin_popcount(msm->signal_mask);
+}
+
+static unsigned msm_cells(const msm7_t *msm) {
+    return __builtin_popcountll(msm->cell_mask);
+}
+
+static size_t msm_header(uint8_t *payload, const msm7_t *msm, uint16_t type) {
+    size_t position = 0;
+    rtcm3_set_bits(payload, position, 12, type), position += 12;
+    rtcm3_set_bits(payload, position, 12, 2003), position += 12;
+    rtcm3_set_bits(payload, position, 30, 345678000), position += 30;
+    rtcm3_set_bits(payload, position, 1, msm->multiple), position += 1;
+    rtcm3_set_bits(payload, position, 3, 5), position += 3;              // IODS
+    rtcm3_set_bits(payload, position, 7, 0), position += 7;
+    rtcm3_set_bits(payload, position, 2, 1), position += 2;              // clock steering
+    rtcm3_set_bits(payload, position, 2, 2), position += 2;              // external clock
+    rtcm3_set_bits(payload, position, 1, 1), position += 1;
+    rtcm3_set_bits(payload, position, 3, 4), position += 3;
+    rtcm3_set_bits(payload, position, 64, msm->satellite_mask), position += 64;
+    rtcm3_set_bits(payload, position, 32, msm->signal_mask), position += 32;
+    rtcm3_set_bits(payload, position, msm_mask_bits(msm), msm->cell_mask), position += msm_mask_bits(msm);
+
+    return position;
+}
+
+static size_t msm7_frame(uint8_t *frame, const msm7_t *msm) {
+    uint8_t payload[RTCM3_PAYLOAD_MAX];
+    memset(payload, 0, sizeof(payload));
+
+    size_t position = msm_header(payload, msm, msm->type);
+    unsigned satellites = msm_satellites(msm), cells = msm_cells(msm);
+    for (unsigned i = 0; i < satellites; i++) rtcm3_set_bits(payload, position, 8, msm->rough_ms[i]), position += 8;
+    for (unsigned i = 0; i < satellites; i++) rtcm3_set_bits(payload, position, 4, msm->extended[i]), position += 4;
+    for (unsigned i = 0; i < satellites; i++) rtcm3_set_bits(payload, position, 10, msm->rough_mod[i]), position += 10;
+    for (unsigned i = 0; i < satellites; i++) rtcm3_set_bits(payload, position, 14, (uint64_t) msm->rough_rate[i]), position += 14;
+    for (unsigned i = 0; i < cells; i++) rtcm3_set_bits(payload, position, 20, (uint64_t) msm->pseudorange[i]), position += 20;
+    for (unsigned i = 0; i < cells; i++) rtcm3_set_bits(payload, position, 24, (uint64_t) msm->phase[i]), position += 24;
+    for (unsigned i = 0; i < cells; i++) rtcm3_set_bits(payload, position, 10, msm->lock[i]), position += 10;
+    for (unsigned i = 0; i < cells; i++) rtcm3_set_bits(payload, position, 1, msm->half_cycle[i]), position += 1;
+    for (unsigned i = 0; i < cells; i++) rtcm3_set_bits(payload, position, 10, msm->cnr[i]), position += 10;
+    for (unsigned i = 0; i < cells; i++) rtcm3_set_bits(payload, position, 15, (uint64_t) msm->rate[i]), position += 15;
+
+    return rtcm3_frame_build(frame, payload, (position + 7) / 8);
+}
+
+/// Детерминированные поля: satellites спутников, signals сигналов, ячейки по маске
+static uint32_t msm_random_state = 12345;
+
+static uint32_t msm_random() {
+    msm_random_state ^= msm_random_state << 13;
+    msm_random_state ^= msm_random_state >> 17;
+    msm_random_state ^= msm_random_state << 5;
+    return msm_random_state;
+}
+
+static void msm7_fill(msm7_t *msm, uint16_t type, unsigned satellites, unsigned signals) {
+    memset(msm, 0, sizeof(*msm));
+    msm->type = type;
+    while (msm_satellites(msm) < satellites) msm->satellite_mask |= 1ULL << (63 - msm_random() % 40);
+    while (__builtin_popcount(msm->signal_mask) < signals) msm->signal_mask |= 1u << (31 - msm_random() % 24);
+
+    unsigned mask_bits = msm_mask_bits(msm);
+    for (unsigned i = 0; i < mask_bits; i++) {
+        if (msm_random() % 8 != 0) msm->cell_mask |= 1ULL << i;
+    }
+
+    for (unsigned i = 0; i < satellites; i++) {
+        msm->rough_ms[i] = 64 + msm_random() % 20;
+        msm->extended[i] = msm_random() % 14;
+        msm->rough_mod[i] = msm_random() % 1024;
+        msm->rough_rate[i] = (int16_t) (msm_random() % 16000) - 8000;
+    }
+    for (unsigned i = 0; i < msm_cells(msm); i++) {
+        msm->pseudorange[i] = (int32_t) (msm_random() % (1 << 20)) - (1 << 19) + 1;
+        msm->phase[i] = (int32_t) (msm_random() % (1 << 24)) - (1 << 23) + 1;
+        msm->lock[i] = msm_random() % 705;
+        msm->half_cycle[i] = msm_random() & 1;
+        msm->cnr[i] = msm_random() % 1024;
+        msm->rate[i] = (int16_t) (msm_random() % 32000) - 16000;
+    }
+}
+
+/// Минимальное время захвата по DF407 (RTCM 10403.3, таблица 3.5-75), мс
+static uint64_t msm_lock_time_ms(unsigned indicator) {
+    static const struct {
+        unsigned from;
+        uint64_t scale, offset;
+    } table[] = {
+            {0, 1, 0}, {64, 2, 64}, {96, 4, 256}, {128, 8, 768}, {160, 16, 2048}, {192, 32, 5120},
+            {224, 64, 12288}, {256, 128, 28672}, {288, 256, 65536}, {320, 512, 147456},
+            {352, 1024, 327680}, {384, 2048, 720896}, {416, 4096, 1572864}, {448, 8192, 3407872},
+            {480, 16384, 7340032}, {512, 32768, 15728640}, {544, 65536, 33554432},
+            {576, 131072, 71303168}, {608, 262144, 150994944}, {640, 524288, 318767104},
+            {672, 1048576, 671088640}, {704, 2097152, 1409286144}
+    };
+
+    size_t i = sizeof(table) / sizeof(table[0]) - 1;
+    while (indicator < table[i].from) i--;
+    return table[i].scale * indicator - table[i].offset;
+}
+
+/// DF402 (таблица 3.5-74): наибольший индикатор, чьё минимальное время не больше заданного
+static unsigned msm_lock_indicator(uint64_t ms) {
+    unsigned indicator = 0;
+    while (indicator < 15 && ms >= 32ULL << indicator) indicator++;
+    return indicator;
+}
+
+static int64_t msm_round(int64_t value, unsigned shift, int64_t limit) {
+    value = (value + (1LL << (shift - 1))) >> shift;
+    return value > limit ? limit : value < -limit ? -limit : value;
+}
+
+/// Проверка кадра MSM4 против исходных полей MSM7
+static bool msm4_compare(const uint8_t *frame, size_t length, const msm7_t *msm) {
+    CHECK(length >= RTCM3_HEADER_SIZE + RTCM3_CRC_SIZE, "length %zu", length);
+    uint32_t crc = (uint32_t) frame[length - 3] << 16 | (uint32_t) frame[length - 2] << 8 | frame[length - 1];
+    CHECK(rtcm3_crc24q(frame, length - RTCM3_CRC_SIZE) == crc, "crc");
+    CHECK(rtcm3_message_type(frame) == msm->type - 3, "type %u", rtcm3_message_type(frame));
+
+    const uint8_t *payload = frame + RTCM3_HEADER_SIZE;
+    uint8_t header[RTCM3_PAYLOAD_MAX] = {0};
+    size_t position = msm_header(header, msm, msm->type - 3);
+    for (size_t bit = 0; bit < position; bit++) {
+        CHECK(rtcm3_get_bits(payload, bit, 1) == rtcm3_get_bits(header, bit, 1), "header bit %zu", bit);
+    }
+
+    unsigned satellites = msm_satellites(msm), cells = msm_cells(msm);
+    size_t expected = (position + satellites * 18 + cells * 48 + 7) / 8;
+    CHECK(length == RTCM3_HEADER_SIZE + expected + RTCM3_CRC_SIZE, "length %zu, expected %zu", length, expected);
+
+    for (unsigned i = 0; i < satellites; i++, position += 8) {
+        CHECK(rtcm3_get_bits(payload, position, 8) == msm->rough_ms[i], "rough ms %u", i);
+    }
+    for (unsigned i = 0; i < satellites; i++, position += 10) {
+        CHECK(rtcm3_get_bits(payload, position, 10) == msm->rough_mod[i], "rough mod %u", i);
+    }
+    for (unsigned i = 0; i < cells; i++, position += 15) {
+        int64_t value = rtcm3_get_signed_bits(payload, position, 15);
+        int64_t want = msm->pseudorange[i] == -(1 << 19) ? -(1 << 14) : msm_round(msm->pseudorange[i], 5, (1 << 14) - 1);
+        CHECK(value == want, "pseudorange %u: %lld from %d", i, (long long) value, msm->pseudorange[i]);
+    }
+    for (unsigned i = 0; i < cells; i++, position += 22) {
+        int64_t value = rtcm3_get_signed_bits(payload, position, 22);
+        int64_t want = msm->phase[i] == -(1 << 23) ? -(1 << 21) : msm_round(msm->phase[i], 2, (1 << 21) - 1);
+        CHECK(value == want, "phase %u: %lld from %d", i, (long long) value, msm->phase[i]);
+    }
+    for (unsigned i = 0; i < cells; i++, position += 4) {
+        unsigned want = msm->lock[i] > 704 ? 0 : msm_lock_indicator(msm_lock_time_ms(msm->lock[i]));
+        CHECK(rtcm3_get_bits(payload, position, 4) == want, "lock %u from %u", i, msm->lock[i]);
+    }
+    for (unsigned i = 0; i < cells; i++, position += 1) {
+        CHECK(rtcm3_get_bits(payload, position, 1) == msm->half_cycle[i], "half cycle %u", i);
+    }
+    for (unsigned i = 0; i < cells; i++, position += 6) {
+        unsigned value = rtcm3_get_bits(payload, position, 6);
+        double cnr = msm->cnr[i] / 16.0;
+        CHECK(msm->cnr[i] == 0 ? value == 0 : value >= 1 && (value == 63 || (value - cnr <= 0.5 && cnr - value <= 0.5) || (cnr < 0.5 && value == 1)),
+                "cnr %u: %u from %u", i, value, msm->cnr[i]);
+    }
+
+    return true;
+}
+
+static bool msm4_fields() {
+    static const uint16_t types[] = {1077, 1087, 1097, 1107, 1117, 1127, 1137};
+    uint8_t frame[RTCM3_FRAME_MAX], out[RTCM3_FRAME_MAX];
+    msm7_t msm;
+
+    for (size_t t = 0; t < sizeof(types) / sizeof(types[0]); t++) {
+        for (unsigned satellites = 1; satellites <= 16; satellites += 3) {
+            for (unsigned signals = 1; signals <= 4 && satellites * signals <= 64; signals++) {
+                msm7_fill(&msm, types[t], satellites, signals);
+                size_t length = msm7_frame(frame, &msm);
+                size_t converted = rtcm3_msm7_to_msm4(frame, length, out);
+                CHECK(converted > 0 && converted < length, "type %u, %u x %u: %zu -> %zu", types[t], satellites, signals,
+                        length, converted);
+                if (!msm4_compare(out, converted, &msm)) return false;
+            }
+        }
+    }
+
+    // Пустое сообщение: только заголовок
+    msm7_fill(&msm, 1077, 0, 0);
+    size_t length = msm7_frame(frame, &msm);
+    size_t converted = rtcm3_msm7_to_msm4(frame, length, out);
+    CHECK(converted == length, "empty %zu -> %zu", length, converted);
+
+    return msm4_compare(out, converted, &msm);
+}
+
+static bool msm4_lock() {
+    // Совпадение с таблицами стандарта и монотонность
+    unsigned previous = 0;
+    for (unsigned indicator = 0; indicator <= 704; indicator++) {
+        msm7_t msm;
+        msm7_fill(&msm, 1077, 1, 1);
+        msm.cell_mask = 1;
+        msm.lock[0] = indicator;
+
+        uint8_t frame[RTCM3_FRAME_MAX];
+        size_t length = msm7_frame(frame, &msm);
+        length = rtcm3_msm7_to_msm4(frame, length, frame);
+        if (!msm4_compare(frame, length, &msm)) return false;
+
+        size_t position = 169 + 1 + 18 + 15 + 22;
+        unsigned value = rtcm3_get_bits(frame + RTCM3_HEADER_SIZE, position, 4);
+        CHECK(value >= previous, "indicator %u: %u after %u", indicator, value, previous);
+        previous = value;
+    }
+    CHECK(previous == 15, "longest lock %u", previous);
+
+    return true;
+}
+
+static bool msm4_limits() {
+    msm7_t msm;
+    msm7_fill(&msm, 1097, 4, 2);
+    unsigned cells = msm_cells(&msm);
+    CHECK(cells >= 4, "cells %u", cells);
+
+    // Недостоверные значения, пределы диапазона и C/N0 у границ
+    msm.pseudorange[0] = -(1 << 19), msm.phase[0] = -(1 << 23), msm.cnr[0] = 0;
+    msm.pseudorange[1] = (1 << 19) - 1, msm.phase[1] = (1 << 23) - 1, msm.cnr[1] = 1023;
+    msm.pseudorange[2] = -(1 << 19) + 1, msm.phase[2] = -(1 << 23) + 1, msm.cnr[2] = 1;
+    msm.pseudorange[3] = 16, msm.phase[3] = -2, msm.cnr[3] = 8;
+    msm.lock[0] = 705, msm.lock[1] = 1023;
+
+    uint8_t frame[RTCM3_FRAME_MAX];
+    size_t length = msm7_frame(frame, &msm);
+    size_t converted = rtcm3_msm7_to_msm4(frame, length, frame);
+    if (!msm4_compare(frame, converted, &msm)) return false;
+
+    // Не MSM7 и длина, не сходящаяся с масками, не преобразуются
+    msm.type = 1074;
+    length = msm7_frame(frame, &msm);
+    CHECK(rtcm3_msm7_to_msm4(frame, length, frame) == 0, "MSM4 input");
+
+    msm.type = 1077;
+    uint8_t payload[RTCM3_PAYLOAD_MAX];
+    length = msm7_frame(frame, &msm);
+    memcpy(payload, frame + RTCM3_HEADER_SIZE, length - RTCM3_HEADER_SIZE - RTCM3_CRC_SIZE);
+    size_t truncated = rtcm3_frame_build(frame, payload, length - RTCM3_HEADER_SIZE - RTCM3_CRC_SIZE - 1);
+    CHECK(rtcm3_msm7_to_msm4(frame, truncated, frame) == 0, "truncated");
+    size_t padded = rtcm3_frame_build(frame, payload, length - RTCM3_HEADER_SIZE - RTCM3_CRC_SIZE + 1);
+    CHECK(rtcm3_msm7_to_msm4(frame, padded, frame) == 0, "padded");
+    CHECK(rtcm3_msm7_to_msm4(frame, RTCM3_HEADER_SIZE + 10 + RTCM3_CRC_SIZE, frame) == 0, "short");
+
+    // 8 спутников и 9 сигналов - маска ячеек больше 64 бит
+    msm7_fill(&msm, 1077, 8, 8);
+    msm.signal_mask |= 1;
+    memset(payload, 0, sizeof(payload));
+    size_t bits = msm_header(payload, &msm, 1077);
+    length = rtcm3_frame_build(frame, payload, bits / 8 + 40);
+    CHECK(rtcm3_msm7_to_msm4(frame, length, frame) == 0, "72 cells");
+
+    return true;
+}
+
+static bool msm4_inplace() {
+    msm7_t msm;
+    msm7_fill(&msm, 1127, 16, 4);
+
+    uint8_t frame[RTCM3_FRAME_MAX], out[RTCM3_FRAME_MAX];
+    size_t length = msm7_frame(frame, &msm);
+    size_t separate = rtcm3_msm7_to_msm4(frame, length, out);
+    size_t inplace = rtcm3_msm7_to_msm4(frame, length, frame);
+    CHECK(separate > 0 && separate == inplace && memcmp(frame, out, separate) == 0, "%zu, %zu", separate, inplace);
+
+    return true;
+}
+
+typedef struct msm4_output {
+    uint8_t data[256 * 1024];
+    size_t length;
+    size_t fail_after;              // ошибка записи после стольких байт, 0 - без ошибок
+} msm4_output_t;
+
+static int msm4_write(void *ctx, const void *data, size_t length) {
+    msm4_output_t *output = ctx;
+    if (output->fail_after > 0 && output->length + length > output->fail_after) return -1;
+
+    memcpy(output->data + output->length, data, length);
+    output->length += length;
+    return length;
+}
+
+static bool msm4_stream() {
+    static uint8_t input[128 * 1024], expected[128 * 1024];
+    static msm4_output_t output;
+    size_t input_length = 0, expected_length = 0;
+    uint32_t msm7_count = 0;
+
+    // Эпохи MSM7 по ГНСС, между ними 1005, MSM4, NMEA, кадр с испорченной CRC и ложная преамбула
+    for (int epoch = 0; epoch < 40; epoch++) {
+        static const uint16_t types[] = {1077, 1087, 1097, 1127};
+        for (size_t t = 0; t < 4; t++) {
+            msm7_t msm;
+            msm7_fill(&msm, types[t], 4 + msm_random() % 10, 1 + msm_random() % 3);
+            if (msm_mask_bits(&msm) > 64) msm7_fill(&msm, types[t], 8, 2);
+            msm.multiple = t < 3;
+
+            size_t length = msm7_frame(input + input_length, &msm);
+            bool corrupt = epoch % 13 == 7 && t == 1;
+            if (corrupt) input[input_length + 20] ^= 0x10;
+
+            memcpy(expected + expected_length, input + input_length, length);
+            if (!corrupt) {
+                expected_length += rtcm3_msm7_to_msm4(input + input_length, length, expected + expected_length);
+                msm7_count++;
+            } else {
+                expected_length += length;
+            }
+            input_length += length;
+        }
+
+        uint8_t chunk[RTCM3_FRAME_MAX];
+        size_t length = 0;
+        if (epoch % 3 == 0) {
+            rtcm3_station_t station = {.station_id = 2003, .ecef = {11141045999LL, -48507297108LL, 39755214643LL}, .gps = true};
+            uint8_t payload[RTCM3_1006_SIZE];
+            length = rtcm3_frame_build(chunk, payload, rtcm3_encode_1005(payload, &station));
+        } else if (epoch % 3 == 1) {
+            msm7_t msm;
+            msm7_fill(&msm, 1077, 6, 2);
+            msm.type = 1074;
+            length = msm7_frame(chunk, &msm);
+        } else {
+            static const char nmea[] = "$GNGGA,123519.00,4807.038,N,01131.000,E,4,12,0.9,545.4,M,46.9,M,1.0,0000*47\r\n\xD3\xF0";
+            length = sizeof(nmea) - 1;
+            memcpy(chunk, nmea, length);
+        }
+        memcpy(input + input_length, chunk, length);
+        memcpy(expected + expected_length, chunk, length);
+        input_length += length;
+        expected_length += length;
+    }
+    CHECK(expected_length < input_length * 3 / 4, "%zu of %zu", expected_length, input_length);
+
+    for (size_t chunk = 1; chunk <= 4096; chunk = chunk * 2 + 1) {
+        rtcm3_msm4_stream_t stream;
+        rtcm3_msm4_stream_init(&stream);
+        output.length = 0;
+        output.fail_after = 0;
+
+        size_t written = 0;
+        for (size_t offset = 0; offset < input_length; offset += chunk) {
+            size_t n = input_length - offset < chunk ? input_length - offset : chunk;
+            int result = rtcm3_msm4_stream_feed(&stream, input + offset, n, msm4_write, &output);
+            CHECK(result >= 0, "chunk %zu: %d", chunk, result);
+            written += result;
+        }
+
+        CHECK(written == output.length, "chunk %zu: %zu returned, %zu written", chunk, written, output.length);
+        CHECK(output.length == expected_length, "chunk %zu: %zu bytes, expected %zu", chunk, output.length, expected_length);
+        CHECK(memcmp(output.data, expected, expected_length) == 0, "chunk %zu: output differs", chunk);
+        CHECK(stream.converted == msm7_count, "chunk %zu: %u converted of %u", chunk, stream.converted, msm7_count);
+        CHECK(stream.crc_errors == 3, "chunk %zu: %u crc errors", chunk, stream.crc_errors);
+        CHECK(stream.saved == input_length - expected_length, "chunk %zu: saved %llu", chunk, (unsigned long long) stream.saved);
+    }
+
+    // Ошибка записи возвращается вызывающему
+    rtcm3_msm4_stream_t stream;
+    rtcm3_msm4_stream_init(&stream);
+    output.length = 0;
+    output.fail_after = 1000;
+    CHECK(rtcm3_msm4_stream_feed(&stream, input, input_length, msm4_write, &output) < 0, "write error");
+
+    return true;
+}
+
+static const struct {
+    const char *name;
+    bool (*run)();
+} checks[] = {
+        {"fields", msm4_fields},
+        {"lock", msm4_lock},
+        {"limits", msm4_limits},
+        {"inplace", msm4_inplace},
+        {"stream", msm4_stream},
+};
+
+int main(int argc, char **argv) {
+    int run = 0, failed = 0;
+
+    for (int i = 0; i < sizeof(checks) / sizeof(checks[0]); i++) {
+        if (argc > 1 && strcmp(argv[1], checks[i].name) != 0) continue;
+
+        printf("%s\n", checks[i].name);
+        bool ok = checks[i].run();
+        printf("%s: %s\n", checks[i].name, ok ? "PASS" : "FAIL");
+        fflush(stdout);
+
+        run++;
+        if (!ok) failed++;
+    }
+
+    if (run == 0) {
+        fprintf(stderr, "Unknown check %s\n", argv[1]);
+        return 2;
+    }
+
+    return failed > 0 ? 1 : 0;
+}
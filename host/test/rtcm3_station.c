@@ -0,0 +1,319 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+
+/// Проверка сообщений станции: битовые поля, 1005 против примера из RTCM 10403.3,
+/// поля 1006 и 1033, сканер кадров против rtcm3_framer_t на потоке с мусором при любом
+/// разбиении на куски и конец эпохи в пачках MSM и legacy-наблюдений
+///
+///   rtcm3_station [проверка]   без аргумента - все проверки
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <protocol/rtcm3.h>
+
+#define CHECK(condition, ...) do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s: ", __FILE__, __LINE__, #condition); \
+            fprintf(stderr, __VA_ARGS__); \
+            fputc('\n', stderr); \
+            return false; \
+        } \
+    } while (0)
+
+static bool station_bits() {
+    uint8_t buffer[16];
+
+    // Запись не трогает соседние биты при любом смещении и ширине
+    for (unsigned bits = 1; bits <= 64; bits++) {
+        for (size_t position = 0; position < 16; position++) {
+            uint64_t value = 0xA5C3F00F5AA5C33CULL & (bits == 64 ? ~0ULL : (1ULL << bits) - 1);
+            memset(buffer, 0xFF, sizeof(buffer));
+            rtcm3_set_bits(buffer, position, bits, value);
+            CHECK(rtcm3_get_bits(buffer, position, bits) == value, "bits %u at %zu", bits, position);
+            CHECK(position == 0 || rtcm3_get_bits(buffer, 0, position) == (1ULL << position) - 1,
+                    "prefix changed, bits %u at %zu", bits, position);
+            CHECK(rtcm3_get_bits(buffer, position + bits, 8) == 0xFF, "suffix changed, bits %u at %zu", bits, position);
+        }
+    }
+
+    rtcm3_set_bits(buffer, 5, 38, (uint64_t) -48507297108LL);
+    CHECK(rtcm3_get_signed_bits(buffer, 5, 38) == -48507297108LL, "%lld", (long long) rtcm3_get_signed_bits(buffer, 5, 38));
+    rtcm3_set_bits(buffer, 3, 1, 1);
+    CHECK(rtcm3_get_signed_bits(buffer, 3, 1) == -1, "1 bit");
+
+    return true;
+}
+
+static size_t station_frame(uint8_t *frame, uint16_t type, const rtcm3_station_t *station) {
+    uint8_t payload[RTCM3_1033_SIZE_MAX];
+    memset(payload, 0xFF, sizeof(payload));         // все биты должны быть записаны
+
+    size_t length = type == 1005 ? rtcm3_encode_1005(payload, station)
+            : type == 1006 ? rtcm3_encode_1006(payload, station)
+            : rtcm3_encode_1033(payload, station);
+    return rtcm3_frame_build(frame, payload, length);
+}
+
+static bool station_1005() {
+    // RTCM 10403.3, пример сообщения 1005
+    static const uint8_t expected[] = {
+            0xD3, 0x00, 0x13, 0x3E, 0xD7, 0xD3, 0x02, 0x02, 0x98, 0x0E, 0xDE, 0xEF, 0x34,
+            0xB4, 0xBD, 0x62, 0xAC, 0x09, 0x41, 0x98, 0x6F, 0x33, 0x36, 0x0B, 0x98
+    };
+    rtcm3_station_t station = {
+            .station_id = 2003,
+            .ecef = {11141045999LL, -48507297108LL, 39755214643LL},
+            .gps = true
+    };
+
+    uint8_t frame[RTCM3_FRAME_MAX];
+    size_t length = station_frame(frame, 1005, &station);
+    CHECK(length == sizeof(expected), "length %zu", length);
+    CHECK(memcmp(frame, expected, length) == 0, "frame differs");
+
+    return true;
+}
+
+static bool station_1006() {
+    rtcm3_station_t station = {
+            .station_id = 4095,
+            .ecef = {-137438953472LL, 137438953471LL, 0},   // пределы 38 бит
+            .antenna_height = 15432,
+            .gps = true,
+            .glonass = true,
+            .galileo = true
+    };
+
+    uint8_t frame[RTCM3_FRAME_MAX];
+    size_t length = station_frame(frame, 1006, &station);
+    CHECK(length == RTCM3_HEADER_SIZE + RTCM3_1006_SIZE + RTCM3_CRC_SIZE, "length %zu", length);
+    CHECK(rtcm3_message_type(frame) == 1006, "type %u", rtcm3_message_type(frame));
+
+    const uint8_t *payload = frame + RTCM3_HEADER_SIZE;
+    CHECK(rtcm3_get_bits(payload, 12, 12) == 4095, "station id");
+    CHECK(rtcm3_get_bits(payload, 30, 3) == 7, "constellations");
+    CHECK(rtcm3_get_signed_bits(payload, 34, 38) == station.ecef[0], "x");
+    CHECK(rtcm3_get_signed_bits(payload, 74, 38) == station.ecef[1], "y");
+    CHECK(rtcm3_get_signed_bits(payload, 114, 38) == station.ecef[2], "z");
+    CHECK(rtcm3_get_bits(payload, 152, 16) == 15432, "antenna height");
+
+    uint32_t crc = (uint32_t) frame[length - 3] << 16 | (uint32_t) frame[length - 2] << 8 | frame[length - 1];
+    CHECK(rtcm3_crc24q(frame, length - RTCM3_CRC_SIZE) == crc, "crc");
+
+    return true;
+}
+
+/// Строка 1033: длина и символы, возвращает позицию за ней
+static size_t station_string(const uint8_t *payload, size_t position, char *out) {
+    size_t length = rtcm3_get_bits(payload, position, 8);
+    position += 8;
+    for (size_t i = 0; i < length; i++, position += 8) out[i] = (char) rtcm3_get_bits(payload, position, 8);
+    out[length] = '\0';
+
+    return position;
+}
+
+static bool station_1033() {
+    rtcm3_station_t station = {
+            .station_id = 17,
+            .antenna_descriptor = "TRM57971.00     NONE",
+            .antenna_setup = 3,
+            .antenna_serial = "",
+            .receiver_type = "SEPT POLARX5",
+            .receiver_firmware = "5.5.0",
+            .receiver_serial = "3034567890123456789012345678901"  // 31 символ
+    };
+
+    uint8_t frame[RTCM3_FRAME_MAX];
+    size_t length = station_frame(frame, 1033, &station);
+    CHECK(rtcm3_message_type(frame) == 1033, "type %u", rtcm3_message_type(frame));
+
+    const uint8_t *payload = frame + RTCM3_HEADER_SIZE;
+    char text[32];
+    size_t position = 24;
+    CHECK(rtcm3_get_bits(payload, 12, 12) == 17, "station id");
+    position = station_string(payload, position, text);
+    CHECK(strcmp(text, station.antenna_descriptor) == 0, "antenna descriptor '%s'", text);
+    CHECK(rtcm3_get_bits(payload, position, 8) == 3, "setup id");
+    position += 8;
+    position = station_string(payload, position, text);
+    CHECK(text[0] == '\0', "antenna serial '%s'", text);
+    position = station_string(payload, position, text);
+    CHECK(strcmp(text, station.receiver_type) == 0, "receiver type '%s'", text);
+    position = station_string(payload, position, text);
+    CHECK(strcmp(text, station.receiver_firmware) == 0, "firmware '%s'", text);
+    position = station_string(payload, position, text);
+    CHECK(strcmp(text, station.receiver_serial) == 0, "receiver serial '%s'", text);
+    CHECK(length == RTCM3_HEADER_SIZE + position / 8 + RTCM3_CRC_SIZE, "length %zu, %zu bits", length, position);
+
+    // Все строки по 31 символу - наибольшее сообщение
+    memset(station.antenna_descriptor, 'A', 31);
+    memset(station.antenna_serial, 'B', 31);
+    memset(station.receiver_type, 'C', 31);
+    memset(station.receiver_firmware, 'D', 31);
+    memset(station.receiver_serial, 'E', 31);
+    length = station_frame(frame, 1033, &station);
+    CHECK(length == RTCM3_HEADER_SIZE + RTCM3_1033_SIZE_MAX + RTCM3_CRC_SIZE, "length %zu", length);
+
+    return true;
+}
+
+/// Заголовок наблюдений: MSM (номер, станция, время 30 бит, Multiple Message) или legacy
+static size_t station_observation(uint8_t *frame, uint16_t type, bool more, size_t payload_length) {
+    uint8_t payload[RTCM3_PAYLOAD_MAX];
+    memset(payload, 0x5A, payload_length);
+    rtcm3_set_bits(payload, 0, 12, type);
+    rtcm3_set_bits(payload, 12, 12, 1);
+    if (type >= 1009 && type <= 1012) rtcm3_set_bits(payload, 24, 27, 12345), rtcm3_set_bits(payload, 51, 1, more);
+    else rtcm3_set_bits(payload, 24, 30, 123456), rtcm3_set_bits(payload, 54, 1, more);
+
+    return rtcm3_frame_build(frame, payload, payload_length);
+}
+
+static void station_count(void *ctx, const uint8_t *frame, size_t length) {
+    (*(uint32_t *) ctx)++;
+}
+
+static bool station_scanner() {
+    static uint8_t stream[64 * 1024];
+    size_t ends[40];                // конец последнего кадра каждой эпохи
+    size_t length = 0;
+    uint32_t seed = 1;
+
+    // Эпохи по пять кадров разной длины вперемешку с мусором без преамбулы
+    for (int i = 0; i < 200; i++) {
+        size_t garbage = (seed = seed * 1103515245 + 12345) >> 24 & 0x1F;
+        for (size_t j = 0; j < garbage; j++) stream[length++] = (uint8_t) ('$' + j % 64);
+        length += station_observation(stream + length, 1077, i % 5 != 4, 8 + (seed >> 8) % 300);
+        if (i % 5 == 4) ends[i / 5] = length;
+    }
+
+    uint32_t expected = 0;
+    rtcm3_framer_t framer;
+    rtcm3_framer_init(&framer, station_count, &expected);
+    rtcm3_framer_feed(&framer, stream, length);
+    CHECK(expected == 200, "framer found %u", expected);
+
+    for (size_t chunk = 1; chunk <= 1500; chunk = chunk * 3 + 1) {
+        rtcm3_scanner_t scanner;
+        rtcm3_scanner_init(&scanner);
+
+        uint32_t frames = 0, epochs = 0;
+        for (size_t offset = 0; offset < length;) {
+            size_t n = length - offset < chunk ? length - offset : chunk;
+            for (size_t used = 0; used < n;) {
+                rtcm3_scan_event_t event;
+                used += rtcm3_scanner_feed(&scanner, stream + offset + used, n - used, &event);
+                if (event != RTCM3_SCAN_NONE) frames++;
+                if (event == RTCM3_SCAN_EPOCH_END) {
+                    // Поглощено ровно до конца последнего кадра эпохи
+                    CHECK(epochs < 40 && offset + used == ends[epochs], "chunk %zu: epoch %u ends at %zu",
+                            chunk, epochs, offset + used);
+                    epochs++;
+                }
+            }
+            offset += n;
+        }
+
+        CHECK(frames == expected && scanner.frames == expected, "chunk %zu: %u frames", chunk, frames);
+        CHECK(epochs == expected / 5, "chunk %zu: %u epochs", chunk, epochs);
+        CHECK(scanner.crc_errors == 0, "chunk %zu: %u crc errors", chunk, scanner.crc_errors);
+    }
+
+    // Испорченный кадр пропускается, следующий находится
+    uint8_t frame[2 * RTCM3_FRAME_MAX];
+    size_t first = station_observation(frame, 1087, false, 40);
+    size_t second = station_observation(frame + first, 1097, false, 40);
+    frame[10] ^= 0x01;
+
+    rtcm3_scanner_t scanner;
+    rtcm3_scanner_init(&scanner);
+    rtcm3_scan_event_t event;
+    size_t used = rtcm3_scanner_feed(&scanner, frame, first + second, &event);
+    CHECK(used == first + second && event == RTCM3_SCAN_EPOCH_END, "used %zu, event %d", used, event);
+    CHECK(scanner.frames == 1 && scanner.crc_errors == 1, "frames %u, errors %u", scanner.frames, scanner.crc_errors);
+
+    return true;
+}
+
+static bool station_epoch() {
+    uint8_t frame[RTCM3_FRAME_MAX];
+    static const struct {
+        uint16_t type;
+        bool more;
+        bool end;
+    } cases[] = {
+            {1074, true, false}, {1074, false, true},
+            {1077, false, true}, {1087, true, false}, {1097, false, true},
+            {1127, false, true}, {1137, false, true}, {1071, false, true},
+            {1004, true, false}, {1004, false, true}, {1001, false, true},
+            {1012, true, false}, {1012, false, true},
+            {1005, false, false}, {1033, false, false}, {1230, false, false},
+            {1078, false, false}, {1070, false, false}, {1138, false, false}
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        size_t length = station_observation(frame, cases[i].type, cases[i].more, 20);
+        CHECK(rtcm3_epoch_end(frame, length) == cases[i].end, "type %u, multiple %d", cases[i].type, cases[i].more);
+    }
+
+    // Слишком короткие данные - не наблюдения
+    size_t length = station_observation(frame, 1077, false, 6);
+    CHECK(!rtcm3_epoch_end(frame, length), "short frame");
+
+    return true;
+}
+
+static const struct {
+    const char *name;
+    bool (*run)();
+} checks[] = {
+        {"bits", station_bits},
+        {"1005", station_1005},
+        {"1006", station_1006},
+        {"1033", station_1033},
+        {"scanner", station_scanner},
+        {"epoch", station_epoch},
+};
+
+int main(int argc, char **argv) {
+    int run = 0, failed = 0;
+
+    for (int i = 0; i < sizeof(checks) / sizeof(checks[0]); i++) {
+        if (argc > 1 && strcmp(argv[1], checks[i].name) != 0) continue;
+
+        printf("%s\n", checks[i].name);
+        bool ok = checks[i].run();
+        printf("%s: %s\n", checks[i].name, ok ? "PASS" : "FAIL");
+        fflush(stdout);
+
+        run++;
+        if (!ok) failed++;
+    }
+
+    if (run == 0) {
+        fprintf(stderr, "Unknown check %s\n", argv[1]);
+        return 2;
+    }
+
+    return failed > 0 ? 1 : 0;
+}
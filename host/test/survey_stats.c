@@ -0,0 +1,241 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+/// Проверка съёмки базы: перевод координат WGS84 <-> ECEF, накопление по Уэлфорду
+/// против двухпроходного расчёта, устойчивость на миллионах измерений и съёмка
+/// по потоку GGA с коррелированным шумом до выполнения порогов
+///
+///   survey_stats [проверка]   без аргумента - все проверки
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <protocol/nmea.h>
+#include <survey_stats.h>
+
+#define CHECK(condition, ...) do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s: ", __FILE__, __LINE__, #condition); \
+            fprintf(stderr, __VA_ARGS__); \
+            fputc('\n', stderr); \
+            return false; \
+        } \
+    } while (0)
+
+/// Детерминированный нормальный шум (xorshift и Бокс-Мюллер)
+static uint64_t survey_random_state = 0x9E3779B97F4A7C15ULL;
+
+static double survey_uniform() {
+    survey_random_state ^= survey_random_state << 13;
+    survey_random_state ^= survey_random_state >> 7;
+    survey_random_state ^= survey_random_state << 17;
+    return ((survey_random_state >> 11) + 0.5) / (double) (1ULL << 53);
+}
+
+static double survey_gauss() {
+    return sqrt(-2 * log(survey_uniform())) * cos(2 * M_PI * survey_uniform());
+}
+
+static bool survey_ecef() {
+    double ecef[3];
+    survey_ecef_from_geodetic(0, 0, 0, ecef);
+    CHECK(fabs(ecef[0] - SURVEY_WGS84_A) < 1e-6 && fabs(ecef[1]) < 1e-6 && fabs(ecef[2]) < 1e-6,
+            "%.6f %.6f %.6f", ecef[0], ecef[1], ecef[2]);
+
+    survey_ecef_from_geodetic(90, 0, 0, ecef);
+    CHECK(fabs(ecef[2] - 6356752.3142) < 1e-3 && fabs(ecef[0]) < 1e-6, "pole %.4f", ecef[2]);
+
+    // Обратный перевод на разных широтах и высотах: ошибка меньше 0.1 мм
+    const double points[][3] = {
+            {55.7522, 37.6156, 150}, {-33.8688, 151.2093, -20}, {89.5, -120, 2500},
+            {-89.9, 10, 0}, {0.0001, -179.9999, 8848}, {49.274, -123.185, 75.123},
+    };
+    for (size_t i = 0; i < sizeof(points) / sizeof(points[0]); i++) {
+        double latitude, longitude, height;
+        survey_ecef_from_geodetic(points[i][0], points[i][1], points[i][2], ecef);
+        survey_geodetic_from_ecef(ecef, &latitude, &longitude, &height);
+        CHECK(fabs(latitude - points[i][0]) < 1e-9 && fabs(longitude - points[i][1]) < 1e-9
+                && fabs(height - points[i][2]) < 1e-4, "%.9f %.9f %.5f", latitude, longitude, height);
+    }
+    return true;
+}
+
+static bool survey_welford() {
+    enum { COUNT = 10000 };
+    static double samples[COUNT][3];
+    const double center[3] = {2850153.9237, -2119488.1542, 5235748.77};
+
+    survey_stats_t stats;
+    survey_stats_reset(&stats);
+    CHECK(survey_stats_spread(&stats) == 0 && isinf(survey_stats_accuracy(&stats, 1000)), "empty stats");
+
+    for (int n = 0; n < COUNT; n++) {
+        for (int i = 0; i < 3; i++) samples[n][i] = center[i] + survey_gauss() * (i == 2 ? 3.0 : 1.5);
+        survey_stats_add(&stats, samples[n]);
+    }
+
+    // Двухпроходный расчёт как эталон
+    double mean[3] = {0}, variance = 0;
+    for (int n = 0; n < COUNT; n++) for (int i = 0; i < 3; i++) mean[i] += samples[n][i] / COUNT;
+    for (int n = 0; n < COUNT; n++) {
+        for (int i = 0; i < 3; i++) variance += (samples[n][i] - mean[i]) * (samples[n][i] - mean[i]) / (COUNT - 1);
+    }
+
+    double result[3];
+    survey_stats_mean(&stats, result);
+    for (int i = 0; i < 3; i++) CHECK(fabs(result[i] - mean[i]) < 1e-7, "axis %d: %.9f vs %.9f", i, result[i], mean[i]);
+    CHECK(fabs(survey_stats_spread(&stats) - sqrt(variance)) < 1e-9, "spread %.12f vs %.12f",
+            survey_stats_spread(&stats), sqrt(variance));
+    CHECK(fabs(sqrt(variance) - sqrt(1.5 * 1.5 * 2 + 9)) < 0.1, "spread %.3f", sqrt(variance));
+
+    // Точность: не лучше разброса на коротком интервале, не больше числа измерений
+    CHECK(survey_stats_accuracy(&stats, 10) == survey_stats_spread(&stats), "short survey accuracy");
+    CHECK(fabs(survey_stats_accuracy(&stats, 600) - sqrt(variance / 10)) < 1e-9, "10 intervals");
+    CHECK(fabs(survey_stats_accuracy(&stats, 1e9) - sqrt(variance / COUNT)) < 1e-9, "limited by samples");
+    return true;
+}
+
+static bool survey_long() {
+    // Десять миллионов измерений (сутки при 100 Гц) с разбросом в миллиметр на 6e6 м:
+    // память постоянная, разброс не теряется на фоне абсолютных координат
+    const double center[3] = {-2694685.473, -4293642.366, 3857878.924};
+    const uint32_t count = 10000000;
+
+    survey_stats_t stats;
+    survey_stats_reset(&stats);
+    double sum_square = 0;
+    for (uint32_t n = 0; n < count; n++) {
+        double offset = (n % 2 ? 1 : -1) * 0.001;
+        double sample[3] = {center[0] + offset, center[1] - offset, center[2] + offset};
+        survey_stats_add(&stats, sample);
+        sum_square += 3 * offset * offset;
+    }
+
+    double mean[3];
+    survey_stats_mean(&stats, mean);
+    for (int i = 0; i < 3; i++) CHECK(fabs(mean[i] - center[i]) < 1e-6, "axis %d: %.9f", i, mean[i] - center[i]);
+    double expected = sqrt(sum_square / (count - 1));
+    CHECK(fabs(survey_stats_spread(&stats) - expected) < 1e-9, "spread %.12f vs %.12f", survey_stats_spread(&stats), expected);
+    CHECK(stats.count == count, "%u samples", stats.count);
+    return true;
+}
+
+typedef struct survey_run {
+    survey_stats_t stats;
+    double ecef[3];
+    uint32_t epochs;
+} survey_run_t;
+
+static void survey_sentence(void *ctx, nmea_sentence_t type, const char *sentence, size_t length) {
+    if (type != NMEA_SENTENCE_GGA) return;
+
+    // Тот же путь, что в survey.c: фиксированная точка GGA -> ECEF
+    survey_run_t *run = ctx;
+    nmea_fix_t fix;
+    memset(&fix, 0, sizeof(fix));
+    nmea_parse_sentence(&fix, sentence, length);
+    if (!fix.position_valid || fix.quality == 0) return;
+
+    survey_ecef_from_geodetic(fix.latitude / 1e7, fix.longitude / 1e7, (fix.altitude + fix.geoid_separation) / 1000.0,
+            run->ecef);
+    survey_stats_add(&run->stats, run->ecef);
+    run->epochs++;
+}
+
+static bool survey_stream() {
+    // Автономное решение 1 Гц: шум Гаусса-Маркова с временем корреляции 60 с, 1.5 м в плане и 3 м по высоте
+    const double latitude = 55.5020576, longitude = 37.5127572, height = 164.0;
+    const uint32_t min_duration = 300;
+    const double accuracy_limit = 2.0;
+
+    nmea_parser_t parser;
+    survey_run_t run = {0};
+    survey_stats_reset(&run.stats);
+    nmea_parser_init(&parser, survey_sentence, &run);
+
+    double north = 0, east = 0, up = 0;
+    const double phi = exp(-1.0 / 60), scale = sqrt(1 - phi * phi);
+    uint32_t seconds = 0;
+    double accuracy = INFINITY;
+    for (; seconds < 24 * 3600; seconds++) {
+        north = north * phi + survey_gauss() * 1.5 * scale;
+        east = east * phi + survey_gauss() * 1.5 * scale;
+        up = up * phi + survey_gauss() * 3.0 * scale;
+
+        double lat = latitude + north / 111320.0, lon = longitude + east / (111320.0 * cos(latitude * M_PI / 180));
+        double lat_minutes = (lat - (int) lat) * 60, lon_minutes = (lon - (int) lon) * 60;
+
+        char sentence[NMEA_EMIT_MAX];
+        int length = nmea_format(sentence, sizeof(sentence), "$GNGGA,%02u%02u%02u.00,%02d%02d.%07d,N,%03d%02d.%07d,E,1,12,0.90,%d.%03d,M,14.000,M,,",
+                seconds / 3600 % 24, seconds / 60 % 60, seconds % 60,
+                (int) lat, (int) lat_minutes, (int) ((lat_minutes - (int) lat_minutes) * 1e7),
+                (int) lon, (int) lon_minutes, (int) ((lon_minutes - (int) lon_minutes) * 1e7),
+                (int) (height - 14 + up), (int) (fmod(height - 14 + up, 1) * 1000));
+        nmea_parser_feed(&parser, (const uint8_t *) sentence, length);
+
+        accuracy = survey_stats_accuracy(&run.stats, seconds);
+        if (run.stats.count >= 10 && seconds >= min_duration && accuracy <= accuracy_limit) break;
+    }
+    CHECK(run.epochs == seconds + 1, "%u epochs for %u s", run.epochs, seconds);
+    CHECK(seconds >= min_duration && seconds < 3600, "finished after %u s", seconds);
+
+    double truth[3], mean[3];
+    survey_ecef_from_geodetic(latitude, longitude, height, truth);
+    survey_stats_mean(&run.stats, mean);
+    double error = sqrt(pow(mean[0] - truth[0], 2) + pow(mean[1] - truth[1], 2) + pow(mean[2] - truth[2], 2));
+    printf("survey: %u s, accuracy %.3f m, spread %.3f m, error %.3f m\n", seconds, accuracy,
+            survey_stats_spread(&run.stats), error);
+    CHECK(error < 3 * accuracy, "error %.3f m, accuracy %.3f m", error, accuracy);
+    return true;
+}
+
+static const struct {
+    const char *name;
+    bool (*run)();
+} checks[] = {
+        {"ecef", survey_ecef},
+        {"welford", survey_welford},
+        {"long", survey_long},
+        {"stream", survey_stream},
+};
+
+int main(int argc, char **argv) {
+    int run = 0, failed = 0;
+
+    for (int i = 0; i < sizeof(checks) / sizeof(checks[0]); i++) {
+        if (argc > 1 && strcmp(argv[1], checks[i].name) != 0) continue;
+
+        printf("%s\n", checks[i].name);
+        bool ok = checks[i].run();
+        printf("%s: %s\n", checks[i].name, ok ? "PASS" : "FAIL");
+        fflush(stdout);
+
+        run++;
+        if (!ok) failed++;
+    }
+
+    if (run == 0) {
+        fprintf(stderr, "Unknown check %s\n", argv[1]);
+        return 2;
+    }
+
+    return failed > 0 ? 1 : 0;
+}
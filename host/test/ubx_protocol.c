@@ -0,0 +1,301 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+/// Проверка UBX: кадрирование рядом с NMEA и RTCM 3, контрольная сумма Флетчера,
+/// разбор NAV-PVT/NAV-SVIN/MON-HW, сборка CFG-VALSET/VALGET и ключи частот сообщений
+///
+///   ubx_protocol [проверка]   без аргумента - все проверки
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <protocol/rtcm3.h>
+#include <protocol/ubx.h>
+
+#define CHECK(condition, ...) do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s: ", __FILE__, __LINE__, #condition); \
+            fprintf(stderr, __VA_ARGS__); \
+            fputc('\n', stderr); \
+            return false; \
+        } \
+    } while (0)
+
+typedef struct protocol_frames {
+    uint32_t count;
+    uint8_t classes[16];
+    uint8_t ids[16];
+    size_t lengths[16];
+} protocol_frames_t;
+
+static void protocol_frame(void *ctx, uint8_t class, uint8_t id, const uint8_t *payload, size_t length) {
+    protocol_frames_t *frames = ctx;
+    if (frames->count < 16) {
+        frames->classes[frames->count] = class;
+        frames->ids[frames->count] = id;
+        frames->lengths[frames->count] = length;
+    }
+    frames->count++;
+}
+
+static void protocol_put_u4(uint8_t *p, uint32_t value) {
+    for (int i = 0; i < 4; i++) p[i] = value >> (i * 8);
+}
+
+static bool protocol_checksum() {
+    // Запрос MON-VER из описания протокола
+    uint8_t frame[8];
+    size_t length = ubx_frame_build(frame, sizeof(frame), UBX_CLASS_MON, 0x04, NULL, 0);
+    const uint8_t expected[] = {0xB5, 0x62, 0x0A, 0x04, 0x00, 0x00, 0x0E, 0x34};
+    CHECK(length == sizeof(expected) && memcmp(frame, expected, length) == 0,
+            "%zu bytes, checksum %02X %02X", length, frame[6], frame[7]);
+
+    CHECK(ubx_frame_build(frame, sizeof(frame), UBX_CLASS_MON, 0x04, (uint8_t *) "x", 1) == 0, "overflow not detected");
+    return true;
+}
+
+static bool protocol_framer() {
+    uint8_t stream[2048];
+    size_t length = 0;
+
+    // NMEA, ложная синхронизация, RTCM 3 с байтами синхронизации в данных, кадр с ошибкой суммы
+    const char *nmea = "$GNGGA,101010.00,5530.1234567,N,03730.7654321,E,4,20,0.60,150.000,M,14.000,M,1.0,0001*5C\r\n";
+    memcpy(stream + length, nmea, strlen(nmea));
+    length += strlen(nmea);
+    stream[length++] = UBX_SYNC_1;
+    stream[length++] = 0x00;
+
+    uint8_t pvt[92] = {0};
+    length += ubx_frame_build(stream + length, sizeof(stream) - length, UBX_CLASS_NAV, UBX_NAV_PVT, pvt, sizeof(pvt));
+
+    uint8_t payload[32];
+    for (size_t i = 0; i < sizeof(payload); i++) payload[i] = i % 2 ? UBX_SYNC_2 : UBX_SYNC_1;
+    length += rtcm3_frame_build(stream + length, payload, sizeof(payload));
+
+    uint8_t ack[2] = {UBX_CLASS_CFG, UBX_CFG_VALSET};
+    size_t broken = length;
+    length += ubx_frame_build(stream + length, sizeof(stream) - length, UBX_CLASS_ACK, UBX_ACK_ACK, ack, sizeof(ack));
+    stream[length - 1] ^= 0xFF;
+    length += ubx_frame_build(stream + length, sizeof(stream) - length, UBX_CLASS_ACK, UBX_ACK_NAK, ack, sizeof(ack));
+
+    // Заголовок с длиной больше UBX_PAYLOAD_MAX (ложные синхронизации в RTCM дают такие же)
+    const uint8_t oversized[] = {UBX_SYNC_1, UBX_SYNC_2, 0x02, 0x15, 0xFF, 0x7F};
+    memcpy(stream + length, oversized, sizeof(oversized));
+    length += sizeof(oversized);
+    length += ubx_frame_build(stream + length, sizeof(stream) - length, UBX_CLASS_ACK, UBX_ACK_ACK, ack, sizeof(ack));
+    CHECK(broken < length, "stream");
+
+    protocol_frames_t whole = {0}, bytes = {0};
+    ubx_framer_t framer;
+    ubx_framer_init(&framer, protocol_frame, &whole);
+    ubx_framer_feed(&framer, stream, length);
+    CHECK(whole.count == 3, "%u frames", whole.count);
+    CHECK(whole.classes[0] == UBX_CLASS_NAV && whole.ids[0] == UBX_NAV_PVT && whole.lengths[0] == 92, "first frame");
+    CHECK(whole.ids[1] == UBX_ACK_NAK && whole.ids[2] == UBX_ACK_ACK, "ack frames %u %u", whole.ids[1], whole.ids[2]);
+    CHECK(framer.checksum_errors >= 1 && framer.oversized >= 1,
+            "%u checksum errors, %u oversized", framer.checksum_errors, framer.oversized);
+
+    ubx_framer_t byte_framer;
+    ubx_framer_init(&byte_framer, protocol_frame, &bytes);
+    for (size_t i = 0; i < length; i++) ubx_framer_feed(&byte_framer, stream + i, 1);
+    CHECK(bytes.count == whole.count && memcmp(bytes.ids, whole.ids, sizeof(whole.ids)) == 0, "byte feed %u frames", bytes.count);
+    CHECK(byte_framer.checksum_errors == framer.checksum_errors, "byte feed %u checksum errors", byte_framer.checksum_errors);
+    return true;
+}
+
+static bool protocol_decode() {
+    uint8_t pvt[92] = {0};
+    protocol_put_u4(pvt, 345600000);
+    pvt[4] = 2024 & 0xFF;
+    pvt[5] = 2024 >> 8;
+    pvt[6] = 11;
+    pvt[7] = 19;
+    pvt[8] = 22;
+    pvt[9] = 54;
+    pvt[10] = 46;
+    pvt[11] = 0x07;
+    pvt[20] = 3;
+    pvt[21] = 0x01 | (2 << 6);
+    pvt[23] = 31;
+    protocol_put_u4(pvt + 24, (uint32_t) -1231853333);
+    protocol_put_u4(pvt + 28, 492741667);
+    protocol_put_u4(pvt + 32, 75123);
+    protocol_put_u4(pvt + 36, 92345);
+    protocol_put_u4(pvt + 40, 14);
+    protocol_put_u4(pvt + 44, 10);
+    pvt[76] = 120;
+
+    ubx_nav_pvt_t nav;
+    CHECK(!ubx_nav_pvt_decode(pvt, 91, &nav), "short NAV-PVT accepted");
+    CHECK(ubx_nav_pvt_decode(pvt, sizeof(pvt), &nav), "NAV-PVT rejected");
+    CHECK(nav.itow == 345600000 && nav.year == 2024 && nav.month == 11 && nav.day == 19 && nav.time_valid,
+            "time %u %u-%u-%u", nav.itow, nav.year, nav.month, nav.day);
+    CHECK(nav.fix_type == 3 && nav.fix_ok && nav.carrier == 2 && nav.satellites == 31,
+            "fix %u ok %d carrier %u satellites %u", nav.fix_type, nav.fix_ok, nav.carrier, nav.satellites);
+    CHECK(nav.longitude == -1231853333 && nav.latitude == 492741667, "position %d %d", nav.latitude, nav.longitude);
+    CHECK(nav.height == 75123 && nav.height_msl == 92345 && nav.h_acc == 14 && nav.v_acc == 10 && nav.pdop == 120,
+            "height %d msl %d acc %u/%u pdop %u", nav.height, nav.height_msl, nav.h_acc, nav.v_acc, nav.pdop);
+
+    uint8_t svin[40] = {0};
+    protocol_put_u4(svin + 8, 600);
+    protocol_put_u4(svin + 12, 285015392);             // X = 2850153.92 м
+    protocol_put_u4(svin + 16, (uint32_t) -211948815);  // Y = -2119488.15 м
+    protocol_put_u4(svin + 20, 523574877);
+    svin[24] = 37;
+    svin[25] = (uint8_t) -42;
+    svin[26] = 0;
+    protocol_put_u4(svin + 28, 15000);
+    protocol_put_u4(svin + 32, 600);
+    svin[36] = 1;
+    svin[37] = 0;
+
+    ubx_nav_svin_t survey;
+    CHECK(ubx_nav_svin_decode(svin, sizeof(svin), &survey), "NAV-SVIN rejected");
+    CHECK(survey.mean[0] == 28501539237LL && survey.mean[1] == -21194881542LL && survey.mean[2] == 52357487700LL,
+            "mean %lld %lld %lld", (long long) survey.mean[0], (long long) survey.mean[1], (long long) survey.mean[2]);
+    CHECK(survey.duration == 600 && survey.mean_acc == 15000 && survey.observations == 600 && survey.valid && !survey.active,
+            "duration %u acc %u", survey.duration, survey.mean_acc);
+
+    uint8_t hw[60] = {0};
+    hw[16] = 0x52;
+    hw[18] = 0x10;
+    hw[19] = 0x0B;
+    hw[20] = 2;
+    hw[21] = 1;
+    hw[22] = 2 << 2;
+    hw[45] = 17;
+    ubx_mon_hw_t monitor;
+    CHECK(ubx_mon_hw_decode(hw, sizeof(hw), &monitor), "MON-HW rejected");
+    CHECK(monitor.noise == 0x52 && monitor.agc == 0x0B10 && monitor.antenna_status == 2 && monitor.antenna_power == 1
+            && monitor.jamming_state == 2 && monitor.jamming == 17, "noise %u agc %u", monitor.noise, monitor.agc);
+
+    const uint8_t ack[2] = {UBX_CLASS_CFG, UBX_CFG_VALSET};
+    CHECK(ubx_ack_matches(ack, 2, UBX_CLASS_CFG, UBX_CFG_VALSET) && !ubx_ack_matches(ack, 1, UBX_CLASS_CFG, UBX_CFG_VALSET)
+            && !ubx_ack_matches(ack, 2, UBX_CLASS_CFG, UBX_CFG_VALGET), "ack correlation");
+    return true;
+}
+
+static bool protocol_config() {
+    ubx_valset_t set;
+    ubx_valset_init(&set, UBX_LAYER_RAM | UBX_LAYER_FLASH);
+    CHECK(ubx_valset_add(&set, UBX_KEY_TMODE_MODE, UBX_TMODE_SURVEY_IN), "U1 key");
+    CHECK(ubx_valset_add(&set, UBX_KEY_TMODE_SVIN_MIN_DUR, 300), "U4 key");
+    CHECK(ubx_valset_add(&set, UBX_KEY_TMODE_ECEF_X_HP, (uint8_t) -42), "I1 key");
+    CHECK(!ubx_valset_add(&set, 0x00000001, 0), "key without size accepted");
+
+    const uint8_t expected[] = {
+            0x00, 0x05, 0x00, 0x00,
+            0x01, 0x00, 0x03, 0x20, 0x01,
+            0x10, 0x00, 0x03, 0x40, 0x2C, 0x01, 0x00, 0x00,
+            0x06, 0x00, 0x03, 0x20, 0xD6
+    };
+    CHECK(set.length == sizeof(expected) && memcmp(set.payload, expected, sizeof(expected)) == 0 && set.count == 3,
+            "%zu bytes", set.length);
+
+    for (int i = set.count; i < UBX_VALSET_KEYS_MAX; i++) ubx_valset_add(&set, 0x40030010, i);
+    CHECK(!ubx_valset_add(&set, 0x20030001, 0), "more than %d keys", UBX_VALSET_KEYS_MAX);
+
+    uint32_t keys[2] = {0x209100BB, 0x40030011};
+    uint8_t poll[16];
+    CHECK(ubx_valget_build(poll, sizeof(poll), 0, keys, 2) == 12, "VALGET length");
+    CHECK(ubx_valget_build(poll, 8, 0, keys, 2) == 0, "VALGET overflow");
+    const uint8_t poll_expected[] = {0x00, 0x00, 0x00, 0x00, 0xBB, 0x00, 0x91, 0x20, 0x11, 0x00, 0x03, 0x40};
+    CHECK(memcmp(poll, poll_expected, sizeof(poll_expected)) == 0, "VALGET payload");
+
+    // Ответ: U1, U4, X8 и обрезанная последняя пара
+    const uint8_t response[] = {
+            0xBB, 0x00, 0x91, 0x20, 0x01,
+            0x11, 0x00, 0x03, 0x40, 0x10, 0x27, 0x00, 0x00,
+            0x01, 0x00, 0x00, 0x50, 1, 2, 3, 4, 5, 6, 7, 8,
+            0x10, 0x00, 0x03, 0x40, 0x01
+    };
+    const uint8_t *cursor = response, *end = response + sizeof(response);
+    uint32_t key;
+    uint64_t value;
+    CHECK(ubx_valget_next(&cursor, end, &key, &value) && key == 0x209100BB && value == 1, "U1 pair");
+    CHECK(ubx_valget_next(&cursor, end, &key, &value) && key == 0x40030011 && value == 10000, "U4 pair");
+    CHECK(ubx_valget_next(&cursor, end, &key, &value) && value == 0x0807060504030201ULL, "X8 pair");
+    CHECK(!ubx_valget_next(&cursor, end, &key, &value), "truncated pair accepted");
+    return true;
+}
+
+static bool protocol_messages() {
+    // Ключи UART1 из описания интерфейса F9P
+    const struct {
+        const char *name;
+        uint32_t uart1;
+    } known[] = {
+            {"GGA", 0x209100BB},
+            {"gsv", 0x209100C5},
+            {"NAV-PVT", 0x20910007},
+            {"NAV-SVIN", 0x20910089},
+            {"MON-HW", 0x209101B5},
+            {"RTCM1005", 0x209102BE},
+            {"RTCM1077", 0x209102CD},
+            {"RTCM1230", 0x20910304},
+            {"RTCM4072", 0x209102FF},
+    };
+    for (size_t i = 0; i < sizeof(known) / sizeof(known[0]); i++) {
+        const ubx_message_t *message = ubx_message_find(known[i].name);
+        CHECK(message != NULL, "%s not found", known[i].name);
+        CHECK(ubx_message_key(message, UBX_PORT_UART1) == known[i].uart1, "%s: %08X", known[i].name,
+                ubx_message_key(message, UBX_PORT_UART1));
+        CHECK(ubx_key_size(message->key) == 1, "%s size", known[i].name);
+    }
+    CHECK(ubx_message_key(ubx_message_find("GGA"), UBX_PORT_USB) == 0x209100BD, "USB key");
+    CHECK(ubx_message_find("RTCM9999") == NULL, "unknown message found");
+    CHECK(ubx_port_find("UART2") == UBX_PORT_UART2 && ubx_port_find("com1") == UBX_PORT_COUNT, "ports");
+    CHECK(UBX_MESSAGE_COUNT <= UBX_VALSET_KEYS_MAX, "%zu messages do not fit one VALGET", UBX_MESSAGE_COUNT);
+    return true;
+}
+
+static const struct {
+    const char *name;
+    bool (*run)();
+} checks[] = {
+        {"checksum", protocol_checksum},
+        {"framer", protocol_framer},
+        {"decode", protocol_decode},
+        {"config", protocol_config},
+        {"messages", protocol_messages},
+};
+
+int main(int argc, char **argv) {
+    int run = 0, failed = 0;
+
+    for (int i = 0; i < sizeof(checks) / sizeof(checks[0]); i++) {
+        if (argc > 1 && strcmp(argv[1], checks[i].name) != 0) continue;
+
+        printf("%s\n", checks[i].name);
+        bool ok = checks[i].run();
+        printf("%s: %s\n", checks[i].name, ok ? "PASS" : "FAIL");
+        fflush(stdout);
+
+        run++;
+        if (!ok) failed++;
+    }
+
+    if (run == 0) {
+        fprintf(stderr, "Unknown check %s\n", argv[1]);
+        return 2;
+    }
+
+    return failed > 0 ? 1 : 0;
+}
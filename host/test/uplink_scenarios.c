@@ -0,0 +1,872 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+/// Сценарии переподключения NTRIP источника к локальному кастеру с неисправностями.
+/// Поток источника повторяет ntrip_server_task: retry_delay, ntrip_uplink_connect,
+/// отправка кадров до ошибки, повтор. Кадры за время разрыва отбрасываются, как
+/// обработчик UART при сброшенном CASTER_READY_BIT. Задержка повторов и тайм-ауты
+/// сокета уменьшены в 10 раз относительно прошивки, буфер отправки как в lwIP.
+///
+///   uplink_scenarios [сценарий]   без аргумента - все сценарии
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <event_journal.h>
+#include <mock_caster.h>
+#include <net.h>
+#include <platform.h>
+#include <retry.h>
+#include <interface/ntrip.h>
+#include <interface/ntrip_uplink.h>
+#include <protocol/rtcm3.h>
+
+#define SCENARIO_MOUNTPOINT "TEST"
+#define SCENARIO_PASSWORD "test"
+
+#define SCENARIO_RETRY_SHORT_COUNT 5
+#define SCENARIO_RETRY_SHORT_DELAY_MS 200       // 2000 в ntrip_server_task
+#define SCENARIO_TIMEOUT_MS 1000                // 10 с в connect_socket
+#define SCENARIO_SNDBUF 5744                    // CONFIG_LWIP_TCP_SND_BUF_DEFAULT
+#define SCENARIO_MARGIN_MS 300                  // допуск планировщика на измеренные интервалы
+#define SCENARIO_SEQ_MAX 65536
+#define SCENARIO_MESSAGE_TYPE 4095
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MS(us) ((int64_t) (us) / 1000)
+
+#define CHECK(condition, ...) do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s: ", __FILE__, __LINE__, #condition); \
+            fprintf(stderr, __VA_ARGS__); \
+            fputc('\n', stderr); \
+            return false; \
+        } \
+    } while (0)
+
+typedef struct scenario_link {
+    uint32_t period_ms;
+    size_t payload;
+
+    mock_caster_handle_t caster;
+    ntrip_uplink_config_t config;
+    pthread_t thread;
+    volatile bool running;
+    uint64_t start_us;
+
+    pthread_mutex_t lock;
+
+    // Источник
+    uint32_t attempts;
+    uint32_t connects;
+    uint32_t failures;
+    uint32_t disconnects;
+    int16_t reason;             // причина последнего неудачного подключения
+    int send_errno;
+    uint32_t sent;
+    uint32_t sent_disconnected;     // отправлено до последнего разрыва
+    uint32_t generated;         // номер следующего кадра по времени
+    uint64_t disconnected_us;   // обнаружение последнего разрыва
+
+    // Приём кастером
+    uint8_t *seen;
+    uint32_t received;
+    uint32_t duplicates;
+    uint32_t reordered;
+    int64_t last_seq;
+} scenario_link_t;
+
+/* Источник */
+
+static size_t scenario_frame(uint8_t *frame, size_t payload_length, uint32_t seq) {
+    uint8_t payload[RTCM3_PAYLOAD_MAX];
+    payload[0] = SCENARIO_MESSAGE_TYPE >> 4;
+    payload[1] = (SCENARIO_MESSAGE_TYPE & 0x0F) << 4;
+    payload[2] = seq >> 24;
+    payload[3] = seq >> 16;
+    payload[4] = seq >> 8;
+    payload[5] = seq;
+    for (size_t i = 6; i < payload_length; i++) payload[i] = (uint8_t) (seq + i);
+
+    return rtcm3_frame_build(frame, payload, payload_length);
+}
+
+static void *scenario_uplink_task(void *ctx) {
+    scenario_link_t *link = ctx;
+    uint8_t frame[RTCM3_FRAME_MAX];
+    uint32_t next = 0;
+
+    retry_delay_handle_t retry = retry_init(true, SCENARIO_RETRY_SHORT_COUNT, SCENARIO_RETRY_SHORT_DELAY_MS, 0);
+
+    while (link->running) {
+        retry_delay(retry);
+        if (!link->running) break;
+
+        int16_t reason;
+        int sock = ntrip_uplink_connect(&link->config, &reason);
+
+        pthread_mutex_lock(&link->lock);
+        link->attempts++;
+        if (sock < 0) {
+            link->failures++;
+            link->reason = reason;
+        } else {
+            link->connects++;
+        }
+        pthread_mutex_unlock(&link->lock);
+        if (sock < 0) continue;
+
+        int size = SCENARIO_SNDBUF;
+        setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+        retry_reset(retry);
+
+        while (link->running) {
+            uint64_t now = platform_time_us();
+            uint32_t seq = (now - link->start_us) / (link->period_ms * 1000);
+            if (seq < next) {
+                uint64_t due = link->start_us + (uint64_t) next * link->period_ms * 1000;
+                platform_sleep_ms((due - now + 999) / 1000);
+                continue;
+            }
+
+            size_t length = scenario_frame(frame, link->payload, seq);
+            int sent = ntrip_uplink_send(sock, frame, length);
+
+            pthread_mutex_lock(&link->lock);
+            if (sent < 0) {
+                link->disconnects++;
+                link->send_errno = errno;
+                link->disconnected_us = platform_time_us();
+                link->sent_disconnected = link->sent;
+            } else {
+                link->sent++;
+            }
+            link->generated = seq + 1;
+            pthread_mutex_unlock(&link->lock);
+
+            if (sent < 0) break;
+            next = seq + 1;
+        }
+
+        destroy_socket(&sock);
+    }
+
+    free(retry);
+    return NULL;
+}
+
+/* Кастер */
+
+static void scenario_caster_frame(void *ctx, const uint8_t *frame, size_t length) {
+    scenario_link_t *link = ctx;
+    if (length < RTCM3_HEADER_SIZE + 6 + RTCM3_CRC_SIZE || rtcm3_message_type(frame) != SCENARIO_MESSAGE_TYPE) return;
+
+    const uint8_t *payload = frame + RTCM3_HEADER_SIZE;
+    uint32_t seq = (uint32_t) payload[2] << 24 | (uint32_t) payload[3] << 16 | payload[4] << 8 | payload[5];
+
+    pthread_mutex_lock(&link->lock);
+    link->received++;
+    if (seq < SCENARIO_SEQ_MAX) {
+        if (link->seen[seq]) link->duplicates++;
+        link->seen[seq] = 1;
+    }
+    if ((int64_t) seq <= link->last_seq) link->reordered++;
+    link->last_seq = seq;
+    pthread_mutex_unlock(&link->lock);
+}
+
+static bool scenario_init(scenario_link_t *link, uint32_t period_ms, size_t payload) {
+    *link = (scenario_link_t) {
+            .period_ms = period_ms,
+            .payload = payload,
+            .last_seq = -1
+    };
+    pthread_mutex_init(&link->lock, NULL);
+    link->seen = calloc(SCENARIO_SEQ_MAX, 1);
+    link->caster = mock_caster_start(SCENARIO_MOUNTPOINT, SCENARIO_PASSWORD, scenario_caster_frame, link);
+    if (link->seen == NULL || link->caster == NULL) return false;
+
+    link->config = (ntrip_uplink_config_t) {
+            .host = "127.0.0.1",
+            .port = mock_caster_port(link->caster),
+            .mountpoint = SCENARIO_MOUNTPOINT,
+            .password = SCENARIO_PASSWORD,
+            .version = "test",
+            .timeout_ms = SCENARIO_TIMEOUT_MS
+    };
+
+    return true;
+}
+
+static void scenario_start(scenario_link_t *link) {
+    link->running = true;
+    link->start_us = platform_time_us();
+    pthread_create(&link->thread, NULL, scenario_uplink_task, link);
+}
+
+/// Остановка источника и кастера после приёма отправленных данных
+static void scenario_stop(scenario_link_t *link) {
+    link->running = false;
+    pthread_join(link->thread, NULL);
+
+    for (int i = 0; i < 20; i++) {
+        pthread_mutex_lock(&link->lock);
+        bool drained = link->received >= link->sent;
+        pthread_mutex_unlock(&link->lock);
+        if (drained) break;
+        platform_sleep_ms(50);
+    }
+
+    mock_caster_stop(link->caster);
+}
+
+static void scenario_free(scenario_link_t *link) {
+    pthread_mutex_destroy(&link->lock);
+    free(link->seen);
+}
+
+/// Ожидание count принятых кастером подключений, время последнего в *connected_us
+static bool scenario_wait_connections(scenario_link_t *link, uint32_t count, uint32_t timeout_ms, uint64_t *connected_us) {
+    uint64_t end = platform_time_us() + (uint64_t) timeout_ms * 1000;
+    mock_caster_stats_t stats;
+    do {
+        mock_caster_stats(link->caster, &stats);
+        if (stats.connections >= count) {
+            if (connected_us != NULL) *connected_us = stats.connected_us;
+            return true;
+        }
+        platform_sleep_ms(10);
+    } while (platform_time_us() < end);
+
+    return false;
+}
+
+static bool scenario_wait_received(scenario_link_t *link, uint32_t count, uint32_t timeout_ms) {
+    uint64_t end = platform_time_us() + (uint64_t) timeout_ms * 1000;
+    do {
+        pthread_mutex_lock(&link->lock);
+        uint32_t received = link->received;
+        pthread_mutex_unlock(&link->lock);
+        if (received >= count) return true;
+        platform_sleep_ms(10);
+    } while (platform_time_us() < end);
+
+    return false;
+}
+
+static void scenario_inject(scenario_link_t *link, mock_caster_fault_type_t type, uint32_t param,
+        const char *response, uint32_t count) {
+    mock_caster_fault_t fault = {.type = type, .param = param};
+    if (response != NULL) snprintf(fault.response, sizeof(fault.response), "%s", response);
+    mock_caster_inject(link->caster, &fault, count);
+}
+
+/// Целостность потока и границы потерь: кадры, отправленные, но не принятые, не больше
+/// буфера отправки; всего потеряно не больше кадров за время разрыва
+static bool scenario_check_stream(scenario_link_t *link, int64_t outage_ms) {
+    mock_caster_stats_t stats;
+    mock_caster_stats(link->caster, &stats);
+
+    uint32_t in_flight = link->sent - link->received;
+    uint32_t lost = link->generated - link->received;
+    uint32_t frame_size = link->payload + RTCM3_HEADER_SIZE + RTCM3_CRC_SIZE;
+    uint32_t in_flight_max = SCENARIO_SNDBUF / frame_size + 2;
+    uint32_t lost_max = in_flight_max + (outage_ms + SCENARIO_MARGIN_MS) / link->period_ms + 1;
+
+    printf("    generated %u, sent %u, received %u, lost %u (max %u), caster bytes %llu\n",
+            link->generated, link->sent, link->received, lost, lost_max, (unsigned long long) stats.bytes);
+
+    CHECK(stats.crc_errors == 0, "%u CRC errors", stats.crc_errors);
+    CHECK(link->duplicates == 0, "%u duplicate frames", link->duplicates);
+    CHECK(link->reordered == 0, "%u frames out of order", link->reordered);
+    CHECK(link->received <= link->sent, "received %u > sent %u", link->received, link->sent);
+    CHECK(in_flight <= in_flight_max, "%u sent frames lost, max %u", in_flight, in_flight_max);
+    CHECK(lost <= lost_max, "%u frames lost, max %u", lost, lost_max);
+    return true;
+}
+
+/* Сценарии */
+
+static bool scenario_baseline() {
+    scenario_link_t link;
+    CHECK(scenario_init(&link, 20, 100), "setup");
+    scenario_start(&link);
+
+    CHECK(scenario_wait_connections(&link, 1, 1000, NULL), "no connection");
+    platform_sleep_ms(2000);
+    scenario_stop(&link);
+
+    CHECK(link.failures == 0 && link.connects == 1 && link.disconnects == 0,
+            "failures %u, connects %u, disconnects %u", link.failures, link.connects, link.disconnects);
+    CHECK(link.sent >= 80, "only %u frames sent", link.sent);
+    CHECK(link.received == link.sent, "received %u of %u", link.received, link.sent);
+    bool ok = scenario_check_stream(&link, 0);
+    scenario_free(&link);
+    return ok;
+}
+
+/// Порт закрыт меньше, чем длятся короткие повторы: подключение через short_delay после открытия
+static bool scenario_refuse() {
+    scenario_link_t link;
+    CHECK(scenario_init(&link, 20, 100), "setup");
+
+    uint32_t refuse_ms = SCENARIO_RETRY_SHORT_DELAY_MS * (SCENARIO_RETRY_SHORT_COUNT - 2) + 100;
+    scenario_inject(&link, MOCK_CASTER_FAULT_REFUSE, refuse_ms, NULL, 0);
+    uint64_t refused_us = platform_time_us();
+    platform_sleep_ms(200);
+    scenario_start(&link);
+
+    uint64_t connected_us;
+    CHECK(scenario_wait_connections(&link, 1, 3000, &connected_us), "no connection");
+    int64_t recovery_ms = MS(connected_us - refused_us) - refuse_ms;
+    printf("    %u refused attempts, connected %lld ms after port reopened\n", link.failures, (long long) recovery_ms);
+    scenario_stop(&link);
+
+    CHECK(link.failures >= 1 && link.reason == EVENT_REASON_CONNECT, "failures %u, reason %d", link.failures, link.reason);
+    CHECK(recovery_ms >= 0, "connected while port closed");
+    CHECK(recovery_ms <= SCENARIO_RETRY_SHORT_DELAY_MS + SCENARIO_MARGIN_MS, "recovery %lld ms", (long long) recovery_ms);
+    bool ok = scenario_check_stream(&link, 0);
+    scenario_free(&link);
+    return ok;
+}
+
+/// Порт закрыт дольше коротких повторов: после short_count попыток задержка по таблице (1 с, в прошивке 10 с)
+static bool scenario_refuse_backoff() {
+    scenario_link_t link;
+    CHECK(scenario_init(&link, 20, 100), "setup");
+
+    scenario_inject(&link, MOCK_CASTER_FAULT_REFUSE, 1500, NULL, 0);
+    platform_sleep_ms(200);
+    scenario_start(&link);
+
+    uint64_t connected_us;
+    CHECK(scenario_wait_connections(&link, 1, 4000, &connected_us), "no connection");
+    int64_t connected_ms = MS(connected_us - link.start_us);
+    int64_t expected_ms = SCENARIO_RETRY_SHORT_DELAY_MS * (SCENARIO_RETRY_SHORT_COUNT - 1) + 1000;
+    printf("    %u refused attempts, connected after %lld ms (schedule %lld ms)\n",
+            link.failures, (long long) connected_ms, (long long) expected_ms);
+    scenario_stop(&link);
+
+    CHECK(link.failures == SCENARIO_RETRY_SHORT_COUNT, "failures %u", link.failures);
+    CHECK(connected_ms >= expected_ms - 50 && connected_ms <= expected_ms + SCENARIO_MARGIN_MS,
+            "connected after %lld ms", (long long) connected_ms);
+    scenario_free(&link);
+    return true;
+}
+
+/// Медленный ответ в пределах тайм-аута не считается ошибкой
+static bool scenario_slow_accept() {
+    scenario_link_t link;
+    CHECK(scenario_init(&link, 20, 100), "setup");
+    scenario_inject(&link, MOCK_CASTER_FAULT_SLOW_ACCEPT, SCENARIO_TIMEOUT_MS / 2, NULL, 1);
+    scenario_start(&link);
+
+    uint64_t connected_us;
+    CHECK(scenario_wait_connections(&link, 1, 3000, &connected_us), "no connection");
+    int64_t connected_ms = MS(connected_us - link.start_us);
+    printf("    connected after %lld ms\n", (long long) connected_ms);
+    platform_sleep_ms(500);
+    scenario_stop(&link);
+
+    CHECK(link.failures == 0 && link.connects == 1, "failures %u, connects %u", link.failures, link.connects);
+    CHECK(connected_ms >= SCENARIO_TIMEOUT_MS / 2, "connected after %lld ms", (long long) connected_ms);
+    bool ok = scenario_check_stream(&link, connected_ms);
+    scenario_free(&link);
+    return ok;
+}
+
+/// Ответ позже тайм-аута: ошибка RESPONSE и повтор через short_delay
+static bool scenario_slow_accept_timeout() {
+    scenario_link_t link;
+    CHECK(scenario_init(&link, 20, 100), "setup");
+    scenario_inject(&link, MOCK_CASTER_FAULT_SLOW_ACCEPT, SCENARIO_TIMEOUT_MS * 2, NULL, 1);
+    scenario_start(&link);
+
+    uint64_t connected_us;
+    CHECK(scenario_wait_connections(&link, 1, 4000, &connected_us), "no connection");
+    int64_t connected_ms = MS(connected_us - link.start_us);
+    int64_t expected_ms = SCENARIO_TIMEOUT_MS + SCENARIO_RETRY_SHORT_DELAY_MS;
+    printf("    connected after %lld ms (expected %lld ms)\n", (long long) connected_ms, (long long) expected_ms);
+    scenario_stop(&link);
+
+    CHECK(link.failures == 1 && link.reason == EVENT_REASON_RESPONSE, "failures %u, reason %d", link.failures, link.reason);
+    CHECK(connected_ms >= expected_ms - 50 && connected_ms <= expected_ms + SCENARIO_MARGIN_MS,
+            "connected after %lld ms", (long long) connected_ms);
+    scenario_free(&link);
+    return true;
+}
+
+/// Кастер принимает соединение и молчит: каждая попытка завершается по тайм-ауту ответа
+static bool scenario_half_open() {
+    scenario_link_t link;
+    CHECK(scenario_init(&link, 20, 100), "setup");
+    scenario_inject(&link, MOCK_CASTER_FAULT_HALF_OPEN, 0, NULL, 2);
+    scenario_start(&link);
+
+    uint64_t connected_us;
+    CHECK(scenario_wait_connections(&link, 1, 5000, &connected_us), "no connection");
+    int64_t connected_ms = MS(connected_us - link.start_us);
+    int64_t expected_ms = 2 * (SCENARIO_TIMEOUT_MS + SCENARIO_RETRY_SHORT_DELAY_MS);
+    printf("    connected after %lld ms (expected %lld ms)\n", (long long) connected_ms, (long long) expected_ms);
+    scenario_stop(&link);
+
+    CHECK(link.failures == 2 && link.reason == EVENT_REASON_RESPONSE, "failures %u, reason %d", link.failures, link.reason);
+    CHECK(connected_ms <= expected_ms + SCENARIO_MARGIN_MS, "connected after %lld ms", (long long) connected_ms);
+    scenario_free(&link);
+    return true;
+}
+
+/// Разрыв посреди потока: обнаружение при отправке и переподключение без задержки
+static bool scenario_reset_check(scenario_link_t *link) {
+    uint64_t connected_us;
+    CHECK(scenario_wait_connections(link, 2, 5000, &connected_us), "no reconnection");
+    pthread_mutex_lock(&link->lock);
+    int64_t recovery_ms = MS(connected_us - link->disconnected_us);
+    int send_errno = link->send_errno;
+    pthread_mutex_unlock(&link->lock);
+    printf("    disconnect detected (%s), reconnected in %lld ms\n", strerror(send_errno), (long long) recovery_ms);
+
+    CHECK(scenario_wait_received(link, link->received + 20, 2000), "no data after reconnection");
+    scenario_stop(link);
+
+    CHECK(link->disconnects == 1 && link->connects == 2 && link->failures == 0,
+            "disconnects %u, connects %u, failures %u", link->disconnects, link->connects, link->failures);
+    CHECK(recovery_ms <= SCENARIO_MARGIN_MS, "recovery %lld ms", (long long) recovery_ms);
+    return scenario_check_stream(link, recovery_ms + SCENARIO_MARGIN_MS);
+}
+
+static bool scenario_reset() {
+    scenario_link_t link;
+    CHECK(scenario_init(&link, 10, 100), "setup");
+    scenario_inject(&link, MOCK_CASTER_FAULT_RESET, 20000, NULL, 1);
+    scenario_start(&link);
+
+    bool ok = scenario_reset_check(&link);
+    scenario_free(&link);
+    return ok;
+}
+
+/// Кастер перезапущен: все соединения сброшены снаружи
+static bool scenario_drop() {
+    scenario_link_t link;
+    CHECK(scenario_init(&link, 10, 100), "setup");
+    scenario_start(&link);
+
+    CHECK(scenario_wait_connections(&link, 1, 1000, NULL), "no connection");
+    platform_sleep_ms(1000);
+    mock_caster_drop(link.caster);
+
+    bool ok = scenario_reset_check(&link);
+    scenario_free(&link);
+    return ok;
+}
+
+/// Кастер перестал читать: буферы заполняются, отправка завершается по тайм-ауту
+static bool scenario_stalled_reader() {
+    scenario_link_t link;
+    CHECK(scenario_init(&link, 5, 1000), "setup");
+    scenario_inject(&link, MOCK_CASTER_FAULT_SLOW_READER, 0, NULL, 1);
+    scenario_start(&link);
+
+    CHECK(scenario_wait_connections(&link, 1, 1000, NULL), "no connection");
+    uint64_t connected_us;
+    CHECK(scenario_wait_connections(&link, 2, 10000, &connected_us), "stall not detected");
+    pthread_mutex_lock(&link.lock);
+    int64_t detected_ms = MS(link.disconnected_us - link.start_us);
+    int64_t recovery_ms = MS(connected_us - link.disconnected_us);
+    int send_errno = link.send_errno;
+    pthread_mutex_unlock(&link.lock);
+    printf("    stall detected after %lld ms (%s), reconnected in %lld ms\n",
+            (long long) detected_ms, strerror(send_errno), (long long) recovery_ms);
+
+    CHECK(scenario_wait_received(&link, 20, 2000), "no data after reconnection");
+    scenario_stop(&link);
+
+    CHECK(send_errno == EAGAIN || send_errno == EWOULDBLOCK, "send error %s", strerror(send_errno));
+    CHECK(link.disconnects == 1 && link.connects == 2, "disconnects %u, connects %u", link.disconnects, link.connects);
+    CHECK(recovery_ms <= SCENARIO_MARGIN_MS, "recovery %lld ms", (long long) recovery_ms);
+    // Всё отправленное в остановленное соединение потеряно, после переподключения - ничего
+    CHECK(link.received == link.sent - link.sent_disconnected, "received %u, sent after reconnection %u",
+            link.received, link.sent - link.sent_disconnected);
+    scenario_free(&link);
+    return true;
+}
+
+/// Кастер читает медленнее, чем поступают данные: поток целый, без повторов и перестановок
+static bool scenario_slow_reader() {
+    scenario_link_t link;
+    CHECK(scenario_init(&link, 10, 100), "setup");
+    scenario_inject(&link, MOCK_CASTER_FAULT_SLOW_READER, 5000, NULL, 1);
+    scenario_start(&link);
+
+    CHECK(scenario_wait_connections(&link, 1, 1000, NULL), "no connection");
+    platform_sleep_ms(3000);
+    link.running = false;
+    pthread_join(link.thread, NULL);
+
+    mock_caster_stats_t stats;
+    mock_caster_stats(link.caster, &stats);
+    printf("    offered %u frames, caster read %llu bytes, disconnects %u\n",
+            link.generated, (unsigned long long) stats.bytes, link.disconnects);
+    mock_caster_stop(link.caster);
+
+    CHECK(stats.crc_errors == 0, "%u CRC errors", stats.crc_errors);
+    CHECK(link.duplicates == 0 && link.reordered == 0, "duplicates %u, reordered %u", link.duplicates, link.reordered);
+    CHECK(link.received > 0 && link.received < link.generated, "received %u of %u", link.received, link.generated);
+    scenario_free(&link);
+    return true;
+}
+
+/// Ответ кастера, принятый за отказ: одна неудачная попытка, затем обычное подключение
+static bool scenario_malformed() {
+    static const struct {
+        const char *response;
+        uint32_t split;
+        int16_t reason;
+    } variants[] = {
+            {"HTTP/1.1 401 Unauthorized\r\n\r\n", 0, EVENT_REASON_REJECTED},
+            {"ERROR - Bad Password\r\n", 0, EVENT_REASON_REJECTED},
+            {"SOURCETABLE 200 OK\r\n\r\n", 0, EVENT_REASON_REJECTED},
+            {"ICY 404 Not Found\r\n", 0, EVENT_REASON_REJECTED},
+            {"\xd3\x01\x13" "binary\r\n", 0, EVENT_REASON_REJECTED},
+            {"\r\n", 0, EVENT_REASON_REJECTED},
+            {"ICY 200 OK", 0, EVENT_REASON_REJECTED},    // без конца строки: ожидание до тайм-аута
+            {"", 0, EVENT_REASON_RESPONSE},
+    };
+
+    for (int i = 0; i < sizeof(variants) / sizeof(variants[0]); i++) {
+        scenario_link_t link;
+        CHECK(scenario_init(&link, 20, 100), "setup");
+        scenario_inject(&link, MOCK_CASTER_FAULT_RESPONSE, variants[i].split, variants[i].response, 1);
+        scenario_start(&link);
+
+        uint64_t connected_us = link.start_us;
+        bool connected = scenario_wait_connections(&link, 1, 3000, &connected_us);
+        int64_t connected_ms = MS(connected_us - link.start_us);
+        scenario_stop(&link);
+
+        printf("    %-36.*s failures %u, reason %d, connected after %lld ms\n",
+                (int) strcspn(variants[i].response, "\r\n"), variants[i].response,
+                link.failures, link.reason, (long long) connected_ms);
+        CHECK(connected, "variant %d: no connection", i);
+        CHECK(link.failures == 1 && link.reason == variants[i].reason,
+                "variant %d: failures %u, reason %d", i, link.failures, link.reason);
+        CHECK(connected_ms <= SCENARIO_TIMEOUT_MS + SCENARIO_RETRY_SHORT_DELAY_MS + SCENARIO_MARGIN_MS,
+                "variant %d: connected after %lld ms", i, (long long) connected_ms);
+        scenario_free(&link);
+    }
+
+    return true;
+}
+
+/// Варианты положительного ответа, в том числе разбитые на сегменты
+static bool scenario_icy_variants() {
+    static const struct {
+        const char *response;
+        uint32_t split;
+    } variants[] = {
+            {"ICY 200 OK\r\n", 0},
+            {"ICY 200 OK\r\n\r\n", 0},
+            {"OK\r\n", 0},
+            {"HTTP/1.1 200 OK\r\nNtrip-Version: Ntrip/2.0\r\nConnection: close\r\n\r\n", 0},
+            {"ICY 200 OK\r\n\r\n", 4},
+            {"ICY 200 OK\r\n\r\n", 11},      // между CR и LF
+    };
+
+    for (int i = 0; i < sizeof(variants) / sizeof(variants[0]); i++) {
+        scenario_link_t link;
+        CHECK(scenario_init(&link, 20, 100), "setup");
+        scenario_inject(&link, MOCK_CASTER_FAULT_RESPONSE, variants[i].split, variants[i].response, 1);
+        scenario_start(&link);
+
+        bool received = scenario_wait_received(&link, 10, 2000);
+        scenario_stop(&link);
+
+        printf("    %-36.*s split %u: connects %u, failures %u, received %u\n",
+                (int) strcspn(variants[i].response, "\r\n"), variants[i].response, variants[i].split,
+                link.connects, link.failures, link.received);
+        CHECK(received, "variant %d: no data", i);
+        CHECK(link.connects == 1 && link.failures == 0, "variant %d: connects %u, failures %u",
+                i, link.connects, link.failures);
+        CHECK(link.received == link.sent, "variant %d: received %u of %u", i, link.received, link.sent);
+        scenario_free(&link);
+    }
+
+    return true;
+}
+
+/// Расписание retry_delay: первая попытка сразу, short_count коротких, затем таблица с ограничением max_delay
+static bool scenario_retry_schedule() {
+    static const struct {
+        bool first_instant;
+        uint8_t short_count;
+        int short_delay;
+        int max_delay;
+        int expected[5];
+    } schedules[] = {
+            {true, 3, 100, 0, {0, 100, 100, 1000, 2000}},
+            {false, 1, 50, 0, {50, 1000, 2000}},
+            {false, 0, 0, 300, {300, 300, 300}},
+            {true, 2, 1500, 0, {0, 1500, 2000}},
+    };
+
+    for (int i = 0; i < sizeof(schedules) / sizeof(schedules[0]); i++) {
+        retry_delay_handle_t retry = retry_init(schedules[i].first_instant, schedules[i].short_count,
+                schedules[i].short_delay, schedules[i].max_delay);
+        CHECK(retry != NULL, "retry_init");
+
+        printf("    schedule %d:", i);
+        for (int k = 0; k < 5; k++) {
+            int expected = schedules[i].expected[k];
+            if (expected == 0 && k > 0) break;
+
+            uint64_t start = platform_time_us();
+            int attempts = retry_delay(retry);
+            int64_t elapsed = MS(platform_time_us() - start);
+            printf(" %lld", (long long) elapsed);
+
+            CHECK(attempts == k + 1, "schedule %d: attempts %d", i, attempts);
+            CHECK(elapsed >= expected && elapsed <= expected + 50,
+                    "schedule %d, attempt %d: %lld ms, expected %d ms", i, k, (long long) elapsed, expected);
+        }
+        printf("\n");
+
+        // После retry_reset расписание начинается заново
+        retry_reset(retry);
+        uint64_t start = platform_time_us();
+        retry_delay(retry);
+        int64_t elapsed = MS(platform_time_us() - start);
+        int expected = schedules[i].expected[0];
+        CHECK(elapsed >= expected && elapsed <= expected + 50, "schedule %d after reset: %lld ms", i, (long long) elapsed);
+        free(retry);
+    }
+
+    return true;
+}
+
+/* Протокол NTRIP 1.0/2.0 кастера */
+
+/// Запрос и чтение ответа до пустой строки, остаток данных в *body
+static bool scenario_request(uint16_t port, const char *request, char *response, size_t size, int *sock, size_t *body) {
+    *sock = connect_socket("127.0.0.1", port, SOCK_STREAM);
+    if (*sock < 0 || ntrip_uplink_send(*sock, request, strlen(request)) < 0) return false;
+
+    size_t used = 0;
+    response[0] = '\0';
+    char *end;
+    while ((end = strstr(response, "\r\n\r\n")) == NULL && used < size - 1) {
+        int n = recv(*sock, response + used, size - 1 - used, 0);
+        if (n <= 0) break;
+        used += n;
+        response[used] = '\0';
+    }
+
+    *body = end != NULL ? end + 4 - response : used;
+    return used > 0;
+}
+
+static bool scenario_response_line(const char *response, const char *expected) {
+    return strncmp(response, expected, strlen(expected)) == 0;
+}
+
+/// Приём потока клиентом, для NTRIP 2.0 с разбором chunked
+static uint32_t scenario_client_frames(int sock, bool chunked, const char *initial, size_t initial_length) {
+    rtcm3_framer_t framer;
+    rtcm3_framer_init(&framer, NULL, NULL);
+
+    char buffer[8192];
+    size_t used = initial_length;
+    memcpy(buffer, initial, initial_length);
+    size_t chunk = 0;           // осталось байт данных текущего куска
+
+    uint64_t end = platform_time_us() + 1000000;
+    while (platform_time_us() < end) {
+        size_t offset = 0;
+        while (offset < used) {
+            if (!chunked) {
+                rtcm3_framer_feed(&framer, (uint8_t *) buffer + offset, used - offset);
+                offset = used;
+            } else if (chunk > 0) {
+                size_t n = MIN(chunk, used - offset);
+                rtcm3_framer_feed(&framer, (uint8_t *) buffer + offset, n);
+                offset += n;
+                chunk -= n;
+            } else {
+                // Конец предыдущего куска и строка размера следующего
+                char *line = memmem(buffer + offset, used - offset, "\r\n", 2);
+                if (line == NULL) break;
+                if (line != buffer + offset) chunk = strtoul(buffer + offset, NULL, 16);
+                offset = line + 2 - buffer;
+            }
+        }
+        memmove(buffer, buffer + offset, used - offset);
+        used -= offset;
+
+        int n = recv(sock, buffer + used, sizeof(buffer) - used, 0);
+        if (n <= 0) break;
+        used += n;
+    }
+
+    return framer.crc_errors == 0 ? framer.frames : 0;
+}
+
+static bool scenario_ntrip_protocol() {
+    scenario_link_t link;
+    CHECK(scenario_init(&link, 20, 100), "setup");
+    scenario_start(&link);
+    CHECK(scenario_wait_connections(&link, 1, 1000, NULL), "no connection");
+    uint16_t port = link.config.port;
+
+    char response[1024];
+    int sock;
+    size_t body;
+
+    // Таблица источников
+    CHECK(scenario_request(port, "GET / HTTP/1.0\r\nUser-Agent: NTRIP test\r\n\r\n", response, sizeof(response), &sock, &body),
+            "sourcetable 1.0");
+    // Таблица может прийти отдельно от заголовка
+    size_t used = strlen(response);
+    while (strstr(response + body, "ENDSOURCETABLE") == NULL && used < sizeof(response) - 1) {
+        int n = recv(sock, response + used, sizeof(response) - 1 - used, 0);
+        if (n <= 0) break;
+        used += n;
+        response[used] = '\0';
+    }
+    destroy_socket(&sock);
+    CHECK(ntrip_response_sourcetable_ok(response), "sourcetable 1.0: %s", response);
+
+    ntrip_sourcetable_stream_t stream;
+    const char *cursor = response + body;
+    CHECK(ntrip_sourcetable_next(&cursor, response + strlen(response), &stream), "no STR record: %s", response);
+    CHECK(stream.mountpoint.length == strlen(SCENARIO_MOUNTPOINT)
+            && memcmp(stream.mountpoint.data, SCENARIO_MOUNTPOINT, stream.mountpoint.length) == 0
+            && stream.authentication == 'B' && !stream.nmea, "STR record: %s", response);
+    CHECK(!ntrip_sourcetable_next(&cursor, response + strlen(response), &stream), "records after the first");
+
+    CHECK(scenario_request(port, "GET / HTTP/1.1\r\nHost: localhost\r\nNtrip-Version: Ntrip/2.0\r\n\r\n",
+            response, sizeof(response), &sock, &body), "sourcetable 2.0");
+    destroy_socket(&sock);
+    CHECK(ntrip_response_sourcetable_ok(response) && strstr(response, "gnss/sourcetable") != NULL,
+            "sourcetable 2.0: %s", response);
+
+    // Клиенты получают поток источника
+    CHECK(scenario_request(port, "GET /" SCENARIO_MOUNTPOINT " HTTP/1.0\r\nUser-Agent: NTRIP test\r\n\r\n",
+            response, sizeof(response), &sock, &body), "client 1.0");
+    CHECK(scenario_response_line(response, "ICY 200 OK"), "client 1.0: %s", response);
+    uint32_t frames = scenario_client_frames(sock, false, response + body, strlen(response + body));
+    destroy_socket(&sock);
+    printf("    client 1.0: %u frames\n", frames);
+    CHECK(frames >= 20, "client 1.0: %u frames", frames);
+
+    CHECK(scenario_request(port, "GET /" SCENARIO_MOUNTPOINT " HTTP/1.1\r\nHost: localhost\r\n"
+            "Ntrip-Version: Ntrip/2.0\r\n\r\n", response, sizeof(response), &sock, &body), "client 2.0");
+    CHECK(scenario_response_line(response, "HTTP/1.1 200 OK") && strstr(response, "Transfer-Encoding: chunked") != NULL,
+            "client 2.0: %s", response);
+    frames = scenario_client_frames(sock, true, response + body, strlen(response + body));
+    destroy_socket(&sock);
+    printf("    client 2.0: %u frames\n", frames);
+    CHECK(frames >= 20, "client 2.0: %u frames", frames);
+
+    CHECK(scenario_request(port, "GET /OTHER HTTP/1.0\r\n\r\n", response, sizeof(response), &sock, &body), "unknown");
+    destroy_socket(&sock);
+    CHECK(!ntrip_response_ok(response), "unknown mountpoint: %s", response);
+
+    // Источники NTRIP 2.0 (user:test) и неверные пароли
+    CHECK(scenario_request(port, "POST /" SCENARIO_MOUNTPOINT " HTTP/1.1\r\nHost: localhost\r\n"
+            "Ntrip-Version: Ntrip/2.0\r\nAuthorization: Basic dXNlcjp0ZXN0\r\n\r\n",
+            response, sizeof(response), &sock, &body), "source 2.0");
+    destroy_socket(&sock);
+    CHECK(ntrip_response_ok(response), "source 2.0: %s", response);
+
+    CHECK(scenario_request(port, "POST /" SCENARIO_MOUNTPOINT " HTTP/1.1\r\nHost: localhost\r\n"
+            "Ntrip-Version: Ntrip/2.0\r\nAuthorization: Basic dXNlcjp3cm9uZw==\r\n\r\n",
+            response, sizeof(response), &sock, &body), "source 2.0 password");
+    destroy_socket(&sock);
+    CHECK(scenario_response_line(response, "HTTP/1.1 401"), "source 2.0 password: %s", response);
+
+    CHECK(scenario_request(port, "SOURCE wrong /" SCENARIO_MOUNTPOINT "\r\n\r\n",
+            response, sizeof(response), &sock, &body), "source 1.0 password");
+    destroy_socket(&sock);
+    CHECK(!ntrip_response_ok(response), "source 1.0 password: %s", response);
+
+    // Потоки кастера считают соединения после отправки ответа
+    mock_caster_stats_t stats;
+    for (int i = 0; i < 100; i++) {
+        mock_caster_stats(link.caster, &stats);
+        if (stats.clients == 2 && stats.connections == 2 && stats.rejected == 3) break;
+        platform_sleep_ms(10);
+    }
+    scenario_stop(&link);
+    CHECK(stats.clients == 2 && stats.connections == 2 && stats.rejected == 3,
+            "clients %u, connections %u, rejected %u", stats.clients, stats.connections, stats.rejected);
+    CHECK(link.disconnects == 0, "source disconnected %u times", link.disconnects);
+    scenario_free(&link);
+    return true;
+}
+
+static const struct {
+    const char *name;
+    bool (*run)();
+} scenarios[] = {
+        {"baseline", scenario_baseline},
+        {"refuse", scenario_refuse},
+        {"refuse_backoff", scenario_refuse_backoff},
+        {"slow_accept", scenario_slow_accept},
+        {"slow_accept_timeout", scenario_slow_accept_timeout},
+        {"half_open", scenario_half_open},
+        {"reset", scenario_reset},
+        {"drop", scenario_drop},
+        {"stalled_reader", scenario_stalled_reader},
+        {"slow_reader", scenario_slow_reader},
+        {"malformed", scenario_malformed},
+        {"icy_variants", scenario_icy_variants},
+        {"retry_schedule", scenario_retry_schedule},
+        {"ntrip_protocol", scenario_ntrip_protocol},
+};
+
+int main(int argc, char **argv) {
+    int count = sizeof(scenarios) / sizeof(scenarios[0]);
+    int run = 0, failed = 0;
+
+
+    for (int i = 0; i < count; i++) {
+        if (argc > 1 && strcmp(argv[1], scenarios[i].name) != 0) continue;
+
+        printf("%s\n", scenarios[i].name);
+        fflush(stdout);
+        bool ok = scenarios[i].run();
+        printf("%s: %s\n", scenarios[i].name, ok ? "PASS" : "FAIL");
+        fflush(stdout);
+
+        run++;
+        if (!ok) failed++;
+    }
+
+    if (run == 0) {
+        fprintf(stderr, "Unknown scenario %s\n", argv[1]);
+        return 2;
+    }
+
+    return failed > 0 ? 1 : 0;
+}
@@ -28,6 +28,7 @@
 #include <esp_err.h>
 #include <nvs_flash.h>
 #include <esp_log.h>
+#include <stdio.h>
 #include <string.h>
 #include <driver/uart.h>
 #include <esp_wifi_types.h>
@@ -36,6 +37,10 @@
 #include <tasks.h>
 #include "config.h"
 #include <esp_netif.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
 
 // Определения GPIO пинов UART по умолчанию для различных типов чипов ESP32
 #ifdef CONFIG_IDF_TARGET_ESP32
@@ -70,328 +75,66 @@ static const char *TAG = "CONFIG";          // Тег для логирован
 static const char *STORAGE = "config";      // Имя пространства NVS для хранения конфигурации
 
 nvs_handle_t config_handle;                     // Дескриптор хранилища NVS для работы с конфигурацией
+static SemaphoreHandle_t config_write_mutex;    // Запись в config_handle, фиксация и подмена дескриптора профиля
+
+static const char *PROFILES_STORAGE = "profiles";   // Пространство NVS с именами профилей и активным профилем
+#define PROFILE_KEY_ACTIVE "active"
+#define PROFILE_NAME_DEFAULT "Default"
+
+static nvs_handle_t profiles_handle;
+static nvs_handle_t profile_handles[CONFIG_PROFILE_MAX];   // Открываются по требованию и не закрываются
+static bool profile_handles_open[CONFIG_PROFILE_MAX];
+static int profile_active = 0;
+
+/// Снимок значений конфигурации в RAM, индексируется KEY_CONFIG_xxx_ID
+/// Снимок неизменяем после публикации: при config_commit собирается новый и подменяется указатель
+/// Освобождается, когда отпущена последняя ссылка: активный снимок, уведомление или читатель строк
+struct config_snapshot {
+    uint32_t refs;
+    config_item_value_t values[CONFIG_ITEM_COUNT];
+};
 
-/// Таблица элементов конфигурации ESP32 NTRIP Duo
-/// Содержит все настройки устройства с их типами данных и значениями по умолчанию
-/// Каждый элемент включает ключ, тип данных, значение по умолчанию и флаг секретности
-const config_item_t CONFIG_ITEMS[] = {
-        // ==================== Параметры администратора ====================
-        {
-                .key = KEY_CONFIG_ADMIN_AUTH,               // Тип авторизации администратора
-                .type = CONFIG_ITEM_TYPE_INT8,
-                .def.int8 = 0                               // 0 = без авторизации
-        },
-        {
-                .key = KEY_CONFIG_ADMIN_USERNAME,           // Имя пользователя администратора
-                .type = CONFIG_ITEM_TYPE_STRING,
-                .def.str = ""                               // Пустое по умолчанию
-        }, {
-                .key = KEY_CONFIG_ADMIN_PASSWORD,           // Пароль администратора  
-                .type = CONFIG_ITEM_TYPE_STRING,
-                .secret = true,                             // Секретное поле - не показывать в веб-интерфейсе
-                .def.str = ""                               // Пустой по умолчанию
-        },
-
-        // ==================== Параметры Bluetooth ====================
-        {
-                .key = KEY_CONFIG_BLUETOOTH_ACTIVE,         // Включить/выключить Bluetooth
-                .type = CONFIG_ITEM_TYPE_BOOL,
-                .def.bool1 = false                          // По умолчанию отключен
-        }, {
-                .key = KEY_CONFIG_BLUETOOTH_DEVICE_NAME,    // Имя Bluetooth устройства
-                .type = CONFIG_ITEM_TYPE_STRING,
-                .def.str = ""                               // Пустое по умолчанию
-        }, {
-                .key = KEY_CONFIG_BLUETOOTH_DEVICE_DISCOVERABLE, // Видимость Bluetooth устройства
-                .type = CONFIG_ITEM_TYPE_BOOL,
-                .def.bool1 = true                           // По умолчанию видимое
-        }, {
-                .key = KEY_CONFIG_BLUETOOTH_PIN_CODE,       // PIN-код для сопряжения
-                .type = CONFIG_ITEM_TYPE_UINT16,
-                .secret = true,                             // Секретное поле
-                .def.uint16 = 1234                          // Стандартный PIN по умолчанию
-        },
-
-        // ==================== ПЕРВИЧНЫЙ NTRIP СЕРВЕР ====================
-        {
-                .key = KEY_CONFIG_NTRIP_SERVER_ACTIVE,      // Включить/выключить первичный NTRIP сервер
-                .type = CONFIG_ITEM_TYPE_BOOL,
-                .def.bool1 = false                          // По умолчанию отключен
-        }, {
-                .key = KEY_CONFIG_NTRIP_SERVER_COLOR,       // Цвет статусного светодиода первичного сервера
-                .type = CONFIG_ITEM_TYPE_COLOR,
-                .def.color.rgba = 0x00000055u               // Тёмно-синий с прозрачностью
-        }, {
-                .key = KEY_CONFIG_NTRIP_SERVER_HOST,        // Адрес NTRIP кастера (например, rtk.onocoy.com)
-                .type = CONFIG_ITEM_TYPE_STRING,
-                .def.str = ""                               // Пустой по умолчанию - должен быть настроен
-        }, {
-                .key = KEY_CONFIG_NTRIP_SERVER_PORT,        // Порт NTRIP кастера
-                .type = CONFIG_ITEM_TYPE_UINT16,
-                .def.uint16 = 2101                          // Стандартный порт NTRIP
-        }, {
-                .key = KEY_CONFIG_NTRIP_SERVER_MOUNTPOINT,  // Точка подключения (mountpoint) на кастере
-                .type = CONFIG_ITEM_TYPE_STRING,
-                .def.str = ""                               // Пустая по умолчанию - должна быть настроена
-        }, {
-                .key = KEY_CONFIG_NTRIP_SERVER_USERNAME,    // Имя пользователя для аутентификации на кастере
-                .type = CONFIG_ITEM_TYPE_STRING,
-                .def.str = ""                               // Пустое по умолчанию
-        }, {
-                .key = KEY_CONFIG_NTRIP_SERVER_PASSWORD,    // Пароль для аутентификации на кастере
-                .type = CONFIG_ITEM_TYPE_STRING,
-                .secret = true,                             // Секретное поле
-                .def.str = ""                               // Пустой по умолчанию
-        },
+static config_snapshot_t *config_snapshot = NULL;          // Активный снимок
+static portMUX_TYPE config_snapshot_mux = portMUX_INITIALIZER_UNLOCKED; // Указатель на снимок и счётчики ссылок
+static SemaphoreHandle_t config_snapshot_lock;             // Защита списка наблюдателей
 
-        // ==================== ВТОРИЧНЫЙ NTRIP СЕРВЕР ====================
-        {
-                .key = KEY_CONFIG_NTRIP_SERVER_2_ACTIVE,    // Включить/выключить вторичный NTRIP сервер
-                .type = CONFIG_ITEM_TYPE_BOOL,
-                .def.bool1 = false                          // По умолчанию отключен
-        }, {
-                .key = KEY_CONFIG_NTRIP_SERVER_2_COLOR,     // Цвет статусного светодиода вторичного сервера
-                .type = CONFIG_ITEM_TYPE_COLOR,
-                .def.color.rgba = 0x00000055u               // Тёмно-синий с прозрачностью
-        }, {
-                .key = KEY_CONFIG_NTRIP_SERVER_2_HOST,      // Адрес второго NTRIP кастера
-                .type = CONFIG_ITEM_TYPE_STRING,
-                .def.str = ""                               // Пустой по умолчанию
-        }, {
-                .key = KEY_CONFIG_NTRIP_SERVER_2_PORT,      // Порт второго NTRIP кастера
-                .type = CONFIG_ITEM_TYPE_UINT16,
-                .def.uint16 = 2101                          // Стандартный порт NTRIP
-        }, {
-                .key = KEY_CONFIG_NTRIP_SERVER_2_MOUNTPOINT, // Точка подключения на втором кастере
-                .type = CONFIG_ITEM_TYPE_STRING,
-                .def.str = ""                               // Пустая по умолчанию
-        }, {
-                .key = KEY_CONFIG_NTRIP_SERVER_2_USERNAME,  // Имя пользователя для второго кастера
-                .type = CONFIG_ITEM_TYPE_STRING,
-                .def.str = ""                               // Пустое по умолчанию
-        }, {
-                .key = KEY_CONFIG_NTRIP_SERVER_2_PASSWORD,  // Пароль для второго кастера
-                .type = CONFIG_ITEM_TYPE_STRING,
-                .secret = true,                             // Секретное поле
-                .def.str = ""
-        },
+#define CONFIG_OBSERVERS_MAX 8
+#define CONFIG_NOTIFY_QUEUE_LENGTH 4
 
-        {
-                .key = KEY_CONFIG_NTRIP_CLIENT_ACTIVE,
-                .type = CONFIG_ITEM_TYPE_BOOL,
-                .def.bool1 = false
-        }, {
-                .key = KEY_CONFIG_NTRIP_CLIENT_COLOR,
-                .type = CONFIG_ITEM_TYPE_COLOR,
-                .def.color.rgba = 0x00000055u
-        }, {
-                .key = KEY_CONFIG_NTRIP_CLIENT_HOST,
-                .type = CONFIG_ITEM_TYPE_STRING,
-                .def.str = ""
-        }, {
-                .key = KEY_CONFIG_NTRIP_CLIENT_PORT,
-                .type = CONFIG_ITEM_TYPE_UINT16,
-                .def.uint16 = 2101
-        }, {
-                .key = KEY_CONFIG_NTRIP_CLIENT_MOUNTPOINT,
-                .type = CONFIG_ITEM_TYPE_STRING,
-                .def.str = ""
-        }, {
-                .key = KEY_CONFIG_NTRIP_CLIENT_USERNAME,
-                .type = CONFIG_ITEM_TYPE_STRING,
-                .def.str = ""
-        }, {
-                .key = KEY_CONFIG_NTRIP_CLIENT_PASSWORD,
-                .type = CONFIG_ITEM_TYPE_STRING,
-                .secret = true,
-                .def.str = ""
-        },
+typedef struct config_observer_entry {
+    uint32_t groups;
+    config_observer_t observer;
+    void *arg;
+} config_observer_entry_t;
 
-        // UART
-        {
-                .key = KEY_CONFIG_UART_NUM,
-                .type = CONFIG_ITEM_TYPE_UINT8,
-                .def.uint8 = UART_NUM_0
-        }, {
-                .key = KEY_CONFIG_UART_TX_PIN,
-                .type = CONFIG_ITEM_TYPE_UINT8,
-                .def.uint8 = DEFAULT_UART_TX_PIN
-        }, {
-                .key = KEY_CONFIG_UART_RX_PIN,
-                .type = CONFIG_ITEM_TYPE_UINT8,
-                .def.uint8 = DEFAULT_UART_RX_PIN
-        }, {
-                .key = KEY_CONFIG_UART_RTS_PIN,
-                .type = CONFIG_ITEM_TYPE_UINT8,
-                .def.uint8 = DEFAULT_UART_RTS_PIN
-        }, {
-                .key = KEY_CONFIG_UART_CTS_PIN,
-                .type = CONFIG_ITEM_TYPE_UINT8,
-                .def.uint8 = DEFAULT_UART_CTS_PIN
-        }, {
-                .key = KEY_CONFIG_UART_BAUD_RATE,
-                .type = CONFIG_ITEM_TYPE_UINT32,
-                .def.uint32 = 115200
-        }, {
-                .key = KEY_CONFIG_UART_DATA_BITS,
-                .type = CONFIG_ITEM_TYPE_INT8,
-                .def.int8 = UART_DATA_8_BITS
-        }, {
-                .key = KEY_CONFIG_UART_STOP_BITS,
-                .type = CONFIG_ITEM_TYPE_INT8,
-                .def.int8 = UART_STOP_BITS_1
-        }, {
-                .key = KEY_CONFIG_UART_PARITY,
-                .type = CONFIG_ITEM_TYPE_INT8,
-                .def.int8 = UART_PARITY_DISABLE
-        }, {
-                .key = KEY_CONFIG_UART_FLOW_CTRL_RTS,
-                .type = CONFIG_ITEM_TYPE_BOOL,
-                .def.bool1 = false
-        }, {
-                .key = KEY_CONFIG_UART_FLOW_CTRL_CTS,
-                .type = CONFIG_ITEM_TYPE_BOOL,
-                .def.bool1 = false
-        }, {
-                .key = KEY_CONFIG_UART_LOG_FORWARD,
-                .type = CONFIG_ITEM_TYPE_BOOL,
-                .def.bool1 = false
-        },
+/// Уведомление об одной замене снимка, владеет старым снимком до завершения доставки
+typedef struct config_notification {
+    config_snapshot_t *old_snapshot;
+    config_snapshot_t *new_snapshot;
+} config_notification_t;
 
-        // WiFi
-        {
-                .key = KEY_CONFIG_WIFI_AP_ACTIVE,
-                .type = CONFIG_ITEM_TYPE_BOOL,
-                .def.bool1 = true
-        }, {
-                .key = KEY_CONFIG_WIFI_AP_COLOR,
-                .type = CONFIG_ITEM_TYPE_COLOR,
-                .def.color.rgba = 0x00000055u
-        }, {
-                .key = KEY_CONFIG_WIFI_AP_SSID,
-                .type = CONFIG_ITEM_TYPE_STRING,
-                .def.str = ""
-        }, {
-                .key = KEY_CONFIG_WIFI_AP_SSID_HIDDEN,
-                .type = CONFIG_ITEM_TYPE_BOOL,
-                .def.bool1 = false
-        }, {
-                .key = KEY_CONFIG_WIFI_AP_AUTH_MODE,
-                .type = CONFIG_ITEM_TYPE_UINT8,
-                .def.uint8 = WIFI_AUTH_OPEN
-        }, {
-                .key = KEY_CONFIG_WIFI_AP_PASSWORD,
-                .type = CONFIG_ITEM_TYPE_STRING,
-                .secret = true,
-                .def.str = ""
-        }, {
-                .key = KEY_CONFIG_WIFI_AP_GATEWAY,
-                .type = CONFIG_ITEM_TYPE_IP,
-                .def.uint32 = esp_netif_htonl(esp_netif_ip4_makeu32(192, 168, 4, 1))
-        }, {
-                .key = KEY_CONFIG_WIFI_AP_SUBNET,
-                .type = CONFIG_ITEM_TYPE_UINT8,
-                .def.uint8 = 24
-        }, {
-                .key = KEY_CONFIG_WIFI_STA_ACTIVE,
-                .type = CONFIG_ITEM_TYPE_BOOL,
-                .def.bool1 = false
-        }, {
-                .key = KEY_CONFIG_WIFI_STA_COLOR,
-                .type = CONFIG_ITEM_TYPE_COLOR,
-                .def.color.rgba = 0x0044ff55u
-        }, {
-                .key = KEY_CONFIG_WIFI_STA_SSID,
-                .type = CONFIG_ITEM_TYPE_STRING,
-                .def.str = ""
-        }, {
-                .key = KEY_CONFIG_WIFI_STA_PASSWORD,
-                .type = CONFIG_ITEM_TYPE_STRING,
-                .secret = true,
-                .def.str = ""
-        }, {
-                .key = KEY_CONFIG_WIFI_STA_SCAN_MODE_ALL,
-                .type = CONFIG_ITEM_TYPE_BOOL,
-                .def.bool1 = false
-        }, {
-                .key = KEY_CONFIG_WIFI_STA_STATIC,
-                .type = CONFIG_ITEM_TYPE_BOOL,
-                .def.bool1 = false
-        }, {
-                .key = KEY_CONFIG_WIFI_STA_IP,
-                .type = CONFIG_ITEM_TYPE_IP,
-                .def.uint32 = esp_netif_htonl(esp_netif_ip4_makeu32(192, 168, 0, 100))
-        }, {
-                .key = KEY_CONFIG_WIFI_STA_GATEWAY,
-                .type = CONFIG_ITEM_TYPE_IP,
-                .def.uint32 = esp_netif_htonl(esp_netif_ip4_makeu32(192, 168, 0, 1))
-        }, {
-                .key = KEY_CONFIG_WIFI_STA_SUBNET,
-                .type = CONFIG_ITEM_TYPE_UINT8,
-                .def.uint8 = 24
-        }, {
-                .key = KEY_CONFIG_WIFI_STA_DNS_A,
-                .type = CONFIG_ITEM_TYPE_IP,
-                .def.uint32 = esp_netif_htonl(esp_netif_ip4_makeu32(1, 1, 1, 1))
-        }, {
-                .key = KEY_CONFIG_WIFI_STA_DNS_B,
-                .type = CONFIG_ITEM_TYPE_IP,
-                .def.uint32 = esp_netif_htonl(esp_netif_ip4_makeu32(1, 0, 0, 1))
-        }, {
-                .key = KEY_CONFIG_SD_LOGGING_ACTIVE,
-                .type = CONFIG_ITEM_TYPE_BOOL,
-                .def.bool1 = false
-        },
+static config_observer_entry_t config_observers[CONFIG_OBSERVERS_MAX];
+static int config_observer_count = 0;
+static uint32_t config_observed_groups = 0;                // Группы, применяемые наблюдателями без перезагрузки
+static QueueHandle_t config_notify_queue;
 
-        // Socket Server
-        {
-                .key = KEY_CONFIG_SOCKET_SERVER_ACTIVE,
-                .type = CONFIG_ITEM_TYPE_BOOL,
-                .def.bool1 = false
-        }, {
-                .key = KEY_CONFIG_SOCKET_SERVER_TCP_ACTIVE,
-                .type = CONFIG_ITEM_TYPE_BOOL,
-                .def.bool1 = false
-        }, {
-                .key = KEY_CONFIG_SOCKET_SERVER_TCP_PORT,
-                .type = CONFIG_ITEM_TYPE_UINT16,
-                .def.uint16 = 8880
-        }, {
-                .key = KEY_CONFIG_SOCKET_SERVER_UDP_ACTIVE,
-                .type = CONFIG_ITEM_TYPE_BOOL,
-                .def.bool1 = false
-        }, {
-                .key = KEY_CONFIG_SOCKET_SERVER_UDP_PORT,
-                .type = CONFIG_ITEM_TYPE_UINT16,
-                .def.uint16 = 8881
+/// Таблица элементов конфигурации ESP32 NTRIP Duo
+/// Генерируется из CONFIG_ITEMS_SCHEMA (config.h), индекс элемента равен KEY_CONFIG_xxx_ID
+const config_item_t CONFIG_ITEMS[CONFIG_ITEM_COUNT] = {
+#define CONFIG_ITEM_ENTRY(_key, _group, _type, _secret, _field, _def) \
+        [_key##_ID] = { \
+                .key = _key, \
+                .group = CONFIG_GROUP_##_group, \
+                .type = CONFIG_ITEM_TYPE_##_type, \
+                .secret = _secret, \
+                .def._field = _def \
         },
-
-        // Socket Client
-        {
-                .key = KEY_CONFIG_SOCKET_CLIENT_ACTIVE,
-                .type = CONFIG_ITEM_TYPE_BOOL,
-                .def.bool1 = false
-        }, {
-                .key = KEY_CONFIG_SOCKET_CLIENT_TCP,
-                .type = CONFIG_ITEM_TYPE_BOOL,
-                .def.bool1 = true
-        }, {
-                .key = KEY_CONFIG_SOCKET_CLIENT_HOST,
-                .type = CONFIG_ITEM_TYPE_STRING,
-                .def.str = ""
-        }, {
-                .key = KEY_CONFIG_SOCKET_CLIENT_PORT,
-                .type = CONFIG_ITEM_TYPE_UINT16,
-                .def.uint16 = 8880
-        }, {
-                .key = KEY_CONFIG_SOCKET_CLIENT_CONNECT_MESSAGE,
-                .type = CONFIG_ITEM_TYPE_STRING,
-                .def.str = ""
-        }
+        CONFIG_ITEMS_SCHEMA(CONFIG_ITEM_ENTRY)
+#undef CONFIG_ITEM_ENTRY
 };
 
 const config_item_t *config_items_get(int *count) {
-    *count = sizeof(CONFIG_ITEMS) / sizeof(config_item_t);
+    *count = CONFIG_ITEM_COUNT;
     return &CONFIG_ITEMS[0];
 }
 
@@ -422,56 +165,638 @@ esp_err_t config_set(const config_item_t *item, void *value) {
     }
 }
 
+/// Запись значения в произвольное пространство NVS в соответствии с типом элемента
+static esp_err_t config_write_value(nvs_handle_t handle, const config_item_t *item, const config_item_value_t *value) {
+    switch (item->type) {
+        case CONFIG_ITEM_TYPE_BOOL:
+            return nvs_set_i8(handle, item->key, value->bool1);
+        case CONFIG_ITEM_TYPE_INT8:
+            return nvs_set_i8(handle, item->key, value->int8);
+        case CONFIG_ITEM_TYPE_INT16:
+            return nvs_set_i16(handle, item->key, value->int16);
+        case CONFIG_ITEM_TYPE_INT32:
+            return nvs_set_i32(handle, item->key, value->int32);
+        case CONFIG_ITEM_TYPE_INT64:
+            return nvs_set_i64(handle, item->key, value->int64);
+        case CONFIG_ITEM_TYPE_UINT8:
+            return nvs_set_u8(handle, item->key, value->uint8);
+        case CONFIG_ITEM_TYPE_UINT16:
+            return nvs_set_u16(handle, item->key, value->uint16);
+        case CONFIG_ITEM_TYPE_UINT32:
+        case CONFIG_ITEM_TYPE_IP:
+            return nvs_set_u32(handle, item->key, value->uint32);
+        case CONFIG_ITEM_TYPE_UINT64:
+            return nvs_set_u64(handle, item->key, value->uint64);
+        case CONFIG_ITEM_TYPE_COLOR:
+            return nvs_set_u32(handle, item->key, value->color.rgba);
+        case CONFIG_ITEM_TYPE_STRING:
+            return nvs_set_str(handle, item->key, value->str);
+        case CONFIG_ITEM_TYPE_BLOB:
+            return nvs_set_blob(handle, item->key, value->blob.data, value->blob.length);
+        default:
+            return ESP_ERR_INVALID_ARG;
+    }
+}
+
+/// Начало записи в активный профиль: до config_write_end профиль не переключится,
+/// и набор config_set_* вместе с config_commit попадёт в одно пространство NVS
+void config_write_begin() {
+    xSemaphoreTakeRecursive(config_write_mutex, portMAX_DELAY);
+}
+
+void config_write_end() {
+    xSemaphoreGiveRecursive(config_write_mutex);
+}
+
+/// Запись значения из объединения config_item_value_t в активный профиль
+esp_err_t config_set_value(const config_item_t *item, const config_item_value_t *value) {
+    config_write_begin();
+    esp_err_t err = config_write_value(config_handle, item, value);
+    config_write_end();
+    return err;
+}
+
 esp_err_t config_set_i8(const char *key, int8_t value) {
-    return nvs_set_i8(config_handle, key, value);
+    config_write_begin();
+    esp_err_t err = nvs_set_i8(config_handle, key, value);
+    config_write_end();
+    return err;
 }
 
 esp_err_t config_set_i16(const char *key, int16_t value) {
-    return nvs_set_i16(config_handle, key, value);
+    config_write_begin();
+    esp_err_t err = nvs_set_i16(config_handle, key, value);
+    config_write_end();
+    return err;
 }
 
 esp_err_t config_set_i32(const char *key, int32_t value) {
-    return nvs_set_i32(config_handle, key, value);
+    config_write_begin();
+    esp_err_t err = nvs_set_i32(config_handle, key, value);
+    config_write_end();
+    return err;
 }
 
 esp_err_t config_set_i64(const char *key, int64_t value) {
-    return nvs_set_i64(config_handle, key, value);
+    config_write_begin();
+    esp_err_t err = nvs_set_i64(config_handle, key, value);
+    config_write_end();
+    return err;
 }
 
 esp_err_t config_set_u8(const char *key, uint8_t value) {
-    return nvs_set_u8(config_handle, key, value);
+    config_write_begin();
+    esp_err_t err = nvs_set_u8(config_handle, key, value);
+    config_write_end();
+    return err;
 }
 
 esp_err_t config_set_u16(const char *key, uint16_t value) {
-    return nvs_set_u16(config_handle, key, value);
+    config_write_begin();
+    esp_err_t err = nvs_set_u16(config_handle, key, value);
+    config_write_end();
+    return err;
 }
 
 esp_err_t config_set_u32(const char *key, uint32_t value) {
-    return nvs_set_u32(config_handle, key, value);
+    config_write_begin();
+    esp_err_t err = nvs_set_u32(config_handle, key, value);
+    config_write_end();
+    return err;
 }
 
 esp_err_t config_set_u64(const char *key, uint64_t value) {
-    return nvs_set_u64(config_handle, key, value);
+    config_write_begin();
+    esp_err_t err = nvs_set_u64(config_handle, key, value);
+    config_write_end();
+    return err;
 }
 
 esp_err_t config_set_color(const char *key, config_color_t value) {
-    return nvs_set_u32(config_handle, key, value.rgba);
+    config_write_begin();
+    esp_err_t err = nvs_set_u32(config_handle, key, value.rgba);
+    config_write_end();
+    return err;
 }
 
 esp_err_t config_set_bool1(const char *key, bool value) {
-    return nvs_set_i8(config_handle, key, value);
+    config_write_begin();
+    esp_err_t err = nvs_set_i8(config_handle, key, value);
+    config_write_end();
+    return err;
 }
 
 esp_err_t config_set_str(const char *key, char *value) {
-    return nvs_set_str(config_handle, key, value);
+    config_write_begin();
+    esp_err_t err = nvs_set_str(config_handle, key, value);
+    config_write_end();
+    return err;
 }
 
 esp_err_t config_set_blob(const char *key, char *value, size_t length) {
-    return nvs_set_blob(config_handle, key, value, length);
+    config_write_begin();
+    esp_err_t err = nvs_set_blob(config_handle, key, value, length);
+    config_write_end();
+    return err;
+}
+
+/// Освобождение снимка вместе со строками, загруженными из NVS
+static void config_snapshot_free(config_snapshot_t *snapshot) {
+    if (snapshot == NULL) return;
+
+    for (int i = 0; i < CONFIG_ITEM_COUNT; i++) {
+        const config_item_t *item = &CONFIG_ITEMS[i];
+        config_item_value_t *value = &snapshot->values[i];
+
+        // Значения по умолчанию указывают на константы таблицы
+        if (item->type == CONFIG_ITEM_TYPE_STRING && value->str != item->def.str) free(value->str);
+        if (item->type == CONFIG_ITEM_TYPE_BLOB && value->blob.data != item->def.blob.data) free(value->blob.data);
+    }
+
+    free(snapshot);
+}
+
+/// Чтение одного значения из NVS, при отсутствии ключа остаётся значение по умолчанию
+static void config_load_value(nvs_handle_t handle, const config_item_t *item, config_item_value_t *value) {
+    *value = item->def;
+
+    switch (item->type) {
+        case CONFIG_ITEM_TYPE_BOOL: {
+            int8_t bool1;
+            if (nvs_get_i8(handle, item->key, &bool1) == ESP_OK) value->bool1 = bool1 > 0;
+            break;
+        }
+        case CONFIG_ITEM_TYPE_INT8:
+            nvs_get_i8(handle, item->key, &value->int8);
+            break;
+        case CONFIG_ITEM_TYPE_INT16:
+            nvs_get_i16(handle, item->key, &value->int16);
+            break;
+        case CONFIG_ITEM_TYPE_INT32:
+            nvs_get_i32(handle, item->key, &value->int32);
+            break;
+        case CONFIG_ITEM_TYPE_INT64:
+            nvs_get_i64(handle, item->key, &value->int64);
+            break;
+        case CONFIG_ITEM_TYPE_UINT8:
+            nvs_get_u8(handle, item->key, &value->uint8);
+            break;
+        case CONFIG_ITEM_TYPE_UINT16:
+            nvs_get_u16(handle, item->key, &value->uint16);
+            break;
+        case CONFIG_ITEM_TYPE_UINT32:
+        case CONFIG_ITEM_TYPE_IP:
+            nvs_get_u32(handle, item->key, &value->uint32);
+            break;
+        case CONFIG_ITEM_TYPE_UINT64:
+            nvs_get_u64(handle, item->key, &value->uint64);
+            break;
+        case CONFIG_ITEM_TYPE_COLOR:
+            nvs_get_u32(handle, item->key, &value->color.rgba);
+            break;
+        case CONFIG_ITEM_TYPE_STRING: {
+            size_t length;
+            if (nvs_get_str(handle, item->key, NULL, &length) != ESP_OK) break;
+
+            char *str = malloc(length);
+            if (str != NULL && nvs_get_str(handle, item->key, str, &length) == ESP_OK) {
+                value->str = str;
+            } else {
+                ESP_LOGE(TAG, "Failed to load config item %s", item->key);
+                free(str);
+            }
+            break;
+        }
+        case CONFIG_ITEM_TYPE_BLOB: {
+            size_t length;
+            if (nvs_get_blob(handle, item->key, NULL, &length) != ESP_OK) break;
+
+            uint8_t *data = length > 0 ? malloc(length) : NULL;
+            if (length == 0 || (data != NULL && nvs_get_blob(handle, item->key, data, &length) == ESP_OK)) {
+                value->blob.data = data;
+                value->blob.length = length;
+            } else {
+                ESP_LOGE(TAG, "Failed to load config item %s", item->key);
+                free(data);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+/// Загрузка полного снимка конфигурации из пространства NVS
+static config_snapshot_t *config_snapshot_load(nvs_handle_t handle) {
+    config_snapshot_t *snapshot = malloc(sizeof(config_snapshot_t));
+    if (snapshot == NULL) return NULL;
+    snapshot->refs = 1;
+
+    for (int i = 0; i < CONFIG_ITEM_COUNT; i++) {
+        config_load_value(handle, &CONFIG_ITEMS[i], &snapshot->values[i]);
+    }
+
+    return snapshot;
+}
+
+/// Сравнение значений одного элемента (строки и блобы - по содержимому)
+bool config_value_equal(const config_item_t *item, const config_item_value_t *a, const config_item_value_t *b) {
+    switch (item->type) {
+        case CONFIG_ITEM_TYPE_BOOL:
+            return a->bool1 == b->bool1;
+        case CONFIG_ITEM_TYPE_INT8:
+        case CONFIG_ITEM_TYPE_UINT8:
+            return a->uint8 == b->uint8;
+        case CONFIG_ITEM_TYPE_INT16:
+        case CONFIG_ITEM_TYPE_UINT16:
+            return a->uint16 == b->uint16;
+        case CONFIG_ITEM_TYPE_INT32:
+        case CONFIG_ITEM_TYPE_UINT32:
+        case CONFIG_ITEM_TYPE_IP:
+        case CONFIG_ITEM_TYPE_COLOR:
+            return a->uint32 == b->uint32;
+        case CONFIG_ITEM_TYPE_INT64:
+        case CONFIG_ITEM_TYPE_UINT64:
+            return a->uint64 == b->uint64;
+        case CONFIG_ITEM_TYPE_STRING:
+            return strcmp(a->str, b->str) == 0;
+        case CONFIG_ITEM_TYPE_BLOB:
+            return a->blob.length == b->blob.length &&
+                    (a->blob.length == 0 || memcmp(a->blob.data, b->blob.data, a->blob.length) == 0);
+        default:
+            return true;
+    }
+}
+
+/// Список изменившихся элементов между двумя снимками
+/// @param changes Массив на CONFIG_ITEM_COUNT элементов или NULL, если нужна только маска групп
+/// @return Маска изменившихся групп
+static uint32_t config_snapshot_diff(const config_snapshot_t *old_snapshot, const config_snapshot_t *new_snapshot,
+        config_item_change_t *changes, size_t *count) {
+    uint32_t groups = 0;
+    size_t n = 0;
+
+    for (int i = 0; i < CONFIG_ITEM_COUNT; i++) {
+        const config_item_t *item = &CONFIG_ITEMS[i];
+        if (config_value_equal(item, &old_snapshot->values[i], &new_snapshot->values[i])) continue;
+
+        groups |= item->group;
+        if (changes != NULL) {
+            changes[n] = (config_item_change_t) {
+                    .item = item,
+                    .old_value = &old_snapshot->values[i],
+                    .new_value = &new_snapshot->values[i]
+            };
+        }
+        n++;
+    }
+
+    if (count != NULL) *count = n;
+    return groups;
+}
+
+/// Ссылка на активный снимок (NULL до загрузки), отпускается config_snapshot_put
+static config_snapshot_t *config_snapshot_acquire() {
+    taskENTER_CRITICAL(&config_snapshot_mux);
+    config_snapshot_t *snapshot = config_snapshot;
+    if (snapshot != NULL) snapshot->refs++;
+    taskEXIT_CRITICAL(&config_snapshot_mux);
+
+    return snapshot;
+}
+
+static void config_snapshot_put(config_snapshot_t *snapshot) {
+    taskENTER_CRITICAL(&config_snapshot_mux);
+    uint32_t refs = --snapshot->refs;
+    taskEXIT_CRITICAL(&config_snapshot_mux);
+
+    if (refs == 0) config_snapshot_free(snapshot);
+}
+
+/// Публикация нового снимка и постановка уведомления наблюдателям в очередь
+/// @param changed_groups Маска изменившихся групп (может быть NULL)
+static esp_err_t config_snapshot_reload(uint32_t *changed_groups) {
+    config_snapshot_t *snapshot = config_snapshot_load(config_handle);
+    if (snapshot == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate config snapshot");
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Ссылка активного снимка переходит от старого к новому, уведомление получает
+    // ссылку старого и свою на новый
+    taskENTER_CRITICAL(&config_snapshot_mux);
+    config_snapshot_t *old_snapshot = config_snapshot;
+    config_snapshot = snapshot;
+    if (old_snapshot != NULL) snapshot->refs++;
+    taskEXIT_CRITICAL(&config_snapshot_mux);
+
+    uint32_t groups = old_snapshot != NULL ? config_snapshot_diff(old_snapshot, snapshot, NULL, NULL) : 0;
+    if (changed_groups != NULL) *changed_groups = groups;
+
+    if (old_snapshot == NULL) return ESP_OK;
+
+    config_notification_t notification = {
+            .old_snapshot = old_snapshot,
+            .new_snapshot = snapshot
+    };
+    if (xQueueSend(config_notify_queue, &notification, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        ESP_LOGE(TAG, "Config notification queue full, observers will miss this change");
+        config_snapshot_put(old_snapshot);
+        config_snapshot_put(snapshot);
+    }
+
+    return ESP_OK;
+}
+
+/// Доставка уведомлений об изменениях вне задачи httpd
+static void config_notify_task(void *ctx) {
+    // Используются только этой задачей
+    static config_item_change_t changes[CONFIG_ITEM_COUNT];
+    static config_item_change_t filtered[CONFIG_ITEM_COUNT];
+
+    config_notification_t notification;
+    while (true) {
+        xQueueReceive(config_notify_queue, &notification, portMAX_DELAY);
+
+        size_t count;
+        uint32_t groups = config_snapshot_diff(notification.old_snapshot, notification.new_snapshot, changes, &count);
+
+        xSemaphoreTake(config_snapshot_lock, portMAX_DELAY);
+        int observer_count = config_observer_count;
+        xSemaphoreGive(config_snapshot_lock);
+
+        for (int o = 0; o < observer_count && groups != 0; o++) {
+            config_observer_entry_t *entry = &config_observers[o];
+            if ((entry->groups & groups) == 0) continue;
+
+            // Наблюдатель получает одно сводное уведомление только по своим группам
+            config_change_t change = { .groups = entry->groups & groups, .count = 0, .items = filtered };
+            for (size_t i = 0; i < count; i++) {
+                if (changes[i].item->group & entry->groups) filtered[change.count++] = changes[i];
+            }
+
+            entry->observer(&change, entry->arg);
+        }
+
+        config_snapshot_put(notification.old_snapshot);
+        config_snapshot_put(notification.new_snapshot);
+    }
+}
+
+esp_err_t config_subscribe(uint32_t groups, config_observer_t observer, void *arg) {
+    xSemaphoreTake(config_snapshot_lock, portMAX_DELAY);
+
+    if (config_observer_count >= CONFIG_OBSERVERS_MAX) {
+        xSemaphoreGive(config_snapshot_lock);
+        ESP_LOGE(TAG, "Too many config observers");
+        return ESP_ERR_NO_MEM;
+    }
+
+    config_observers[config_observer_count] = (config_observer_entry_t) {
+            .groups = groups,
+            .observer = observer,
+            .arg = arg
+    };
+    config_observer_count++;
+    config_observed_groups |= groups;
+
+    xSemaphoreGive(config_snapshot_lock);
+
+    return ESP_OK;
+}
+
+/// Есть ли среди изменившихся групп такие, которые никто не применяет без перезагрузки
+static bool config_groups_need_restart(uint32_t groups) {
+    xSemaphoreTake(config_snapshot_lock, portMAX_DELAY);
+    uint32_t live_groups = config_observed_groups | CONFIG_GROUPS_ON_DEMAND;
+    xSemaphoreGive(config_snapshot_lock);
+
+    return (groups & ~live_groups) != 0;
+}
+
+/// Копия значения примитива из активного снимка (до загрузки снимка - значение по умолчанию)
+/// Копирование под спинлоком: снимок не может быть освобождён во время чтения
+static inline config_item_value_t config_value(const config_item_t *item) {
+    taskENTER_CRITICAL(&config_snapshot_mux);
+    config_item_value_t value = config_snapshot != NULL ? config_snapshot->values[item - CONFIG_ITEMS] : item->def;
+    taskEXIT_CRITICAL(&config_snapshot_mux);
+
+    return value;
+}
+
+/// Дескриптор пространства NVS профиля: "config" для профиля 0, "config_N" для остальных
+static esp_err_t config_profile_handle(int profile, nvs_handle_t *handle) {
+    if (profile < 0 || profile >= CONFIG_PROFILE_MAX) return ESP_ERR_INVALID_ARG;
+
+    if (!profile_handles_open[profile]) {
+        char storage[NVS_KEY_NAME_MAX_SIZE];
+        if (profile == 0) {
+            strlcpy(storage, STORAGE, sizeof(storage));
+        } else {
+            snprintf(storage, sizeof(storage), "%s_%d", STORAGE, profile);
+        }
+
+        esp_err_t err = nvs_open(storage, NVS_READWRITE, &profile_handles[profile]);
+        if (err != ESP_OK) return err;
+        profile_handles_open[profile] = true;
+    }
+
+    *handle = profile_handles[profile];
+    return ESP_OK;
+}
+
+static void config_profile_name_key(int profile, char *key, size_t length) {
+    snprintf(key, length, "name%d", profile);
+}
+
+static bool config_profile_exists(int profile) {
+    if (profile == 0) return true;
+
+    char key[8];
+    size_t length;
+    config_profile_name_key(profile, key, sizeof(key));
+    return nvs_get_str(profiles_handle, key, NULL, &length) == ESP_OK;
+}
+
+int config_profile_active() {
+    return profile_active;
+}
+
+esp_err_t config_profile_name(int profile, char *name, size_t length) {
+    if (profile < 0 || profile >= CONFIG_PROFILE_MAX) return ESP_ERR_INVALID_ARG;
+
+    char key[8];
+    config_profile_name_key(profile, key, sizeof(key));
+    esp_err_t err = nvs_get_str(profiles_handle, key, name, &length);
+
+    // Профиль 0 существует всегда, даже если имя не задано
+    if (err == ESP_ERR_NVS_NOT_FOUND && profile == 0) {
+        strlcpy(name, PROFILE_NAME_DEFAULT, length);
+        return ESP_OK;
+    }
+    return err == ESP_ERR_NVS_NOT_FOUND ? ESP_ERR_NOT_FOUND : err;
+}
+
+esp_err_t config_profile_rename(int profile, const char *name) {
+    if (profile < 0 || profile >= CONFIG_PROFILE_MAX || strlen(name) == 0 || strlen(name) >= CONFIG_PROFILE_NAME_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!config_profile_exists(profile)) return ESP_ERR_NOT_FOUND;
+
+    char key[8];
+    config_profile_name_key(profile, key, sizeof(key));
+    esp_err_t err = nvs_set_str(profiles_handle, key, name);
+    if (err != ESP_OK) return err;
+
+    return nvs_commit(profiles_handle);
+}
+
+static esp_err_t config_profile_create_locked(int profile, const char *name, int source) {
+    if (profile <= 0 || profile >= CONFIG_PROFILE_MAX || strlen(name) == 0 || strlen(name) >= CONFIG_PROFILE_NAME_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (profile == profile_active) return ESP_ERR_INVALID_STATE;
+    if (source >= CONFIG_PROFILE_MAX || (source >= 0 && !config_profile_exists(source))) return ESP_ERR_NOT_FOUND;
+
+    nvs_handle_t handle;
+    esp_err_t err = config_profile_handle(profile, &handle);
+    if (err == ESP_OK) err = nvs_erase_all(handle);
+    if (err != ESP_OK) return err;
+
+    if (source >= 0) {
+        config_snapshot_t *snapshot = config_profile_snapshot(source);
+        if (snapshot == NULL) return ESP_ERR_NO_MEM;
+
+        for (int i = 0; i < CONFIG_ITEM_COUNT && err == ESP_OK; i++) {
+            const config_item_t *item = &CONFIG_ITEMS[i];
+            if (config_value_equal(item, &item->def, &snapshot->values[i])) continue;
+            err = config_write_value(handle, item, &snapshot->values[i]);
+        }
+
+        config_snapshot_release(snapshot);
+        if (err != ESP_OK) return err;
+    }
+
+    err = nvs_commit(handle);
+    if (err != ESP_OK) return err;
+
+    // Имя записывается последним: профиль считается существующим только после копирования
+    char key[8];
+    config_profile_name_key(profile, key, sizeof(key));
+    err = nvs_set_str(profiles_handle, key, name);
+    if (err != ESP_OK) return err;
+
+    return nvs_commit(profiles_handle);
+}
+
+/// Создание профиля: копия существующего профиля или значения по умолчанию (source < 0)
+/// Записываются только значения, отличные от значений по умолчанию
+esp_err_t config_profile_create(int profile, const char *name, int source) {
+    config_write_begin();
+    esp_err_t err = config_profile_create_locked(profile, name, source);
+    config_write_end();
+    return err;
+}
+
+static esp_err_t config_profile_delete_locked(int profile) {
+    if (profile <= 0 || profile >= CONFIG_PROFILE_MAX) return ESP_ERR_INVALID_ARG;
+    if (profile == profile_active) return ESP_ERR_INVALID_STATE;
+    if (!config_profile_exists(profile)) return ESP_ERR_NOT_FOUND;
+
+    char key[8];
+    config_profile_name_key(profile, key, sizeof(key));
+    esp_err_t err = nvs_erase_key(profiles_handle, key);
+    if (err == ESP_OK) err = nvs_commit(profiles_handle);
+    if (err != ESP_OK) return err;
+
+    nvs_handle_t handle;
+    err = config_profile_handle(profile, &handle);
+    if (err == ESP_OK) err = nvs_erase_all(handle);
+    if (err == ESP_OK) err = nvs_commit(handle);
+    return err;
+}
+
+esp_err_t config_profile_delete(int profile) {
+    config_write_begin();
+    esp_err_t err = config_profile_delete_locked(profile);
+    config_write_end();
+    return err;
+}
+
+static esp_err_t config_profile_activate_locked(int profile, bool *restart_required) {
+    if (profile < 0 || profile >= CONFIG_PROFILE_MAX) return ESP_ERR_INVALID_ARG;
+    if (!config_profile_exists(profile)) return ESP_ERR_NOT_FOUND;
+
+    if (restart_required != NULL) *restart_required = false;
+    if (profile == profile_active) return ESP_OK;
+
+    nvs_handle_t handle;
+    esp_err_t err = config_profile_handle(profile, &handle);
+    if (err != ESP_OK) return err;
+
+    err = nvs_set_u8(profiles_handle, PROFILE_KEY_ACTIVE, profile);
+    if (err == ESP_OK) err = nvs_commit(profiles_handle);
+    if (err != ESP_OK) return err;
+
+    uart_pesp(NMEA_PESP_CFG, "PROFILE,%d", profile);
+    ESP_LOGI(TAG, "Switching to profile %d", profile);
+
+    config_handle = handle;
+    profile_active = profile;
+
+    uint32_t groups;
+    err = config_snapshot_reload(&groups);
+    if (err != ESP_OK) return err;
+
+    if (restart_required != NULL) *restart_required = config_groups_need_restart(groups);
+    return ESP_OK;
+}
+
+/// Переключение профиля: подмена дескриптора NVS и снимка без перезаписи ключей
+/// Наблюдатели получают изменения как после обычного config_commit
+/// Ждёт незавершённую запись, иначе её фиксация ушла бы в новый профиль
+esp_err_t config_profile_activate(int profile, bool *restart_required) {
+    config_write_begin();
+    esp_err_t err = config_profile_activate_locked(profile, restart_required);
+    config_write_end();
+    return err;
+}
+
+/// Следующий существующий профиль по кругу (для жеста кнопкой)
+esp_err_t config_profile_activate_next(bool *restart_required) {
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+
+    config_write_begin();
+    for (int i = 1; i <= CONFIG_PROFILE_MAX; i++) {
+        int profile = (profile_active + i) % CONFIG_PROFILE_MAX;
+        if (config_profile_exists(profile)) {
+            err = config_profile_activate_locked(profile, restart_required);
+            break;
+        }
+    }
+    config_write_end();
+
+    return err;
+}
+
+/// Снимок произвольного профиля для сравнения, освобождается config_snapshot_release
+config_snapshot_t *config_profile_snapshot(int profile) {
+    nvs_handle_t handle;
+    if (!config_profile_exists(profile) || config_profile_handle(profile, &handle) != ESP_OK) return NULL;
+    return config_snapshot_load(handle);
+}
+
+const config_item_value_t *config_snapshot_value(const config_snapshot_t *snapshot, const config_item_t *item) {
+    return &snapshot->values[item - CONFIG_ITEMS];
+}
+
+void config_snapshot_release(config_snapshot_t *snapshot) {
+    if (snapshot == NULL) return;
+    config_snapshot_put(snapshot);
 }
 
 /// Инициализация модуля конфигурации
-/// Инициализирует NVS (Non-Volatile Storage) для хранения настроек устройства
+/// Инициализирует NVS (Non-Volatile Storage) и загружает снимок настроек в RAM
 /// @return ESP_OK при успешной инициализации, код ошибки в противном случае
 esp_err_t config_init() {
     // Инициализация флэш-памяти NVS
@@ -483,9 +808,27 @@ esp_err_t config_init() {
     }
     ESP_ERROR_CHECK(err);
 
-    // Открытие дескриптора NVS для пространства конфигурации
-    ESP_LOGD(TAG, "Opening Non-Volatile Storage (NVS) handle '%s'... ", STORAGE);
-    return nvs_open(STORAGE, NVS_READWRITE, &config_handle);
+    config_snapshot_lock = xSemaphoreCreateMutex();
+    config_write_mutex = xSemaphoreCreateRecursiveMutex();
+    config_notify_queue = xQueueCreate(CONFIG_NOTIFY_QUEUE_LENGTH, sizeof(config_notification_t));
+    task_create(TASK_CONFIG_NOTIFY, config_notify_task, NULL, NULL);
+
+    // Выбор активного профиля
+    err = nvs_open(PROFILES_STORAGE, NVS_READWRITE, &profiles_handle);
+    if (err != ESP_OK) return err;
+
+    uint8_t active = 0;
+    nvs_get_u8(profiles_handle, PROFILE_KEY_ACTIVE, &active);
+    if (active >= CONFIG_PROFILE_MAX || !config_profile_exists(active)) active = 0;
+
+    // Открытие дескриптора NVS для пространства конфигурации активного профиля
+    ESP_LOGD(TAG, "Opening Non-Volatile Storage (NVS) handle for profile %d... ", active);
+    err = config_profile_handle(active, &config_handle);
+    if (err != ESP_OK) return err;
+    profile_active = active;
+
+    // Все дальнейшие чтения выполняются из RAM
+    return config_snapshot_reload(NULL);
 }
 
 /// Сброс конфигурации к заводским настройкам
@@ -493,79 +836,80 @@ esp_err_t config_init() {
 /// Вызывается при длительном удержании кнопки сброса на устройстве
 /// @return ESP_OK при успешном сбросе, код ошибки в противном случае  
 esp_err_t config_reset() {
-    uart_nmea("$PESP,CFG,RESET");                   // NMEA сообщение о сбросе конфигурации
+    uart_pesp(NMEA_PESP_CFG, "RESET");                   // NMEA сообщение о сбросе конфигурации
+
+    // Полная очистка всех профилей, активным становится профиль по умолчанию
+    config_write_begin();
+    esp_err_t err = ESP_OK;
+    for (int i = 0; i < CONFIG_PROFILE_MAX && err == ESP_OK; i++) {
+        nvs_handle_t handle;
+        err = config_profile_handle(i, &handle);
+        if (err == ESP_OK) err = nvs_erase_all(handle);
+        if (err == ESP_OK) err = nvs_commit(handle);
+    }
 
-    return nvs_erase_all(config_handle);            // Полная очистка пространства конфигурации
+    if (err == ESP_OK) err = nvs_erase_all(profiles_handle);
+    if (err == ESP_OK) err = nvs_commit(profiles_handle);
+    if (err == ESP_OK) {
+        config_profile_handle(0, &config_handle);
+        profile_active = 0;
+        err = config_snapshot_reload(NULL);
+    }
+    config_write_end();
+
+    return err;
 }
 
 /// Получение 8-битного целого значения из конфигурации
 /// @param item Указатель на элемент конфигурации
-/// @return Значение из NVS или значение по умолчанию, если ключ не найден
+/// @return Значение из снимка в RAM (значение по умолчанию, если ключ не сохранён)
 int8_t config_get_i8(const config_item_t *item) {
-    int8_t value = item->def.int8;                  // Загрузка значения по умолчанию
-    nvs_get_i8(config_handle, item->key, &value);  // Попытка чтения из NVS (если не найдено, value не изменится)
-    return value;
+    return config_value(item).int8;
 }
 
 /// Получение 16-битного целого значения из конфигурации
 /// @param item Указатель на элемент конфигурации
-/// @return Значение из NVS или значение по умолчанию
+/// @return Значение из снимка в RAM
 int16_t config_get_i16(const config_item_t *item) {
-    int16_t value = item->def.int16;                // Загрузка значения по умолчанию
-    nvs_get_i16(config_handle, item->key, &value); // Попытка чтения из NVS
-    return value;
+    return config_value(item).int16;
 }
 
 int32_t config_get_i32(const config_item_t *item) {
-    int32_t value = item->def.int32;
-    nvs_get_i32(config_handle, item->key, &value);
-    return value;
+    return config_value(item).int32;
 }
 
 int64_t config_get_i64(const config_item_t *item) {
-    int64_t value = item->def.int64;
-    nvs_get_i64(config_handle, item->key, &value);
-    return value;
+    return config_value(item).int64;
 }
 
 uint8_t config_get_u8(const config_item_t *item) {
-    uint8_t value = item->def.uint8;
-    nvs_get_u8(config_handle, item->key, &value);
-    return value;
+    return config_value(item).uint8;
 }
 
 uint16_t config_get_u16(const config_item_t *item) {
-    uint16_t value = item->def.uint16;
-    nvs_get_u16(config_handle, item->key, &value);
-    return value;
+    return config_value(item).uint16;
 }
 
 uint32_t config_get_u32(const config_item_t *item) {
-    uint32_t value = item->def.uint32;
-    nvs_get_u32(config_handle, item->key, &value);
-    return value;
+    return config_value(item).uint32;
 }
 
 uint64_t config_get_u64(const config_item_t *item) {
-    uint64_t value = item->def.uint64;
-    nvs_get_u64(config_handle, item->key, &value);
-    return value;
+    return config_value(item).uint64;
 }
 
 config_color_t config_get_color(const config_item_t *item) {
-    config_color_t value = item->def.color;
-    nvs_get_u32(config_handle, item->key, &value.rgba);
-    return value;
+    return config_value(item).color;
 }
 
 bool config_get_bool1(const config_item_t *item) {
-    int8_t value = item->def.bool1;
-    nvs_get_i8(config_handle, item->key, &value);
-    return value > 0;
+    return config_value(item).bool1;
 }
 
+/// Поиск элемента по строковому ключу во время выполнения (JSON, импорт)
+/// Для ключей, известных при компиляции, используется CONF_ITEM()
 const config_item_t * config_get_item(const char *key) {
-    for (unsigned int i = 0; i < sizeof(CONFIG_ITEMS) / sizeof(config_item_t); i++) {
+    for (unsigned int i = 0; i < CONFIG_ITEM_COUNT; i++) {
         const config_item_t *item = &CONFIG_ITEMS[i];
         if (strcmp(item->key, key) == 0) {
             return item;
@@ -579,97 +923,129 @@ const config_item_t * config_get_item(const char *key) {
 }
 
 esp_err_t config_get_primitive(const config_item_t *item, void *out_value) {
-    esp_err_t ret;
+    config_item_value_t value = config_value(item);
     switch (item->type) {
         case CONFIG_ITEM_TYPE_BOOL:
-            *((bool *) out_value) = item->def.bool1;
-            ret = nvs_get_i8(config_handle, item->key, out_value);
+            *((bool *) out_value) = value.bool1;
             break;
         case CONFIG_ITEM_TYPE_INT8:
-            *((int8_t *) out_value) = item->def.int8;
-            ret = nvs_get_i8(config_handle, item->key, out_value);
+            *((int8_t *) out_value) = value.int8;
             break;
         case CONFIG_ITEM_TYPE_INT16:
-            *((int16_t *) out_value) = item->def.int16;
-            ret = nvs_get_i16(config_handle, item->key, out_value);
+            *((int16_t *) out_value) = value.int16;
             break;
         case CONFIG_ITEM_TYPE_INT32:
-            *((int32_t *) out_value) = item->def.int32;
-            ret = nvs_get_i32(config_handle, item->key, out_value);
+            *((int32_t *) out_value) = value.int32;
             break;
         case CONFIG_ITEM_TYPE_INT64:
-            *((int64_t *) out_value) = item->def.int64;
-            ret = nvs_get_i64(config_handle, item->key, out_value);
+            *((int64_t *) out_value) = value.int64;
             break;
         case CONFIG_ITEM_TYPE_UINT8:
-            *((uint8_t *) out_value) = item->def.uint8;
-            ret = nvs_get_u8(config_handle, item->key, out_value);
+            *((uint8_t *) out_value) = value.uint8;
             break;
         case CONFIG_ITEM_TYPE_UINT16:
-            *((uint16_t *) out_value) = item->def.uint16;
-            ret = nvs_get_u16(config_handle, item->key, out_value);
+            *((uint16_t *) out_value) = value.uint16;
             break;
         case CONFIG_ITEM_TYPE_UINT32:
         case CONFIG_ITEM_TYPE_IP:
-            *((uint32_t *) out_value) = item->def.uint32;
-            ret = nvs_get_u32(config_handle, item->key, out_value);
+            *((uint32_t *) out_value) = value.uint32;
             break;
         case CONFIG_ITEM_TYPE_UINT64:
-            *((uint64_t *) out_value) = item->def.uint64;
-            ret = nvs_get_u64(config_handle, item->key, out_value);
+            *((uint64_t *) out_value) = value.uint64;
             break;
         case CONFIG_ITEM_TYPE_COLOR:
-            *((config_color_t *) out_value) = item->def.color;
-            ret = nvs_get_u32(config_handle, item->key, out_value);
+            *((config_color_t *) out_value) = value.color;
             break;
         default:
             return ESP_ERR_INVALID_ARG;
     }
 
-    return (ret == ESP_OK || ret == ESP_ERR_NVS_NOT_FOUND) ? ESP_OK : ret;
+    return ESP_OK;
+}
+
+static void config_str_blob_data(const config_item_t *item, const config_item_value_t *value, const void **data, size_t *length) {
+    if (item->type == CONFIG_ITEM_TYPE_STRING) {
+        *data = value->str;
+        *length = strlen(value->str) + 1;
+    } else {
+        *data = value->blob.data;
+        *length = value->blob.length;
+    }
 }
 
+/// Строка или блоб из одного снимка в новом буфере, освобождается вызывающим
 esp_err_t config_get_str_blob_alloc(const config_item_t *item, void **out_value) {
+    *out_value = NULL;
+    if (item->type != CONFIG_ITEM_TYPE_STRING && item->type != CONFIG_ITEM_TYPE_BLOB) return ESP_ERR_INVALID_ARG;
+
+    // Длина и содержимое берутся из одного снимка, замена между ними не влияет
+    config_snapshot_t *snapshot = config_snapshot_acquire();
+    const config_item_value_t *value = snapshot != NULL ? &snapshot->values[item - CONFIG_ITEMS] : &item->def;
+    const void *data;
     size_t length;
-    esp_err_t ret = config_get_str_blob(item, NULL, &length);
-    if (ret != ESP_OK) return ret;
-    *out_value = malloc(length);
+    config_str_blob_data(item, value, &data, &length);
+
+    esp_err_t ret = ESP_OK;
+    *out_value = malloc(length > 0 ? length : 1);
     if (*out_value == NULL) {
-        ESP_LOGE(TAG, "Failed to allocate %d bytes for config item %s", length, item->key);
-        return ESP_ERR_NO_MEM;
+        ESP_LOGE(TAG, "Failed to allocate %u bytes for config item %s", (unsigned) length, item->key);
+        ret = ESP_ERR_NO_MEM;
+    } else if (length > 0) {
+        memcpy(*out_value, data, length);
     }
-    return config_get_str_blob(item, *out_value, &length);
+
+    if (snapshot != NULL) config_snapshot_put(snapshot);
+
+    return ret;
 }
 
+/// Копирование строки или блоба из снимка (семантика как у nvs_get_str/nvs_get_blob)
+/// @param out_value Буфер назначения или NULL для получения требуемой длины
+/// @param length Размер буфера на входе, длина значения на выходе
 esp_err_t config_get_str_blob(const config_item_t *item, void *out_value, size_t *length) {
-    esp_err_t ret;
-
-    switch (item->type) {
-        case CONFIG_ITEM_TYPE_STRING:
-            ret = nvs_get_str(config_handle, item->key, out_value, length);
-            if (ret == ESP_ERR_NVS_NOT_FOUND) {
-                if (length != NULL) *length = strlen(item->def.str) + 1;
-                if (out_value != NULL) strcpy(out_value, item->def.str);
-            }
-            break;
-        case CONFIG_ITEM_TYPE_BLOB:
-            ret = nvs_get_blob(config_handle, item->key, out_value, length);
-            if (ret == ESP_ERR_NVS_NOT_FOUND) {
-                if (length != NULL) *length = item->def.blob.length;
-                if (out_value != NULL) memcpy(out_value, item->def.blob.data, item->def.blob.length);
-            }
-            break;
-        default:
-            return ESP_ERR_INVALID_ARG;
+    if (item->type != CONFIG_ITEM_TYPE_STRING && item->type != CONFIG_ITEM_TYPE_BLOB) return ESP_ERR_INVALID_ARG;
+
+    esp_err_t ret = ESP_OK;
+
+    // Строки принадлежат снимку, ссылка защищает их от освобождения при замене
+    config_snapshot_t *snapshot = config_snapshot_acquire();
+    const config_item_value_t *value = snapshot != NULL ? &snapshot->values[item - CONFIG_ITEMS] : &item->def;
+    const void *data;
+    size_t data_length;
+    config_str_blob_data(item, value, &data, &data_length);
+
+    if (out_value != NULL) {
+        if (*length < data_length) {
+            ret = ESP_ERR_NVS_INVALID_LENGTH;
+        } else if (data_length > 0) {
+            memcpy(out_value, data, data_length);
+        }
     }
+    if (ret == ESP_OK) *length = data_length;
 
-    return (ret == ESP_OK || ret == ESP_ERR_NVS_NOT_FOUND) ? ESP_OK : ret;
+    if (snapshot != NULL) config_snapshot_put(snapshot);
+
+    return ret;
 }
 
+/// Фиксация изменений в NVS и публикация нового снимка в RAM
 esp_err_t config_commit() {
-    uart_nmea("$PESP,CFG,UPDATED");
+    return config_commit_live(NULL);
+}
+
+esp_err_t config_commit_live(bool *restart_required) {
+    uart_pesp(NMEA_PESP_CFG, "UPDATED");
+
+    uint32_t groups = 0;
+    config_write_begin();
+    esp_err_t err = nvs_commit(config_handle);
+    if (err == ESP_OK) err = config_snapshot_reload(&groups);
+    config_write_end();
+    if (err != ESP_OK) return err;
+
+    if (restart_required != NULL) *restart_required = config_groups_need_restart(groups);
 
-    return nvs_commit(config_handle);
+    return ESP_OK;
 }
 
 static void config_restart_task(void *pvParameters) {
@@ -678,9 +1054,9 @@ static void config_restart_task(void *pvParameters) {
 }
 
 void config_restart() {
-    uart_nmea("$PESP,CFG,RESTARTING");
+    uart_pesp(NMEA_PESP_CFG, "RESTARTING");
 
-    xTaskCreate(config_restart_task, "config_restart_task", 4096, NULL, TASK_PRIORITY_MAX, NULL);
+    task_create(TASK_CONFIG_RESTART, config_restart_task, NULL, NULL);
 }
 
 // Socket configuration helper functions
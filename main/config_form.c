@@ -0,0 +1,154 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <stdlib.h>
+#include <string.h>
+#include "config_form.h"
+
+/// Целое со знаком из строки целиком; "0.0" допускается как ноль, как и в форме
+static bool form_integer(const char *string, int64_t min, int64_t max, int64_t *out) {
+    if (strcmp(string, "0.0") == 0) {
+        *out = 0;
+        return true;
+    }
+
+    char *end;
+    long long n = strtoll(string, &end, 10);
+    if (end == string || *end != '\0' || n < min || n > max) return false;
+
+    *out = n;
+    return true;
+}
+
+static bool form_unsigned(const char *string, uint64_t max, uint64_t *out) {
+    if (strcmp(string, "0.0") == 0) {
+        *out = 0;
+        return true;
+    }
+
+    // strtoull принимает минус и переворачивает значение
+    if (strchr(string, '-') != NULL) return false;
+
+    char *end;
+    unsigned long long n = strtoull(string, &end, 10);
+    if (end == string || *end != '\0' || n > max) return false;
+
+    *out = n;
+    return true;
+}
+
+static esp_err_t form_ip(const cJSON *entry, config_item_value_t *value) {
+    if (!cJSON_IsArray(entry) || cJSON_GetArraySize(entry) != 4) return ESP_ERR_INVALID_ARG;
+
+    // Порядок байт сети, как esp_netif_htonl(esp_netif_ip4_makeu32(...))
+    uint8_t *bytes = (uint8_t *) &value->uint32;
+    for (int b = 0; b < 4; b++) {
+        const cJSON *part = cJSON_GetArrayItem(entry, b);
+        uint64_t n;
+        if (!cJSON_IsString(part)) return ESP_ERR_INVALID_ARG;
+        if (part->valuestring[0] == '\0') n = 0;
+        else if (!form_unsigned(part->valuestring, UINT8_MAX, &n)) return ESP_ERR_INVALID_ARG;
+        bytes[b] = n;
+    }
+
+    return ESP_OK;
+}
+
+static esp_err_t form_color(const config_item_t *item, const char *string, config_item_value_t *value) {
+    if (string[0] != '#') return ESP_ERR_INVALID_ARG;
+
+    char *end;
+    unsigned long rgb = strtoul(string + 1, &end, 16);
+    if (*end != '\0' || end - string != 7) return ESP_ERR_INVALID_ARG;
+
+    // Яркость по умолчанию для любого цвета кроме чёрного (выключено)
+    value->color.rgba = (uint32_t) rgb << 8u;
+    if (rgb != 0) value->color.values.alpha = item->def.color.values.alpha;
+    return ESP_OK;
+}
+
+esp_err_t config_form_value(const config_item_t *item, const cJSON *entry, config_item_value_t *value) {
+    memset(value, 0, sizeof(*value));
+
+    if (item->type == CONFIG_ITEM_TYPE_IP) return form_ip(entry, value);
+    if (!cJSON_IsString(entry)) return ESP_ERR_INVALID_ARG;
+
+    const char *string = entry->valuestring;
+    size_t length = strlen(string);
+
+    if (item->type == CONFIG_ITEM_TYPE_STRING) {
+        if (strcmp(string, CONFIG_VALUE_UNCHANGED) == 0) return ESP_ERR_NOT_FOUND;
+        value->str = entry->valuestring;
+        return ESP_OK;
+    }
+    if (item->type == CONFIG_ITEM_TYPE_BLOB) {
+        if (strcmp(string, CONFIG_VALUE_UNCHANGED) == 0) return ESP_ERR_NOT_FOUND;
+        value->blob.data = (uint8_t *) entry->valuestring;
+        value->blob.length = length;
+        return ESP_OK;
+    }
+
+    // Пустые примитивы не меняются
+    if (length == 0 || strcmp(string, CONFIG_VALUE_UNCHANGED) == 0) return ESP_ERR_NOT_FOUND;
+
+    int64_t i;
+    uint64_t u;
+    switch (item->type) {
+        case CONFIG_ITEM_TYPE_BOOL:
+            if (!form_integer(string, 0, 1, &i)) return ESP_ERR_INVALID_ARG;
+            value->bool1 = i != 0;
+            return ESP_OK;
+        case CONFIG_ITEM_TYPE_INT8:
+            if (!form_integer(string, INT8_MIN, INT8_MAX, &i)) return ESP_ERR_INVALID_ARG;
+            value->int8 = (int8_t) i;
+            return ESP_OK;
+        case CONFIG_ITEM_TYPE_INT16:
+            if (!form_integer(string, INT16_MIN, INT16_MAX, &i)) return ESP_ERR_INVALID_ARG;
+            value->int16 = (int16_t) i;
+            return ESP_OK;
+        case CONFIG_ITEM_TYPE_INT32:
+            if (!form_integer(string, INT32_MIN, INT32_MAX, &i)) return ESP_ERR_INVALID_ARG;
+            value->int32 = (int32_t) i;
+            return ESP_OK;
+        case CONFIG_ITEM_TYPE_INT64:
+            if (!form_integer(string, INT64_MIN, INT64_MAX, &i)) return ESP_ERR_INVALID_ARG;
+            value->int64 = i;
+            return ESP_OK;
+        case CONFIG_ITEM_TYPE_UINT8:
+            if (!form_unsigned(string, UINT8_MAX, &u)) return ESP_ERR_INVALID_ARG;
+            value->uint8 = (uint8_t) u;
+            return ESP_OK;
+        case CONFIG_ITEM_TYPE_UINT16:
+            if (!form_unsigned(string, UINT16_MAX, &u)) return ESP_ERR_INVALID_ARG;
+            value->uint16 = (uint16_t) u;
+            return ESP_OK;
+        case CONFIG_ITEM_TYPE_UINT32:
+            if (!form_unsigned(string, UINT32_MAX, &u)) return ESP_ERR_INVALID_ARG;
+            value->uint32 = (uint32_t) u;
+            return ESP_OK;
+        case CONFIG_ITEM_TYPE_UINT64:
+            if (!form_unsigned(string, UINT64_MAX, &u)) return ESP_ERR_INVALID_ARG;
+            value->uint64 = u;
+            return ESP_OK;
+        case CONFIG_ITEM_TYPE_COLOR:
+            return form_color(item, string, value);
+        default:
+            return ESP_ERR_INVALID_ARG;
+    }
+}
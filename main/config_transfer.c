@@ -0,0 +1,857 @@
+/*
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2019 Nebojsa Cvetkovic.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <esp_log.h>
+#include <esp_random.h>
+#include <esp_rom_crc.h>
+#include <mbedtls/base64.h>
+#include <mbedtls/gcm.h>
+#include <mbedtls/md.h>
+#include <mbedtls/pkcs5.h>
+
+#include "config.h"
+#include "config_transfer.h"
+
+static const char *TAG = "CONFIG_TRANSFER";
+
+/*
+ * Двоичный формат (little-endian):
+ *   "NTCF" | u8 версия | u8 флаги | u16 число элементов | u32 хеш схемы
+ *   элементы: u8 длина ключа | ключ | u8 тип | u16 длина значения | значение
+ *   [флаг SECRETS] соль[16] | IV[12] | тег[16] | u16 число секретов | u16 длина | шифротекст элементов
+ *   u32 CRC32 всего предыдущего
+ */
+#define HEADER_SIZE 12
+#define FLAG_SECRETS 0x01
+
+#define SALT_SIZE 16
+#define IV_SIZE 12
+#define GCM_TAG_SIZE 16
+#define KEY_SIZE 32
+#define PBKDF2_ITERATIONS 4096
+
+/// Набор значений для импорта, проверяется целиком до записи в NVS
+typedef struct config_staging {
+    config_item_value_t values[CONFIG_ITEM_COUNT];
+    bool present[CONFIG_ITEM_COUNT];
+} config_staging_t;
+
+/// Растущий буфер для сборки двоичного экспорта
+typedef struct transfer_buffer {
+    uint8_t *data;
+    size_t length;
+    size_t capacity;
+    bool failed;
+} transfer_buffer_t;
+
+/// Хеш схемы (FNV-1a по ключам и типам): меняется при добавлении, удалении или смене типа настройки
+uint32_t config_schema_hash() {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < CONFIG_ITEM_COUNT; i++) {
+        for (const char *c = CONFIG_ITEMS[i].key; *c; c++) {
+            hash = (hash ^ (uint8_t) *c) * 16777619u;
+        }
+        hash = (hash ^ (uint8_t) CONFIG_ITEMS[i].type) * 16777619u;
+    }
+    return hash;
+}
+
+/// Поиск элемента без аварийного завершения (в отличие от config_get_item)
+static const config_item_t *transfer_find_item(const char *key, size_t length) {
+    for (int i = 0; i < CONFIG_ITEM_COUNT; i++) {
+        const char *item_key = CONFIG_ITEMS[i].key;
+        if (strlen(item_key) == length && memcmp(item_key, key, length) == 0) return &CONFIG_ITEMS[i];
+    }
+    return NULL;
+}
+
+/// Размер двоичного представления значения
+static size_t value_size(const config_item_t *item, const config_item_value_t *value) {
+    switch (item->type) {
+        case CONFIG_ITEM_TYPE_BOOL:
+        case CONFIG_ITEM_TYPE_INT8:
+        case CONFIG_ITEM_TYPE_UINT8:
+            return 1;
+        case CONFIG_ITEM_TYPE_INT16:
+        case CONFIG_ITEM_TYPE_UINT16:
+            return 2;
+        case CONFIG_ITEM_TYPE_INT32:
+        case CONFIG_ITEM_TYPE_UINT32:
+        case CONFIG_ITEM_TYPE_IP:
+        case CONFIG_ITEM_TYPE_COLOR:
+            return 4;
+        case CONFIG_ITEM_TYPE_INT64:
+        case CONFIG_ITEM_TYPE_UINT64:
+            return 8;
+        case CONFIG_ITEM_TYPE_STRING:
+            return value != NULL ? strlen(value->str) : 0;
+        case CONFIG_ITEM_TYPE_BLOB:
+            return value != NULL ? value->blob.length : 0;
+        default:
+            return 0;
+    }
+}
+
+static bool is_str_blob(const config_item_t *item) {
+    return item->type == CONFIG_ITEM_TYPE_STRING || item->type == CONFIG_ITEM_TYPE_BLOB;
+}
+
+/// Чтение текущего значения, строки и блобы копируются в кучу
+static esp_err_t value_read(const config_item_t *item, config_item_value_t *value) {
+    memset(value, 0, sizeof(*value));
+    if (!is_str_blob(item)) return config_get_primitive(item, value);
+
+    size_t length;
+    esp_err_t err = config_get_str_blob(item, NULL, &length);
+    if (err != ESP_OK) return err;
+
+    uint8_t *data = malloc(length > 0 ? length : 1);
+    if (data == NULL) return ESP_ERR_NO_MEM;
+
+    err = config_get_str_blob(item, data, &length);
+    if (err != ESP_OK) {
+        free(data);
+        return err;
+    }
+
+    if (item->type == CONFIG_ITEM_TYPE_STRING) {
+        value->str = (char *) data;
+    } else {
+        value->blob.data = data;
+        value->blob.length = length;
+    }
+    return ESP_OK;
+}
+
+static void value_release(const config_item_t *item, config_item_value_t *value) {
+    if (item->type == CONFIG_ITEM_TYPE_STRING) free(value->str);
+    if (item->type == CONFIG_ITEM_TYPE_BLOB) free(value->blob.data);
+    memset(value, 0, sizeof(*value));
+}
+
+static void staging_free(config_staging_t *staging) {
+    if (staging == NULL) return;
+    for (int i = 0; i < CONFIG_ITEM_COUNT; i++) {
+        if (staging->present[i]) value_release(&CONFIG_ITEMS[i], &staging->values[i]);
+    }
+    free(staging);
+}
+
+/// Занесение значения в набор импорта (владение строкой/блобом переходит набору)
+static void staging_put(config_staging_t *staging, const config_item_t *item, config_item_value_t *value) {
+    int index = item - CONFIG_ITEMS;
+    if (staging->present[index]) value_release(item, &staging->values[index]);
+    staging->values[index] = *value;
+    staging->present[index] = true;
+}
+
+/// Запись проверенного набора в NVS с единственной фиксацией.
+/// nvs_set_* пишет во flash сразу, поэтому при ошибке уже записанные элементы
+/// возвращаются к прежним значениям: импорт применяется целиком или не применяется
+static esp_err_t staging_apply(config_staging_t *staging, int *applied, bool *restart_required) {
+    config_staging_t *previous = calloc(1, sizeof(config_staging_t));
+    if (previous == NULL) return ESP_ERR_NO_MEM;
+
+    esp_err_t err = ESP_OK;
+    for (int i = 0; i < CONFIG_ITEM_COUNT && err == ESP_OK; i++) {
+        if (!staging->present[i]) continue;
+        err = value_read(&CONFIG_ITEMS[i], &previous->values[i]);
+        if (err == ESP_OK) previous->present[i] = true;
+    }
+
+    // Запись, откат и фиксация - в один профиль, даже если его переключат параллельно
+    config_write_begin();
+
+    int count = 0;
+    for (int i = 0; i < CONFIG_ITEM_COUNT && err == ESP_OK; i++) {
+        if (!staging->present[i]) continue;
+
+        err = config_set_value(&CONFIG_ITEMS[i], &staging->values[i]);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Error setting %s: %d - %s", CONFIG_ITEMS[i].key, err, esp_err_to_name(err));
+            break;
+        }
+        count++;
+    }
+
+    if (err != ESP_OK) {
+        for (int i = 0, restored = 0; i < CONFIG_ITEM_COUNT && restored < count; i++) {
+            if (!staging->present[i]) continue;
+            restored++;
+
+            esp_err_t rollback = config_set_value(&CONFIG_ITEMS[i], &previous->values[i]);
+            if (rollback != ESP_OK) ESP_LOGE(TAG, "Could not restore %s: %s", CONFIG_ITEMS[i].key, esp_err_to_name(rollback));
+        }
+        if (count > 0) ESP_LOGW(TAG, "Import rolled back, %d items restored", count);
+
+        config_write_end();
+        staging_free(previous);
+        return err;
+    }
+    staging_free(previous);
+
+    if (applied != NULL) *applied = count;
+
+    err = config_commit_live(restart_required);
+    config_write_end();
+    return err;
+}
+
+/*
+ * Шифрование секретов
+ */
+
+static esp_err_t derive_key(const char *passphrase, const uint8_t *salt, uint8_t *key) {
+    int ret = mbedtls_pkcs5_pbkdf2_hmac_ext(MBEDTLS_MD_SHA256,
+            (const unsigned char *) passphrase, strlen(passphrase),
+            salt, SALT_SIZE, PBKDF2_ITERATIONS, KEY_SIZE, key);
+    return ret == 0 ? ESP_OK : ESP_FAIL;
+}
+
+/// AES-256-GCM, магическая строка формата используется как дополнительные аутентифицируемые данные
+static esp_err_t secrets_crypt(bool encrypt, const char *passphrase, const uint8_t *salt, const uint8_t *iv,
+        uint8_t *tag, const uint8_t *input, uint8_t *output, size_t length) {
+    uint8_t key[KEY_SIZE];
+    esp_err_t err = derive_key(passphrase, salt, key);
+    if (err != ESP_OK) return err;
+
+    mbedtls_gcm_context gcm;
+    mbedtls_gcm_init(&gcm);
+
+    int ret = mbedtls_gcm_setkey(&gcm, MBEDTLS_CIPHER_ID_AES, key, KEY_SIZE * 8);
+    if (ret == 0) {
+        const uint8_t *aad = (const uint8_t *) CONFIG_TRANSFER_MAGIC;
+        if (encrypt) {
+            ret = mbedtls_gcm_crypt_and_tag(&gcm, MBEDTLS_GCM_ENCRYPT, length, iv, IV_SIZE,
+                    aad, strlen(CONFIG_TRANSFER_MAGIC), input, output, GCM_TAG_SIZE, tag);
+        } else {
+            ret = mbedtls_gcm_auth_decrypt(&gcm, length, iv, IV_SIZE,
+                    aad, strlen(CONFIG_TRANSFER_MAGIC), tag, GCM_TAG_SIZE, input, output);
+        }
+    }
+
+    mbedtls_gcm_free(&gcm);
+    memset(key, 0, sizeof(key));
+
+    if (ret != 0) {
+        ESP_LOGE(TAG, "Failed to %s secrets%s", encrypt ? "encrypt" : "decrypt", encrypt ? "" : " (wrong passphrase?)");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+/*
+ * JSON
+ */
+
+static char *base64_encode(const uint8_t *data, size_t length) {
+    size_t out_length = 0;
+    mbedtls_base64_encode(NULL, 0, &out_length, data, length);
+
+    char *out = malloc(out_length + 1);
+    if (out == NULL) return NULL;
+
+    if (mbedtls_base64_encode((unsigned char *) out, out_length + 1, &out_length, data, length) != 0) {
+        free(out);
+        return NULL;
+    }
+    out[out_length] = '\0';
+    return out;
+}
+
+static uint8_t *base64_decode(const char *string, size_t *length) {
+    size_t out_length = 0;
+    int ret = mbedtls_base64_decode(NULL, 0, &out_length, (const unsigned char *) string, strlen(string));
+    if (ret == MBEDTLS_ERR_BASE64_INVALID_CHARACTER) return NULL;
+
+    uint8_t *out = malloc(out_length > 0 ? out_length : 1);
+    if (out == NULL) return NULL;
+
+    if (mbedtls_base64_decode(out, out_length, length, (const unsigned char *) string, strlen(string)) != 0) {
+        free(out);
+        return NULL;
+    }
+    return out;
+}
+
+cJSON *config_value_to_json(const config_item_t *item, const config_item_value_t *value) {
+    char string[16];
+    switch (item->type) {
+        case CONFIG_ITEM_TYPE_BOOL:
+            return cJSON_CreateBool(value->bool1);
+        case CONFIG_ITEM_TYPE_INT8:
+            return cJSON_CreateNumber(value->int8);
+        case CONFIG_ITEM_TYPE_INT16:
+            return cJSON_CreateNumber(value->int16);
+        case CONFIG_ITEM_TYPE_INT32:
+            return cJSON_CreateNumber(value->int32);
+        case CONFIG_ITEM_TYPE_INT64:
+            return cJSON_CreateNumber((double) value->int64);
+        case CONFIG_ITEM_TYPE_UINT8:
+            return cJSON_CreateNumber(value->uint8);
+        case CONFIG_ITEM_TYPE_UINT16:
+            return cJSON_CreateNumber(value->uint16);
+        case CONFIG_ITEM_TYPE_UINT32:
+            return cJSON_CreateNumber(value->uint32);
+        case CONFIG_ITEM_TYPE_UINT64:
+            return cJSON_CreateNumber((double) value->uint64);
+        case CONFIG_ITEM_TYPE_IP: {
+            // Адрес хранится в сетевом порядке байт
+            const uint8_t *b = (const uint8_t *) &value->uint32;
+            snprintf(string, sizeof(string), "%u.%u.%u.%u", b[0], b[1], b[2], b[3]);
+            return cJSON_CreateString(string);
+        }
+        case CONFIG_ITEM_TYPE_COLOR:
+            snprintf(string, sizeof(string), "#%02x%02x%02x%02x", value->color.values.red,
+                    value->color.values.green, value->color.values.blue, value->color.values.alpha);
+            return cJSON_CreateString(string);
+        case CONFIG_ITEM_TYPE_STRING:
+            return cJSON_CreateString(value->str);
+        case CONFIG_ITEM_TYPE_BLOB: {
+            char *encoded = base64_encode(value->blob.data, value->blob.length);
+            cJSON *json = encoded != NULL ? cJSON_CreateString(encoded) : NULL;
+            free(encoded);
+            return json;
+        }
+        default:
+            return NULL;
+    }
+}
+
+static bool json_integer(const cJSON *json, double min, double max, double *out) {
+    double number;
+    if (cJSON_IsNumber(json)) {
+        number = json->valuedouble;
+    } else if (cJSON_IsBool(json)) {
+        number = cJSON_IsTrue(json) ? 1 : 0;
+    } else {
+        return false;
+    }
+
+    if (number < min || number > max || number != (double) (int64_t) number) return false;
+    *out = number;
+    return true;
+}
+
+/// Разбор значения из JSON с проверкой типа и диапазона
+static esp_err_t value_from_json(const config_item_t *item, const cJSON *json, config_item_value_t *value) {
+    memset(value, 0, sizeof(*value));
+    double n;
+
+    switch (item->type) {
+        case CONFIG_ITEM_TYPE_BOOL:
+            if (!json_integer(json, 0, 1, &n)) return ESP_ERR_INVALID_ARG;
+            value->bool1 = n != 0;
+            return ESP_OK;
+        case CONFIG_ITEM_TYPE_INT8:
+            if (!json_integer(json, INT8_MIN, INT8_MAX, &n)) return ESP_ERR_INVALID_ARG;
+            value->int8 = (int8_t) n;
+            return ESP_OK;
+        case CONFIG_ITEM_TYPE_INT16:
+            if (!json_integer(json, INT16_MIN, INT16_MAX, &n)) return ESP_ERR_INVALID_ARG;
+            value->int16 = (int16_t) n;
+            return ESP_OK;
+        case CONFIG_ITEM_TYPE_INT32:
+            if (!json_integer(json, INT32_MIN, INT32_MAX, &n)) return ESP_ERR_INVALID_ARG;
+            value->int32 = (int32_t) n;
+            return ESP_OK;
+        case CONFIG_ITEM_TYPE_INT64:
+            if (!json_integer(json, -9007199254740992.0, 9007199254740992.0, &n)) return ESP_ERR_INVALID_ARG;
+            value->int64 = (int64_t) n;
+            return ESP_OK;
+        case CONFIG_ITEM_TYPE_UINT8:
+            if (!json_integer(json, 0, UINT8_MAX, &n)) return ESP_ERR_INVALID_ARG;
+            value->uint8 = (uint8_t) n;
+            return ESP_OK;
+        case CONFIG_ITEM_TYPE_UINT16:
+            if (!json_integer(json, 0, UINT16_MAX, &n)) return ESP_ERR_INVALID_ARG;
+            value->uint16 = (uint16_t) n;
+            return ESP_OK;
+        case CONFIG_ITEM_TYPE_UINT32:
+            if (!json_integer(json, 0, UINT32_MAX, &n)) return ESP_ERR_INVALID_ARG;
+            value->uint32 = (uint32_t) n;
+            return ESP_OK;
+        case CONFIG_ITEM_TYPE_UINT64:
+            if (!json_integer(json, 0, 9007199254740992.0, &n)) return ESP_ERR_INVALID_ARG;
+            value->uint64 = (uint64_t) n;
+            return ESP_OK;
+        case CONFIG_ITEM_TYPE_IP: {
+            unsigned int a, b, c, d;
+            char end;
+            if (!cJSON_IsString(json) ||
+                    sscanf(json->valuestring, "%u.%u.%u.%u%c", &a, &b, &c, &d, &end) != 4 ||
+                    a > 255 || b > 255 || c > 255 || d > 255) return ESP_ERR_INVALID_ARG;
+            uint8_t *bytes = (uint8_t *) &value->uint32;
+            bytes[0] = a;
+            bytes[1] = b;
+            bytes[2] = c;
+            bytes[3] = d;
+            return ESP_OK;
+        }
+        case CONFIG_ITEM_TYPE_COLOR: {
+            if (!cJSON_IsString(json) || json->valuestring[0] != '#') return ESP_ERR_INVALID_ARG;
+            size_t digits = strlen(json->valuestring + 1);
+            char *end;
+            uint32_t rgb = strtoul(json->valuestring + 1, &end, 16);
+            if (*end != '\0') return ESP_ERR_INVALID_ARG;
+
+            if (digits == 8) {
+                value->color.rgba = rgb;
+            } else if (digits == 6) {
+                // Как и в веб-форме: яркость по умолчанию для заданного цвета
+                value->color.rgba = rgb << 8u;
+                value->color.values.alpha = item->def.color.values.alpha;
+            } else {
+                return ESP_ERR_INVALID_ARG;
+            }
+            return ESP_OK;
+        }
+        case CONFIG_ITEM_TYPE_STRING:
+            if (!cJSON_IsString(json)) return ESP_ERR_INVALID_ARG;
+            value->str = strdup(json->valuestring);
+            return value->str != NULL ? ESP_OK : ESP_ERR_NO_MEM;
+        case CONFIG_ITEM_TYPE_BLOB:
+            if (!cJSON_IsString(json)) return ESP_ERR_INVALID_ARG;
+            value->blob.data = base64_decode(json->valuestring, &value->blob.length);
+            return value->blob.data != NULL ? ESP_OK : ESP_ERR_INVALID_ARG;
+        default:
+            return ESP_ERR_INVALID_ARG;
+    }
+}
+
+/// Объект {ключ: значение} для открытых или секретных настроек
+static cJSON *items_to_json(bool secret) {
+    cJSON *items = cJSON_CreateObject();
+
+    for (int i = 0; i < CONFIG_ITEM_COUNT; i++) {
+        const config_item_t *item = &CONFIG_ITEMS[i];
+        if (item->secret != secret) continue;
+
+        config_item_value_t value;
+        if (value_read(item, &value) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to read %s", item->key);
+            continue;
+        }
+
+        cJSON *json = config_value_to_json(item, &value);
+        if (json != NULL) cJSON_AddItemToObject(items, item->key, json);
+        value_release(item, &value);
+    }
+
+    return items;
+}
+
+static esp_err_t items_from_json(const cJSON *items, config_staging_t *staging) {
+    if (!cJSON_IsObject(items)) return ESP_ERR_INVALID_ARG;
+
+    const cJSON *entry;
+    cJSON_ArrayForEach(entry, items) {
+        const config_item_t *item = transfer_find_item(entry->string, strlen(entry->string));
+        if (item == NULL) {
+            ESP_LOGW(TAG, "Ignoring unknown config item %s", entry->string);
+            continue;
+        }
+
+        config_item_value_t value;
+        esp_err_t err = value_from_json(item, entry, &value);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Invalid value for %s", item->key);
+            return err;
+        }
+
+        staging_put(staging, item, &value);
+    }
+
+    return ESP_OK;
+}
+
+cJSON *config_export_json(const char *passphrase) {
+    cJSON *root = cJSON_CreateObject();
+
+    char schema[9];
+    snprintf(schema, sizeof(schema), "%08" PRIx32, config_schema_hash());
+
+    cJSON_AddStringToObject(root, "format", CONFIG_TRANSFER_MAGIC);
+    cJSON_AddNumberToObject(root, "version", CONFIG_TRANSFER_VERSION);
+    cJSON_AddStringToObject(root, "schema", schema);
+    cJSON_AddItemToObject(root, "items", items_to_json(false));
+
+    if (passphrase == NULL || passphrase[0] == '\0') return root;
+
+    // Секреты шифруются одним блоком: сериализованный объект {ключ: значение}
+    cJSON *secrets = items_to_json(true);
+    char *plain = cJSON_PrintUnformatted(secrets);
+    cJSON_Delete(secrets);
+    if (plain == NULL) goto _error;
+
+    size_t length = strlen(plain);
+    uint8_t salt[SALT_SIZE], iv[IV_SIZE], tag[GCM_TAG_SIZE];
+    uint8_t *cipher = malloc(length > 0 ? length : 1);
+    esp_fill_random(salt, sizeof(salt));
+    esp_fill_random(iv, sizeof(iv));
+
+    esp_err_t err = cipher != NULL ? secrets_crypt(true, passphrase, salt, iv, tag, (uint8_t *) plain, cipher, length) : ESP_ERR_NO_MEM;
+    memset(plain, 0, length);
+    free(plain);
+
+    if (err != ESP_OK) {
+        free(cipher);
+        goto _error;
+    }
+
+    cJSON *encrypted = cJSON_AddObjectToObject(root, "secrets");
+    char *encoded;
+    encoded = base64_encode(salt, sizeof(salt));
+    cJSON_AddStringToObject(encrypted, "salt", encoded ? encoded : "");
+    free(encoded);
+    encoded = base64_encode(iv, sizeof(iv));
+    cJSON_AddStringToObject(encrypted, "iv", encoded ? encoded : "");
+    free(encoded);
+    encoded = base64_encode(tag, sizeof(tag));
+    cJSON_AddStringToObject(encrypted, "tag", encoded ? encoded : "");
+    free(encoded);
+    encoded = base64_encode(cipher, length);
+    cJSON_AddStringToObject(encrypted, "data", encoded ? encoded : "");
+    free(encoded);
+    free(cipher);
+
+    return root;
+
+    _error:
+    cJSON_Delete(root);
+    return NULL;
+}
+
+/// Расшифровка блока секретов JSON и занесение их в набор импорта
+static esp_err_t secrets_from_json(const cJSON *secrets, const char *passphrase, config_staging_t *staging) {
+    if (passphrase == NULL || passphrase[0] == '\0') {
+        ESP_LOGE(TAG, "Passphrase required to import secrets");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    const char *fields[] = {"salt", "iv", "tag", "data"};
+    const size_t sizes[] = {SALT_SIZE, IV_SIZE, GCM_TAG_SIZE, 0};
+    uint8_t *decoded[4] = {NULL};
+    size_t lengths[4] = {0};
+
+    esp_err_t err = ESP_OK;
+    for (int i = 0; i < 4 && err == ESP_OK; i++) {
+        const cJSON *field = cJSON_GetObjectItem(secrets, fields[i]);
+        if (!cJSON_IsString(field) || (decoded[i] = base64_decode(field->valuestring, &lengths[i])) == NULL ||
+                (sizes[i] != 0 && lengths[i] != sizes[i])) {
+            err = ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    char *plain = NULL;
+    if (err == ESP_OK) {
+        plain = calloc(1, lengths[3] + 1);
+        err = plain != NULL ? secrets_crypt(false, passphrase, decoded[0], decoded[1], decoded[2], decoded[3],
+                (uint8_t *) plain, lengths[3]) : ESP_ERR_NO_MEM;
+    }
+
+    if (err == ESP_OK) {
+        cJSON *items = cJSON_Parse(plain);
+        err = items_from_json(items, staging);
+        cJSON_Delete(items);
+    }
+
+    if (plain != NULL) {
+        memset(plain, 0, lengths[3]);
+        free(plain);
+    }
+    for (int i = 0; i < 4; i++) free(decoded[i]);
+
+    return err;
+}
+
+esp_err_t config_import_json(const cJSON *root, const char *passphrase, int *applied, bool *restart_required) {
+    const cJSON *format = cJSON_GetObjectItem(root, "format");
+    const cJSON *version = cJSON_GetObjectItem(root, "version");
+    const cJSON *schema = cJSON_GetObjectItem(root, "schema");
+
+    // Формат и версия необязательны: скрипт может прислать только {"items": {...}}
+    if (format != NULL && (!cJSON_IsString(format) || strcmp(format->valuestring, CONFIG_TRANSFER_MAGIC) != 0)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (version != NULL && (!cJSON_IsNumber(version) || version->valueint != CONFIG_TRANSFER_VERSION)) {
+        ESP_LOGE(TAG, "Unsupported config version");
+        return ESP_ERR_INVALID_VERSION;
+    }
+    if (cJSON_IsString(schema) && strtoul(schema->valuestring, NULL, 16) != config_schema_hash()) {
+        ESP_LOGW(TAG, "Config schema differs, importing matching keys only");
+    }
+
+    config_staging_t *staging = calloc(1, sizeof(config_staging_t));
+    if (staging == NULL) return ESP_ERR_NO_MEM;
+
+    esp_err_t err = items_from_json(cJSON_GetObjectItem(root, "items"), staging);
+
+    const cJSON *secrets = cJSON_GetObjectItem(root, "secrets");
+    if (err == ESP_OK && secrets != NULL) err = secrets_from_json(secrets, passphrase, staging);
+
+    if (err == ESP_OK) err = staging_apply(staging, applied, restart_required);
+
+    staging_free(staging);
+    return err;
+}
+
+/*
+ * Двоичный формат
+ */
+
+static void buffer_put(transfer_buffer_t *buffer, const void *data, size_t length) {
+    if (buffer->failed) return;
+
+    if (buffer->length + length > buffer->capacity) {
+        size_t capacity = buffer->capacity * 2 > buffer->length + length ? buffer->capacity * 2 : buffer->length + length;
+        uint8_t *grown = realloc(buffer->data, capacity);
+        if (grown == NULL) {
+            buffer->failed = true;
+            return;
+        }
+        buffer->data = grown;
+        buffer->capacity = capacity;
+    }
+
+    memcpy(buffer->data + buffer->length, data, length);
+    buffer->length += length;
+}
+
+static void buffer_put_u16(transfer_buffer_t *buffer, uint16_t value) {
+    uint8_t bytes[2] = {value & 0xff, value >> 8};
+    buffer_put(buffer, bytes, sizeof(bytes));
+}
+
+static void buffer_put_u32(transfer_buffer_t *buffer, uint32_t value) {
+    uint8_t bytes[4] = {value & 0xff, (value >> 8) & 0xff, (value >> 16) & 0xff, value >> 24};
+    buffer_put(buffer, bytes, sizeof(bytes));
+}
+
+static uint16_t read_u16(const uint8_t *data) {
+    return data[0] | (data[1] << 8);
+}
+
+static uint32_t read_u32(const uint8_t *data) {
+    return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t) data[3] << 24);
+}
+
+/// Запись элементов одного вида (открытые или секретные)
+/// @return Число записанных элементов
+static uint16_t entries_put(transfer_buffer_t *buffer, bool secret) {
+    uint16_t count = 0;
+
+    for (int i = 0; i < CONFIG_ITEM_COUNT; i++) {
+        const config_item_t *item = &CONFIG_ITEMS[i];
+        if (item->secret != secret) continue;
+
+        config_item_value_t value;
+        if (value_read(item, &value) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to read %s", item->key);
+            continue;
+        }
+
+        size_t size = value_size(item, &value);
+        const void *data = item->type == CONFIG_ITEM_TYPE_STRING ? (const void *) value.str :
+                item->type == CONFIG_ITEM_TYPE_BLOB ? (const void *) value.blob.data : (const void *) &value;
+
+        uint8_t key_length = strlen(item->key);
+        buffer_put(buffer, &key_length, 1);
+        buffer_put(buffer, item->key, key_length);
+        uint8_t type = item->type;
+        buffer_put(buffer, &type, 1);
+        buffer_put_u16(buffer, size);
+        buffer_put(buffer, data, size);
+
+        value_release(item, &value);
+        count++;
+    }
+
+    return count;
+}
+
+/// Разбор последовательности элементов в набор импорта
+/// @param consumed Число разобранных байт (элементы могут быть не последними в буфере)
+static esp_err_t entries_parse(const uint8_t *data, size_t length, uint16_t count, config_staging_t *staging, size_t *consumed) {
+    size_t offset = 0;
+
+    for (int n = 0; n < count; n++) {
+        if (offset + 1 > length) return ESP_ERR_INVALID_SIZE;
+        uint8_t key_length = data[offset++];
+        if (offset + key_length + 3 > length) return ESP_ERR_INVALID_SIZE;
+        const char *key = (const char *) data + offset;
+        offset += key_length;
+        uint8_t type = data[offset++];
+        uint16_t size = read_u16(data + offset);
+        offset += 2;
+        if (offset + size > length) return ESP_ERR_INVALID_SIZE;
+        const uint8_t *value_data = data + offset;
+        offset += size;
+
+        const config_item_t *item = transfer_find_item(key, key_length);
+        if (item == NULL) {
+            ESP_LOGW(TAG, "Ignoring unknown config item %.*s", key_length, key);
+            continue;
+        }
+        if (item->type != type || (!is_str_blob(item) && size != value_size(item, NULL))) {
+            ESP_LOGE(TAG, "Type mismatch for %s", item->key);
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        config_item_value_t value = {0};
+        if (item->type == CONFIG_ITEM_TYPE_STRING) {
+            value.str = malloc(size + 1);
+            if (value.str == NULL) return ESP_ERR_NO_MEM;
+            memcpy(value.str, value_data, size);
+            value.str[size] = '\0';
+        } else if (item->type == CONFIG_ITEM_TYPE_BLOB) {
+            value.blob.data = malloc(size > 0 ? size : 1);
+            if (value.blob.data == NULL) return ESP_ERR_NO_MEM;
+            memcpy(value.blob.data, value_data, size);
+            value.blob.length = size;
+        } else {
+            memcpy(&value, value_data, size);
+        }
+
+        staging_put(staging, item, &value);
+    }
+
+    *consumed = offset;
+    return ESP_OK;
+}
+
+esp_err_t config_export_binary(const char *passphrase, uint8_t **out, size_t *length) {
+    transfer_buffer_t buffer = {0};
+    bool secrets = passphrase != NULL && passphrase[0] != '\0';
+
+    buffer_put(&buffer, CONFIG_TRANSFER_MAGIC, 4);
+    uint8_t version = CONFIG_TRANSFER_VERSION, flags = secrets ? FLAG_SECRETS : 0;
+    buffer_put(&buffer, &version, 1);
+    buffer_put(&buffer, &flags, 1);
+    buffer_put_u16(&buffer, 0);                     // Число элементов, заполняется ниже
+    buffer_put_u32(&buffer, config_schema_hash());
+
+    uint16_t count = entries_put(&buffer, false);
+    if (!buffer.failed) {
+        buffer.data[6] = count & 0xff;
+        buffer.data[7] = count >> 8;
+    }
+
+    if (secrets && !buffer.failed) {
+        transfer_buffer_t plain = {0};
+        uint16_t secret_count = entries_put(&plain, true);
+
+        uint8_t salt[SALT_SIZE], iv[IV_SIZE], tag[GCM_TAG_SIZE];
+        esp_fill_random(salt, sizeof(salt));
+        esp_fill_random(iv, sizeof(iv));
+
+        uint8_t *cipher = plain.failed ? NULL : malloc(plain.length > 0 ? plain.length : 1);
+        if (cipher == NULL || secrets_crypt(true, passphrase, salt, iv, tag, plain.data, cipher, plain.length) != ESP_OK) {
+            buffer.failed = true;
+        } else {
+            buffer_put(&buffer, salt, sizeof(salt));
+            buffer_put(&buffer, iv, sizeof(iv));
+            buffer_put(&buffer, tag, sizeof(tag));
+            buffer_put_u16(&buffer, secret_count);
+            buffer_put_u16(&buffer, plain.length);
+            buffer_put(&buffer, cipher, plain.length);
+        }
+
+        if (plain.data != NULL) memset(plain.data, 0, plain.length);
+        free(plain.data);
+        free(cipher);
+    }
+
+    if (!buffer.failed) buffer_put_u32(&buffer, esp_rom_crc32_le(0, buffer.data, buffer.length));
+
+    if (buffer.failed) {
+        free(buffer.data);
+        return ESP_ERR_NO_MEM;
+    }
+
+    *out = buffer.data;
+    *length = buffer.length;
+    return ESP_OK;
+}
+
+esp_err_t config_import_binary(const uint8_t *data, size_t length, const char *passphrase, int *applied, bool *restart_required) {
+    if (length < HEADER_SIZE + 4 || memcmp(data, CONFIG_TRANSFER_MAGIC, 4) != 0) return ESP_ERR_INVALID_ARG;
+    if (data[4] != CONFIG_TRANSFER_VERSION) {
+        ESP_LOGE(TAG, "Unsupported config version %d", data[4]);
+        return ESP_ERR_INVALID_VERSION;
+    }
+    if (esp_rom_crc32_le(0, data, length - 4) != read_u32(data + length - 4)) {
+        ESP_LOGE(TAG, "Config CRC mismatch");
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    uint8_t flags = data[5];
+    uint16_t count = read_u16(data + 6);
+    if (read_u32(data + 8) != config_schema_hash()) {
+        ESP_LOGW(TAG, "Config schema differs, importing matching keys only");
+    }
+
+    // Открытая часть идёт от заголовка до блока секретов или до CRC
+    const uint8_t *entries = data + HEADER_SIZE;
+    size_t available = length - HEADER_SIZE - 4;
+
+    config_staging_t *staging = calloc(1, sizeof(config_staging_t));
+    if (staging == NULL) return ESP_ERR_NO_MEM;
+
+    size_t consumed;
+    esp_err_t err = entries_parse(entries, available, count, staging, &consumed);
+
+    if (err == ESP_OK && !(flags & FLAG_SECRETS) && consumed != available) err = ESP_ERR_INVALID_SIZE;
+
+    if (err == ESP_OK && (flags & FLAG_SECRETS)) {
+        const uint8_t *salt = entries + consumed;
+        const uint8_t *iv = salt + SALT_SIZE;
+        const uint8_t *tag = iv + IV_SIZE;
+        const uint8_t *cipher = tag + GCM_TAG_SIZE + 4;
+        size_t remaining = available - consumed;
+
+        if (remaining < SALT_SIZE + IV_SIZE + GCM_TAG_SIZE + 4) {
+            err = ESP_ERR_INVALID_SIZE;
+        } else if (read_u16(tag + GCM_TAG_SIZE + 2) != remaining - (SALT_SIZE + IV_SIZE + GCM_TAG_SIZE + 4)) {
+            err = ESP_ERR_INVALID_SIZE;
+        } else if (passphrase == NULL || passphrase[0] == '\0') {
+            ESP_LOGE(TAG, "Passphrase required to import secrets");
+            err = ESP_ERR_INVALID_STATE;
+        } else {
+            uint16_t secret_count = read_u16(tag + GCM_TAG_SIZE);
+            uint16_t cipher_length = read_u16(tag + GCM_TAG_SIZE + 2);
+            uint8_t tag_copy[GCM_TAG_SIZE];
+            memcpy(tag_copy, tag, GCM_TAG_SIZE);
+
+            uint8_t *plain = malloc(cipher_length > 0 ? cipher_length : 1);
+            err = plain != NULL ? secrets_crypt(false, passphrase, salt, iv, tag_copy, cipher, plain, cipher_length) : ESP_ERR_NO_MEM;
+            if (err == ESP_OK) err = entries_parse(plain, cipher_length, secret_count, staging, &consumed);
+            if (err == ESP_OK && consumed != cipher_length) err = ESP_ERR_INVALID_SIZE;
+            if (plain != NULL) memset(plain, 0, cipher_length);
+            free(plain);
+        }
+    }
+
+    if (err == ESP_OK) err = staging_apply(staging, applied, restart_required);
+
+    staging_free(staging);
+    return err;
+}
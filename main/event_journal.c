@@ -0,0 +1,220 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "include/event_journal.h"
+
+#include <freertos/FreeRTOS.h>
+
+#include <string.h>
+#include <esp_timer.h>
+
+/// Показатели считаются в микросекундах, наружу отдаются в секундах
+typedef struct event_link_state {
+    char target[EVENT_JOURNAL_TARGET_MAX];
+    bool tracking;
+    bool connected;
+    bool dropped;       // был обрыв после подключения, следующее подключение - восстановление
+    bool data_lost;
+
+    int64_t tracking_since;
+    int64_t state_since;
+    int64_t gap_since;
+
+    int64_t up;
+    int64_t down;
+    int64_t reconnect_time;
+    int64_t gap_time;
+
+    uint32_t connects;
+    uint32_t disconnects;
+    uint32_t failures;
+    uint32_t reconnects;
+    uint32_t gaps;
+    uint64_t bytes;
+} event_link_state_t;
+
+static portMUX_TYPE event_journal_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static event_journal_entry_t journal[EVENT_JOURNAL_SIZE];
+static uint32_t journal_seq = 0;        // номер следующей записи
+
+static event_link_state_t links[EVENT_SUBSYSTEM_COUNT];
+
+static const char *subsystem_names[EVENT_SUBSYSTEM_COUNT] = {
+        [EVENT_SUBSYSTEM_WIFI] = "wifi",
+        [EVENT_SUBSYSTEM_NTRIP_SERVER] = "ntrip_server",
+        [EVENT_SUBSYSTEM_NTRIP_SERVER_2] = "ntrip_server_2"
+};
+
+static const char *type_names[EVENT_TYPE_COUNT] = {
+        [EVENT_CONNECTING] = "connecting",
+        [EVENT_CONNECTED] = "connected",
+        [EVENT_DISCONNECTED] = "disconnected",
+        [EVENT_CONNECT_FAILED] = "connect_failed",
+        [EVENT_DATA_LOST] = "data_lost",
+        [EVENT_DATA_RESUMED] = "data_resumed"
+};
+
+static void event_link_update(event_link_state_t *link, event_type_t event, uint32_t bytes, int64_t now) {
+    if (!link->tracking) {
+        link->tracking = true;
+        link->tracking_since = now;
+        link->state_since = now;
+    }
+
+    switch (event) {
+        case EVENT_CONNECTED:
+            if (link->connected) break;
+            link->down += now - link->state_since;
+            if (link->dropped) {
+                link->reconnect_time += now - link->state_since;
+                link->reconnects++;
+                link->dropped = false;
+            }
+            link->connects++;
+            link->connected = true;
+            link->state_since = now;
+            break;
+        case EVENT_DISCONNECTED:
+            // Отключение без подключения - неудачная попытка (WiFi сообщает так о каждой)
+            if (!link->connected) {
+                link->failures++;
+                break;
+            }
+            link->up += now - link->state_since;
+            link->disconnects++;
+            link->bytes += bytes;
+            link->connected = false;
+            link->dropped = true;
+            link->state_since = now;
+            break;
+        case EVENT_CONNECT_FAILED:
+            link->failures++;
+            break;
+        case EVENT_DATA_LOST:
+            if (link->data_lost) break;
+            link->data_lost = true;
+            link->gap_since = now;
+            link->gaps++;
+            break;
+        case EVENT_DATA_RESUMED:
+            if (!link->data_lost) break;
+            link->gap_time += now - link->gap_since;
+            link->data_lost = false;
+            break;
+        default:
+            break;
+    }
+}
+
+void event_journal_add(event_subsystem_t subsystem, event_type_t event, int16_t reason, uint32_t bytes) {
+    if (subsystem >= EVENT_SUBSYSTEM_COUNT) return;
+
+    int64_t now = esp_timer_get_time();
+
+    taskENTER_CRITICAL(&event_journal_lock);
+    journal[journal_seq % EVENT_JOURNAL_SIZE] = (event_journal_entry_t) {
+            .time = now / 1000000,
+            .subsystem = subsystem,
+            .event = event,
+            .reason = reason,
+            .bytes = bytes
+    };
+    journal_seq++;
+
+    event_link_update(&links[subsystem], event, bytes, now);
+    taskEXIT_CRITICAL(&event_journal_lock);
+}
+
+void event_journal_target(event_subsystem_t subsystem, const char *target) {
+    if (subsystem >= EVENT_SUBSYSTEM_COUNT) return;
+
+    taskENTER_CRITICAL(&event_journal_lock);
+    event_link_state_t *link = &links[subsystem];
+    if (strncmp(link->target, target, sizeof(link->target) - 1) != 0) {
+        memset(link, 0, sizeof(*link));
+        strncpy(link->target, target, sizeof(link->target) - 1);
+    }
+    taskEXIT_CRITICAL(&event_journal_lock);
+}
+
+size_t event_journal_read(uint32_t *seq, event_journal_entry_t *entries, size_t max, uint32_t *next) {
+    taskENTER_CRITICAL(&event_journal_lock);
+    uint32_t first = journal_seq > EVENT_JOURNAL_SIZE ? journal_seq - EVENT_JOURNAL_SIZE : 0;
+    if (*seq < first || *seq > journal_seq) *seq = first;
+
+    size_t count = journal_seq - *seq;
+    if (count > max) count = max;
+    for (size_t i = 0; i < count; i++) {
+        entries[i] = journal[(*seq + i) % EVENT_JOURNAL_SIZE];
+    }
+    *next = *seq + count;
+    taskEXIT_CRITICAL(&event_journal_lock);
+
+    return count;
+}
+
+void event_journal_link(event_subsystem_t subsystem, event_journal_link_t *values) {
+    memset(values, 0, sizeof(*values));
+    if (subsystem >= EVENT_SUBSYSTEM_COUNT) return;
+
+    int64_t now = esp_timer_get_time();
+
+    taskENTER_CRITICAL(&event_journal_lock);
+    event_link_state_t link = links[subsystem];
+    taskEXIT_CRITICAL(&event_journal_lock);
+
+    // Текущие незавершённые интервалы учитываются на момент запроса
+    if (link.tracking) {
+        if (link.connected) {
+            link.up += now - link.state_since;
+        } else {
+            link.down += now - link.state_since;
+            if (link.dropped) link.reconnect_time += now - link.state_since;
+        }
+        if (link.data_lost) link.gap_time += now - link.gap_since;
+    }
+
+    memcpy(values->target, link.target, sizeof(values->target));
+    values->tracking = link.tracking;
+    values->connected = link.connected;
+    values->tracked = link.tracking ? (now - link.tracking_since) / 1000000 : 0;
+    values->up = link.up / 1000000;
+    values->down = link.down / 1000000;
+    values->connects = link.connects;
+    values->disconnects = link.disconnects;
+    values->failures = link.failures;
+    values->reconnects = link.reconnects;
+    values->reconnect_time = link.reconnect_time / 1000000;
+    values->gaps = link.gaps;
+    values->gap_time = link.gap_time / 1000000;
+    values->bytes = link.bytes;
+
+    int64_t total = link.up + link.down;
+    values->availability = total > 0 ? 100.0f * link.up / total : 0;
+    values->mtbf = link.disconnects > 0 ? link.up / link.disconnects / 1000000 : 0;
+    values->mean_reconnect = link.reconnects > 0 ? link.reconnect_time / link.reconnects / 1000000 : 0;
+}
+
+const char *event_journal_subsystem_name(event_subsystem_t subsystem) {
+    return subsystem < EVENT_SUBSYSTEM_COUNT ? subsystem_names[subsystem] : "unknown";
+}
+
+const char *event_journal_type_name(event_type_t event) {
+    return event < EVENT_TYPE_COUNT ? type_names[event] : "unknown";
+}
@@ -0,0 +1,59 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "gnss.h"
+
+#include <freertos/FreeRTOS.h>
+
+#include <esp_timer.h>
+#include <uart.h>
+
+// Разбор идёт в задаче цикла событий, под блокировкой только копирование готового решения
+static portMUX_TYPE gnss_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static nmea_parser_t parser;
+static gnss_state_t state;
+
+static void gnss_sentence(void *ctx, nmea_sentence_t type, const char *sentence, size_t length) {
+    if (type == NMEA_SENTENCE_OTHER) return;
+
+    int64_t now = esp_timer_get_time();
+
+    taskENTER_CRITICAL(&gnss_lock);
+    state.fix = parser.fix;
+    if (type == NMEA_SENTENCE_GGA || type == NMEA_SENTENCE_RMC) state.updated = now;
+    state.sentences = parser.sentences;
+    state.checksum_errors = parser.checksum_errors;
+    state.overflows = parser.overflows;
+    taskEXIT_CRITICAL(&gnss_lock);
+}
+
+static void gnss_uart_handler(void *handler_args, esp_event_base_t base, int32_t length, void *buffer) {
+    nmea_parser_feed(&parser, buffer, length);
+}
+
+void gnss_init() {
+    nmea_parser_init(&parser, gnss_sentence, NULL);
+    uart_register_read_handler(gnss_uart_handler);
+}
+
+void gnss_state(gnss_state_t *out) {
+    taskENTER_CRITICAL(&gnss_lock);
+    *out = state;
+    taskEXIT_CRITICAL(&gnss_lock);
+}
@@ -0,0 +1,324 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "include/heap_diag.h"
+
+#include <freertos/FreeRTOS.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#if CONFIG_HEAP_TRACING_STANDALONE
+#include <esp_heap_trace.h>
+#endif
+#if CONFIG_HEAP_TASK_TRACKING
+#include <esp_heap_task_info.h>
+#endif
+
+static const char *TAG = "HEAP_DIAG";
+
+static heap_diag_sample_t history[HEAP_DIAG_SAMPLES];
+static unsigned int history_index = 0, history_count = 0;
+static float fragmentation_trend = 0;
+static int32_t free_trend = 0;
+
+static SemaphoreHandle_t heap_diag_mutex;
+static esp_timer_handle_t heap_diag_timer;
+
+static float heap_diag_fragmentation(uint32_t free, uint32_t largest) {
+    return free > 0 ? 1.0f - (float) largest / free : 0;
+}
+
+static const heap_diag_sample_t *heap_diag_history_at(unsigned int i) {
+    return &history[(history_index + HEAP_DIAG_SAMPLES - history_count + i) % HEAP_DIAG_SAMPLES];
+}
+
+/// Наклон линейной регрессии по истории, пересчитанный в единицы за час
+static void heap_diag_trend() {
+    unsigned int n = history_count;
+    if (n < 2) return;
+
+    double sx = 0, sxx = 0, sf = 0, sxf = 0, sb = 0, sxb = 0;
+    for (unsigned int i = 0; i < n; i++) {
+        const heap_diag_sample_t *sample = heap_diag_history_at(i);
+        double fragmentation = heap_diag_fragmentation(sample->free, sample->largest);
+        double free = (double) sample->free * HEAP_DIAG_UNIT;
+
+        sx += i;
+        sxx += (double) i * i;
+        sf += fragmentation;
+        sxf += i * fragmentation;
+        sb += free;
+        sxb += i * free;
+    }
+
+    double denominator = n * sxx - sx * sx;
+    double samples_per_hour = 3600000.0 / HEAP_DIAG_PERIOD_MS;
+    fragmentation_trend = (n * sxf - sx * sf) / denominator * samples_per_hour;
+    free_trend = (n * sxb - sx * sb) / denominator * samples_per_hour;
+}
+
+static uint16_t heap_diag_units(size_t bytes) {
+    size_t units = bytes / HEAP_DIAG_UNIT;
+    return units > UINT16_MAX ? UINT16_MAX : units;
+}
+
+static void heap_diag_sample(void *arg) {
+    multi_heap_info_t info;
+    heap_caps_get_info(&info, MALLOC_CAP_DEFAULT);
+
+    // Обратный вызов esp_timer не ждёт читателя из httpd: иначе задерживаются все
+    // остальные таймеры. Пропущенный замер только немного прореживает историю
+    if (xSemaphoreTake(heap_diag_mutex, 0) != pdTRUE) return;
+
+    history[history_index] = (heap_diag_sample_t) {
+            .free = heap_diag_units(info.total_free_bytes),
+            .largest = heap_diag_units(info.largest_free_block)
+    };
+    history_index = (history_index + 1) % HEAP_DIAG_SAMPLES;
+    if (history_count < HEAP_DIAG_SAMPLES) history_count++;
+
+    heap_diag_trend();
+
+    xSemaphoreGive(heap_diag_mutex);
+}
+
+void heap_diag_init() {
+    heap_diag_mutex = xSemaphoreCreateMutex();
+
+    // Замеры в задаче esp_timer: отдельный стек под редкие замеры не нужен
+    esp_timer_create_args_t timer_args = {
+            .callback = heap_diag_sample,
+            .name = "heap_diag"
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &heap_diag_timer));
+    ESP_ERROR_CHECK(esp_timer_start_periodic(heap_diag_timer, (uint64_t) HEAP_DIAG_PERIOD_MS * 1000));
+
+    heap_diag_sample(NULL);
+}
+
+void heap_diag_status(heap_diag_status_t *status) {
+    multi_heap_info_t info;
+    heap_caps_get_info(&info, MALLOC_CAP_DEFAULT);
+
+    xSemaphoreTake(heap_diag_mutex, portMAX_DELAY);
+    *status = (heap_diag_status_t) {
+            .free = info.total_free_bytes,
+            .minimum = info.minimum_free_bytes,
+            .largest = info.largest_free_block,
+            .fragmentation = heap_diag_fragmentation(info.total_free_bytes, info.largest_free_block),
+            .fragmentation_trend = fragmentation_trend,
+            .free_trend = free_trend,
+            .samples = history_count
+    };
+    xSemaphoreGive(heap_diag_mutex);
+}
+
+size_t heap_diag_history(heap_diag_sample_t *samples, size_t length) {
+    xSemaphoreTake(heap_diag_mutex, portMAX_DELAY);
+
+    size_t count = history_count < length ? history_count : length;
+    for (size_t i = 0; i < count; i++) {
+        samples[i] = *heap_diag_history_at(history_count - count + i);
+    }
+
+    xSemaphoreGive(heap_diag_mutex);
+
+    return count;
+}
+
+#if CONFIG_HEAP_TRACING_STANDALONE
+
+static heap_trace_record_t *trace_records = NULL;
+static bool trace_running = false;
+
+bool heap_diag_trace_available() {
+    return true;
+}
+
+bool heap_diag_trace_running() {
+    return trace_running;
+}
+
+esp_err_t heap_diag_trace_start() {
+    if (trace_running) return ESP_OK;
+
+    if (trace_records == NULL) {
+        trace_records = heap_caps_calloc(HEAP_DIAG_TRACE_RECORDS, sizeof(heap_trace_record_t), MALLOC_CAP_INTERNAL);
+        if (trace_records == NULL) return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t err = heap_trace_init_standalone(trace_records, HEAP_DIAG_TRACE_RECORDS);
+    if (err == ESP_OK) err = heap_trace_start(HEAP_TRACE_LEAKS);
+    if (err != ESP_OK) return err;
+
+    trace_running = true;
+    ESP_LOGI(TAG, "Heap tracing started, %d records", HEAP_DIAG_TRACE_RECORDS);
+
+    return ESP_OK;
+}
+
+esp_err_t heap_diag_trace_stop() {
+    if (!trace_running) return ESP_OK;
+
+    esp_err_t err = heap_trace_stop();
+    if (err == ESP_OK) trace_running = false;
+
+    return err;
+}
+
+size_t heap_diag_trace_sites(heap_diag_site_t *sites, size_t length, size_t *records, bool *full) {
+    size_t record_count = trace_records != NULL ? heap_trace_get_count() : 0;
+    *records = record_count;
+    *full = record_count >= HEAP_DIAG_TRACE_RECORDS;
+    if (length == 0) return 0;
+
+    size_t count = 0;
+    for (size_t r = 0; r < record_count; r++) {
+        heap_trace_record_t record;
+        if (heap_trace_get(r, &record) != ESP_OK || record.address == NULL) continue;
+
+        // Сайты, не поместившиеся в таблицу, собираются в последнюю запись с pc = 0
+        uintptr_t pc = (uintptr_t) record.alloced_by[0];
+        size_t i;
+        for (i = 0; i < count && sites[i].pc != pc; i++);
+        if (i == count) {
+            if (count == length) {
+                i = length - 1;
+                sites[i].pc = 0;
+            } else {
+                sites[count++] = (heap_diag_site_t) {.pc = pc};
+            }
+        }
+
+        sites[i].count++;
+        sites[i].bytes += record.size;
+    }
+
+    // Сортировка по объёму, по убыванию
+    for (size_t i = 1; i < count; i++) {
+        heap_diag_site_t site = sites[i];
+        size_t j = i;
+        for (; j > 0 && sites[j - 1].bytes < site.bytes; j--) sites[j] = sites[j - 1];
+        sites[j] = site;
+    }
+
+    return count;
+}
+
+#else
+
+bool heap_diag_trace_available() {
+    return false;
+}
+
+bool heap_diag_trace_running() {
+    return false;
+}
+
+esp_err_t heap_diag_trace_start() {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t heap_diag_trace_stop() {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+size_t heap_diag_trace_sites(heap_diag_site_t *sites, size_t length, size_t *records, bool *full) {
+    *records = 0;
+    *full = false;
+
+    return 0;
+}
+
+#endif
+
+#if CONFIG_HEAP_TASK_TRACKING
+
+bool heap_diag_tasks_available() {
+    return true;
+}
+
+static void heap_diag_task_name(TaskHandle_t task, char *name, size_t length) {
+    if (task == NULL) {
+        strlcpy(name, "(startup)", length);
+        return;
+    }
+
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+    // Задача могла быть удалена, имя берётся только у существующих
+    UBaseType_t task_count = uxTaskGetNumberOfTasks() + 2;
+    TaskStatus_t *status = malloc(task_count * sizeof(TaskStatus_t));
+    if (status != NULL) {
+        task_count = uxTaskGetSystemState(status, task_count, NULL);
+        for (UBaseType_t i = 0; i < task_count; i++) {
+            if (status[i].xHandle == task) {
+                strlcpy(name, status[i].pcTaskName, length);
+                free(status);
+                return;
+            }
+        }
+        free(status);
+    }
+#endif
+
+    snprintf(name, length, "%p", task);
+}
+
+size_t heap_diag_tasks(heap_diag_task_t *tasks, size_t length) {
+    heap_task_totals_t *totals = calloc(HEAP_DIAG_TASKS, sizeof(heap_task_totals_t));
+    if (totals == NULL) return 0;
+
+    size_t total_count = 0;
+    heap_task_info_params_t params = {
+            .caps = {MALLOC_CAP_8BIT},
+            .mask = {MALLOC_CAP_8BIT},
+            .totals = totals,
+            .num_totals = &total_count,
+            .max_totals = HEAP_DIAG_TASKS,
+    };
+    heap_caps_get_per_task_info(&params);
+
+    size_t count = total_count < length ? total_count : length;
+    for (size_t i = 0; i < count; i++) {
+        heap_diag_task_name(totals[i].task, tasks[i].name, sizeof(tasks[i].name));
+        tasks[i].bytes = totals[i].size[0];
+        tasks[i].blocks = totals[i].count[0];
+    }
+
+    free(totals);
+
+    return count;
+}
+
+#else
+
+bool heap_diag_tasks_available() {
+    return false;
+}
+
+size_t heap_diag_tasks(heap_diag_task_t *tasks, size_t length) {
+    return 0;
+}
+
+#endif
@@ -49,8 +49,34 @@ typedef union {
 
 } config_item_value_t;
 
+/// Группы настроек: единица подписки на изменения и перезапуска подсистемы
+typedef enum {
+    CONFIG_GROUP_ADMIN = 1u << 0,
+    CONFIG_GROUP_BLUETOOTH = 1u << 1,
+    CONFIG_GROUP_NTRIP_SERVER = 1u << 2,
+    CONFIG_GROUP_NTRIP_SERVER_2 = 1u << 3,
+    CONFIG_GROUP_NTRIP_CLIENT = 1u << 4,
+    CONFIG_GROUP_UART = 1u << 5,                // Порт, пины, flow control - только после перезагрузки
+    CONFIG_GROUP_UART_LINE = 1u << 6,           // Скорость, формат кадра, форвардинг логов
+    CONFIG_GROUP_WIFI_AP = 1u << 7,
+    CONFIG_GROUP_WIFI_STA = 1u << 8,
+    CONFIG_GROUP_WIFI_SCAN = 1u << 9,
+    CONFIG_GROUP_SD_LOGGING = 1u << 10,
+    CONFIG_GROUP_SOCKET_SERVER = 1u << 11,
+    CONFIG_GROUP_SOCKET_CLIENT = 1u << 12,
+    CONFIG_GROUP_SURVEY = 1u << 13,            // Съёмка и координаты базы
+    CONFIG_GROUP_STATION = 1u << 14,           // Сообщения станции 1005/1006/1033
+
+    CONFIG_GROUP_ALL = (1u << 15) - 1
+} config_group_t;
+
+// Группы, значения которых читаются в момент использования и не требуют применения.
+// ADMIN применяется наблюдателем web_server, а не здесь: его значения кэшируются при старте
+#define CONFIG_GROUPS_ON_DEMAND (CONFIG_GROUP_WIFI_SCAN)
+
 typedef struct config_item {
     char *key;
+    config_group_t group;
     config_item_type_t type;
     bool secret;
     config_item_value_t def;
@@ -77,6 +103,7 @@ typedef struct config_item {
 #define KEY_CONFIG_NTRIP_SERVER_MOUNTPOINT "ntr_srv_mp"
 #define KEY_CONFIG_NTRIP_SERVER_USERNAME "ntr_srv_user"
 #define KEY_CONFIG_NTRIP_SERVER_PASSWORD "ntr_srv_pass"
+#define KEY_CONFIG_NTRIP_SERVER_MSM4 "ntr_srv_msm4"
 
 #define KEY_CONFIG_NTRIP_SERVER_2_ACTIVE "ntr_srv2_active"
 #define KEY_CONFIG_NTRIP_SERVER_2_COLOR "ntr_srv2_color"
@@ -85,6 +112,7 @@ typedef struct config_item {
 #define KEY_CONFIG_NTRIP_SERVER_2_MOUNTPOINT "ntr_srv2_mp"
 #define KEY_CONFIG_NTRIP_SERVER_2_USERNAME "ntr_srv2_user"
 #define KEY_CONFIG_NTRIP_SERVER_2_PASSWORD "ntr_srv2_pass"
+#define KEY_CONFIG_NTRIP_SERVER_2_MSM4 "ntr_srv2_msm4"
 
 #define KEY_CONFIG_NTRIP_CLIENT_ACTIVE "ntr_cli_active"
 #define KEY_CONFIG_NTRIP_CLIENT_COLOR "ntr_cli_color"
@@ -123,6 +151,7 @@ typedef struct config_item {
 #define KEY_CONFIG_WIFI_STA_SSID "w_sta_ssid"
 #define KEY_CONFIG_WIFI_STA_PASSWORD "w_sta_pass"
 #define KEY_CONFIG_WIFI_STA_SCAN_MODE_ALL "w_sta_scan_mode"
+#define KEY_CONFIG_WIFI_STA_SCAN_DWELL "w_sta_scan_dw"
 #define KEY_CONFIG_WIFI_STA_STATIC "w_sta_static"
 #define KEY_CONFIG_WIFI_STA_IP "w_sta_ip"
 #define KEY_CONFIG_WIFI_STA_GATEWAY "w_sta_gw"
@@ -147,13 +176,180 @@ typedef struct config_item {
 #define KEY_CONFIG_SOCKET_CLIENT_PORT "sock_cli_port"
 #define KEY_CONFIG_SOCKET_CLIENT_CONNECT_MESSAGE "sock_cli_conn_msg"
 
+// Survey
+#define KEY_CONFIG_SURVEY_AUTO "svy_auto"
+#define KEY_CONFIG_SURVEY_MIN_DURATION "svy_min_dur"
+#define KEY_CONFIG_SURVEY_ACCURACY "svy_acc"
+#define KEY_CONFIG_SURVEY_PROGRAM_RECEIVER "svy_ubx"
+#define KEY_CONFIG_BASE_VALID "base_valid"
+#define KEY_CONFIG_BASE_ECEF_X "base_x"
+#define KEY_CONFIG_BASE_ECEF_Y "base_y"
+#define KEY_CONFIG_BASE_ECEF_Z "base_z"
+#define KEY_CONFIG_BASE_ACCURACY "base_acc"
+
+// Station messages
+#define KEY_CONFIG_STATION_ACTIVE "stn_active"
+#define KEY_CONFIG_STATION_INTERVAL "stn_interval"
+#define KEY_CONFIG_STATION_ID "stn_id"
+#define KEY_CONFIG_STATION_ANTENNA_HEIGHT "stn_ant_height"
+#define KEY_CONFIG_STATION_ANTENNA_DESCRIPTOR "stn_ant_desc"
+#define KEY_CONFIG_STATION_ANTENNA_SETUP "stn_ant_setup"
+#define KEY_CONFIG_STATION_ANTENNA_SERIAL "stn_ant_serial"
+#define KEY_CONFIG_STATION_RECEIVER_TYPE "stn_rcv_type"
+#define KEY_CONFIG_STATION_RECEIVER_FIRMWARE "stn_rcv_fw"
+#define KEY_CONFIG_STATION_RECEIVER_SERIAL "stn_rcv_serial"
+
+/// Схема конфигурации: X(ключ, группа, тип, секрет, поле значения по умолчанию, значение по умолчанию)
+/// Порядок элементов задаёт индексы config_item_id_t и таблицы CONFIG_ITEMS.
+/// Значения по умолчанию раскрываются только в config.c (пины зависят от чипа)
+#define CONFIG_ITEMS_SCHEMA(X) \
+        /* Admin */ \
+        X(KEY_CONFIG_ADMIN_AUTH,                    ADMIN,          INT8,   false, int8,       0) \
+        X(KEY_CONFIG_ADMIN_USERNAME,                ADMIN,          STRING, false, str,        "") \
+        X(KEY_CONFIG_ADMIN_PASSWORD,                ADMIN,          STRING, true,  str,        "") \
+        /* Bluetooth */ \
+        X(KEY_CONFIG_BLUETOOTH_ACTIVE,              BLUETOOTH,      BOOL,   false, bool1,      false) \
+        X(KEY_CONFIG_BLUETOOTH_DEVICE_NAME,         BLUETOOTH,      STRING, false, str,        "") \
+        X(KEY_CONFIG_BLUETOOTH_DEVICE_DISCOVERABLE, BLUETOOTH,      BOOL,   false, bool1,      true) \
+        X(KEY_CONFIG_BLUETOOTH_PIN_CODE,            BLUETOOTH,      UINT16, true,  uint16,     1234) \
+        /* NTRIP */ \
+        X(KEY_CONFIG_NTRIP_SERVER_ACTIVE,           NTRIP_SERVER,   BOOL,   false, bool1,      false) \
+        X(KEY_CONFIG_NTRIP_SERVER_COLOR,            NTRIP_SERVER,   COLOR,  false, color.rgba, 0x00000055u) \
+        X(KEY_CONFIG_NTRIP_SERVER_HOST,             NTRIP_SERVER,   STRING, false, str,        "") \
+        X(KEY_CONFIG_NTRIP_SERVER_PORT,             NTRIP_SERVER,   UINT16, false, uint16,     2101) \
+        X(KEY_CONFIG_NTRIP_SERVER_MOUNTPOINT,       NTRIP_SERVER,   STRING, false, str,        "") \
+        X(KEY_CONFIG_NTRIP_SERVER_USERNAME,         NTRIP_SERVER,   STRING, false, str,        "") \
+        X(KEY_CONFIG_NTRIP_SERVER_PASSWORD,         NTRIP_SERVER,   STRING, true,  str,        "") \
+        X(KEY_CONFIG_NTRIP_SERVER_MSM4,             NTRIP_SERVER,   BOOL,   false, bool1,      false) \
+        X(KEY_CONFIG_NTRIP_SERVER_2_ACTIVE,         NTRIP_SERVER_2, BOOL,   false, bool1,      false) \
+        X(KEY_CONFIG_NTRIP_SERVER_2_COLOR,          NTRIP_SERVER_2, COLOR,  false, color.rgba, 0x00000055u) \
+        X(KEY_CONFIG_NTRIP_SERVER_2_HOST,           NTRIP_SERVER_2, STRING, false, str,        "") \
+        X(KEY_CONFIG_NTRIP_SERVER_2_PORT,           NTRIP_SERVER_2, UINT16, false, uint16,     2101) \
+        X(KEY_CONFIG_NTRIP_SERVER_2_MOUNTPOINT,     NTRIP_SERVER_2, STRING, false, str,        "") \
+        X(KEY_CONFIG_NTRIP_SERVER_2_USERNAME,       NTRIP_SERVER_2, STRING, false, str,        "") \
+        X(KEY_CONFIG_NTRIP_SERVER_2_PASSWORD,       NTRIP_SERVER_2, STRING, true,  str,        "") \
+        X(KEY_CONFIG_NTRIP_SERVER_2_MSM4,           NTRIP_SERVER_2, BOOL,   false, bool1,      false) \
+        X(KEY_CONFIG_NTRIP_CLIENT_ACTIVE,           NTRIP_CLIENT,   BOOL,   false, bool1,      false) \
+        X(KEY_CONFIG_NTRIP_CLIENT_COLOR,            NTRIP_CLIENT,   COLOR,  false, color.rgba, 0x00000055u) \
+        X(KEY_CONFIG_NTRIP_CLIENT_HOST,             NTRIP_CLIENT,   STRING, false, str,        "") \
+        X(KEY_CONFIG_NTRIP_CLIENT_PORT,             NTRIP_CLIENT,   UINT16, false, uint16,     2101) \
+        X(KEY_CONFIG_NTRIP_CLIENT_MOUNTPOINT,       NTRIP_CLIENT,   STRING, false, str,        "") \
+        X(KEY_CONFIG_NTRIP_CLIENT_USERNAME,         NTRIP_CLIENT,   STRING, false, str,        "") \
+        X(KEY_CONFIG_NTRIP_CLIENT_PASSWORD,         NTRIP_CLIENT,   STRING, true,  str,        "") \
+        /* UART */ \
+        X(KEY_CONFIG_UART_NUM,                      UART,           UINT8,  false, uint8,      UART_NUM_0) \
+        X(KEY_CONFIG_UART_TX_PIN,                   UART,           UINT8,  false, uint8,      DEFAULT_UART_TX_PIN) \
+        X(KEY_CONFIG_UART_RX_PIN,                   UART,           UINT8,  false, uint8,      DEFAULT_UART_RX_PIN) \
+        X(KEY_CONFIG_UART_RTS_PIN,                  UART,           UINT8,  false, uint8,      DEFAULT_UART_RTS_PIN) \
+        X(KEY_CONFIG_UART_CTS_PIN,                  UART,           UINT8,  false, uint8,      DEFAULT_UART_CTS_PIN) \
+        X(KEY_CONFIG_UART_BAUD_RATE,                UART_LINE,      UINT32, false, uint32,     115200) \
+        X(KEY_CONFIG_UART_DATA_BITS,                UART_LINE,      INT8,   false, int8,       UART_DATA_8_BITS) \
+        X(KEY_CONFIG_UART_STOP_BITS,                UART_LINE,      INT8,   false, int8,       UART_STOP_BITS_1) \
+        X(KEY_CONFIG_UART_PARITY,                   UART_LINE,      INT8,   false, int8,       UART_PARITY_DISABLE) \
+        X(KEY_CONFIG_UART_FLOW_CTRL_RTS,            UART,           BOOL,   false, bool1,      false) \
+        X(KEY_CONFIG_UART_FLOW_CTRL_CTS,            UART,           BOOL,   false, bool1,      false) \
+        X(KEY_CONFIG_UART_LOG_FORWARD,              UART_LINE,      BOOL,   false, bool1,      false) \
+        /* WiFi */ \
+        X(KEY_CONFIG_WIFI_AP_ACTIVE,                WIFI_AP,        BOOL,   false, bool1,      true) \
+        X(KEY_CONFIG_WIFI_AP_COLOR,                 WIFI_AP,        COLOR,  false, color.rgba, 0x00000055u) \
+        X(KEY_CONFIG_WIFI_AP_SSID,                  WIFI_AP,        STRING, false, str,        "") \
+        X(KEY_CONFIG_WIFI_AP_SSID_HIDDEN,           WIFI_AP,        BOOL,   false, bool1,      false) \
+        X(KEY_CONFIG_WIFI_AP_AUTH_MODE,             WIFI_AP,        UINT8,  false, uint8,      WIFI_AUTH_OPEN) \
+        X(KEY_CONFIG_WIFI_AP_PASSWORD,              WIFI_AP,        STRING, true,  str,        "") \
+        X(KEY_CONFIG_WIFI_AP_GATEWAY,               WIFI_AP,        IP,     false, uint32,     esp_netif_htonl(esp_netif_ip4_makeu32(192, 168, 4, 1))) \
+        X(KEY_CONFIG_WIFI_AP_SUBNET,                WIFI_AP,        UINT8,  false, uint8,      24) \
+        X(KEY_CONFIG_WIFI_STA_ACTIVE,               WIFI_STA,       BOOL,   false, bool1,      false) \
+        X(KEY_CONFIG_WIFI_STA_COLOR,                WIFI_STA,       COLOR,  false, color.rgba, 0x0044ff55u) \
+        X(KEY_CONFIG_WIFI_STA_SSID,                 WIFI_STA,       STRING, false, str,        "") \
+        X(KEY_CONFIG_WIFI_STA_PASSWORD,             WIFI_STA,       STRING, true,  str,        "") \
+        X(KEY_CONFIG_WIFI_STA_SCAN_MODE_ALL,        WIFI_STA,       BOOL,   false, bool1,      false) \
+        X(KEY_CONFIG_WIFI_STA_SCAN_DWELL,           WIFI_SCAN,      UINT16, false, uint16,     120) \
+        X(KEY_CONFIG_WIFI_STA_STATIC,               WIFI_STA,       BOOL,   false, bool1,      false) \
+        X(KEY_CONFIG_WIFI_STA_IP,                   WIFI_STA,       IP,     false, uint32,     esp_netif_htonl(esp_netif_ip4_makeu32(192, 168, 0, 100))) \
+        X(KEY_CONFIG_WIFI_STA_GATEWAY,              WIFI_STA,       IP,     false, uint32,     esp_netif_htonl(esp_netif_ip4_makeu32(192, 168, 0, 1))) \
+        X(KEY_CONFIG_WIFI_STA_SUBNET,               WIFI_STA,       UINT8,  false, uint8,      24) \
+        X(KEY_CONFIG_WIFI_STA_DNS_A,                WIFI_STA,       IP,     false, uint32,     esp_netif_htonl(esp_netif_ip4_makeu32(1, 1, 1, 1))) \
+        X(KEY_CONFIG_WIFI_STA_DNS_B,                WIFI_STA,       IP,     false, uint32,     esp_netif_htonl(esp_netif_ip4_makeu32(1, 0, 0, 1))) \
+        /* SD Logging */ \
+        X(KEY_CONFIG_SD_LOGGING_ACTIVE,             SD_LOGGING,     BOOL,   false, bool1,      false) \
+        /* Socket Server */ \
+        X(KEY_CONFIG_SOCKET_SERVER_ACTIVE,          SOCKET_SERVER,  BOOL,   false, bool1,      false) \
+        X(KEY_CONFIG_SOCKET_SERVER_TCP_ACTIVE,      SOCKET_SERVER,  BOOL,   false, bool1,      false) \
+        X(KEY_CONFIG_SOCKET_SERVER_TCP_PORT,        SOCKET_SERVER,  UINT16, false, uint16,     8880) \
+        X(KEY_CONFIG_SOCKET_SERVER_UDP_ACTIVE,      SOCKET_SERVER,  BOOL,   false, bool1,      false) \
+        X(KEY_CONFIG_SOCKET_SERVER_UDP_PORT,        SOCKET_SERVER,  UINT16, false, uint16,     8881) \
+        /* Socket Client */ \
+        X(KEY_CONFIG_SOCKET_CLIENT_ACTIVE,          SOCKET_CLIENT,  BOOL,   false, bool1,      false) \
+        X(KEY_CONFIG_SOCKET_CLIENT_TCP,             SOCKET_CLIENT,  BOOL,   false, bool1,      true) \
+        X(KEY_CONFIG_SOCKET_CLIENT_HOST,            SOCKET_CLIENT,  STRING, false, str,        "") \
+        X(KEY_CONFIG_SOCKET_CLIENT_PORT,            SOCKET_CLIENT,  UINT16, false, uint16,     8880) \
+        X(KEY_CONFIG_SOCKET_CLIENT_CONNECT_MESSAGE, SOCKET_CLIENT,  STRING, false, str,        "") \
+        /* Survey: секунды, мм; координаты базы ECEF и точность в 0.1 мм */ \
+        X(KEY_CONFIG_SURVEY_AUTO,                   SURVEY,         BOOL,   false, bool1,      false) \
+        X(KEY_CONFIG_SURVEY_MIN_DURATION,           SURVEY,         UINT32, false, uint32,     300) \
+        X(KEY_CONFIG_SURVEY_ACCURACY,               SURVEY,         UINT32, false, uint32,     2000) \
+        X(KEY_CONFIG_SURVEY_PROGRAM_RECEIVER,       SURVEY,         BOOL,   false, bool1,      false) \
+        X(KEY_CONFIG_BASE_VALID,                    SURVEY,         BOOL,   false, bool1,      false) \
+        X(KEY_CONFIG_BASE_ECEF_X,                   SURVEY,         INT64,  false, int64,      0) \
+        X(KEY_CONFIG_BASE_ECEF_Y,                   SURVEY,         INT64,  false, int64,      0) \
+        X(KEY_CONFIG_BASE_ECEF_Z,                   SURVEY,         INT64,  false, int64,      0) \
+        X(KEY_CONFIG_BASE_ACCURACY,                 SURVEY,         UINT32, false, uint32,     0) \
+        /* Station messages: интервал в секундах, высота антенны в мм */ \
+        X(KEY_CONFIG_STATION_ACTIVE,                STATION,        BOOL,   false, bool1,      false) \
+        X(KEY_CONFIG_STATION_INTERVAL,              STATION,        UINT16, false, uint16,     10) \
+        X(KEY_CONFIG_STATION_ID,                    STATION,        UINT16, false, uint16,     0) \
+        X(KEY_CONFIG_STATION_ANTENNA_HEIGHT,        STATION,        UINT16, false, uint16,     0) \
+        X(KEY_CONFIG_STATION_ANTENNA_DESCRIPTOR,    STATION,        STRING, false, str,        "") \
+        X(KEY_CONFIG_STATION_ANTENNA_SETUP,         STATION,        UINT8,  false, uint8,      0) \
+        X(KEY_CONFIG_STATION_ANTENNA_SERIAL,        STATION,        STRING, false, str,        "") \
+        X(KEY_CONFIG_STATION_RECEIVER_TYPE,         STATION,        STRING, false, str,        "") \
+        X(KEY_CONFIG_STATION_RECEIVER_FIRMWARE,     STATION,        STRING, false, str,        "") \
+        X(KEY_CONFIG_STATION_RECEIVER_SERIAL,       STATION,        STRING, false, str,        "")
+
+/// Индексы элементов конфигурации: KEY_CONFIG_xxx -> KEY_CONFIG_xxx_ID
+typedef enum {
+#define CONFIG_ITEM_ID(key, group, type, secret, field, def) key##_ID,
+    CONFIG_ITEMS_SCHEMA(CONFIG_ITEM_ID)
+#undef CONFIG_ITEM_ID
+    CONFIG_ITEM_COUNT
+} config_item_id_t;
+
+extern const config_item_t CONFIG_ITEMS[CONFIG_ITEM_COUNT];
+
+/// Изменение одного элемента: значения действительны только во время вызова наблюдателя
+typedef struct config_item_change {
+    const config_item_t *item;
+    const config_item_value_t *old_value;
+    const config_item_value_t *new_value;
+} config_item_change_t;
+
+/// Сводное уведомление об одном config_commit, отфильтрованное по группам подписчика
+typedef struct config_change {
+    uint32_t groups;                            // Изменившиеся группы
+    size_t count;
+    const config_item_change_t *items;
+} config_change_t;
+
+typedef void (*config_observer_t)(const config_change_t *change, void *arg);
+
+#define CONFIG_PROFILE_MAX 4
+#define CONFIG_PROFILE_NAME_MAX 32
+
+typedef struct config_snapshot config_snapshot_t;
+
 esp_err_t config_init();
 esp_err_t config_reset();
 
+/// Подписка на изменения групп настроек
+/// Наблюдатель вызывается из задачи config_notify (не из httpd) после config_commit
+/// и считается применяющим эти группы без перезагрузки
+esp_err_t config_subscribe(uint32_t groups, config_observer_t observer, void *arg);
+
 const config_item_t *config_items_get(int *count);
 const config_item_t * config_get_item(const char *key);
 
-#define CONF_ITEM( key ) config_get_item(key)
+// Поиск по ключу на этапе компиляции: O(1) индекс вместо strcmp по всей таблице
+#define CONF_ITEM( key ) (&CONFIG_ITEMS[key##_ID])
 
 bool config_get_bool1(const config_item_t *item);
 int8_t config_get_i8(const config_item_t *item);
@@ -166,7 +362,12 @@ uint32_t config_get_u32(const config_item_t *item);
 uint64_t config_get_u64(const config_item_t *item);
 config_color_t config_get_color(const config_item_t *item);
 
+/// Запись нескольких ключей с последующим config_commit без переключения профиля между ними
+void config_write_begin();
+void config_write_end();
+
 esp_err_t config_set(const config_item_t *item, void *value);
+esp_err_t config_set_value(const config_item_t *item, const config_item_value_t *value);
 esp_err_t config_set_bool1(const char *key, bool value);
 esp_err_t config_set_i8(const char *key, int8_t value);
 esp_err_t config_set_i16(const char *key, int16_t value);
@@ -184,7 +385,23 @@ esp_err_t config_get_str_blob_alloc(const config_item_t *item, void **out_value)
 esp_err_t config_get_str_blob(const config_item_t *item, void *out_value, size_t *length);
 esp_err_t config_get_primitive(const config_item_t *item, void *out_value);
 
+/// Профили: отдельные пространства NVS, переключение без перезаписи ключей
+int config_profile_active();
+esp_err_t config_profile_name(int profile, char *name, size_t length);
+esp_err_t config_profile_create(int profile, const char *name, int source);
+esp_err_t config_profile_rename(int profile, const char *name);
+esp_err_t config_profile_delete(int profile);
+esp_err_t config_profile_activate(int profile, bool *restart_required);
+esp_err_t config_profile_activate_next(bool *restart_required);
+
+config_snapshot_t *config_profile_snapshot(int profile);
+const config_item_value_t *config_snapshot_value(const config_snapshot_t *snapshot, const config_item_t *item);
+void config_snapshot_release(config_snapshot_t *snapshot);
+bool config_value_equal(const config_item_t *item, const config_item_value_t *a, const config_item_value_t *b);
+
 esp_err_t config_commit();
+/// Фиксация с оценкой необходимости перезагрузки: true, если изменилась группа без наблюдателя
+esp_err_t config_commit_live(bool *restart_required);
 void config_restart();
 
 // Socket configuration helper functions
@@ -0,0 +1,36 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#ifndef ESP32_XBEE_CONFIG_FORM_H
+#define ESP32_XBEE_CONFIG_FORM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include <cJSON.h>
+#include "config.h"
+
+/// Значение из тела POST /config в формате формы веб-интерфейса: примитивы и цвет
+/// строками ("1", "#rrggbb"), IP массивом из четырёх чисел строками.
+/// Строки и блобы указывают в entry и действительны, пока жив разобранный JSON.
+/// ESP_ERR_NOT_FOUND - значение не меняется (пустой примитив или CONFIG_VALUE_UNCHANGED),
+/// ESP_ERR_INVALID_ARG - неверный тип JSON, формат или выход за диапазон типа
+esp_err_t config_form_value(const config_item_t *item, const cJSON *entry, config_item_value_t *value);
+
+#endif //ESP32_XBEE_CONFIG_FORM_H
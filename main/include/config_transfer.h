@@ -0,0 +1,49 @@
+/*
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2019 Nebojsa Cvetkovic.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ESP32_XBEE_CONFIG_TRANSFER_H
+#define ESP32_XBEE_CONFIG_TRANSFER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include <cJSON.h>
+#include "config.h"
+
+#define CONFIG_TRANSFER_MAGIC "NTCF"
+#define CONFIG_TRANSFER_VERSION 1
+
+// Максимальный размер принимаемого файла конфигурации
+#define CONFIG_TRANSFER_MAX_SIZE 16384
+
+uint32_t config_schema_hash();
+
+/// Значение в JSON в формате экспорта (IP строкой, цвет "#rrggbbaa", блоб в base64)
+cJSON *config_value_to_json(const config_item_t *item, const config_item_value_t *value);
+
+/// Экспорт всех настроек. Секреты включаются только при заданной парольной фразе
+/// и шифруются AES-256-GCM ключом, выведенным из неё через PBKDF2
+cJSON *config_export_json(const char *passphrase);
+esp_err_t config_export_binary(const char *passphrase, uint8_t **out, size_t *length);
+
+/// Импорт настроек: всё содержимое проверяется до первой записи,
+/// затем значения пишутся в NVS и фиксируются одним config_commit
+esp_err_t config_import_json(const cJSON *root, const char *passphrase, int *applied, bool *restart_required);
+esp_err_t config_import_binary(const uint8_t *data, size_t length, const char *passphrase, int *applied, bool *restart_required);
+
+#endif //ESP32_XBEE_CONFIG_TRANSFER_H
@@ -0,0 +1,105 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef ESP32_XBEE_EVENT_JOURNAL_H
+#define ESP32_XBEE_EVENT_JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define EVENT_JOURNAL_SIZE 256
+#define EVENT_JOURNAL_TARGET_MAX 64
+
+typedef enum {
+    EVENT_SUBSYSTEM_WIFI = 0,
+    EVENT_SUBSYSTEM_NTRIP_SERVER,
+    EVENT_SUBSYSTEM_NTRIP_SERVER_2,
+    EVENT_SUBSYSTEM_COUNT
+} event_subsystem_t;
+
+typedef enum {
+    EVENT_CONNECTING = 0,
+    EVENT_CONNECTED,
+    EVENT_DISCONNECTED,
+    EVENT_CONNECT_FAILED,
+    EVENT_DATA_LOST,
+    EVENT_DATA_RESUMED,
+    EVENT_TYPE_COUNT
+} event_type_t;
+
+/// Коды причин NTRIP. Для WiFi используется код причины 802.11 из события отключения,
+/// для ошибок сокета - errno со знаком минус
+typedef enum {
+    EVENT_REASON_NONE = 0,
+    EVENT_REASON_RESOLVE,
+    EVENT_REASON_CONNECT,
+    EVENT_REASON_REQUEST,
+    EVENT_REASON_RESPONSE,
+    EVENT_REASON_REJECTED,
+    EVENT_REASON_SEND,
+    EVENT_REASON_NO_DATA,
+    EVENT_REASON_MEMORY
+} event_reason_t;
+
+/// Запись журнала, 12 байт
+typedef struct event_journal_entry {
+    uint32_t time;          // секунды с момента загрузки
+    uint8_t subsystem;
+    uint8_t event;
+    int16_t reason;
+    uint32_t bytes;         // байт передано за сеанс (для отключений)
+} event_journal_entry_t;
+
+/// Показатели доступности подсистемы с начала отслеживания (первого события)
+typedef struct event_journal_link {
+    char target[EVENT_JOURNAL_TARGET_MAX];
+    bool tracking;
+    bool connected;
+
+    uint32_t tracked;           // секунд с начала отслеживания
+    uint32_t up;                // секунд в подключённом состоянии
+    uint32_t down;              // секунд без подключения
+    uint32_t connects;
+    uint32_t disconnects;
+    uint32_t failures;          // неудачных попыток подключения
+    uint32_t reconnects;        // восстановлений после обрыва
+    uint32_t reconnect_time;    // суммарно секунд от обрыва до восстановления
+    uint32_t gaps;              // перерывов в данных от UART
+    uint32_t gap_time;
+    uint64_t bytes;
+
+    float availability;         // процент времени в подключённом состоянии
+    uint32_t mtbf;              // среднее время между обрывами, секунд (0 без обрывов)
+    uint32_t mean_reconnect;    // среднее время восстановления, секунд
+} event_journal_link_t;
+
+/// Безопасно вызывать из любой задачи
+void event_journal_add(event_subsystem_t subsystem, event_type_t event, int16_t reason, uint32_t bytes);
+/// Смена кастера сбрасывает накопленные показатели подсистемы
+void event_journal_target(event_subsystem_t subsystem, const char *target);
+
+/// Копирует записи с порядковым номером >= *seq, возвращает их число.
+/// *seq получает номер первой скопированной записи, *next - номер следующей за последней
+size_t event_journal_read(uint32_t *seq, event_journal_entry_t *entries, size_t max, uint32_t *next);
+void event_journal_link(event_subsystem_t subsystem, event_journal_link_t *link);
+
+const char *event_journal_subsystem_name(event_subsystem_t subsystem);
+const char *event_journal_type_name(event_type_t event);
+
+#endif //ESP32_XBEE_EVENT_JOURNAL_H
@@ -0,0 +1,40 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef ESP32_XBEE_GNSS_H
+#define ESP32_XBEE_GNSS_H
+
+#include <stdint.h>
+#include "protocol/nmea.h"
+
+/// Решение приёмника по его NMEA в потоке UART: общее состояние для выгрузки GGA
+/// на кастер, съёмки базы, синхронизации времени и интерфейса
+typedef struct gnss_state {
+    nmea_fix_t fix;
+    int64_t updated;            // esp_timer_get_time() последнего GGA/RMC, 0 - не было
+    uint32_t sentences;
+    uint32_t checksum_errors;
+    uint32_t overflows;
+} gnss_state_t;
+
+void gnss_init();
+
+/// Копия текущего состояния, безопасно из любой задачи
+void gnss_state(gnss_state_t *state);
+
+#endif //ESP32_XBEE_GNSS_H
@@ -0,0 +1,84 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef ESP32_XBEE_HEAP_DIAG_H
+#define ESP32_XBEE_HEAP_DIAG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+
+// Один замер раз в 5 минут, история за сутки
+#define HEAP_DIAG_PERIOD_MS (5 * 60 * 1000)
+#define HEAP_DIAG_SAMPLES 288
+// Отсчёты хранятся в единицах по 16 байт, чтобы поместиться в uint16_t
+#define HEAP_DIAG_UNIT 16
+
+// Трассировка выделений (CONFIG_HEAP_TRACING_STANDALONE)
+#define HEAP_DIAG_TRACE_RECORDS 64
+#define HEAP_DIAG_TRACE_SITES 16
+
+// Учёт памяти по задачам (CONFIG_HEAP_TASK_TRACKING)
+#define HEAP_DIAG_TASKS 24
+
+typedef struct heap_diag_sample {
+    uint16_t free;
+    uint16_t largest;
+} heap_diag_sample_t;
+
+typedef struct heap_diag_status {
+    uint32_t free;
+    uint32_t minimum;
+    uint32_t largest;
+    float fragmentation;        // 1 - largest / free
+    float fragmentation_trend;  // изменение фрагментации за час по истории
+    int32_t free_trend;         // изменение свободной памяти за час, байт
+    uint32_t samples;
+} heap_diag_status_t;
+
+typedef struct heap_diag_site {
+    uintptr_t pc;
+    uint32_t count;
+    uint32_t bytes;
+} heap_diag_site_t;
+
+typedef struct heap_diag_task {
+    char name[16];
+    uint32_t bytes;
+    uint32_t blocks;
+} heap_diag_task_t;
+
+void heap_diag_init();
+
+void heap_diag_status(heap_diag_status_t *status);
+/// Копирует историю от старых отсчётов к новым, возвращает их число
+size_t heap_diag_history(heap_diag_sample_t *samples, size_t length);
+
+bool heap_diag_trace_available();
+bool heap_diag_trace_running();
+esp_err_t heap_diag_trace_start();
+esp_err_t heap_diag_trace_stop();
+/// Невысвобожденные выделения, сгруппированные по адресу вызова, по убыванию объёма.
+/// full — буфер записей заполнен и новые выделения больше не отслеживаются
+size_t heap_diag_trace_sites(heap_diag_site_t *sites, size_t length, size_t *records, bool *full);
+
+bool heap_diag_tasks_available();
+size_t heap_diag_tasks(heap_diag_task_t *tasks, size_t length);
+
+#endif //ESP32_XBEE_HEAP_DIAG_H
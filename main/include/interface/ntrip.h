@@ -1,6 +1,10 @@
 #ifndef ESP32_XBEE_NTRIP_H
 #define ESP32_XBEE_NTRIP_H
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
 #define NTRIP_GENERIC_NAME "ESP32-XBee"
 
 #define NTRIP_SERVER_NAME NTRIP_GENERIC_NAME "_Server"
@@ -19,4 +23,30 @@ void ntrip_server_2_init();
 bool ntrip_response_ok(void *response);
 bool ntrip_response_sourcetable_ok(void *response);
 
+/// Поле записи таблицы источников: указатель в исходный буфер, без завершающего нуля
+typedef struct ntrip_field {
+    const char *data;
+    size_t length;
+} ntrip_field_t;
+
+/// Запись STR таблицы источников, отсутствующие в конце поля пустые
+typedef struct ntrip_sourcetable_stream {
+    ntrip_field_t mountpoint;
+    ntrip_field_t identifier;
+    ntrip_field_t format;
+    ntrip_field_t format_details;
+    ntrip_field_t nav_system;
+    ntrip_field_t network;
+    ntrip_field_t country;
+    double latitude;
+    double longitude;
+    bool nmea;                  // источник ждёт GGA от клиента
+    char authentication;        // N - нет, B - Basic, D - Digest
+    uint32_t bitrate;
+} ntrip_sourcetable_stream_t;
+
+/// Следующая запись STR из [*cursor, end) без копирования, завершающий ноль не нужен.
+/// Остальные строки (заголовки, CAS, NET) пропускаются; false в конце данных или на ENDSOURCETABLE
+bool ntrip_sourcetable_next(const char **cursor, const char *end, ntrip_sourcetable_stream_t *stream);
+
 #endif //ESP32_XBEE_NTRIP_H
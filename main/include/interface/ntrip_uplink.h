@@ -0,0 +1,42 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef ESP32_XBEE_NTRIP_UPLINK_H
+#define ESP32_XBEE_NTRIP_UPLINK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// Параметры подключения к кастеру в роли источника (SOURCE)
+typedef struct ntrip_uplink_config {
+    char *host;
+    uint16_t port;
+    const char *mountpoint;
+    const char *password;
+    const char *version;    // версия прошивки для Source-Agent
+    uint32_t timeout_ms;    // тайм-аут ответа и отправки, 0 - как в connect_socket (10 с)
+} ntrip_uplink_config_t;
+
+/// Подключение и SOURCE запрос. Возвращает сокет или -1, причина (event_reason_t) в *reason.
+/// Без зависимостей от ESP-IDF: тот же код работает в сборке на хосте
+int ntrip_uplink_connect(const ntrip_uplink_config_t *config, int16_t *reason);
+
+/// Отправка всего буфера. Возвращает число отправленных байт или -1 (errno сохраняется)
+int ntrip_uplink_send(int sock, const void *data, size_t length);
+
+#endif //ESP32_XBEE_NTRIP_UPLINK_H
@@ -0,0 +1,59 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef ESP32_XBEE_LOG_PERSIST_H
+#define ESP32_XBEE_LOG_PERSIST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Хвост лога в RTC памяти, переживает программный сброс, панику, watchdog и brownout.
+// Записи попадают туда при постановке в очередь, ещё не отформатированными, поэтому
+// сохраняются и строки, до которых задача логирования не дошла. Вывод обработчика
+// паники (причина, регистры, backtrace) идёт только в UART
+#define LOG_PERSIST_RTC_SIZE 2048
+
+// Необязательный раздел "log" во flash: кольцо страниц, запись пакетами
+#define LOG_PERSIST_PARTITION "log"
+#define LOG_PERSIST_PAGE_SIZE 1024
+#define LOG_PERSIST_FLUSH_MS (60 * 1000)
+
+// Сколько текста предыдущего сеанса хранится после загрузки
+#define LOG_PERSIST_PREVIOUS_MAX 4096
+#define LOG_PERSIST_LINE_MAX 512
+
+/// Форматирование записи RTC кольца при загрузке. format == NULL: в data готовая строка
+typedef size_t (*log_persist_format_t)(const char *format, const uint8_t *data, size_t length, char *out, size_t size);
+
+void log_persist_init(log_persist_format_t format);
+
+/// Вызывается при постановке записи в очередь лога, из любой задачи
+void log_persist_record(const char *format, const void *data, size_t length);
+/// Вызывается задачей логирования для каждой строки, копия во flash
+void log_persist_write(const char *line, size_t length);
+/// Запись неполной страницы во flash, если с прошлой записи прошло LOG_PERSIST_FLUSH_MS
+void log_persist_flush(bool force);
+
+void log_persist_set_reset_reason(const char *reason);
+const char *log_persist_reset_reason();
+
+/// Хвост лога предыдущего сеанса, NULL если его нет
+const char *log_persist_previous(size_t *length, const char **source);
+
+#endif //ESP32_XBEE_LOG_PERSIST_H
@@ -0,0 +1,31 @@
+/*
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2019 Nebojsa Cvetkovic.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ESP32_XBEE_NET_H
+#define ESP32_XBEE_NET_H
+
+/// Сокетные функции без зависимостей от ESP-IDF, собираются и на хосте
+
+#define CONNECT_SOCKET_ERROR_OPTS -3
+#define CONNECT_SOCKET_ERROR_RESOLVE -2
+#define CONNECT_SOCKET_ERROR_CONNECT -1
+
+void destroy_socket(int *socket);
+char *extract_http_header(const char *buffer, const char *key);
+int connect_socket(char *host, int port, int socktype);
+
+#endif //ESP32_XBEE_NET_H
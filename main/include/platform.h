@@ -0,0 +1,35 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef ESP32_XBEE_PLATFORM_H
+#define ESP32_XBEE_PLATFORM_H
+
+#include <stdint.h>
+
+/// Тонкий слой платформы для переносимой части конвейера (кадрирование, протокол,
+/// повторы, трассировка). На устройстве - FreeRTOS и esp_timer (platform.c),
+/// при сборке на хосте - POSIX (host/platform_posix.c)
+
+/// Монотонное время в микросекундах
+uint64_t platform_time_us();
+void platform_sleep_ms(uint32_t ms);
+
+/// Номер текущей задачи (потока) для трассировки
+uint16_t platform_task_id();
+
+#endif //ESP32_XBEE_PLATFORM_H
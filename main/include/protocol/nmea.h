@@ -1,7 +1,116 @@
 #ifndef ESP32_XBEE_NMEA_H
 #define ESP32_XBEE_NMEA_H
 
-int nmea_asprintf(char **strp, const char *fmt, ...);
-int nmea_vasprintf(char **strp, const char *fmt, va_list args);
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// Вывод в буфер размером NMEA_EMIT_MAX вмещает любое предложение $PESP устройства
+#define NMEA_EMIT_MAX 160
+
+/// Семейства $PESP с заранее посчитанной суммой префикса
+typedef enum nmea_pesp {
+    NMEA_PESP_INIT = 0,     // $PESP,INIT,
+    NMEA_PESP_WIFI_STA,     // $PESP,WIFI,STA,
+    NMEA_PESP_WIFI_AP,      // $PESP,WIFI,AP,
+    NMEA_PESP_NTRIP_SRV,    // $PESP,NTRIP,SRV,
+    NMEA_PESP_NTRIP_SRV2,   // $PESP,NTRIP,SRV2,
+    NMEA_PESP_CFG,          // $PESP,CFG,
+    NMEA_PESP_HEAP,         // $PESP,HEAP,
+    NMEA_PESP_DBG,          // $PESP,DBG,
+    NMEA_PESP_COUNT
+} nmea_pesp_t;
+
+/// Предложение с суммой и CRLF в буфер вызывающего за один проход, без кучи и блокировок
+/// (можно из ISR). fmt - подмножество printf: d i u x X c s %, флаги '0' '-', ширина, точность.
+/// Не помещающееся обрезается, предложение остаётся целым. Возвращает длину без нуля
+int nmea_format(char *out, size_t size, const char *fmt, ...);
+int nmea_vformat(char *out, size_t size, const char *fmt, va_list args);
+
+/// То же с префиксом семейства: fmt - поля после префикса
+int nmea_pesp(char *out, size_t size, nmea_pesp_t family, const char *fmt, ...);
+int nmea_vpesp(char *out, size_t size, nmea_pesp_t family, const char *fmt, va_list args);
+
+/// NMEA 0183 ограничивает предложение 82 символами, приёмники с расширенными
+/// сообщениями (NMEA 4.11, проприетарные) иногда длиннее
+#define NMEA_SENTENCE_MAX 128
+#define NMEA_FIELDS_MAX 24
+
+typedef enum nmea_sentence {
+    NMEA_SENTENCE_OTHER = 0,
+    NMEA_SENTENCE_GGA,
+    NMEA_SENTENCE_RMC,
+    NMEA_SENTENCE_GSA,
+    NMEA_SENTENCE_GSV
+} nmea_sentence_t;
+
+/// Системы для подсчёта видимых спутников по GSV (по идентификатору источника)
+typedef enum nmea_system {
+    NMEA_SYSTEM_GPS = 0,
+    NMEA_SYSTEM_GLONASS,
+    NMEA_SYSTEM_GALILEO,
+    NMEA_SYSTEM_BEIDOU,
+    NMEA_SYSTEM_QZSS,
+    NMEA_SYSTEM_OTHER,
+    NMEA_SYSTEM_COUNT
+} nmea_system_t;
+
+/// Состояние решения, собранное из GGA/RMC/GSA/GSV. Координаты в фиксированной
+/// точке, без float: разбор не зависит от FPU и не теряет точность RTK
+typedef struct nmea_fix {
+    int32_t latitude;           // 1e-7 градуса, север положительный
+    int32_t longitude;          // 1e-7 градуса, восток положительный
+    int32_t altitude;           // мм над геоидом (GGA)
+    int32_t geoid_separation;   // мм (GGA)
+    uint32_t speed;             // мм/с (RMC)
+    uint16_t course;            // сотые доли градуса (RMC)
+
+    uint8_t quality;            // GGA: 0 нет, 1 GPS, 2 DGPS, 4 RTK fixed, 5 RTK float, 6 счисление
+    uint8_t mode;               // GSA: 1 нет, 2 2D, 3 3D
+    uint8_t satellites_used;    // GGA
+    uint8_t satellites_in_view; // сумма по системам GSV
+    uint8_t in_view[NMEA_SYSTEM_COUNT];
+    uint16_t hdop;              // сотые доли
+    uint16_t pdop;
+    uint16_t vdop;
+
+    uint8_t hour, minute, second;
+    uint16_t millisecond;
+    uint8_t day, month;
+    uint16_t year;
+
+    bool position_valid;        // последняя GGA/RMC с решением
+    bool time_valid;
+    bool date_valid;
+} nmea_fix_t;
+
+/// Вызывается для каждого предложения с верной контрольной суммой после обновления
+/// fix. sentence - от '$' до контрольной суммы включительно, без CRLF, с завершающим нулём
+typedef void (*nmea_sentence_handler_t)(void *ctx, nmea_sentence_t type, const char *sentence, size_t length);
+
+/// Потоковый разбор NMEA без выделения памяти: данные подаются кусками любой длины,
+/// двоичные данные между предложениями (RTCM 3, UBX) пропускаются
+typedef struct nmea_parser {
+    char buffer[NMEA_SENTENCE_MAX + 1];
+    size_t used;
+    size_t star;                // позиция '*' или 0
+    uint8_t checksum;
+
+    nmea_fix_t fix;
+
+    nmea_sentence_handler_t handler;
+    void *ctx;
+
+    uint32_t sentences;
+    uint32_t checksum_errors;   // неверная или отсутствующая контрольная сумма
+    uint32_t overflows;         // предложения длиннее NMEA_SENTENCE_MAX
+} nmea_parser_t;
+
+void nmea_parser_init(nmea_parser_t *parser, nmea_sentence_handler_t handler, void *ctx);
+void nmea_parser_feed(nmea_parser_t *parser, const uint8_t *data, size_t length);
+
+/// Разбор одного предложения (без CRLF, контрольная сумма уже проверена) в fix
+nmea_sentence_t nmea_parse_sentence(nmea_fix_t *fix, const char *sentence, size_t length);
 
 #endif //ESP32_XBEE_NMEA_H
@@ -0,0 +1,149 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef ESP32_XBEE_RTCM3_H
+#define ESP32_XBEE_RTCM3_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define RTCM3_PREAMBLE 0xD3
+#define RTCM3_HEADER_SIZE 3
+#define RTCM3_CRC_SIZE 3
+#define RTCM3_PAYLOAD_MAX 1023
+#define RTCM3_FRAME_MAX (RTCM3_HEADER_SIZE + RTCM3_PAYLOAD_MAX + RTCM3_CRC_SIZE)
+
+/// Вызывается для каждого кадра с верной контрольной суммой (заголовок, данные и CRC)
+typedef void (*rtcm3_frame_handler_t)(void *ctx, const uint8_t *frame, size_t length);
+
+/// Потоковое кадрирование RTCM 3: данные подаются кусками любой длины,
+/// после ошибки CRC поиск следующей преамбулы продолжается со следующего байта
+typedef struct rtcm3_framer {
+    uint8_t buffer[RTCM3_FRAME_MAX];
+    size_t used;
+
+    rtcm3_frame_handler_t handler;
+    void *ctx;
+
+    uint32_t frames;
+    uint32_t crc_errors;
+    uint32_t skipped;       // байт вне кадров
+} rtcm3_framer_t;
+
+uint32_t rtcm3_crc24q(const uint8_t *data, size_t length);
+
+void rtcm3_framer_init(rtcm3_framer_t *framer, rtcm3_frame_handler_t handler, void *ctx);
+void rtcm3_framer_feed(rtcm3_framer_t *framer, const uint8_t *data, size_t length);
+
+/// Номер сообщения (первые 12 бит данных) кадра не короче 5 байт
+uint16_t rtcm3_message_type(const uint8_t *frame);
+
+/// Сборка кадра: заголовок и CRC вокруг payload, out не меньше length + 6 байт. Возвращает длину кадра
+size_t rtcm3_frame_build(uint8_t *out, const uint8_t *payload, size_t length);
+
+/// Битовые поля данных сообщения, старший бит первым. bits до 64
+uint64_t rtcm3_get_bits(const uint8_t *buffer, size_t position, unsigned bits);
+int64_t rtcm3_get_signed_bits(const uint8_t *buffer, size_t position, unsigned bits);
+void rtcm3_set_bits(uint8_t *buffer, size_t position, unsigned bits, uint64_t value);
+
+/// Последнее сообщение наблюдений эпохи: MSM1-7 со сброшенным битом Multiple Message,
+/// 1001-1004 и 1009-1012 со сброшенным флагом синхронных наблюдений
+bool rtcm3_epoch_end(const uint8_t *frame, size_t length);
+
+typedef enum rtcm3_scan_event {
+    RTCM3_SCAN_NONE = 0,
+    RTCM3_SCAN_FRAME,               // закончился кадр с верной CRC
+    RTCM3_SCAN_EPOCH_END            // закончился последний кадр эпохи
+} rtcm3_scan_event_t;
+
+/// Границы кадров в потоке без копирования: CRC считается по ходу, из кадра сохраняются
+/// только заголовок и начало данных. После ошибки CRC поиск продолжается за ложным
+/// кадром, а не с байта после его преамбулы, как в rtcm3_framer_t
+typedef struct rtcm3_scanner {
+    uint8_t head[RTCM3_HEADER_SIZE + 8];
+    size_t used;                    // байт текущего кадра, 0 - поиск преамбулы
+    size_t length;
+    uint32_t crc;
+    uint32_t received_crc;
+
+    uint32_t frames;
+    uint32_t crc_errors;
+} rtcm3_scanner_t;
+
+void rtcm3_scanner_init(rtcm3_scanner_t *scanner);
+
+/// Разбор до конца ближайшего кадра включительно. Возвращает число поглощённых байт;
+/// *event - чем закончился последний из них
+size_t rtcm3_scanner_feed(rtcm3_scanner_t *scanner, const uint8_t *data, size_t length, rtcm3_scan_event_t *event);
+
+/// Описание базовой станции для 1005/1006 и 1033. Строки до 31 символа
+typedef struct rtcm3_station {
+    uint16_t station_id;
+    int64_t ecef[3];                // ARP, 0.1 мм
+    uint16_t antenna_height;        // 0.1 мм над маркером (1006)
+    uint8_t itrf_year;
+    bool gps;
+    bool glonass;
+    bool galileo;
+
+    char antenna_descriptor[32];
+    uint8_t antenna_setup;
+    char antenna_serial[32];
+    char receiver_type[32];
+    char receiver_firmware[32];
+    char receiver_serial[32];
+} rtcm3_station_t;
+
+// Наибольшие данные 1006 и 1033 (пять строк по 31 символу)
+#define RTCM3_1006_SIZE 21
+#define RTCM3_1033_SIZE_MAX 164
+
+/// Данные сообщений (без заголовка и CRC) в payload. Возвращают их длину
+size_t rtcm3_encode_1005(uint8_t *payload, const rtcm3_station_t *station);
+size_t rtcm3_encode_1006(uint8_t *payload, const rtcm3_station_t *station);
+size_t rtcm3_encode_1033(uint8_t *payload, const rtcm3_station_t *station);
+
+/// Запись потока: число записанных байт или отрицательное значение при ошибке
+typedef int (*rtcm3_write_t)(void *ctx, const void *data, size_t length);
+
+/// MSM7 (1077, 1087, 1097, 1127 и др.) в MSM4 того же ГНСС: без расширенных данных спутников,
+/// скорости изменения фазы и с полями сигналов MSM4 меньшей разрядности. Кадр с верной CRC,
+/// out не меньше length байт и может совпадать с frame. Возвращает длину кадра MSM4
+/// или 0, если кадр не MSM7 или его длина не сходится с масками
+size_t rtcm3_msm7_to_msm4(const uint8_t *frame, size_t length, uint8_t *out);
+
+/// Поток с заменой MSM7 на MSM4: копируются только кадры MSM7, остальное (другие
+/// сообщения, NMEA, мусор) проходит без изменений и без копирования
+typedef struct rtcm3_msm4_stream {
+    uint8_t buffer[RTCM3_FRAME_MAX];
+    size_t used;                    // байт возможного кадра в buffer
+    size_t length;                  // его длина по заголовку
+    size_t skip;                    // байт другого кадра, которые пройдут без разбора
+
+    uint32_t converted;
+    uint32_t crc_errors;            // кадров MSM7 с неверной CRC, переданы как есть
+    uint64_t saved;                 // байт, сэкономленных заменой
+} rtcm3_msm4_stream_t;
+
+void rtcm3_msm4_stream_init(rtcm3_msm4_stream_t *stream);
+
+/// Возвращает число записанных байт (после замены) или ошибку write
+int rtcm3_msm4_stream_feed(rtcm3_msm4_stream_t *stream, const void *data, size_t length, rtcm3_write_t write, void *ctx);
+
+#endif //ESP32_XBEE_RTCM3_H
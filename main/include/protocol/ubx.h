@@ -0,0 +1,188 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef ESP32_XBEE_UBX_H
+#define ESP32_XBEE_UBX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define UBX_SYNC_1 0xB5
+#define UBX_SYNC_2 0x62
+#define UBX_HEADER_SIZE 6
+#define UBX_CHECKSUM_SIZE 2
+// Самые длинные разбираемые ответы (CFG-VALGET, MON-*) заметно короче
+#define UBX_PAYLOAD_MAX 512
+#define UBX_FRAME_MAX (UBX_HEADER_SIZE + UBX_PAYLOAD_MAX + UBX_CHECKSUM_SIZE)
+
+#define UBX_CLASS_NAV 0x01
+#define UBX_CLASS_ACK 0x05
+#define UBX_CLASS_CFG 0x06
+#define UBX_CLASS_MON 0x0A
+
+#define UBX_NAV_PVT 0x07
+#define UBX_NAV_SVIN 0x3B
+#define UBX_ACK_NAK 0x00
+#define UBX_ACK_ACK 0x01
+#define UBX_CFG_VALSET 0x8A
+#define UBX_CFG_VALGET 0x8B
+#define UBX_MON_HW 0x09
+
+/// Слои хранения конфигурации
+#define UBX_LAYER_RAM 0x01
+#define UBX_LAYER_BBR 0x02
+#define UBX_LAYER_FLASH 0x04
+
+/// Ключи режима базы (CFG-TMODE-*)
+#define UBX_KEY_TMODE_MODE 0x20030001           // 0 выключен, 1 съёмка, 2 фиксированная позиция
+#define UBX_KEY_TMODE_POS_TYPE 0x20030002       // 0 ECEF, 1 LLH
+#define UBX_KEY_TMODE_ECEF_X 0x40030003         // см
+#define UBX_KEY_TMODE_ECEF_Y 0x40030004
+#define UBX_KEY_TMODE_ECEF_Z 0x40030005
+#define UBX_KEY_TMODE_ECEF_X_HP 0x20030006      // 0.1 мм
+#define UBX_KEY_TMODE_ECEF_Y_HP 0x20030007
+#define UBX_KEY_TMODE_ECEF_Z_HP 0x20030008
+#define UBX_KEY_TMODE_FIXED_POS_ACC 0x4003000F  // 0.1 мм
+#define UBX_KEY_TMODE_SVIN_MIN_DUR 0x40030010   // с
+#define UBX_KEY_TMODE_SVIN_ACC_LIMIT 0x40030011 // 0.1 мм
+
+#define UBX_TMODE_DISABLED 0
+#define UBX_TMODE_SURVEY_IN 1
+#define UBX_TMODE_FIXED 2
+
+/// Вызывается для каждого кадра с верной контрольной суммой
+typedef void (*ubx_frame_handler_t)(void *ctx, uint8_t class, uint8_t id, const uint8_t *payload, size_t length);
+
+/// Потоковое кадрирование UBX рядом с NMEA и RTCM 3 в одном потоке: после ошибки
+/// контрольной суммы поиск синхронизации продолжается со следующего байта
+typedef struct ubx_framer {
+    uint8_t buffer[UBX_FRAME_MAX];
+    size_t used;
+
+    ubx_frame_handler_t handler;
+    void *ctx;
+
+    uint32_t frames;
+    uint32_t checksum_errors;
+    uint32_t oversized;     // кадры длиннее UBX_PAYLOAD_MAX
+} ubx_framer_t;
+
+/// Контрольная сумма Флетчера-8 (CK_A, CK_B) по классу, номеру, длине и данным
+void ubx_checksum(const uint8_t *data, size_t length, uint8_t checksum[2]);
+
+void ubx_framer_init(ubx_framer_t *framer, ubx_frame_handler_t handler, void *ctx);
+void ubx_framer_feed(ubx_framer_t *framer, const uint8_t *data, size_t length);
+
+/// Сборка кадра в out размером size. Возвращает длину кадра или 0, если не помещается
+size_t ubx_frame_build(uint8_t *out, size_t size, uint8_t class, uint8_t id, const uint8_t *payload, size_t length);
+
+/// NAV-PVT: навигационное решение
+typedef struct ubx_nav_pvt {
+    uint32_t itow;          // мс недели GPS
+    uint16_t year;
+    uint8_t month, day, hour, minute, second;
+    bool time_valid;        // validDate и validTime
+    uint8_t fix_type;       // 0 нет, 2 2D, 3 3D, 5 только время...
+    uint8_t carrier;        // 0 нет, 1 float, 2 fixed
+    bool fix_ok;
+    uint8_t satellites;
+    int32_t longitude;      // 1e-7 градуса
+    int32_t latitude;
+    int32_t height;         // мм над эллипсоидом
+    int32_t height_msl;     // мм над геоидом
+    uint32_t h_acc;         // мм
+    uint32_t v_acc;
+    uint16_t pdop;          // сотые доли
+} ubx_nav_pvt_t;
+
+/// NAV-SVIN: ход съёмки позиции базы
+typedef struct ubx_nav_svin {
+    uint32_t duration;      // с
+    int64_t mean[3];        // ECEF X, Y, Z в 0.1 мм
+    uint32_t mean_acc;      // 0.1 мм
+    uint32_t observations;
+    bool valid;
+    bool active;
+} ubx_nav_svin_t;
+
+/// MON-HW: состояние антенны и помех
+typedef struct ubx_mon_hw {
+    uint16_t noise;         // шум на мс
+    uint16_t agc;           // 0..8191
+    uint8_t antenna_status; // 0 инициализация, 1 неизвестно, 2 ОК, 3 КЗ, 4 обрыв
+    uint8_t antenna_power;  // 0 выкл, 1 вкл, 2 неизвестно
+    uint8_t jamming_state;  // 0 неизвестно, 1 ОК, 2 предупреждение, 3 критично
+    uint8_t jamming;        // индикатор CW-помех 0..255
+} ubx_mon_hw_t;
+
+bool ubx_nav_pvt_decode(const uint8_t *payload, size_t length, ubx_nav_pvt_t *pvt);
+bool ubx_nav_svin_decode(const uint8_t *payload, size_t length, ubx_nav_svin_t *svin);
+bool ubx_mon_hw_decode(const uint8_t *payload, size_t length, ubx_mon_hw_t *hw);
+
+/// Для ACK-ACK/ACK-NAK: подтверждён ли кадр class/id
+bool ubx_ack_matches(const uint8_t *payload, size_t length, uint8_t class, uint8_t id);
+
+/// Размер значения ключа конфигурации в байтах (по битам 28-30 ключа), 0 - неизвестный
+size_t ubx_key_size(uint32_t key);
+
+#define UBX_VALSET_KEYS_MAX 32
+
+/// Данные CFG-VALSET: слои и пары ключ-значение
+typedef struct ubx_valset {
+    uint8_t payload[4 + UBX_VALSET_KEYS_MAX * 12];
+    size_t length;
+    uint8_t count;
+} ubx_valset_t;
+
+void ubx_valset_init(ubx_valset_t *set, uint8_t layers);
+/// false, если набор полон или размер ключа неизвестен
+bool ubx_valset_add(ubx_valset_t *set, uint32_t key, uint64_t value);
+
+/// Данные запроса CFG-VALGET для слоя (0 - RAM, 7 - по умолчанию). Возвращает длину
+size_t ubx_valget_build(uint8_t *payload, size_t size, uint8_t layer, const uint32_t *keys, size_t count);
+/// Перебор пар ответа CFG-VALGET; *cursor в начале - данные ответа целиком
+bool ubx_valget_next(const uint8_t **cursor, const uint8_t *end, uint32_t *key, uint64_t *value);
+
+/// Порты приёмника для ключей частоты сообщений CFG-MSGOUT-*
+typedef enum ubx_port {
+    UBX_PORT_I2C = 0,
+    UBX_PORT_UART1,
+    UBX_PORT_UART2,
+    UBX_PORT_USB,
+    UBX_PORT_SPI,
+    UBX_PORT_COUNT
+} ubx_port_t;
+
+typedef struct ubx_message {
+    const char *name;       // "GGA", "RTCM1077", "NAV-PVT"...
+    uint32_t key;           // ключ CFG-MSGOUT-* для I2C, другие порты следуют за ним
+} ubx_message_t;
+
+extern const ubx_message_t UBX_MESSAGES[];
+extern const size_t UBX_MESSAGE_COUNT;
+
+const ubx_message_t *ubx_message_find(const char *name);
+/// Ключ частоты сообщения на порту (в эпохах навигации, 0 - выключено)
+uint32_t ubx_message_key(const ubx_message_t *message, ubx_port_t port);
+
+const char *ubx_port_name(ubx_port_t port);
+/// UBX_PORT_COUNT, если имя неизвестно
+ubx_port_t ubx_port_find(const char *name);
+
+#endif //ESP32_XBEE_UBX_H
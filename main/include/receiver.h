@@ -0,0 +1,69 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef ESP32_XBEE_RECEIVER_H
+#define ESP32_XBEE_RECEIVER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include "protocol/ubx.h"
+
+/// Ожидание ACK/NAK приёмника на одну транзакцию UBX
+#define RECEIVER_ACK_TIMEOUT_MS 1000
+
+/// Состояние приёмника u-blox по его сообщениям UBX в потоке UART
+typedef struct receiver_state {
+    ubx_nav_pvt_t pvt;
+    ubx_nav_svin_t svin;
+    ubx_mon_hw_t hw;
+    int64_t pvt_updated;        // esp_timer_get_time() последнего сообщения, 0 - не было
+    int64_t svin_updated;
+    int64_t hw_updated;
+
+    uint32_t frames;
+    uint32_t checksum_errors;
+    uint32_t acks;
+    uint32_t naks;
+    uint32_t timeouts;
+} receiver_state_t;
+
+void receiver_init();
+
+/// Копия текущего состояния, безопасно из любой задачи
+void receiver_state(receiver_state_t *state);
+
+/// Транзакции ждут ответа приёмника, их нельзя вызывать из задачи цикла событий
+/// (в ней разбирается поток UART). ESP_OK - ACK, ESP_FAIL - NAK, ESP_ERR_TIMEOUT - нет ответа
+
+/// CFG-VALSET
+esp_err_t receiver_valset(const ubx_valset_t *set);
+
+/// CFG-VALGET: значения ключей слоя (0 - RAM) в том же порядке. ESP_ERR_NOT_FOUND - ключа нет в ответе
+esp_err_t receiver_valget(uint8_t layer, const uint32_t *keys, size_t count, uint64_t *values);
+
+/// Съёмка позиции базы: до min_duration секунд и точности accuracy (0.1 мм), после - фиксированная позиция
+esp_err_t receiver_survey_start(uint32_t min_duration, uint32_t accuracy, uint8_t layers);
+
+/// Фиксированная позиция базы в ECEF (0.1 мм) с точностью accuracy (0.1 мм)
+esp_err_t receiver_fixed_position(const int64_t ecef[3], uint32_t accuracy, uint8_t layers);
+
+/// Отключение режима базы (CFG-TMODE-MODE 0)
+esp_err_t receiver_survey_stop(uint8_t layers);
+
+#endif //ESP32_XBEE_RECEIVER_H
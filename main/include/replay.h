@@ -0,0 +1,76 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef ESP32_XBEE_REPLAY_H
+#define ESP32_XBEE_REPLAY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// Воспроизведение записанного потока (RTCM 3, NMEA или смесь) во входной конвейер.
+/// Темп задают метки времени самой записи: эпохи MSM и наблюдений 1001-1012 RTCM 3
+/// или время GGA/RMC/GNS/ZDA NMEA. Внутри эпохи скорость ограничивается как у UART.
+/// Без меток времени остаётся только ограничение по скорости UART
+
+typedef void (*replay_sink_t)(void *ctx, const uint8_t *data, size_t length);
+
+typedef struct replay_config {
+    const char *path;
+    uint16_t speed;         // 1 - исходный темп, N - в N раз быстрее, 0 - без пауз
+    bool loop;              // повтор с начала файла до остановки
+    uint32_t baud;          // скорость UART для темпа внутри эпохи, 0 - без ограничения
+} replay_config_t;
+
+typedef struct replay_stats {
+    uint64_t bytes;
+    uint32_t frames;        // кадры RTCM 3 с верной CRC
+    uint32_t sentences;     // строки NMEA
+    uint32_t epochs;
+    uint32_t loops;
+    uint32_t lag_max_ms;    // наибольшее опоздание доставки относительно расписания
+    bool timed;             // в записи найдены метки времени
+} replay_stats_t;
+
+/// Воспроизведение в текущей задаче до конца файла (без loop) или до *stop.
+/// Возвращает 0 или -1 при ошибке открытия/чтения файла (errno сохраняется)
+int replay_run(const replay_config_t *config, replay_sink_t sink, void *ctx, volatile bool *stop, replay_stats_t *stats);
+
+#ifdef ESP_PLATFORM
+
+#include <esp_err.h>
+
+#define REPLAY_FILE_MAX 32
+
+typedef struct replay_state {
+    bool running;
+    char file[REPLAY_FILE_MAX];
+    uint16_t speed;
+    bool loop;
+    int error;              // errno последнего завершения, 0 - без ошибок
+    replay_stats_t stats;
+} replay_state_t;
+
+/// Запуск воспроизведения файла MOUNT_POINT/logs/<file> в uart_inject
+esp_err_t replay_start(const char *file, uint16_t speed, bool loop);
+esp_err_t replay_stop();
+void replay_state(replay_state_t *state);
+
+#endif
+
+#endif //ESP32_XBEE_REPLAY_H
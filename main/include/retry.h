@@ -18,6 +18,7 @@
 #ifndef ESP32_XBEE_RETRY_H
 #define ESP32_XBEE_RETRY_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
 typedef struct retry_delay *retry_delay_handle_t;
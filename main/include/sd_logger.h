@@ -33,6 +33,12 @@ esp_err_t sd_logger_enable(bool enable);
  */
 bool sd_logger_is_enabled(void);
 
+/**
+ * Check if the SD card is mounted
+ * @return true if mounted, false otherwise
+ */
+bool sd_logger_is_mounted(void);
+
 /**
  * Check if a new log file needs to be created (new day)
  * @return ESP_OK on success
@@ -47,6 +53,14 @@ esp_err_t sd_logger_check_date(void);
  */
 esp_err_t sd_logger_write(const uint8_t *data, size_t len);
 
+/**
+ * Write formatted log text to the daily text log (YYYYMMDD.log)
+ * @param text pointer to text
+ * @param len length of text
+ * @return ESP_OK on success
+ */
+esp_err_t sd_logger_write_text(const char *text, size_t len);
+
 /**
  * Deinitialize SD card logger
  */
@@ -0,0 +1,64 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef ESP32_XBEE_STATION_H
+#define ESP32_XBEE_STATION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "protocol/rtcm3.h"
+
+#define STATION_FRAMES_MAX (2 * (RTCM3_HEADER_SIZE + RTCM3_CRC_SIZE) + RTCM3_1006_SIZE + RTCM3_1033_SIZE_MAX)
+
+/// Отправка приёмнику потока: число отправленных байт или отрицательное значение при ошибке
+typedef rtcm3_write_t station_send_t;
+
+/// Вставка 1005/1006 и 1033 в поток одного приёмника (кастер, сокет): свои границы
+/// кадров и своё время последней вставки. С msm4 поток после вставки идёт через замену
+/// MSM7 на MSM4 (буфер кадра держит сам приёмник, NULL - без замены)
+typedef struct station_sink {
+    rtcm3_scanner_t scanner;
+    int64_t injected_at;        // esp_timer_get_time() последней вставки, 0 - не было
+    uint32_t injections;
+    rtcm3_msm4_stream_t *msm4;
+} station_sink_t;
+
+typedef struct station_status {
+    bool active;                // включено и есть позиция базы: кадры собраны
+    uint16_t type;              // 1005 или 1006
+    uint16_t station_id;
+    uint16_t interval;          // с
+    size_t length;              // байт кадров за одну вставку
+    uint32_t injections;        // вставок по всем приёмникам
+} station_status_t;
+
+/// Кадры собираются один раз из настроек станции и сохранённой позиции базы
+/// и пересобираются при их изменении
+void station_init();
+
+void station_sink_init(station_sink_t *sink, rtcm3_msm4_stream_t *msm4);
+
+/// Передача куска потока приёмнику. Кадры станции вставляются сразу после последнего
+/// сообщения эпохи наблюдений, не чаще интервала, так что пачка MSM не разрывается.
+/// Возвращает число отправленных байт (со вставленными) или ошибку send
+int station_forward(station_sink_t *sink, const void *data, size_t length, station_send_t send, void *ctx);
+
+void station_status(station_status_t *status);
+
+#endif //ESP32_XBEE_STATION_H
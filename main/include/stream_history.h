@@ -0,0 +1,80 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ESP32_XBEE_STREAM_HISTORY_H
+#define ESP32_XBEE_STREAM_HISTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// 10 с за последний час и 1 мин за последние сутки: ~7 КБ на поток
+#define STREAM_HISTORY_FINE_RESOLUTION 10
+#define STREAM_HISTORY_FINE_LENGTH 360
+#define STREAM_HISTORY_COARSE_RESOLUTION 60
+#define STREAM_HISTORY_COARSE_LENGTH 1440
+
+// Период дозаписи поминутной истории на SD карту
+#define STREAM_HISTORY_PERSIST_PERIOD_MS (10 * 60 * 1000)
+
+#define STREAM_HISTORY_MAGIC "NTHS"
+#define STREAM_HISTORY_VERSION 1
+
+typedef enum {
+    STREAM_HISTORY_FINE = 0,
+    STREAM_HISTORY_COARSE,
+    STREAM_HISTORY_RESOLUTION_COUNT
+} stream_history_resolution_t;
+
+/// Средняя скорость (байт/с) за интервал, в 16-битном виде:
+/// 4 бита порядка и 12 бит мантиссы, см. stream_history_decode
+typedef struct stream_history_sample {
+    uint16_t in;
+    uint16_t out;
+} stream_history_sample_t;
+
+/// Заголовок двоичного формата, все поля little-endian, за ним count отсчётов
+typedef struct __attribute__((packed)) stream_history_header {
+    char magic[4];
+    uint8_t version;
+    uint8_t reserved;
+    uint16_t resolution;
+    uint32_t end_uptime;
+    uint32_t end_time;
+    uint16_t count;
+    uint16_t reserved2;
+} stream_history_header_t;
+
+typedef struct stream_history stream_history_t;
+
+void stream_history_init();
+stream_history_t *stream_history_new(const char *name);
+
+/// Вызывается задачей статистики раз в секунду
+void stream_history_record(stream_history_t *history, uint32_t rate_in, uint32_t rate_out);
+
+/// Копирует отсчёты новее since (по порядковому номеру), от старых к новым.
+/// end_seq — номер последнего отсчёта, end_uptime — время его записи в секундах
+size_t stream_history_read(stream_history_t *history, stream_history_resolution_t resolution, uint32_t since,
+        stream_history_sample_t *samples, size_t length, uint32_t *end_seq, uint32_t *end_uptime);
+
+uint16_t stream_history_resolution(stream_history_resolution_t resolution);
+size_t stream_history_length(stream_history_resolution_t resolution);
+
+uint16_t stream_history_encode(uint32_t rate);
+uint32_t stream_history_decode(uint16_t value);
+
+#endif //ESP32_XBEE_STREAM_HISTORY_H
@@ -19,15 +19,38 @@
 #define ESP32_XBEE_STREAM_STATS_H
 
 #include <stdint.h>
+#include "stream_history.h"
+
+/// Окна статистики скорости: среднее, минимум и максимум посекундной скорости
+typedef enum {
+    STREAM_STATS_WINDOW_1S = 0,
+    STREAM_STATS_WINDOW_10S,
+    STREAM_STATS_WINDOW_60S,
+    STREAM_STATS_WINDOW_15M,
+    STREAM_STATS_WINDOW_COUNT
+} stream_stats_window_t;
+
+typedef struct stream_stats_rate {
+    uint32_t avg;
+    uint32_t min;
+    uint32_t max;
+} stream_stats_rate_t;
 
 typedef struct stream_stats_values {
     const char *name;
 
-    uint32_t total_in;
-    uint32_t total_out;
+    uint64_t total_in;
+    uint64_t total_out;
 
     uint32_t rate_in;
     uint32_t rate_out;
+
+    // Максимальная посекундная скорость с момента запуска
+    uint32_t peak_in;
+    uint32_t peak_out;
+
+    stream_stats_rate_t window_in[STREAM_STATS_WINDOW_COUNT];
+    stream_stats_rate_t window_out[STREAM_STATS_WINDOW_COUNT];
 } stream_stats_values_t;
 
 typedef struct stream_stats *stream_stats_handle_t;
@@ -35,10 +58,15 @@ typedef struct stream_stats *stream_stats_handle_t;
 void stream_stats_init();
 stream_stats_handle_t stream_stats_new(const char *name);
 
+/// Безопасно вызывать из любой задачи: счётчики разделены по ядрам и увеличиваются атомарно
 void stream_stats_increment(stream_stats_handle_t stats, uint32_t in, uint32_t out);
 void stream_stats_values(stream_stats_handle_t stats, stream_stats_values_t *values);
 
 stream_stats_handle_t stream_stats_first();
 stream_stats_handle_t stream_stats_next(stream_stats_handle_t stats);
+stream_stats_handle_t stream_stats_get(const char *name);
+stream_history_t *stream_stats_history(stream_stats_handle_t stats);
+
+const char *stream_stats_window_name(stream_stats_window_t window);
 
 #endif //ESP32_XBEE_STREAM_STATS_H
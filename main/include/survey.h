@@ -0,0 +1,64 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef ESP32_XBEE_SURVEY_H
+#define ESP32_XBEE_SURVEY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include "survey_stats.h"
+
+// Меньше измерений не дают осмысленной оценки разброса
+#define SURVEY_SAMPLES_MIN 10
+
+typedef enum survey_phase {
+    SURVEY_IDLE = 0,
+    SURVEY_RUNNING,
+    SURVEY_DONE
+} survey_phase_t;
+
+/// Съёмка базы по решению приёмника (NMEA GGA): среднее ECEF накапливается, пока не
+/// выполнены оба порога - длительность и оценка точности, затем координаты сохраняются
+/// в настройках и, если включено, передаются приёмнику u-blox как фиксированная позиция
+typedef struct survey_status {
+    survey_phase_t phase;
+    survey_stats_t stats;
+    double duration;            // с от первого принятого измерения
+    uint32_t rejected;          // эпохи без решения или с неподходящим качеством
+    uint32_t min_duration;      // пороги текущей или последней съёмки: с, мм
+    uint32_t accuracy_limit;
+
+    bool base_valid;            // сохранённая позиция базы
+    int64_t base[3];            // ECEF, 0.1 мм
+    uint32_t base_accuracy;     // 0.1 мм
+    esp_err_t receiver_result;  // последняя передача позиции приёмнику, ESP_ERR_NOT_FINISHED - не было
+} survey_status_t;
+
+void survey_init();
+
+/// Новая съёмка с порогами (0 - из настроек), предыдущие измерения сбрасываются
+esp_err_t survey_start(uint32_t min_duration, uint32_t accuracy_mm);
+void survey_stop();
+
+void survey_status(survey_status_t *status);
+
+/// Сохранённая позиция базы: ECEF и точность в 0.1 мм, false - не задана
+bool survey_base_position(int64_t ecef[3], uint32_t *accuracy);
+
+#endif //ESP32_XBEE_SURVEY_H
@@ -0,0 +1,57 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef ESP32_XBEE_SURVEY_STATS_H
+#define ESP32_XBEE_SURVEY_STATS_H
+
+#include <stdint.h>
+
+/// Эллипсоид WGS84
+#define SURVEY_WGS84_A 6378137.0
+#define SURVEY_WGS84_F (1 / 298.257223563)
+
+/// Время корреляции ошибок автономного решения, с: измерения внутри него почти
+/// не независимы, поэтому точность среднего оценивается по длительности, а не по числу
+#define SURVEY_STATS_CORRELATION_S 60.0
+
+/// Накопление ECEF координат по Уэлфорду в постоянной памяти: среднее и сумма квадратов
+/// отклонений обновляются на каждом измерении, сами измерения не хранятся. Всё считается
+/// от первого измерения, чтобы не терять точность double на величинах порядка 6e6 м
+typedef struct survey_stats {
+    uint32_t count;
+    double origin[3];
+    double mean[3];             // среднее относительно origin, м
+    double m2[3];               // сумма квадратов отклонений по осям, м^2
+} survey_stats_t;
+
+/// Широта и долгота в градусах, высота над эллипсоидом в метрах
+void survey_ecef_from_geodetic(double latitude, double longitude, double height, double ecef[3]);
+void survey_geodetic_from_ecef(const double ecef[3], double *latitude, double *longitude, double *height);
+
+void survey_stats_reset(survey_stats_t *stats);
+void survey_stats_add(survey_stats_t *stats, const double ecef[3]);
+void survey_stats_mean(const survey_stats_t *stats, double ecef[3]);
+
+/// Трёхмерное СКО отдельного измерения, м (0 при менее чем двух измерениях)
+double survey_stats_spread(const survey_stats_t *stats);
+
+/// Оценка трёхмерного СКО среднего за duration секунд: разброс, делённый на корень из
+/// числа независимых интервалов SURVEY_STATS_CORRELATION_S (не больше числа измерений)
+double survey_stats_accuracy(const survey_stats_t *stats, double duration);
+
+#endif //ESP32_XBEE_SURVEY_STATS_H
@@ -0,0 +1,64 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef ESP32_XBEE_TASK_MONITOR_H
+#define ESP32_XBEE_TASK_MONITOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TASK_MONITOR_PERIOD_MS 1000
+// Загрузка CPU считается по скользящему окну из TASK_MONITOR_WINDOW периодов
+#define TASK_MONITOR_WINDOW 10
+#define TASK_MONITOR_MAX_TASKS 32
+#define TASK_MONITOR_NAME_LEN 16
+
+// Бюджет по умолчанию, % одного ядра, и минимальный запас стека в байтах
+#define TASK_MONITOR_CPU_BUDGET 80
+#define TASK_MONITOR_STACK_MIN 512
+
+typedef struct task_monitor_info {
+    char name[TASK_MONITOR_NAME_LEN];
+    uint32_t number;
+    uint8_t state;
+    uint8_t priority;
+    int8_t core;            // -1: без привязки к ядру или неизвестно
+    uint8_t budget;         // % одного ядра
+    float cpu;              // % одного ядра за окно, -1 если статистика выключена
+    uint32_t stack_free;    // минимальный свободный стек за всё время, байт
+    uint32_t stack_size;    // по реестру задач (tasks.h), 0 для системных задач
+    bool cpu_overload;
+    bool stack_low;
+} task_monitor_info_t;
+
+typedef struct task_monitor_summary {
+    bool cpu_available;
+    uint32_t window_ms;
+    uint8_t cores;
+    float core_load[2];     // 100% минус доля idle-задачи ядра
+} task_monitor_summary_t;
+
+void task_monitor_init();
+
+/// Копирует последний замер, возвращает число задач
+size_t task_monitor_snapshot(task_monitor_info_t *tasks, size_t length, task_monitor_summary_t *summary);
+
+const char *task_monitor_state_name(uint8_t state);
+
+#endif //ESP32_XBEE_TASK_MONITOR_H
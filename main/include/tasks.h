@@ -1,12 +1,114 @@
 #ifndef ESP32_XBEE_TASKS_H
 #define ESP32_XBEE_TASKS_H
 
+#include <stdint.h>
+#include <esp_err.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
 #define TASK_PRIORITY_STATUS_LED 0
 #define TASK_PRIORITY_RESET_BUTTON 0
 #define TASK_PRIORITY_WIFI_STATUS 0
 #define TASK_PRIORITY_STATS 0
+#define TASK_PRIORITY_STREAM_HISTORY 0
+#define TASK_PRIORITY_WEB_TERMINAL 1
+#define TASK_PRIORITY_CONFIG_NOTIFY 1
+#define TASK_PRIORITY_CONFIG_TRANSFER 1
+#define TASK_PRIORITY_LOG 1
+#define TASK_PRIORITY_SURVEY 1
 #define TASK_PRIORITY_INTERFACE 5
+#define TASK_PRIORITY_HTTPD 5
+#define TASK_PRIORITY_REPLAY 5
 #define TASK_PRIORITY_UART 10
+#define TASK_PRIORITY_TASK_MONITOR 15
 #define TASK_PRIORITY_MAX 100
 
+#define TASK_CORE_ANY -1
+
+// Запас сверх наибольшего замеренного использования стека при подборе размера
+#define TASK_STACK_MARGIN 512
+
+/// Реестр задач приложения: идентификатор, имя (до 15 символов, дальше FreeRTOS обрезает),
+/// стек в байтах, приоритет, ядро и бюджет CPU в % одного ядра (0 - TASK_MONITOR_CPU_BUDGET).
+/// Размеры стеков сверяются с замерами /tasks (stack_used, stack_suggested)
+#define TASKS_SCHEMA(X) \
+        X(UART,                 "uart_task",        3072, TASK_PRIORITY_UART,           TASK_CORE_ANY, 50) \
+        X(NTRIP_SERVER,         "ntrip_server",     4096, TASK_PRIORITY_INTERFACE,      TASK_CORE_ANY, 30) \
+        X(NTRIP_SERVER_SLEEP,   "ntrip_sleep",      2048, TASK_PRIORITY_INTERFACE,      TASK_CORE_ANY, 0) \
+        X(NTRIP_SERVER_2,       "ntrip_server_2",   4096, TASK_PRIORITY_INTERFACE,      TASK_CORE_ANY, 30) \
+        X(NTRIP_SERVER_2_SLEEP, "ntrip_2_sleep",    2048, TASK_PRIORITY_INTERFACE,      TASK_CORE_ANY, 0) \
+        X(SOCKET_SERVER,        "socket_server",    4096, TASK_PRIORITY_INTERFACE,      TASK_CORE_ANY, 0) \
+        X(SOCKET_CLIENT,        "socket_client",    4096, TASK_PRIORITY_INTERFACE,      TASK_CORE_ANY, 0) \
+        X(REPLAY,               "replay",           4096, TASK_PRIORITY_REPLAY,         TASK_CORE_ANY, 0) \
+        X(SURVEY,               "survey",           3072, TASK_PRIORITY_SURVEY,         TASK_CORE_ANY, 0) \
+        X(HTTPD,                "httpd",            4096, TASK_PRIORITY_HTTPD,          TASK_CORE_ANY, 40) \
+        X(WEB_TERMINAL,         "web_terminal",     3072, TASK_PRIORITY_WEB_TERMINAL,   TASK_CORE_ANY, 20) \
+        X(LOG,                  "log",              4096, TASK_PRIORITY_LOG,            TASK_CORE_ANY, 0) \
+        X(CONFIG_NOTIFY,        "config_notify",    4096, TASK_PRIORITY_CONFIG_NOTIFY,  TASK_CORE_ANY, 0) \
+        X(CONFIG_RESTART,       "config_restart",   4096, TASK_PRIORITY_MAX,            TASK_CORE_ANY, 0) \
+        X(CONFIG_TRANSFER,      "config_transfer",  3584, TASK_PRIORITY_CONFIG_TRANSFER, TASK_CORE_ANY, 0) \
+        X(WIFI_STA_STATUS,      "wifi_sta_status",  2048, TASK_PRIORITY_WIFI_STATUS,    TASK_CORE_ANY, 0) \
+        X(WIFI_STA_RECONNECT,   "wifi_reconnect",   4096, TASK_PRIORITY_WIFI_STATUS,    TASK_CORE_ANY, 0) \
+        X(STATUS_LED,           "status_led",       2048, TASK_PRIORITY_STATUS_LED,     TASK_CORE_ANY, 0) \
+        X(RESET_BUTTON,         "reset_button",     4096, TASK_PRIORITY_RESET_BUTTON,   TASK_CORE_ANY, 0) \
+        X(STREAM_STATS,         "stream_stats",     2048, TASK_PRIORITY_STATS,          TASK_CORE_ANY, 0) \
+        X(STREAM_HISTORY,       "stream_history",   4096, TASK_PRIORITY_STREAM_HISTORY, TASK_CORE_ANY, 0) \
+        X(TASK_MONITOR,         "task_monitor",     3072, TASK_PRIORITY_TASK_MONITOR,   TASK_CORE_ANY, 0)
+
+typedef enum {
+#define TASK_ID(id, name, stack, priority, core, budget) TASK_##id,
+    TASKS_SCHEMA(TASK_ID)
+#undef TASK_ID
+    TASK_COUNT
+} task_id_t;
+
+/// Задача цикла событий по умолчанию создаётся ESP-IDF, но в ней работают обработчики
+/// чтения UART (NTRIP серверы со станцией и MSM4, NMEA, UBX, веб-терминал), поэтому
+/// она входит в бюджет стеков и отчёт /tasks. Стек задаётся в sdkconfig
+#define TASK_EVENT_LOOP_NAME "sys_evt"
+#define TASK_EVENT_LOOP_STACK CONFIG_ESP_SYSTEM_EVENT_TASK_STACK_SIZE
+
+// Сумма стеков всех задач реестра и цикла событий, как если бы они работали одновременно
+#define TASK_STACK_ADD(id, name, stack, priority, core, budget) + (stack)
+#define TASK_STACK_TOTAL (TASK_EVENT_LOOP_STACK TASKS_SCHEMA(TASK_STACK_ADD))
+
+/// Бюджеты RAM по целям: стеки задач реестра и они же вместе со статическими данными
+/// (.data, .bss, .noinit). Стеки проверяются при компиляции tasks.c, полный бюджет -
+/// tools/ram_budget.py по .map после сборки
+#define TASK_STACK_BUDGET_ESP32 (80 * 1024)
+#define TASK_STACK_BUDGET_ESP32S3 (80 * 1024)
+#define TASK_STACK_BUDGET_ESP32C3 (76 * 1024)
+#define TASK_STACK_BUDGET_ESP32C6 (76 * 1024)
+
+#define RAM_BUDGET_ESP32 (160 * 1024)
+#define RAM_BUDGET_ESP32S3 (192 * 1024)
+#define RAM_BUDGET_ESP32C3 (144 * 1024)
+#define RAM_BUDGET_ESP32C6 (160 * 1024)
+
+#if CONFIG_IDF_TARGET_ESP32C3
+#define TASK_STACK_BUDGET TASK_STACK_BUDGET_ESP32C3
+#elif CONFIG_IDF_TARGET_ESP32C6
+#define TASK_STACK_BUDGET TASK_STACK_BUDGET_ESP32C6
+#elif CONFIG_IDF_TARGET_ESP32S3
+#define TASK_STACK_BUDGET TASK_STACK_BUDGET_ESP32S3
+#else
+#define TASK_STACK_BUDGET TASK_STACK_BUDGET_ESP32
+#endif
+
+typedef struct task_definition {
+    const char *name;
+    uint32_t stack;
+    uint8_t priority;
+    int8_t core;
+    uint8_t budget;
+} task_definition_t;
+
+extern const task_definition_t TASKS[TASK_COUNT];
+
+/// Создание задачи реестра с её стеком, приоритетом и ядром
+esp_err_t task_create(task_id_t id, TaskFunction_t function, void *arg, TaskHandle_t *handle);
+
+/// Задача реестра или цикла событий по имени FreeRTOS (с учётом обрезки), NULL для остальных системных задач
+const task_definition_t *task_find(const char *name);
+
 #endif //ESP32_XBEE_TASKS_H
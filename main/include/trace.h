@@ -0,0 +1,71 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef ESP32_XBEE_TRACE_H
+#define ESP32_XBEE_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sdkconfig.h"
+
+typedef enum {
+    TRACE_UART_READ = 0,
+    TRACE_UART_DISPATCH,
+    TRACE_RTCM3_FRAMING,
+    TRACE_NTRIP_SERVER_SEND,
+    TRACE_NTRIP_SERVER_2_SEND,
+    TRACE_SOCKET_SERVER_SEND,
+    TRACE_SOCKET_CLIENT_SEND,
+    TRACE_SD_WRITE,
+    TRACE_SD_WRITE_TEXT,
+    TRACE_LOG_FORMAT,
+    TRACE_HTTP_HANDLER,
+    TRACE_EVENT_COUNT
+} trace_event_t;
+
+/// Запись кольца, 16 байт. Время - младшие 32 бита esp_timer в микросекундах
+typedef struct trace_record {
+    uint32_t start;
+    uint32_t duration;
+    uint16_t event;
+    uint16_t task;
+    uint32_t arg;
+} trace_record_t;
+
+/// Приёмник выгрузки: HTTP ответ частями на устройстве, файл на хосте
+typedef int (*trace_writer_t)(void *ctx, const char *data, size_t length);
+
+#if CONFIG_PIPELINE_TRACE
+
+uint32_t trace_now();
+void trace_record(trace_event_t event, uint32_t start, uintptr_t arg);
+/// Выгрузка снимка кольца в формате Chrome Trace Event JSON
+int trace_dump(trace_writer_t writer, void *ctx);
+
+#define TRACE_BEGIN(start) uint32_t start = trace_now()
+#define TRACE_END(event, start, arg) trace_record(event, start, (uintptr_t) (arg))
+
+#else
+
+#define TRACE_BEGIN(start)
+#define TRACE_END(event, start, arg) ((void) 0)
+
+#endif
+
+#endif //ESP32_XBEE_TRACE_H
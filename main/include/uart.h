@@ -2,6 +2,7 @@
 #define ESP32_XBEE_UART_H
 
 #include <esp_event.h>
+#include <protocol/nmea.h>
 
 ESP_EVENT_DECLARE_BASE(UART_EVENT_READ);
 ESP_EVENT_DECLARE_BASE(UART_EVENT_WRITE);
@@ -13,7 +14,10 @@ void uart_init();
 void uart_inject(void *data, size_t len);
 int uart_log(char *buffer, size_t len);
 int uart_nmea(const char *fmt, ...);
+/// Статусное предложение $PESP семейства family, fmt - поля после префикса
+int uart_pesp(nmea_pesp_t family, const char *fmt, ...);
 int uart_write(char *buffer, size_t len);
+int uart_write_command(const char *command);
 
 void uart_register_read_handler(esp_event_handler_t event_handler);
 void uart_register_write_handler(esp_event_handler_t event_handler);
@@ -0,0 +1,40 @@
+/*
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2019 Nebojsa Cvetkovic.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ESP32_XBEE_WEB_TERMINAL_H
+#define ESP32_XBEE_WEB_TERMINAL_H
+
+#include <esp_http_server.h>
+
+#define WEB_TERMINAL_MAX_SESSIONS 2
+#define WEB_TERMINAL_BUFFER_SIZE 2048
+
+#define WEB_TERMINAL_RATE_DEFAULT 4096
+#define WEB_TERMINAL_RATE_MIN 256
+#define WEB_TERMINAL_RATE_MAX 32768
+
+typedef enum {
+    WEB_TERMINAL_MODE_TEXT = 0,
+    WEB_TERMINAL_MODE_HEX
+} web_terminal_mode_t;
+
+esp_err_t web_terminal_init(httpd_handle_t server);
+
+esp_err_t web_terminal_ws_handler(httpd_req_t *req);
+void web_terminal_close(int sockfd);
+
+#endif //ESP32_XBEE_WEB_TERMINAL_H
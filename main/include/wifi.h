@@ -26,9 +26,15 @@ typedef struct wifi_sta_status {
     esp_ip6_addr_t ip6_addr;
 } wifi_sta_status_t;
 
+typedef struct wifi_scan_status {
+    bool scanning;
+    int64_t timestamp;
+} wifi_scan_status_t;
+
 void wifi_init();
 
-wifi_ap_record_t * wifi_scan(uint16_t *number);
+esp_err_t wifi_scan_start();
+wifi_ap_record_t *wifi_scan_results(uint16_t *number, wifi_scan_status_t *status);
 
 wifi_sta_list_t *wifi_ap_sta_list();
 
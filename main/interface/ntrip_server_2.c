@@ -34,18 +34,20 @@
 #include <status_led.h>
 #include <retry.h>
 #include <stream_stats.h>
+#include <station.h>
+#include <event_journal.h>
+#include <trace.h>
 #include <freertos/event_groups.h>
 #include <freertos/semphr.h>
 #include <esp_ota_ops.h>
 #include "interface/ntrip.h"
+#include "interface/ntrip_uplink.h"
 #include "config.h"
 #include "util.h"
 #include "uart.h"
 
 static const char *TAG = "NTRIP_SERVER_2";       // Тег для логирования вторичного NTRIP сервера
 
-#define BUFFER_SIZE 512                             // Размер буфера для сетевых операций (байт)
-
 // Биты состояния для синхронизации между задачами
 static const int CASTER_READY_BIT = BIT0;           // Кастер готов принимать данные
 static const int DATA_READY_BIT = BIT1;             // Данные доступны от UART
@@ -63,6 +65,15 @@ static stream_stats_handle_t stream_stats = NULL;   // Дескриптор ст
 static TaskHandle_t server_task = NULL;             // Дескриптор основной задачи второго сервера
 static TaskHandle_t sleep_task = NULL;              // Дескриптор задачи контроля keep-alive второго сервера
 
+static bool data_gap = false;                       // Перерыв в данных от UART зафиксирован в журнале
+static int send_errno = 0;                          // errno последней ошибки отправки на кастер
+static station_sink_t station_sink;                  // Вставка сообщений станции 1005/1006/1033
+static rtcm3_msm4_stream_t msm4_stream;             // Замена MSM7 на MSM4 для этого кастера
+
+static int ntrip_server_send(void *ctx, const void *data, size_t length) {
+    return ntrip_uplink_send(*(int *) ctx, data, length);
+}
+
 /// Обработчик данных от UART для вторичного NTRIP сервера
 /// Аналогичен первичному серверу, но отправляет на второй кастер
 /// Оба сервера получают одинаковые RTK данные от одного UART
@@ -73,6 +84,11 @@ static void ntrip_server_uart_handler(void* handler_args, esp_event_base_t base,
     if ((event_bits & DATA_READY_BIT) == 0) {
         xEventGroupSetBits(server_event_group, DATA_READY_BIT);
 
+        if (data_gap) {
+            data_gap = false;
+            event_journal_add(EVENT_SUBSYSTEM_NTRIP_SERVER_2, EVENT_DATA_RESUMED, EVENT_REASON_NONE, 0);
+        }
+
         if (event_bits & DATA_SENT_BIT)
             ESP_LOGI(TAG, "Data received by UART, will now reconnect to caster if disconnected");
     }
@@ -88,8 +104,11 @@ static void ntrip_server_uart_handler(void* handler_args, esp_event_base_t base,
     if (xSemaphoreTake(sock_mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
         if (sock >= 0) {
             // Отправка RTK данных во второй NTRIP кастер
-            int sent = write(sock, buffer, length);
+            TRACE_BEGIN(send_start);
+            int sent = station_forward(&station_sink, buffer, length, ntrip_server_send, &sock);
+            TRACE_END(TRACE_NTRIP_SERVER_2_SEND, send_start, sent);
             if (sent < 0) {
+                send_errno = errno;
                 // При ошибке - закрытие сокета и переподключение
                 destroy_socket(&sock);
                 xSemaphoreGive(sock_mutex);
@@ -113,6 +132,8 @@ static void ntrip_server_sleep_task(void *ctx) {
         // Проверка превышения времени ожидания данных от UART
         if (data_keep_alive == NTRIP_KEEP_ALIVE_THRESHOLD) {
             xEventGroupClearBits(server_event_group, DATA_READY_BIT);
+            data_gap = true;
+            event_journal_add(EVENT_SUBSYSTEM_NTRIP_SERVER_2, EVENT_DATA_LOST, EVENT_REASON_NO_DATA, 0);
             ESP_LOGW(TAG, "No data received by UART in %d seconds, will not reconnect to caster if disconnected", NTRIP_KEEP_ALIVE_THRESHOLD / 1000);
         }
         data_keep_alive += NTRIP_KEEP_ALIVE_THRESHOLD / 10;
@@ -136,7 +157,7 @@ static void ntrip_server_task(void *ctx) {
     // Регистрация обработчика UART (оба сервера получают одинаковые данные)
     uart_register_read_handler(ntrip_server_uart_handler);
     // Создание независимой задачи keep-alive для второго сервера
-    xTaskCreate(ntrip_server_sleep_task, "ntrip_server_sleep_task", 2048, NULL, TASK_PRIORITY_INTERFACE, &sleep_task);
+    task_create(TASK_NTRIP_SERVER_2_SLEEP, ntrip_server_sleep_task, NULL, &sleep_task);
 
     // Настройка отдельного статусного светодиода для второго сервера
     config_color_t status_led_color = config_get_color(CONF_ITEM(KEY_CONFIG_NTRIP_SERVER_2_COLOR));
@@ -149,21 +170,13 @@ static void ntrip_server_task(void *ctx) {
     // Независимый механизм повторных подключений для второго сервера
     retry_delay_handle_t delay_handle = retry_init(true, 5, 2000, 0);
 
-    // Выделение буфера один раз вне цикла для оптимизации памяти
-    char *buffer = malloc(BUFFER_SIZE);
-    if (!buffer) {
-        ESP_LOGE(TAG, "Failed to allocate buffer");
-        vTaskDelete(NULL);
-        return;
-    }
-
     while (true) {
         retry_delay(delay_handle);
 
         /* Ожидание наличия данных от UART для второго сервера */
         if ((xEventGroupGetBits(server_event_group) & DATA_READY_BIT) == 0) {
             ESP_LOGI(TAG, "Waiting for UART input to connect to caster");
-            uart_nmea("$PESP,NTRIP,SRV2,WAITING");        // NMEA сообщение для второго сервера
+            uart_pesp(NMEA_PESP_NTRIP_SRV2, "WAITING");        // NMEA сообщение для второго сервера
             xEventGroupWaitBits(server_event_group, DATA_READY_BIT, true, false, portMAX_DELAY);
         }
 
@@ -173,48 +186,55 @@ static void ntrip_server_task(void *ctx) {
 
         /* Загрузка отдельной конфигурации для второго NTRIP кастера */
         char *host = NULL, *mountpoint = NULL, *password = NULL;
+        int16_t reason = EVENT_REASON_NONE;
         uint16_t port = config_get_u16(CONF_ITEM(KEY_CONFIG_NTRIP_SERVER_2_PORT));
         config_get_primitive(CONF_ITEM(KEY_CONFIG_NTRIP_SERVER_2_PORT), &port);
-        config_get_str_blob_alloc(CONF_ITEM(KEY_CONFIG_NTRIP_SERVER_2_HOST), (void **) &host);
-        config_get_str_blob_alloc(CONF_ITEM(KEY_CONFIG_NTRIP_SERVER_2_PASSWORD), (void **) &password);
-        config_get_str_blob_alloc(CONF_ITEM(KEY_CONFIG_NTRIP_SERVER_2_MOUNTPOINT), (void **) &mountpoint);
-
-        // Проверка успешного выделения памяти для конфигурационных строк
-        if (!host || !password || !mountpoint) {
-            ESP_LOGE(TAG, "Failed to allocate memory for configuration strings");
+        esp_err_t err = config_get_str_blob_alloc(CONF_ITEM(KEY_CONFIG_NTRIP_SERVER_2_HOST), (void **) &host);
+        if (err == ESP_OK) err = config_get_str_blob_alloc(CONF_ITEM(KEY_CONFIG_NTRIP_SERVER_2_PASSWORD), (void **) &password);
+        if (err == ESP_OK) err = config_get_str_blob_alloc(CONF_ITEM(KEY_CONFIG_NTRIP_SERVER_2_MOUNTPOINT), (void **) &mountpoint);
+
+        // Проверка успешного чтения конфигурационных строк
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to read configuration strings: %s", esp_err_to_name(err));
+            reason = EVENT_REASON_MEMORY;
             goto _error;
         }
 
         ESP_LOGI(TAG, "Connecting to %s:%d/%s", host, port, mountpoint);
-        uart_nmea("$PESP,NTRIP,SRV2,CONNECTING,%s:%d,%s", host, port, mountpoint);
-        sock = connect_socket(host, port, SOCK_STREAM);
-        ERROR_ACTION(TAG, sock == CONNECT_SOCKET_ERROR_RESOLVE, goto _error, "Could not resolve host");
-        ERROR_ACTION(TAG, sock == CONNECT_SOCKET_ERROR_CONNECT, goto _error, "Could not connect to host");
-
-        snprintf(buffer, BUFFER_SIZE, "SOURCE %s /%s" NEWLINE \
-                "Source-Agent: NTRIP %s/%s" NEWLINE \
-                NEWLINE, password, mountpoint, NTRIP_SERVER_NAME, &esp_app_get_description()->version[1]);
-
-        int err = write(sock, buffer, strlen(buffer));
-        ERROR_ACTION(TAG, err < 0, goto _error, "Could not send request to caster: %d %s", errno, strerror(errno));
-
-        int len = read(sock, buffer, BUFFER_SIZE - 1);
-        ERROR_ACTION(TAG, len <= 0, goto _error, "Could not receive response from caster: %d %s", errno, strerror(errno));
-        buffer[len] = '\0';
-
-        char *status = extract_http_header(buffer, "");
-        ERROR_ACTION(TAG, status == NULL || !ntrip_response_ok(status), free(status); goto _error,
-                "Could not connect to mountpoint: %s", status == NULL ? "HTTP response malformed" : status);
-        free(status);
+        uart_pesp(NMEA_PESP_NTRIP_SRV2, "CONNECTING,%s:%d,%s", host, port, mountpoint);
+
+        char target[EVENT_JOURNAL_TARGET_MAX];
+        snprintf(target, sizeof(target), "%s:%d/%s", host, port, mountpoint);
+        event_journal_target(EVENT_SUBSYSTEM_NTRIP_SERVER_2, target);
+        event_journal_add(EVENT_SUBSYSTEM_NTRIP_SERVER_2, EVENT_CONNECTING, EVENT_REASON_NONE, 0);
+
+        ntrip_uplink_config_t uplink_config = {
+                .host = host,
+                .port = port,
+                .mountpoint = mountpoint,
+                .password = password,
+                .version = &esp_app_get_description()->version[1]
+        };
+        sock = ntrip_uplink_connect(&uplink_config, &reason);
+        if (sock < 0) goto _error;
 
         /* Успешное подключение ко второму кастеру */
         ESP_LOGI(TAG, "Successfully connected to %s:%d/%s", host, port, mountpoint);
-        uart_nmea("$PESP,NTRIP,SRV2,CONNECTED,%s:%d,%s", host, port, mountpoint);  // SRV2 для второго сервера
+        uart_pesp(NMEA_PESP_NTRIP_SRV2, "CONNECTED,%s:%d,%s", host, port, mountpoint);  // SRV2 для второго сервера
+
+        stream_stats_values_t values;
+        stream_stats_values(stream_stats, &values);
+        uint64_t session_start = values.total_out;           // Для подсчёта байт за сеанс
+        event_journal_add(EVENT_SUBSYSTEM_NTRIP_SERVER_2, EVENT_CONNECTED, EVENT_REASON_NONE, 0);
 
         retry_reset(delay_handle);                              // Сброс счётчика попыток
 
         if (status_led != NULL) status_led->active = true;     // Включение светодиода второго сервера
 
+        bool msm4 = config_get_bool1(CONF_ITEM(KEY_CONFIG_NTRIP_SERVER_2_MSM4));
+        station_sink_init(&station_sink, msm4 ? &msm4_stream : NULL); // Новый сеанс: первая эпоха сразу со станцией
+        if (msm4) ESP_LOGI(TAG, "Converting MSM7 to MSM4");
+
         /* Установка готовности второго кастера */
         xEventGroupSetBits(server_event_group, CASTER_READY_BIT);
 
@@ -227,11 +247,24 @@ static void ntrip_server_task(void *ctx) {
         if (status_led != NULL) status_led->active = false;    // Отключение светодиода
 
         ESP_LOGW(TAG, "Disconnected from %s:%d/%s", host, port, mountpoint);
-        uart_nmea("$PESP,NTRIP,SRV2,DISCONNECTED,%s:%d,%s", host, port, mountpoint);  // SRV2 для второго сервера
+        uart_pesp(NMEA_PESP_NTRIP_SRV2, "DISCONNECTED,%s:%d,%s", host, port, mountpoint);  // SRV2 для второго сервера
+
+        if (msm4) {
+            ESP_LOGI(TAG, "MSM4: %u frames converted, %llu bytes saved, %u CRC errors", (unsigned) msm4_stream.converted,
+                    (unsigned long long) msm4_stream.saved, (unsigned) msm4_stream.crc_errors);
+        }
+
+        stream_stats_values(stream_stats, &values);
+        uint64_t session_bytes = values.total_out - session_start;
+        event_journal_add(EVENT_SUBSYSTEM_NTRIP_SERVER_2, EVENT_DISCONNECTED, send_errno != 0 ? -send_errno : EVENT_REASON_SEND,
+                session_bytes > UINT32_MAX ? UINT32_MAX : session_bytes);
+        send_errno = 0;
 
         _error:
         vTaskSuspend(sleep_task);
 
+        if (reason != EVENT_REASON_NONE) event_journal_add(EVENT_SUBSYSTEM_NTRIP_SERVER_2, EVENT_CONNECT_FAILED, reason, 0);
+
         destroy_socket(&sock);
 
         // Освобождение выделенной памяти для конфигурационных строк
@@ -239,9 +272,6 @@ static void ntrip_server_task(void *ctx) {
         if (mountpoint) free(mountpoint);
         if (password) free(password);
     }
-    
-    // Освобождение буфера при выходе из задачи (никогда не должно произойти)
-    free(buffer);
 }
 
 /// Инициализация вторичного NTRIP сервера
@@ -252,5 +282,5 @@ void ntrip_server_2_init() {
     if (!config_get_bool1(CONF_ITEM(KEY_CONFIG_NTRIP_SERVER_2_ACTIVE))) return;
 
     // Создание задачи второго NTRIP сервера с тем же приоритетом что и у первого
-    xTaskCreate(ntrip_server_task, "ntrip_server_2_task", 4096, NULL, TASK_PRIORITY_INTERFACE, &server_task);
+    task_create(TASK_NTRIP_SERVER_2, ntrip_server_task, NULL, &server_task);
 }
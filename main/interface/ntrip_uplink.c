@@ -0,0 +1,124 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <esp_log.h>
+#include <event_journal.h>
+#include <net.h>
+#include "interface/ntrip.h"
+#include "interface/ntrip_uplink.h"
+
+#define NTRIP_UPLINK_BUFFER_SIZE 512
+
+// На хосте закрытый кастером сокет не должен завершать процесс по SIGPIPE
+#ifdef MSG_NOSIGNAL
+#define NTRIP_UPLINK_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define NTRIP_UPLINK_SEND_FLAGS 0
+#endif
+
+static const char *TAG = "NTRIP_UPLINK";
+
+int ntrip_uplink_connect(const ntrip_uplink_config_t *config, int16_t *reason) {
+    char buffer[NTRIP_UPLINK_BUFFER_SIZE];
+
+    int sock = connect_socket(config->host, config->port, SOCK_STREAM);
+    if (sock == CONNECT_SOCKET_ERROR_RESOLVE) {
+        ESP_LOGE(TAG, "Could not resolve host %s", config->host);
+        *reason = EVENT_REASON_RESOLVE;
+        return -1;
+    }
+    if (sock < 0) {
+        ESP_LOGE(TAG, "Could not connect to host %s:%d", config->host, config->port);
+        *reason = EVENT_REASON_CONNECT;
+        return -1;
+    }
+
+    if (config->timeout_ms > 0) {
+        struct timeval timeout = {
+                .tv_sec = config->timeout_ms / 1000,
+                .tv_usec = (config->timeout_ms % 1000) * 1000
+        };
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    }
+
+    // SOURCE запрос NTRIP v1.0
+    int length = snprintf(buffer, sizeof(buffer), "SOURCE %s /%s" NEWLINE \
+            "Source-Agent: NTRIP %s/%s" NEWLINE \
+            NEWLINE, config->password, config->mountpoint, NTRIP_SERVER_NAME, config->version);
+    if (length < 0 || length >= sizeof(buffer) || ntrip_uplink_send(sock, buffer, length) < 0) {
+        ESP_LOGE(TAG, "Could not send request to caster: %d %s", errno, strerror(errno));
+        *reason = EVENT_REASON_REQUEST;
+        goto _error;
+    }
+
+    // Ответ может прийти несколькими сегментами: чтение до конца строки статуса
+    int len = 0;
+    buffer[0] = '\0';
+    while (len < sizeof(buffer) - 1 && strstr(buffer, NEWLINE) == NULL) {
+        int n = recv(sock, buffer + len, sizeof(buffer) - 1 - len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        len += n;
+        buffer[len] = '\0';
+    }
+    if (len == 0) {
+        ESP_LOGE(TAG, "Could not receive response from caster: %d %s", errno, strerror(errno));
+        *reason = EVENT_REASON_RESPONSE;
+        goto _error;
+    }
+
+    // Статус ответа должен быть 200 OK
+    char *status = extract_http_header(buffer, "");
+    if (status == NULL || !ntrip_response_ok(status)) {
+        ESP_LOGE(TAG, "Could not connect to mountpoint: %s", status == NULL ? "HTTP response malformed" : status);
+        free(status);
+        *reason = EVENT_REASON_REJECTED;
+        goto _error;
+    }
+    free(status);
+
+    *reason = EVENT_REASON_NONE;
+    return sock;
+
+    _error:
+    destroy_socket(&sock);
+    return -1;
+}
+
+int ntrip_uplink_send(int sock, const void *data, size_t length) {
+    const uint8_t *bytes = data;
+    size_t sent = 0;
+    while (sent < length) {
+        int n = send(sock, bytes + sent, length - sent, NTRIP_UPLINK_SEND_FLAGS);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        sent += n;
+    }
+
+    return sent;
+}
@@ -15,8 +15,10 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <interface/ntrip.h>
 
 static bool str_starts_with(const char *a, const char *b) {
     return strncmp(a, b, strlen(b)) == 0;
@@ -29,4 +31,91 @@ bool ntrip_response_ok(void *response) {
 
 bool ntrip_response_sourcetable_ok(void *response) {
     return str_starts_with(response, "HTTP/1.1 200 OK") || str_starts_with(response, "SOURCETABLE 200 OK");
-}
\ No newline at end of file
+}
+
+#define NTRIP_SOURCETABLE_NUMBER_MAX 24
+
+enum {
+    STR_MOUNTPOINT = 1,
+    STR_IDENTIFIER,
+    STR_FORMAT,
+    STR_FORMAT_DETAILS,
+    STR_CARRIER,
+    STR_NAV_SYSTEM,
+    STR_NETWORK,
+    STR_COUNTRY,
+    STR_LATITUDE,
+    STR_LONGITUDE,
+    STR_NMEA,
+    STR_SOLUTION,
+    STR_GENERATOR,
+    STR_COMPRESSION,
+    STR_AUTHENTICATION,
+    STR_FEE,
+    STR_BITRATE,
+    STR_FIELDS
+};
+
+static bool field_equals(const ntrip_field_t *field, const char *string) {
+    return field->length == strlen(string) && memcmp(field->data, string, field->length) == 0;
+}
+
+/// Число из поля без завершающего нуля: strtod не должен выйти за границу поля
+static double field_number(const ntrip_field_t *field) {
+    char number[NTRIP_SOURCETABLE_NUMBER_MAX];
+    if (field->length == 0 || field->length >= sizeof(number)) return 0;
+
+    memcpy(number, field->data, field->length);
+    number[field->length] = '\0';
+
+    char *end;
+    double value = strtod(number, &end);
+    return *end == '\0' && value == value ? value : 0;
+}
+
+bool ntrip_sourcetable_next(const char **cursor, const char *end, ntrip_sourcetable_stream_t *stream) {
+    while (*cursor < end) {
+        const char *line = *cursor;
+        const char *line_end = memchr(line, '\n', end - line);
+        *cursor = line_end != NULL ? line_end + 1 : end;
+        if (line_end == NULL) line_end = end;
+        if (line_end > line && line_end[-1] == '\r') line_end--;
+
+        ntrip_field_t fields[STR_FIELDS] = {0};
+        int count = 0;
+        for (const char *field = line; count < STR_FIELDS; count++) {
+            const char *separator = memchr(field, ';', line_end - field);
+            fields[count] = (ntrip_field_t) {field, (separator != NULL ? separator : line_end) - field};
+            if (separator == NULL) {
+                count++;
+                break;
+            }
+            field = separator + 1;
+        }
+
+        if (field_equals(&fields[0], "ENDSOURCETABLE")) {
+            *cursor = end;
+            return false;
+        }
+        if (!field_equals(&fields[0], "STR") || count <= STR_MOUNTPOINT || fields[STR_MOUNTPOINT].length == 0) continue;
+
+        double bitrate = field_number(&fields[STR_BITRATE]);
+        *stream = (ntrip_sourcetable_stream_t) {
+                .mountpoint = fields[STR_MOUNTPOINT],
+                .identifier = fields[STR_IDENTIFIER],
+                .format = fields[STR_FORMAT],
+                .format_details = fields[STR_FORMAT_DETAILS],
+                .nav_system = fields[STR_NAV_SYSTEM],
+                .network = fields[STR_NETWORK],
+                .country = fields[STR_COUNTRY],
+                .latitude = field_number(&fields[STR_LATITUDE]),
+                .longitude = field_number(&fields[STR_LONGITUDE]),
+                .nmea = field_equals(&fields[STR_NMEA], "1"),
+                .authentication = fields[STR_AUTHENTICATION].length == 1 ? fields[STR_AUTHENTICATION].data[0] : 'N',
+                .bitrate = bitrate >= 0 && bitrate <= UINT32_MAX ? (uint32_t) bitrate : 0
+        };
+        return true;
+    }
+
+    return false;
+}
@@ -26,11 +26,13 @@
 #include "uart.h"
 #include "status_led.h"
 #include "wifi.h"
+#include "trace.h"
+#include "tasks.h"
+#include "station.h"
 
 static const char *TAG = "socket_client";
 
 #define SOCKET_BUFFER_SIZE 1024
-#define SOCKET_CLIENT_STACK_SIZE 4096
 #define RECONNECT_DELAY_MS 5000
 #define MAX_RECONNECT_DELAY_MS 60000
 
@@ -39,6 +41,7 @@ static TaskHandle_t client_task_handle = NULL;
 static int client_socket = -1;
 static socket_client_stats_t client_stats = {0};
 static bool connected = false;
+static station_sink_t station_sink;
 
 // Forward declarations
 static void socket_client_task(void *params);
@@ -116,6 +119,7 @@ static esp_err_t socket_client_connect(void) {
         }
 
         connected = true;
+        station_sink_init(&station_sink, NULL);
         client_stats.connection_count++;
         client_stats.last_connect_time = time(NULL);
         reconnect_delay = RECONNECT_DELAY_MS;  // Reset delay on successful connection
@@ -158,7 +162,9 @@ static esp_err_t socket_client_send_data(const char *data, size_t length) {
         return ESP_ERR_INVALID_STATE;
     }
 
+    TRACE_BEGIN(send_start);
     int sent = send(client_socket, data, length, 0);
+    TRACE_END(TRACE_SOCKET_CLIENT_SEND, send_start, sent);
     if (sent < 0) {
         ESP_LOGE(TAG, "Send failed: errno %d", errno);
         socket_client_disconnect();
@@ -170,6 +176,10 @@ static esp_err_t socket_client_send_data(const char *data, size_t length) {
     return ESP_OK;
 }
 
+static int socket_client_station_send(void *ctx, const void *data, size_t length) {
+    return socket_client_send_data(data, length) == ESP_OK ? (int) length : -1;
+}
+
 static void socket_client_task(void *params) {
     char buffer[SOCKET_BUFFER_SIZE];
     
@@ -193,7 +203,7 @@ static void socket_client_task(void *params) {
                 size_t uart_data_len = uart_read_bytes(uart_port, (uint8_t*)buffer, 
                                                        sizeof(buffer) - 1, 10 / portTICK_PERIOD_MS);
                 if (uart_data_len > 0) {
-                    socket_client_send_data(buffer, uart_data_len);
+                    station_forward(&station_sink, buffer, uart_data_len, socket_client_station_send, NULL);
                 }
                 continue;
             } else {
@@ -217,7 +227,7 @@ static void socket_client_task(void *params) {
         size_t uart_data_len = uart_read_bytes(UART_NUM_0, (uint8_t*)buffer, 
                                                sizeof(buffer) - 1, 10 / portTICK_PERIOD_MS);
         if (uart_data_len > 0) {
-            socket_client_send_data(buffer, uart_data_len);
+            station_forward(&station_sink, buffer, uart_data_len, socket_client_station_send, NULL);
         }
 
         vTaskDelay(10 / portTICK_PERIOD_MS);
@@ -261,10 +271,9 @@ esp_err_t socket_client_init(void) {
 
     // Start client task
     client_running = true;
-    BaseType_t ret = xTaskCreate(socket_client_task, "socket_client", 
-                                SOCKET_CLIENT_STACK_SIZE, NULL, 5, &client_task_handle);
+    esp_err_t ret = task_create(TASK_SOCKET_CLIENT, socket_client_task, NULL, &client_task_handle);
     
-    if (ret != pdPASS) {
+    if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to create socket client task");
         client_running = false;
         return ESP_ERR_NO_MEM;
@@ -25,12 +25,14 @@
 #include "config.h"
 #include "uart.h"
 #include "status_led.h"
+#include "trace.h"
+#include "tasks.h"
+#include "station.h"
 
 static const char *TAG = "socket_server";
 
 #define MAX_CLIENTS 10
 #define SOCKET_BUFFER_SIZE 1024
-#define SOCKET_SERVER_STACK_SIZE 4096
 
 static bool server_running = false;
 static TaskHandle_t server_task_handle = NULL;
@@ -48,6 +50,7 @@ typedef struct {
 
 static socket_client_t clients[MAX_CLIENTS];
 static SemaphoreHandle_t clients_mutex;
+static station_sink_t station_sink;  // One UART stream broadcast to every client
 
 // Forward declarations
 static int socket_init(int type, int port);
@@ -223,6 +226,7 @@ static void socket_send_to_all_clients(const char *data, size_t length) {
     for (int i = 0; i < MAX_CLIENTS; i++) {
         if (clients[i].connected) {
             int sent = 0;
+            TRACE_BEGIN(send_start);
             
             if (clients[i].socket == udp_server_socket) {
                 // UDP client
@@ -232,6 +236,7 @@ static void socket_send_to_all_clients(const char *data, size_t length) {
                 // TCP client
                 sent = send(clients[i].socket, data, length, 0);
             }
+            TRACE_END(TRACE_SOCKET_SERVER_SEND, send_start, sent);
             
             if (sent < 0) {
                 ESP_LOGE(TAG, "Send failed to client %d: errno %d", i, errno);
@@ -245,12 +250,18 @@ static void socket_send_to_all_clients(const char *data, size_t length) {
     xSemaphoreGive(clients_mutex);
 }
 
+static int socket_server_station_send(void *ctx, const void *data, size_t length) {
+    socket_send_to_all_clients(data, length);
+    return length;
+}
+
 static void socket_server_task(void *params) {
     char buffer[SOCKET_BUFFER_SIZE];
     fd_set read_fds;
     int max_fd = 0;
 
     ESP_LOGI(TAG, "Socket server task started");
+    station_sink_init(&station_sink, NULL);
 
     while (server_running) {
         FD_ZERO(&read_fds);
@@ -298,7 +309,7 @@ static void socket_server_task(void *params) {
             size_t uart_data_len = uart_read_bytes(UART_NUM_0, (uint8_t*)buffer, 
                                                    sizeof(buffer) - 1, 10 / portTICK_PERIOD_MS);
             if (uart_data_len > 0) {
-                socket_send_to_all_clients(buffer, uart_data_len);
+                station_forward(&station_sink, buffer, uart_data_len, socket_server_station_send, NULL);
             }
             continue;
         }
@@ -367,7 +378,7 @@ static void socket_server_task(void *params) {
         size_t uart_data_len = uart_read_bytes(UART_NUM_0, (uint8_t*)buffer, 
                                                sizeof(buffer) - 1, 10 / portTICK_PERIOD_MS);
         if (uart_data_len > 0) {
-            socket_send_to_all_clients(buffer, uart_data_len);
+            station_forward(&station_sink, buffer, uart_data_len, socket_server_station_send, NULL);
         }
 
         vTaskDelay(10 / portTICK_PERIOD_MS);
@@ -439,10 +450,9 @@ esp_err_t socket_server_init(void) {
 
     // Start server task
     server_running = true;
-    BaseType_t ret = xTaskCreate(socket_server_task, "socket_server", 
-                                SOCKET_SERVER_STACK_SIZE, NULL, 5, &server_task_handle);
+    esp_err_t ret = task_create(TASK_SOCKET_SERVER, socket_server_task, NULL, &server_task_handle);
     
-    if (ret != pdPASS) {
+    if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to create socket server task");
         socket_server_deinit();
         return ESP_ERR_NO_MEM;
@@ -17,45 +17,409 @@
 
 #include <esp_log.h>
 #include <esp_err.h>
+#include <esp_memory_utils.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/ringbuf.h>
+#include <freertos/task.h>
+#include <ctype.h>
+#include <log_persist.h>
+#include <stdio.h>
 #include <string.h>
+#include <sd_logger.h>
+#include <tasks.h>
+#include <trace.h>
 #include <uart.h>
 #include "log.h"
 
 #define INITIAL_MAGIC "@@@@\n"
 
+#define LOG_WEB_BUFFER_SIZE 4096
+#define LOG_QUEUE_SIZE 6144
+#define LOG_RECORD_DATA_MAX 192
+#define LOG_LINE_MAX 512
+#define LOG_SPEC_MAX 24
+
 static const char *TAG = "LOG";
 
+/// Запись очереди: указатель на строку формата во flash и сырые аргументы.
+/// При format == NULL в data уже отформатированная строка
+typedef struct log_record {
+    const char *format;
+    uint16_t length;
+    uint8_t data[];
+} log_record_t;
+
+typedef enum {
+    LOG_ARG_PERCENT = 0,
+    LOG_ARG_INT,
+    LOG_ARG_LONG,
+    LOG_ARG_LLONG,
+    LOG_ARG_DOUBLE,
+    LOG_ARG_PTR,
+    LOG_ARG_STR,
+    LOG_ARG_UNSUPPORTED
+} log_arg_type_t;
+
+typedef struct log_spec {
+    const char *start;
+    const char *end;
+    uint8_t stars;
+    bool precision_star;    // точность передаётся последним из аргументов '*'
+    int precision;          // -1, если не задана
+    log_arg_type_t type;
+} log_spec_t;
+
 static RingbufHandle_t ringbuf_handle;
+static RingbufHandle_t queue_handle;
+static uint32_t log_dropped = 0;
+
+/// Следующая спецификация преобразования в строке формата.
+/// Один разбор используется и при записи аргументов, и при форматировании
+static bool log_spec_next(const char **format, log_spec_t *spec) {
+    const char *p = strchr(*format, '%');
+    if (p == NULL) return false;
+
+    spec->start = p++;
+    spec->stars = 0;
+    spec->precision_star = false;
+    spec->precision = -1;
+
+    if (*p == '%') {
+        spec->type = LOG_ARG_PERCENT;
+        spec->end = *format = p + 1;
+        return true;
+    }
+
+    while (*p != '\0' && strchr("-+ #0", *p) != NULL) p++;
+    if (*p == '*') {
+        spec->stars++;
+        p++;
+    } else {
+        while (isdigit((unsigned char) *p)) p++;
+    }
+    if (*p == '.') {
+        p++;
+        if (*p == '*') {
+            spec->stars++;
+            spec->precision_star = true;
+            p++;
+        } else {
+            spec->precision = 0;
+            while (isdigit((unsigned char) *p)) spec->precision = spec->precision * 10 + (*p++ - '0');
+        }
+    }
+
+    log_arg_type_t integer = LOG_ARG_INT;
+    bool long_double = false;
+    switch (*p) {
+        case 'h':
+            p++;
+            if (*p == 'h') p++;
+            break;
+        case 'l':
+            p++;
+            integer = LOG_ARG_LONG;
+            if (*p == 'l') {
+                p++;
+                integer = LOG_ARG_LLONG;
+            }
+            break;
+        case 'j':
+            p++;
+            integer = LOG_ARG_LLONG;
+            break;
+        case 'z':
+        case 't':
+            p++;
+            integer = sizeof(size_t) == sizeof(long) ? LOG_ARG_LONG : LOG_ARG_INT;
+            break;
+        case 'L':
+            p++;
+            long_double = true;
+            break;
+    }
+
+    switch (*p) {
+        case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+            spec->type = long_double ? LOG_ARG_UNSUPPORTED : integer;
+            break;
+        case 'c':
+            spec->type = integer == LOG_ARG_INT ? LOG_ARG_INT : LOG_ARG_UNSUPPORTED;
+            break;
+        case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+            spec->type = long_double ? LOG_ARG_UNSUPPORTED : LOG_ARG_DOUBLE;
+            break;
+        case 's':
+            spec->type = integer == LOG_ARG_INT ? LOG_ARG_STR : LOG_ARG_UNSUPPORTED;
+            break;
+        case 'p':
+            spec->type = LOG_ARG_PTR;
+            break;
+        default:
+            // %n, %ls и прочее форматируется сразу
+            spec->type = LOG_ARG_UNSUPPORTED;
+            break;
+    }
+
+    if (*p != '\0') p++;
+    spec->end = *format = p;
+
+    return true;
+}
+
+static bool log_pack(uint8_t *data, size_t *used, const void *value, size_t size) {
+    if (*used + size > LOG_RECORD_DATA_MAX) return false;
+    memcpy(data + *used, value, size);
+    *used += size;
+    return true;
+}
+
+static bool log_pack_args(const char *format, va_list arg, uint8_t *data, size_t *used) {
+    log_spec_t spec;
+    while (log_spec_next(&format, &spec)) {
+        if (spec.type == LOG_ARG_PERCENT) continue;
+        if (spec.type == LOG_ARG_UNSUPPORTED) return false;
+
+        int precision = spec.precision;
+        for (int i = 0; i < spec.stars; i++) {
+            int star = va_arg(arg, int);
+            if (!log_pack(data, used, &star, sizeof(star))) return false;
+            // Отрицательная точность считается незаданной
+            if (spec.precision_star && i == spec.stars - 1) precision = star < 0 ? -1 : star;
+        }
+
+        bool packed;
+        switch (spec.type) {
+            case LOG_ARG_INT: {
+                int value = va_arg(arg, int);
+                packed = log_pack(data, used, &value, sizeof(value));
+                break;
+            }
+            case LOG_ARG_LONG: {
+                long value = va_arg(arg, long);
+                packed = log_pack(data, used, &value, sizeof(value));
+                break;
+            }
+            case LOG_ARG_LLONG: {
+                long long value = va_arg(arg, long long);
+                packed = log_pack(data, used, &value, sizeof(value));
+                break;
+            }
+            case LOG_ARG_DOUBLE: {
+                double value = va_arg(arg, double);
+                packed = log_pack(data, used, &value, sizeof(value));
+                break;
+            }
+            case LOG_ARG_PTR: {
+                void *value = va_arg(arg, void *);
+                packed = log_pack(data, used, &value, sizeof(value));
+                break;
+            }
+            case LOG_ARG_STR: {
+                // Строки могут лежать на стеке вызывающего, копируется содержимое.
+                // С точностью строка может быть без '\0', читается не больше precision байт
+                const char *value = va_arg(arg, const char *);
+                if (value == NULL) value = "(null)";
+                size_t limit = precision >= 0 && precision < LOG_RECORD_DATA_MAX ? precision : LOG_RECORD_DATA_MAX;
+                size_t length = strnlen(value, limit);
+                packed = log_pack(data, used, value, length) && log_pack(data, used, "", 1);
+                break;
+            }
+            default:
+                packed = false;
+                break;
+        }
+
+        if (!packed) return false;
+    }
+
+    return true;
+}
+
+#define LOG_UNPACK(type) ({ type _value; memcpy(&_value, data, sizeof(type)); data += sizeof(type); _value; })
+
+#define LOG_FORMAT_ARG(value) ( \
+        spec.stars == 2 ? snprintf(out + n, size - n, spec_format, stars[0], stars[1], value) : \
+        spec.stars == 1 ? snprintf(out + n, size - n, spec_format, stars[0], value) : \
+        snprintf(out + n, size - n, spec_format, value))
+
+static size_t log_append(char *out, size_t n, size_t size, const char *text, size_t length) {
+    if (n + length >= size) length = size - n - 1;
+    memcpy(out + n, text, length);
+    return n + length;
+}
+
+/// Форматирование записи в задаче логирования
+static size_t log_format(const char *format, const uint8_t *data, size_t length, char *out, size_t size) {
+    if (format == NULL) {
+        if (length > size - 1) length = size - 1;
+        memcpy(out, data, length);
+        out[length] = '\0';
+        return length;
+    }
+
+    const char *literal = format;
+    size_t n = 0;
+
+    log_spec_t spec;
+    while (n < size - 1 && log_spec_next(&format, &spec)) {
+        n = log_append(out, n, size, literal, spec.start - literal);
+        literal = spec.end;
+
+        if (spec.type == LOG_ARG_PERCENT) {
+            n = log_append(out, n, size, "%", 1);
+            continue;
+        }
+
+        char spec_format[LOG_SPEC_MAX];
+        size_t spec_length = spec.end - spec.start;
+        if (spec_length >= sizeof(spec_format)) spec_length = sizeof(spec_format) - 1;
+        memcpy(spec_format, spec.start, spec_length);
+        spec_format[spec_length] = '\0';
+
+        int stars[2];
+        for (int i = 0; i < spec.stars; i++) stars[i] = LOG_UNPACK(int);
+
+        int written = 0;
+        switch (spec.type) {
+            case LOG_ARG_INT: written = LOG_FORMAT_ARG(LOG_UNPACK(int)); break;
+            case LOG_ARG_LONG: written = LOG_FORMAT_ARG(LOG_UNPACK(long)); break;
+            case LOG_ARG_LLONG: written = LOG_FORMAT_ARG(LOG_UNPACK(long long)); break;
+            case LOG_ARG_DOUBLE: written = LOG_FORMAT_ARG(LOG_UNPACK(double)); break;
+            case LOG_ARG_PTR: written = LOG_FORMAT_ARG(LOG_UNPACK(void *)); break;
+            case LOG_ARG_STR: {
+                const char *value = (const char *) data;
+                data += strlen(value) + 1;
+                written = LOG_FORMAT_ARG(value);
+                break;
+            }
+            default:
+                break;
+        }
+
+        if (written > 0) n += written;
+        if (n >= size) n = size - 1;
+    }
+
+    n = log_append(out, n, size, literal, strlen(literal));
+    out[n] = '\0';
+
+    return n;
+}
+
+/// Удаление ANSI-последовательностей цвета ("\033[0;31m", "\033[0m") для веб-лога
+static size_t log_strip_colors(char *line, size_t length) {
+    size_t out = 0;
+    for (size_t i = 0; i < length; i++) {
+        if (line[i] == '\033' && i + 1 < length && line[i + 1] == '[') {
+            i += 2;
+            while (i < length && !isalpha((unsigned char) line[i])) i++;
+            continue;
+        }
+        line[out++] = line[i];
+    }
+
+    return out;
+}
+
+/// Записи предыдущего сеанса из RTC памяти, без цветов, как в веб-логе
+static size_t log_format_previous(const char *format, const uint8_t *data, size_t length, char *out, size_t size) {
+    return log_strip_colors(out, log_format(format, data, length, out, size));
+}
+
+static void log_output(char *line, size_t length) {
+    uart_log(line, length);
+
+    length = log_strip_colors(line, length);
+    sd_logger_write_text(line, length);
+    log_persist_write(line, length);
+    xRingbufferSend(ringbuf_handle, line, length, 0);
+}
+
+static void log_task(void *ctx) {
+    char line[LOG_LINE_MAX];
+
+    while (true) {
+        size_t size;
+        log_record_t *record = xRingbufferReceive(queue_handle, &size, pdMS_TO_TICKS(LOG_PERSIST_FLUSH_MS));
+        log_persist_flush(false);
+        if (record == NULL) continue;
+
+        TRACE_BEGIN(format_start);
+        size_t length = log_format(record->format, record->data, record->length, line, sizeof(line));
+        TRACE_END(TRACE_LOG_FORMAT, format_start, length);
+        vRingbufferReturnItem(queue_handle, record);
+
+        uint32_t dropped = __atomic_exchange_n(&log_dropped, 0, __ATOMIC_RELAXED);
+        if (dropped > 0) {
+            char notice[48];
+            int notice_length = snprintf(notice, sizeof(notice), "W %s: %lu messages dropped\n", TAG, (unsigned long) dropped);
+            log_output(notice, notice_length);
+        }
+
+        log_output(line, length);
+    }
+}
+
+static void log_enqueue(const char *format, const void *data, size_t length) {
+    // В RTC память сразу, даже если очередь переполнена: при сбросе строки в очереди теряются
+    log_persist_record(format, data, length);
+
+    log_record_t *record;
+    if (xRingbufferSendAcquire(queue_handle, (void **) &record, sizeof(log_record_t) + length, 0) != pdTRUE) {
+        __atomic_fetch_add(&log_dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    record->format = format;
+    record->length = length;
+    memcpy(record->data, data, length);
+    xRingbufferSendComplete(queue_handle, record);
+}
 
 esp_err_t log_init() {
-    ringbuf_handle = xRingbufferCreate(4096, RINGBUF_TYPE_BYTEBUF);
-    if (ringbuf_handle == NULL) {
+    ringbuf_handle = xRingbufferCreate(LOG_WEB_BUFFER_SIZE, RINGBUF_TYPE_BYTEBUF);
+    queue_handle = xRingbufferCreate(LOG_QUEUE_SIZE, RINGBUF_TYPE_NOSPLIT);
+    if (ringbuf_handle == NULL || queue_handle == NULL) {
         ESP_LOGE(TAG, "Could not create log ring buffer");
         return ESP_FAIL;
     }
 
+    log_persist_init(log_format_previous);
+
     // Magic string to let web log know that ESP32 has restart (to reset line counter)
     xRingbufferSend(ringbuf_handle, INITIAL_MAGIC, strlen(INITIAL_MAGIC), 0);
 
+    task_create(TASK_LOG, log_task, NULL, NULL);
+
     return ESP_OK;
 }
 
 int log_vprintf(const char * format, va_list arg) {
-    char buffer[512];
-    int n = vsnprintf(buffer, 512, format, arg);
+    // Строки формата ESP_LOGx лежат во flash и живут всё время работы,
+    // поэтому в очередь попадает только указатель и сырые аргументы
+    if (esp_ptr_in_drom(format)) {
+        uint8_t data[LOG_RECORD_DATA_MAX];
+        size_t used = 0;
+
+        va_list args;
+        va_copy(args, arg);
+        bool packed = log_pack_args(format, args, data, &used);
+        va_end(args);
 
-    if (n > 512) {
-        n = 512;
+        if (packed) {
+            log_enqueue(format, data, used);
+            return 0;
+        }
     }
 
-    // Remove log colors for web log buffer
-    xRingbufferSend(ringbuf_handle, buffer + strlen(LOG_COLOR_E),
-            n - strlen(LOG_COLOR_E) - strlen(LOG_RESET_COLOR) - 1, 0);
-    xRingbufferSend(ringbuf_handle, "\n", 1, 0);
+    // Формат в RAM, неподдерживаемые преобразования или длинные строки: форматирование сразу
+    char buffer[LOG_LINE_MAX];
+    int n = vsnprintf(buffer, sizeof(buffer), format, arg);
+    if (n < 0) return n;
+    if (n >= sizeof(buffer)) n = sizeof(buffer) - 1;
 
-    uart_log(buffer, n);
+    log_enqueue(NULL, buffer, n);
 
     return n;
 }
@@ -0,0 +1,333 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "include/log_persist.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <esp_app_desc.h>
+#include <esp_attr.h>
+#include <esp_log.h>
+#include <esp_memory_utils.h>
+#include <esp_partition.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#define LOG_PERSIST_MAGIC 0x4C4F4752    // "LOGR"
+#define LOG_PAGE_MAGIC 0x4C4F4750       // "LOGP"
+#define LOG_SECTOR_SIZE 4096
+#define LOG_IMAGE_SIZE 17              // начало SHA256 образа в hex, как в esp_app_get_elf_sha256
+
+static const char *TAG = "LOG_PERSIST";
+
+typedef struct log_persist_rtc {
+    uint32_t magic;
+    uint32_t boot;
+    uint32_t check;
+    char image[LOG_IMAGE_SIZE];     // указатели на форматы действительны только для этого образа
+    uint32_t head;      // всего записано байт, позиция в кольце head % LOG_PERSIST_RTC_SIZE
+    uint32_t tail;      // начало самой старой записи
+    uint8_t data[LOG_PERSIST_RTC_SIZE];
+} log_persist_rtc_t;
+
+/// Заголовок записи в RTC кольце, за ним length байт аргументов или готовой строки
+typedef struct log_persist_rtc_record {
+    const char *format;
+    uint16_t length;
+} log_persist_rtc_record_t;
+
+typedef struct log_page_header {
+    uint32_t magic;
+    uint32_t seq;
+    uint16_t boot;
+    uint16_t length;
+} log_page_header_t;
+
+#define LOG_PAGE_DATA_SIZE (LOG_PERSIST_PAGE_SIZE - sizeof(log_page_header_t))
+
+// Не инициализируется при старте: содержимое остаётся после тёплого сброса
+static RTC_NOINIT_ATTR log_persist_rtc_t rtc_log;
+static portMUX_TYPE rtc_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static char *previous = NULL;
+static size_t previous_length = 0;
+static const char *previous_source = NULL;
+static const char *reset_reason = "UNKNOWN";
+
+static const esp_partition_t *partition = NULL;
+static uint8_t *page = NULL;
+static size_t page_count = 0, page_index = 0, page_used = 0;
+static uint32_t page_seq = 0;
+static uint16_t page_boot = 0;
+static int64_t page_flushed = 0;
+
+static void log_persist_rtc_copy_in(uint32_t position, const void *data, size_t length) {
+    size_t offset = position % LOG_PERSIST_RTC_SIZE;
+    size_t first = length < LOG_PERSIST_RTC_SIZE - offset ? length : LOG_PERSIST_RTC_SIZE - offset;
+    memcpy(rtc_log.data + offset, data, first);
+    memcpy(rtc_log.data, (const uint8_t *) data + first, length - first);
+}
+
+static void log_persist_rtc_copy_out(uint32_t position, void *data, size_t length) {
+    size_t offset = position % LOG_PERSIST_RTC_SIZE;
+    size_t first = length < LOG_PERSIST_RTC_SIZE - offset ? length : LOG_PERSIST_RTC_SIZE - offset;
+    memcpy(data, rtc_log.data + offset, first);
+    memcpy((uint8_t *) data + first, rtc_log.data, length - first);
+}
+
+/// Добавление строки в конец текста предыдущего сеанса, старые байты вытесняются
+static void log_persist_previous_append(const char *line, size_t length) {
+    if (length > LOG_PERSIST_PREVIOUS_MAX) {
+        line += length - LOG_PERSIST_PREVIOUS_MAX;
+        length = LOG_PERSIST_PREVIOUS_MAX;
+    }
+    if (previous_length + length > LOG_PERSIST_PREVIOUS_MAX) {
+        size_t drop = previous_length + length - LOG_PERSIST_PREVIOUS_MAX;
+        memmove(previous, previous + drop, previous_length - drop);
+        previous_length -= drop;
+    }
+    memcpy(previous + previous_length, line, length);
+    previous_length += length;
+}
+
+/// Записи предыдущего сеанса форматируются здесь: часть из них не успела дойти до задачи логирования
+static void log_persist_rtc_previous(bool same_image, log_persist_format_t format) {
+    if (rtc_log.head < rtc_log.tail || rtc_log.head - rtc_log.tail > LOG_PERSIST_RTC_SIZE) return;
+
+    previous = malloc(LOG_PERSIST_PREVIOUS_MAX + 1);
+    uint8_t *data = calloc(1, LOG_PERSIST_RTC_SIZE + 1);
+    char *line = malloc(LOG_PERSIST_LINE_MAX);
+    if (previous == NULL || data == NULL || line == NULL) {
+        free(previous);
+        previous = NULL;
+        free(data);
+        free(line);
+        return;
+    }
+
+    uint32_t position = rtc_log.tail;
+    while (rtc_log.head - position >= sizeof(log_persist_rtc_record_t)) {
+        log_persist_rtc_record_t record;
+        log_persist_rtc_copy_out(position, &record, sizeof(record));
+        position += sizeof(record);
+        if (record.length > rtc_log.head - position) break;
+
+        log_persist_rtc_copy_out(position, data, record.length);
+        data[record.length] = '\0';
+        position += record.length;
+
+        // После обновления прошивки указатели на форматы ведут в другой образ
+        if (record.format != NULL && (!same_image || !esp_ptr_in_drom(record.format))) continue;
+
+        size_t length = format(record.format, data, record.length, line, LOG_PERSIST_LINE_MAX);
+        log_persist_previous_append(line, length);
+    }
+
+    free(data);
+    free(line);
+
+    if (previous_length == 0) {
+        free(previous);
+        previous = NULL;
+        return;
+    }
+    previous[previous_length] = '\0';
+    previous_source = "rtc";
+}
+
+static void log_persist_rtc_init(log_persist_format_t format) {
+    char image[LOG_IMAGE_SIZE] = {0};
+    esp_app_get_elf_sha256(image, sizeof(image));
+
+    // После включения питания содержимое RTC памяти случайно
+    if (esp_reset_reason() == ESP_RST_POWERON) rtc_log.magic = 0;
+
+    if (rtc_log.magic == LOG_PERSIST_MAGIC && rtc_log.check == ~(rtc_log.magic ^ rtc_log.boot)) {
+        log_persist_rtc_previous(memcmp(rtc_log.image, image, sizeof(image)) == 0, format);
+    }
+
+    uint32_t boot = rtc_log.magic == LOG_PERSIST_MAGIC ? rtc_log.boot + 1 : 0;
+    rtc_log.magic = LOG_PERSIST_MAGIC;
+    rtc_log.boot = boot;
+    rtc_log.check = ~(rtc_log.magic ^ rtc_log.boot);
+    memcpy(rtc_log.image, image, sizeof(image));
+    rtc_log.head = 0;
+    rtc_log.tail = 0;
+}
+
+static bool log_persist_page_header(size_t index, log_page_header_t *header) {
+    if (esp_partition_read(partition, index * LOG_PERSIST_PAGE_SIZE, header, sizeof(*header)) != ESP_OK) return false;
+    return header->magic == LOG_PAGE_MAGIC && header->length <= LOG_PAGE_DATA_SIZE;
+}
+
+/// Хвост последнего сеанса из flash, если в RTC памяти ничего не сохранилось
+static void log_persist_flash_previous(size_t newest, uint16_t boot) {
+    size_t indexes[LOG_PERSIST_PREVIOUS_MAX / LOG_PAGE_DATA_SIZE + 1];
+    size_t count = 0, length = 0;
+
+    for (size_t i = 0; i < page_count && count < sizeof(indexes) / sizeof(indexes[0]); i++) {
+        size_t index = (newest + page_count - i) % page_count;
+        log_page_header_t header;
+        if (!log_persist_page_header(index, &header) || header.boot != boot) break;
+
+        indexes[count++] = index;
+        length += header.length;
+    }
+    if (length == 0) return;
+
+    previous = malloc(length + 1);
+    if (previous == NULL) return;
+
+    for (size_t i = count; i > 0; i--) {
+        log_page_header_t header;
+        log_persist_page_header(indexes[i - 1], &header);
+        esp_partition_read(partition, indexes[i - 1] * LOG_PERSIST_PAGE_SIZE + sizeof(header),
+                previous + previous_length, header.length);
+        previous_length += header.length;
+    }
+    previous[previous_length] = '\0';
+    previous_source = "flash";
+}
+
+static void log_persist_flash_init() {
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, LOG_PERSIST_PARTITION);
+    if (partition == NULL) return;
+
+    page_count = partition->size / LOG_PERSIST_PAGE_SIZE;
+    page = malloc(LOG_PERSIST_PAGE_SIZE);
+    if (page_count < LOG_SECTOR_SIZE / LOG_PERSIST_PAGE_SIZE || page == NULL) {
+        ESP_LOGW(TAG, "Flash log disabled");
+        free(page);
+        page = NULL;
+        partition = NULL;
+        return;
+    }
+
+    // Самая новая страница определяет место продолжения записи
+    bool found = false;
+    size_t newest = 0;
+    log_page_header_t newest_header = {0};
+    for (size_t i = 0; i < page_count; i++) {
+        log_page_header_t header;
+        if (!log_persist_page_header(i, &header)) continue;
+        if (!found || header.seq > newest_header.seq) {
+            found = true;
+            newest = i;
+            newest_header = header;
+        }
+    }
+
+    if (found) {
+        if (previous == NULL) log_persist_flash_previous(newest, newest_header.boot);
+
+        page_index = (newest + 1) % page_count;
+        page_seq = newest_header.seq + 1;
+        page_boot = newest_header.boot + 1;
+    }
+
+    page_flushed = esp_timer_get_time();
+}
+
+void log_persist_init(log_persist_format_t format) {
+    log_persist_rtc_init(format);
+    log_persist_flash_init();
+}
+
+static void log_persist_page_write() {
+    size_t offset = page_index * LOG_PERSIST_PAGE_SIZE;
+
+    // Страницы в секторе стираются при входе в сектор, следующие остаются чистыми
+    esp_err_t err = ESP_OK;
+    if (offset % LOG_SECTOR_SIZE == 0) err = esp_partition_erase_range(partition, offset, LOG_SECTOR_SIZE);
+
+    log_page_header_t *header = (log_page_header_t *) page;
+    *header = (log_page_header_t) {
+            .magic = LOG_PAGE_MAGIC,
+            .seq = page_seq,
+            .boot = page_boot,
+            .length = page_used
+    };
+    if (err == ESP_OK) err = esp_partition_write(partition, offset, page, sizeof(*header) + page_used);
+
+    // Ошибка записи не логируется, чтобы не зациклить задачу логирования
+    page_index = (page_index + 1) % page_count;
+    page_seq++;
+    page_used = 0;
+    page_flushed = esp_timer_get_time();
+}
+
+void log_persist_record(const char *format, const void *data, size_t length) {
+    log_persist_rtc_record_t record = {
+            .format = format,
+            .length = length
+    };
+    if (sizeof(record) + length > LOG_PERSIST_RTC_SIZE) return;
+
+    // Сначала освобождается место, head сдвигается последним: запись, прерванная
+    // паникой на другом ядре, не попадает в разобранную при загрузке часть кольца
+    taskENTER_CRITICAL(&rtc_lock);
+    while (rtc_log.head + sizeof(record) + length - rtc_log.tail > LOG_PERSIST_RTC_SIZE) {
+        log_persist_rtc_record_t oldest;
+        log_persist_rtc_copy_out(rtc_log.tail, &oldest, sizeof(oldest));
+        rtc_log.tail += sizeof(oldest) + oldest.length;
+    }
+    log_persist_rtc_copy_in(rtc_log.head, &record, sizeof(record));
+    log_persist_rtc_copy_in(rtc_log.head + sizeof(record), data, length);
+    rtc_log.head += sizeof(record) + length;
+    taskEXIT_CRITICAL(&rtc_lock);
+}
+
+void log_persist_write(const char *line, size_t length) {
+    if (page == NULL) return;
+
+    while (length > 0) {
+        size_t chunk = LOG_PAGE_DATA_SIZE - page_used;
+        if (chunk > length) chunk = length;
+
+        memcpy(page + sizeof(log_page_header_t) + page_used, line, chunk);
+        page_used += chunk;
+        line += chunk;
+        length -= chunk;
+
+        if (page_used == LOG_PAGE_DATA_SIZE) log_persist_page_write();
+    }
+}
+
+void log_persist_flush(bool force) {
+    if (page == NULL || page_used == 0) return;
+    if (!force && esp_timer_get_time() - page_flushed < (int64_t) LOG_PERSIST_FLUSH_MS * 1000) return;
+
+    log_persist_page_write();
+}
+
+void log_persist_set_reset_reason(const char *reason) {
+    reset_reason = reason;
+}
+
+const char *log_persist_reset_reason() {
+    return reset_reason;
+}
+
+const char *log_persist_previous(size_t *length, const char **source) {
+    *length = previous_length;
+    if (source != NULL) *source = previous_source;
+
+    return previous;
+}
@@ -26,6 +26,7 @@
 
 #include <web_server.h>
 #include <log.h>
+#include <log_persist.h>
 #include <status_led.h>
 #include "interface/socket_server.h"
 #include "interface/socket_client.h"
@@ -34,7 +35,9 @@
 #include <esp_sntp.h>
 #include <core_dump.h>
 #include <esp_ota_ops.h>
+#include <heap_diag.h>
 #include <stream_stats.h>
+#include <task_monitor.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_system.h"
@@ -48,6 +51,10 @@
 #include "wifi.h"
 
 #include "uart.h"
+#include "gnss.h"
+#include "receiver.h"
+#include "survey.h"
+#include "station.h"
 #include "interface/ntrip.h"
 #include "tasks.h"
 
@@ -70,13 +77,40 @@ static const char *TAG = "MAIN";  // Тег для логирования в о
 /// Преобразует код причины сброса в читаемую строку
 static char *reset_reason_name(esp_reset_reason_t reason);
 
-/// Задача обработки кнопки сброса настроек
-/// Сбрасывает конфигурацию при удержании кнопки более 5 секунд
+#define BUTTON_SHORT_PRESS_MAX_MS 500    // Максимальная длительность короткого нажатия
+#define BUTTON_DOUBLE_PRESS_GAP_MS 600   // Максимальный интервал между двумя короткими нажатиями
+#define PROFILE_BLINK_INTERVAL_MS 150
+
+/// Переключение на следующий профиль конфигурации по двойному нажатию кнопки
+/// Номер нового профиля показывается числом белых вспышек светодиода
+static void profile_button_switch() {
+    bool restart = false;
+    esp_err_t err = config_profile_activate_next(&restart);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Could not switch profile: %s", esp_err_to_name(err));
+        return;
+    }
+
+    int blinks = config_profile_active() + 1;
+    uint32_t duration = 2 * PROFILE_BLINK_INTERVAL_MS * blinks;
+    status_led_handle_t profile_led = status_led_add(0xFFFFFF55, STATUS_LED_BLINK, PROFILE_BLINK_INTERVAL_MS, duration, 0);
+    vTaskDelay(pdMS_TO_TICKS(duration + 2 * PROFILE_BLINK_INTERVAL_MS));
+    status_led_remove(profile_led);
+
+    if (restart) config_restart();
+}
+
+/// Задача обработки кнопки
+/// Сбрасывает конфигурацию при удержании кнопки более 5 секунд,
+/// двойное короткое нажатие переключает профиль конфигурации
 static void reset_button_task(void *pvParameters) {
     // Инициализация кнопки и очереди событий
     QueueHandle_t button_queue = button_init(PIN_BIT(BUTTON_GPIO));
     gpio_set_pull_mode(BUTTON_GPIO, GPIO_PULLUP_ONLY); // Подтягивающий резистор к VCC
-    
+
+    TickType_t last_short_press = 0;
+    bool short_pressed = false;
+
     while (true) {
         button_event_t button_ev;
         // Ожидание события кнопки с таймаутом 1 секунда
@@ -87,6 +121,20 @@ static void reset_button_task(void *pvParameters) {
                 vTaskDelay(2000 / portTICK_PERIOD_MS);        // Пауза 2 секунды
                 esp_restart();                                // Перезагрузка ESP32
             }
+
+            // Двойное короткое нажатие — переключение профиля
+            if (button_ev.event == BUTTON_UP) {
+                TickType_t now = xTaskGetTickCount();
+                if (button_ev.duration > BUTTON_SHORT_PRESS_MAX_MS) {
+                    short_pressed = false;
+                } else if (short_pressed && now - last_short_press <= pdMS_TO_TICKS(BUTTON_DOUBLE_PRESS_GAP_MS)) {
+                    short_pressed = false;
+                    profile_button_switch();
+                } else {
+                    short_pressed = true;
+                    last_short_press = now;
+                }
+            }
         }
     }
 }
@@ -118,18 +166,25 @@ void app_main()
     // Проверка core dump после возможного краха системы
     core_dump_check();
 
-    // Создание задачи обработки кнопки сброса (приоритет определён в tasks.h)
-    xTaskCreate(reset_button_task, "reset_button", 4096, NULL, TASK_PRIORITY_RESET_BUTTON, NULL);
+    // Создание задачи обработки кнопки сброса (стек и приоритет в реестре tasks.h)
+    task_create(TASK_RESET_BUTTON, reset_button_task, NULL, NULL);
 
     // Инициализация статистики потоков данных
     stream_stats_init();
+    task_monitor_init();
+    heap_diag_init();
 
     // Инициализация системы конфигурации (NVS) и UART
     config_init();
     uart_init();
+    gnss_init();                                              // Разбор NMEA приёмника
+    receiver_init();                                          // UBX приёмника u-blox
+    survey_init();                                            // Съёмка позиции базы
+    station_init();                                           // Сообщения станции 1005/1006/1033
 
     // Получение причины последнего сброса ESP32
     esp_reset_reason_t reset_reason = esp_reset_reason();
+    log_persist_set_reset_reason(reset_reason_name(reset_reason));
 
     // Получение информации о прошивке и её хеша
     const esp_app_desc_t *app_desc = esp_app_get_description();
@@ -137,7 +192,7 @@ void app_main()
     esp_app_get_elf_sha256(elf_buffer, sizeof(elf_buffer));
 
     // Отправка NMEA сообщения о начале инициализации в UART
-    uart_nmea("$PESP,INIT,START,%s,%s", app_desc->version, reset_reason_name(reset_reason));
+    uart_pesp(NMEA_PESP_INIT, "START,%s,%s", app_desc->version, reset_reason_name(reset_reason));
 
     // Вывод красивого баннера с информацией о прошивке в лог
     ESP_LOGI(TAG, "╔══════════════════════════════════════════════╗");
@@ -195,7 +250,7 @@ void app_main()
     sd_logger_init();
 
     // NMEA сообщение о завершении инициализации
-    uart_nmea("$PESP,INIT,COMPLETE");
+    uart_pesp(NMEA_PESP_INIT, "COMPLETE");
 
     // Ожидание получения IP адреса (WiFi подключение)
     wait_for_ip();
@@ -216,7 +271,7 @@ void app_main()
         heap_caps_get_info(&info, MALLOC_CAP_DEFAULT);        // Получение информации о heap
 
         // Отправка NMEA сообщения со статистикой памяти
-        uart_nmea("$PESP,HEAP,FREE,%d/%d,%d%%", info.total_free_bytes,
+        uart_pesp(NMEA_PESP_HEAP, "FREE,%d/%d,%d%%", info.total_free_bytes,
                 info.total_allocated_bytes + info.total_free_bytes,
                 100 * info.total_free_bytes / (info.total_allocated_bytes + info.total_free_bytes));
     }
@@ -15,41 +15,520 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <stdlib.h>
-#include <stdio.h>
 #include <stdint.h>
 #include <string.h>
 #include <stdarg.h>
+#include <sys/types.h>
 
 #include "protocol/nmea.h"
 
-uint8_t nmea_calculate_checksum(char *sentence) {
-    uint8_t checksum = 0;
-    unsigned int length = strlen(sentence);
-    for (unsigned int i = 1; i < length; i++) {
-        checksum ^= (uint8_t) sentence[i];
+/// Префиксы $PESP с заранее посчитанной суммой (XOR символов после '$')
+static const struct {
+    const char *text;
+    uint8_t length;
+    uint8_t checksum;
+} nmea_pesp_prefixes[NMEA_PESP_COUNT] = {
+        [NMEA_PESP_INIT] = {"$PESP,INIT,", 11, 0x0C},
+        [NMEA_PESP_WIFI_STA] = {"$PESP,WIFI,STA,", 15, 0x6D},
+        [NMEA_PESP_WIFI_AP] = {"$PESP,WIFI,AP,", 14, 0x3A},
+        [NMEA_PESP_NTRIP_SRV] = {"$PESP,NTRIP,SRV,", 16, 0x3C},
+        [NMEA_PESP_NTRIP_SRV2] = {"$PESP,NTRIP,SRV2,", 17, 0x0E},
+        [NMEA_PESP_CFG] = {"$PESP,CFG,", 10, 0x54},
+        [NMEA_PESP_HEAP] = {"$PESP,HEAP,", 11, 0x0A},
+        [NMEA_PESP_DBG] = {"$PESP,DBG,", 10, 0x57},
+};
+
+static const char nmea_hex_digits[] = "0123456789ABCDEF";
+
+/// Запись предложения в буфер вызывающего с суммой по ходу форматирования.
+/// Место под "*XX\r\n" и завершающий ноль резервируется, лишнее отбрасывается
+typedef struct nmea_writer {
+    char *out;
+    size_t limit;
+    size_t used;
+    uint8_t checksum;
+} nmea_writer_t;
+
+static void nmea_put(nmea_writer_t *writer, char c) {
+    if (writer->used >= writer->limit) return;
+
+    writer->out[writer->used++] = c;
+    writer->checksum ^= (uint8_t) c;
+}
+
+/// Символы аргументов, ломающие кадр предложения, заменяются
+static void nmea_put_field(nmea_writer_t *writer, char c) {
+    if (c == '$' || c == '*' || c == '!' || c < 0x20 || c > 0x7E) c = '_';
+    nmea_put(writer, c);
+}
+
+static void nmea_put_padded(nmea_writer_t *writer, const char *digits, size_t length, bool negative,
+        int width, bool zero, bool left) {
+    int pad = width - (int) length - (negative ? 1 : 0);
+
+    if (!left && !zero) for (; pad > 0; pad--) nmea_put(writer, ' ');
+    if (negative) nmea_put(writer, '-');
+    if (!left && zero) for (; pad > 0; pad--) nmea_put(writer, '0');
+    for (size_t i = 0; i < length; i++) nmea_put(writer, digits[i]);
+    if (left) for (; pad > 0; pad--) nmea_put(writer, ' ');
+}
+
+static void nmea_put_number(nmea_writer_t *writer, unsigned long long value, bool negative, unsigned int base,
+        bool upper, int width, bool zero, bool left) {
+    char digits[24];
+    size_t length = sizeof(digits);
+    do {
+        char digit = nmea_hex_digits[value % base];
+        digits[--length] = !upper && digit >= 'A' ? digit - 'A' + 'a' : digit;
+        value /= base;
+    } while (value > 0);
+
+    nmea_put_padded(writer, digits + length, sizeof(digits) - length, negative, width, zero, left);
+}
+
+/// Подмножество printf без кучи и блокировок: флаги '0' и '-', ширина и точность
+/// (в том числе '*'), модификаторы hh/h/l/ll/z, преобразования d i u x X c s %
+static void nmea_put_format(nmea_writer_t *writer, const char *fmt, va_list args) {
+    for (const char *p = fmt; *p; p++) {
+        if (*p != '%') {
+            nmea_put(writer, *p);
+            continue;
+        }
+
+        bool zero = false, left = false;
+        for (p++; *p == '0' || *p == '-'; p++) {
+            if (*p == '0') zero = true;
+            else left = true;
+        }
+
+        int width = 0;
+        if (*p == '*') {
+            width = va_arg(args, int);
+            if (width < 0) {
+                left = true;
+                width = -width;
+            }
+            p++;
+        } else {
+            for (; *p >= '0' && *p <= '9'; p++) width = width * 10 + (*p - '0');
+        }
+
+        int precision = -1;
+        if (*p == '.') {
+            p++;
+            precision = 0;
+            if (*p == '*') {
+                precision = va_arg(args, int);
+                p++;
+            } else {
+                for (; *p >= '0' && *p <= '9'; p++) precision = precision * 10 + (*p - '0');
+            }
+        }
+
+        int size = 0;           // 0 - int, 1 - long, 2 - long long, 3 - size_t
+        while (*p == 'h' || *p == 'l' || *p == 'z') {
+            if (*p == 'l') size = size == 1 ? 2 : 1;
+            else if (*p == 'z') size = 3;
+            p++;
+        }
+
+        switch (*p) {
+            case 'd':
+            case 'i': {
+                long long value = size == 0 ? va_arg(args, int) : size == 1 ? va_arg(args, long)
+                        : size == 2 ? va_arg(args, long long) : (long long) va_arg(args, ssize_t);
+                unsigned long long magnitude = value < 0 ? -(unsigned long long) value : (unsigned long long) value;
+                nmea_put_number(writer, magnitude, value < 0, 10, false, width, zero, left);
+                break;
+            }
+            case 'u':
+            case 'x':
+            case 'X': {
+                unsigned long long value = size == 0 ? va_arg(args, unsigned int) : size == 1 ? va_arg(args, unsigned long)
+                        : size == 2 ? va_arg(args, unsigned long long) : va_arg(args, size_t);
+                nmea_put_number(writer, value, false, *p == 'u' ? 10 : 16, *p == 'X', width, zero, left);
+                break;
+            }
+            case 'c': {
+                char c = (char) va_arg(args, int);
+                nmea_put_field(writer, c);
+                break;
+            }
+            case 's': {
+                const char *string = va_arg(args, const char *);
+                if (string == NULL) string = "(null)";
+                size_t length = precision >= 0 ? strnlen(string, precision) : strlen(string);
+                int pad = width - (int) length;
+                if (!left) for (; pad > 0; pad--) nmea_put(writer, ' ');
+                for (size_t i = 0; i < length; i++) nmea_put_field(writer, string[i]);
+                if (left) for (; pad > 0; pad--) nmea_put(writer, ' ');
+                break;
+            }
+            case '%':
+                nmea_put(writer, '%');
+                break;
+            default:
+                // Неизвестное преобразование не разбирается дальше: аргументы не совпадут
+                return;
+        }
+    }
+}
+
+static int nmea_emit(char *out, size_t size, const char *prefix, size_t prefix_length, uint8_t checksum,
+        const char *fmt, va_list args) {
+    // "*XX\r\n" и завершающий ноль
+    if (size < prefix_length + 6) {
+        if (size > 0) out[0] = '\0';
+        return 0;
     }
 
-    return checksum;
+    memcpy(out, prefix, prefix_length);
+    nmea_writer_t writer = {.out = out, .limit = size - 6, .used = prefix_length, .checksum = checksum};
+    nmea_put_format(&writer, fmt, args);
+
+    out[writer.used++] = '*';
+    out[writer.used++] = nmea_hex_digits[writer.checksum >> 4];
+    out[writer.used++] = nmea_hex_digits[writer.checksum & 0x0F];
+    out[writer.used++] = '\r';
+    out[writer.used++] = '\n';
+    out[writer.used] = '\0';
+
+    return (int) writer.used;
 }
 
-int nmea_asprintf(char **strp, const char *fmt, ...) {
+int nmea_format(char *out, size_t size, const char *fmt, ...) {
     va_list args;
     va_start(args, fmt);
+    int length = nmea_vformat(out, size, fmt, args);
+    va_end(args);
 
-    int l = nmea_vasprintf(strp, fmt, args);
+    return length;
+}
+
+int nmea_vformat(char *out, size_t size, const char *fmt, va_list args) {
+    // '$' не входит в сумму
+    if (fmt[0] != '$') return nmea_emit(out, size, "$", 1, 0, fmt, args);
+    return nmea_emit(out, size, "$", 1, 0, fmt + 1, args);
+}
 
+int nmea_pesp(char *out, size_t size, nmea_pesp_t family, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int length = nmea_vpesp(out, size, family, fmt, args);
     va_end(args);
 
-    return l;
+    return length;
+}
+
+int nmea_vpesp(char *out, size_t size, nmea_pesp_t family, const char *fmt, va_list args) {
+    return nmea_emit(out, size, nmea_pesp_prefixes[family].text, nmea_pesp_prefixes[family].length,
+            nmea_pesp_prefixes[family].checksum, fmt, args);
+}
+
+typedef struct nmea_field {
+    const char *value;
+    size_t length;
+} nmea_field_t;
+
+void nmea_parser_init(nmea_parser_t *parser, nmea_sentence_handler_t handler, void *ctx) {
+    memset(parser, 0, sizeof(*parser));
+    parser->handler = handler;
+    parser->ctx = ctx;
 }
 
-int nmea_vasprintf(char **strp, const char *fmt, va_list args) {
-    char *sentence;
-    vasprintf(&sentence, fmt, args);
-    uint8_t checksum = nmea_calculate_checksum(sentence);
-    int l = asprintf(strp, "%s*%02X\r\n", sentence, checksum);
-    free(sentence);
+static int nmea_hex(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+/// Завершение предложения по CR/LF: проверка контрольной суммы, разбор и обработчик
+static void nmea_parser_complete(nmea_parser_t *parser) {
+    size_t used = parser->used;
+    parser->used = 0;
+
+    if (parser->star == 0 || used != parser->star + 3) {
+        parser->checksum_errors++;
+        return;
+    }
+
+    int high = nmea_hex(parser->buffer[used - 2]), low = nmea_hex(parser->buffer[used - 1]);
+    if (high < 0 || low < 0 || ((high << 4) | low) != parser->checksum) {
+        parser->checksum_errors++;
+        return;
+    }
+
+    parser->buffer[used] = '\0';
+    parser->sentences++;
+
+    nmea_sentence_t type = nmea_parse_sentence(&parser->fix, parser->buffer, used);
+    if (parser->handler != NULL) parser->handler(parser->ctx, type, parser->buffer, used);
+}
+
+void nmea_parser_feed(nmea_parser_t *parser, const uint8_t *data, size_t length) {
+    const uint8_t *end = data + length;
+
+    while (data < end) {
+        // Вне предложения всё до '$' пропускается без копирования
+        if (parser->used == 0) {
+            const uint8_t *start = memchr(data, '$', end - data);
+            if (start == NULL) return;
+
+            parser->buffer[0] = '$';
+            parser->used = 1;
+            parser->star = 0;
+            parser->checksum = 0;
+            data = start + 1;
+            continue;
+        }
+
+        uint8_t c = *data++;
+        if (c == '\r' || c == '\n') {
+            nmea_parser_complete(parser);
+        } else if (c == '$') {
+            // Оборванное предложение: начало следующего не должно теряться
+            parser->used = 1;
+            parser->star = 0;
+            parser->checksum = 0;
+        } else if (c < 0x20 || c > 0x7E) {
+            // Двоичные данные внутри текста - это не NMEA
+            parser->used = 0;
+        } else if (parser->used >= NMEA_SENTENCE_MAX) {
+            parser->overflows++;
+            parser->used = 0;
+        } else {
+            if (c == '*' && parser->star == 0) {
+                parser->star = parser->used;
+            } else if (parser->star == 0) {
+                parser->checksum ^= c;
+            }
+            parser->buffer[parser->used++] = (char) c;
+        }
+    }
+}
+
+/// Десятичное поле в фиксированной точке: value * 10^decimals, лишние знаки отбрасываются
+static bool nmea_field_fixed(const nmea_field_t *field, uint8_t decimals, int64_t *value) {
+    const char *p = field->value, *end = field->value + field->length;
+    bool negative = p < end && *p == '-';
+    if (negative) p++;
+
+    int64_t result = 0;
+    int digits = 0, fraction = -1;
+    for (; p < end; p++) {
+        if (*p == '.' && fraction < 0) {
+            fraction = 0;
+            continue;
+        }
+        if (*p < '0' || *p > '9') return false;
+        if (fraction >= decimals) continue;
+        if (++digits > 15) return false;
+
+        result = result * 10 + (*p - '0');
+        if (fraction >= 0) fraction++;
+    }
+    if (digits == 0) return false;
+
+    for (int i = fraction < 0 ? 0 : fraction; i < decimals; i++) result *= 10;
+
+    *value = negative ? -result : result;
+    return true;
+}
+
+static bool nmea_field_uint(const nmea_field_t *field, uint32_t max, uint32_t *value) {
+    int64_t v;
+    if (!nmea_field_fixed(field, 0, &v) || v < 0 || v > max) return false;
+
+    *value = v;
+    return true;
+}
+
+static bool nmea_field_uint16(const nmea_field_t *field, uint8_t decimals, uint16_t *value) {
+    int64_t v;
+    if (!nmea_field_fixed(field, decimals, &v) || v < 0 || v > UINT16_MAX) return false;
+
+    *value = v;
+    return true;
+}
+
+/// Координата (d)ddmm.mmmmm и полушарие в 1e-7 градуса, не больше max градусов
+static bool nmea_field_coordinate(const nmea_field_t *field, const nmea_field_t *hemisphere, int64_t max, int32_t *value) {
+    int64_t v;
+    if (!nmea_field_fixed(field, 7, &v) || v < 0 || hemisphere->length != 1) return false;
+
+    int64_t degrees = v / 1000000000;
+    int64_t minutes = v % 1000000000;   // минуты * 1e7
+    int64_t result = degrees * 10000000 + (minutes + 30) / 60;
+    if (minutes >= 600000000 || result > max * 10000000) return false;
+
+    switch (hemisphere->value[0]) {
+        case 'N':
+        case 'E':
+            break;
+        case 'S':
+        case 'W':
+            result = -result;
+            break;
+        default:
+            return false;
+    }
+
+    *value = (int32_t) result;
+    return true;
+}
+
+static bool nmea_field_time(const nmea_field_t *field, nmea_fix_t *fix) {
+    int64_t v;
+    if (field->length < 6 || !nmea_field_fixed(field, 3, &v) || v < 0) return false;
+
+    uint32_t ms = v % 1000, seconds = v / 1000 % 100, minutes = v / 100000 % 100, hours = v / 10000000;
+    if (hours > 23 || minutes > 59 || seconds > 60) return false;
+
+    fix->hour = hours;
+    fix->minute = minutes;
+    fix->second = seconds;
+    fix->millisecond = ms;
+    fix->time_valid = true;
+    return true;
+}
+
+static bool nmea_field_date(const nmea_field_t *field, nmea_fix_t *fix) {
+    uint32_t v;
+    if (field->length != 6 || !nmea_field_uint(field, 311299, &v)) return false;
+
+    uint32_t day = v / 10000, month = v / 100 % 100;
+    if (day < 1 || day > 31 || month < 1 || month > 12) return false;
+
+    fix->day = day;
+    fix->month = month;
+    fix->year = 2000 + v % 100;
+    fix->date_valid = true;
+    return true;
+}
+
+static nmea_system_t nmea_talker_system(const char *talker) {
+    switch (talker[0] << 8 | talker[1]) {
+        case 'G' << 8 | 'P': return NMEA_SYSTEM_GPS;
+        case 'G' << 8 | 'L': return NMEA_SYSTEM_GLONASS;
+        case 'G' << 8 | 'A': return NMEA_SYSTEM_GALILEO;
+        case 'G' << 8 | 'B':
+        case 'B' << 8 | 'D': return NMEA_SYSTEM_BEIDOU;
+        case 'G' << 8 | 'Q':
+        case 'Q' << 8 | 'Z': return NMEA_SYSTEM_QZSS;
+        default: return NMEA_SYSTEM_OTHER;
+    }
+}
+
+static void nmea_parse_gga(nmea_fix_t *fix, const nmea_field_t *fields, int count) {
+    if (count < 12) return;
+
+    nmea_field_time(&fields[1], fix);
+
+    uint32_t quality;
+    if (!nmea_field_uint(&fields[6], 9, &quality)) return;
+    fix->quality = quality;
+
+    int32_t latitude, longitude;
+    fix->position_valid = quality > 0
+            && nmea_field_coordinate(&fields[2], &fields[3], 90, &latitude)
+            && nmea_field_coordinate(&fields[4], &fields[5], 180, &longitude);
+    if (fix->position_valid) {
+        fix->latitude = latitude;
+        fix->longitude = longitude;
+    }
+
+    uint32_t satellites;
+    if (nmea_field_uint(&fields[7], UINT8_MAX, &satellites)) fix->satellites_used = satellites;
+    nmea_field_uint16(&fields[8], 2, &fix->hdop);
+
+    int64_t v;
+    if (nmea_field_fixed(&fields[9], 3, &v) && v > INT32_MIN && v < INT32_MAX) fix->altitude = v;
+    if (nmea_field_fixed(&fields[11], 3, &v) && v > INT32_MIN && v < INT32_MAX) fix->geoid_separation = v;
+}
+
+static void nmea_parse_rmc(nmea_fix_t *fix, const nmea_field_t *fields, int count) {
+    if (count < 10) return;
+
+    nmea_field_time(&fields[1], fix);
+    nmea_field_date(&fields[9], fix);
+
+    if (fields[2].length != 1 || fields[2].value[0] != 'A') {
+        fix->position_valid = false;
+        return;
+    }
+
+    int32_t latitude, longitude;
+    if (nmea_field_coordinate(&fields[3], &fields[4], 90, &latitude)
+            && nmea_field_coordinate(&fields[5], &fields[6], 180, &longitude)) {
+        fix->latitude = latitude;
+        fix->longitude = longitude;
+        fix->position_valid = true;
+    }
+
+    // 1 узел = 1852 / 3600 м/с
+    int64_t knots;
+    if (nmea_field_fixed(&fields[7], 3, &knots) && knots >= 0 && knots < INT32_MAX) fix->speed = knots * 1852 / 3600;
+    nmea_field_uint16(&fields[8], 2, &fix->course);
+}
+
+static void nmea_parse_gsa(nmea_fix_t *fix, const nmea_field_t *fields, int count) {
+    if (count < 18) return;
+
+    uint32_t mode;
+    if (nmea_field_uint(&fields[2], 3, &mode)) fix->mode = mode;
+    nmea_field_uint16(&fields[15], 2, &fix->pdop);
+    nmea_field_uint16(&fields[16], 2, &fix->hdop);
+    nmea_field_uint16(&fields[17], 2, &fix->vdop);
+}
+
+static void nmea_parse_gsv(nmea_fix_t *fix, const nmea_field_t *fields, int count) {
+    if (count < 4) return;
+
+    // Серии GSV по сигналам (NMEA 4.11) повторяют одно число, поэтому присваивание, а не сумма
+    uint32_t in_view;
+    if (!nmea_field_uint(&fields[3], UINT8_MAX, &in_view)) return;
+    fix->in_view[nmea_talker_system(fields[0].value)] = in_view;
+
+    uint32_t total = 0;
+    for (int i = 0; i < NMEA_SYSTEM_COUNT; i++) total += fix->in_view[i];
+    fix->satellites_in_view = total > UINT8_MAX ? UINT8_MAX : total;
+}
+
+nmea_sentence_t nmea_parse_sentence(nmea_fix_t *fix, const char *sentence, size_t length) {
+    if (length < 6 || sentence[0] != '$') return NMEA_SENTENCE_OTHER;
+
+    // Поля между '$' и '*' без копирования
+    nmea_field_t fields[NMEA_FIELDS_MAX];
+    int count = 0;
+    const char *p = sentence + 1, *end = sentence + length;
+    const char *star = memchr(p, '*', end - p);
+    if (star != NULL) end = star;
+    while (count < NMEA_FIELDS_MAX) {
+        const char *comma = memchr(p, ',', end - p);
+        const char *field_end = comma != NULL ? comma : end;
+        fields[count++] = (nmea_field_t) {.value = p, .length = field_end - p};
+        if (comma == NULL) break;
+        p = comma + 1;
+    }
+
+    // Адрес: источник из двух букв и тип предложения, проприетарные $P... не разбираются
+    if (fields[0].length != 5 || sentence[1] == 'P') return NMEA_SENTENCE_OTHER;
+    const char *type = fields[0].value + 2;
+
+    if (memcmp(type, "GGA", 3) == 0) {
+        nmea_parse_gga(fix, fields, count);
+        return NMEA_SENTENCE_GGA;
+    } else if (memcmp(type, "RMC", 3) == 0) {
+        nmea_parse_rmc(fix, fields, count);
+        return NMEA_SENTENCE_RMC;
+    } else if (memcmp(type, "GSA", 3) == 0) {
+        nmea_parse_gsa(fix, fields, count);
+        return NMEA_SENTENCE_GSA;
+    } else if (memcmp(type, "GSV", 3) == 0) {
+        nmea_parse_gsv(fix, fields, count);
+        return NMEA_SENTENCE_GSV;
+    }
 
-    return l;
+    return NMEA_SENTENCE_OTHER;
 }
@@ -0,0 +1,529 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <string.h>
+
+#include "protocol/rtcm3.h"
+
+// CRC-24Q, полином 0x1864CFB
+static const uint32_t crc24q_table[256] = {
+        0x000000, 0x864CFB, 0x8AD50D, 0x0C99F6, 0x93E6E1, 0x15AA1A, 0x1933EC, 0x9F7F17,
+        0xA18139, 0x27CDC2, 0x2B5434, 0xAD18CF, 0x3267D8, 0xB42B23, 0xB8B2D5, 0x3EFE2E,
+        0xC54E89, 0x430272, 0x4F9B84, 0xC9D77F, 0x56A868, 0xD0E493, 0xDC7D65, 0x5A319E,
+        0x64CFB0, 0xE2834B, 0xEE1ABD, 0x685646, 0xF72951, 0x7165AA, 0x7DFC5C, 0xFBB0A7,
+        0x0CD1E9, 0x8A9D12, 0x8604E4, 0x00481F, 0x9F3708, 0x197BF3, 0x15E205, 0x93AEFE,
+        0xAD50D0, 0x2B1C2B, 0x2785DD, 0xA1C926, 0x3EB631, 0xB8FACA, 0xB4633C, 0x322FC7,
+        0xC99F60, 0x4FD39B, 0x434A6D, 0xC50696, 0x5A7981, 0xDC357A, 0xD0AC8C, 0x56E077,
+        0x681E59, 0xEE52A2, 0xE2CB54, 0x6487AF, 0xFBF8B8, 0x7DB443, 0x712DB5, 0xF7614E,
+        0x19A3D2, 0x9FEF29, 0x9376DF, 0x153A24, 0x8A4533, 0x0C09C8, 0x00903E, 0x86DCC5,
+        0xB822EB, 0x3E6E10, 0x32F7E6, 0xB4BB1D, 0x2BC40A, 0xAD88F1, 0xA11107, 0x275DFC,
+        0xDCED5B, 0x5AA1A0, 0x563856, 0xD074AD, 0x4F0BBA, 0xC94741, 0xC5DEB7, 0x43924C,
+        0x7D6C62, 0xFB2099, 0xF7B96F, 0x71F594, 0xEE8A83, 0x68C678, 0x645F8E, 0xE21375,
+        0x15723B, 0x933EC0, 0x9FA736, 0x19EBCD, 0x8694DA, 0x00D821, 0x0C41D7, 0x8A0D2C,
+        0xB4F302, 0x32BFF9, 0x3E260F, 0xB86AF4, 0x2715E3, 0xA15918, 0xADC0EE, 0x2B8C15,
+        0xD03CB2, 0x567049, 0x5AE9BF, 0xDCA544, 0x43DA53, 0xC596A8, 0xC90F5E, 0x4F43A5,
+        0x71BD8B, 0xF7F170, 0xFB6886, 0x7D247D, 0xE25B6A, 0x641791, 0x688E67, 0xEEC29C,
+        0x3347A4, 0xB50B5F, 0xB992A9, 0x3FDE52, 0xA0A145, 0x26EDBE, 0x2A7448, 0xAC38B3,
+        0x92C69D, 0x148A66, 0x181390, 0x9E5F6B, 0x01207C, 0x876C87, 0x8BF571, 0x0DB98A,
+        0xF6092D, 0x7045D6, 0x7CDC20, 0xFA90DB, 0x65EFCC, 0xE3A337, 0xEF3AC1, 0x69763A,
+        0x578814, 0xD1C4EF, 0xDD5D19, 0x5B11E2, 0xC46EF5, 0x42220E, 0x4EBBF8, 0xC8F703,
+        0x3F964D, 0xB9DAB6, 0xB54340, 0x330FBB, 0xAC70AC, 0x2A3C57, 0x26A5A1, 0xA0E95A,
+        0x9E1774, 0x185B8F, 0x14C279, 0x928E82, 0x0DF195, 0x8BBD6E, 0x872498, 0x016863,
+        0xFAD8C4, 0x7C943F, 0x700DC9, 0xF64132, 0x693E25, 0xEF72DE, 0xE3EB28, 0x65A7D3,
+        0x5B59FD, 0xDD1506, 0xD18CF0, 0x57C00B, 0xC8BF1C, 0x4EF3E7, 0x426A11, 0xC426EA,
+        0x2AE476, 0xACA88D, 0xA0317B, 0x267D80, 0xB90297, 0x3F4E6C, 0x33D79A, 0xB59B61,
+        0x8B654F, 0x0D29B4, 0x01B042, 0x87FCB9, 0x1883AE, 0x9ECF55, 0x9256A3, 0x141A58,
+        0xEFAAFF, 0x69E604, 0x657FF2, 0xE33309, 0x7C4C1E, 0xFA00E5, 0xF69913, 0x70D5E8,
+        0x4E2BC6, 0xC8673D, 0xC4FECB, 0x42B230, 0xDDCD27, 0x5B81DC, 0x57182A, 0xD154D1,
+        0x26359F, 0xA07964, 0xACE092, 0x2AAC69, 0xB5D37E, 0x339F85, 0x3F0673, 0xB94A88,
+        0x87B4A6, 0x01F85D, 0x0D61AB, 0x8B2D50, 0x145247, 0x921EBC, 0x9E874A, 0x18CBB1,
+        0xE37B16, 0x6537ED, 0x69AE1B, 0xEFE2E0, 0x709DF7, 0xF6D10C, 0xFA48FA, 0x7C0401,
+        0x42FA2F, 0xC4B6D4, 0xC82F22, 0x4E63D9, 0xD11CCE, 0x575035, 0x5BC9C3, 0xDD8538
+};
+
+uint32_t rtcm3_crc24q(const uint8_t *data, size_t length) {
+    uint32_t crc = 0;
+    for (size_t i = 0; i < length; i++) {
+        crc = ((crc << 8) & 0xFFFFFF) ^ crc24q_table[(crc >> 16) ^ data[i]];
+    }
+
+    return crc;
+}
+
+void rtcm3_framer_init(rtcm3_framer_t *framer, rtcm3_frame_handler_t handler, void *ctx) {
+    memset(framer, 0, sizeof(*framer));
+    framer->handler = handler;
+    framer->ctx = ctx;
+}
+
+static size_t rtcm3_frame_length(const uint8_t *header) {
+    return RTCM3_HEADER_SIZE + (((header[1] & 0x03) << 8) | header[2]) + RTCM3_CRC_SIZE;
+}
+
+/// Отбрасывает начало буфера до следующей возможной преамбулы
+static void rtcm3_framer_resync(rtcm3_framer_t *framer) {
+    const uint8_t *next = memchr(framer->buffer + 1, RTCM3_PREAMBLE, framer->used - 1);
+    size_t drop = next != NULL ? next - framer->buffer : framer->used;
+
+    framer->skipped += drop;
+    framer->used -= drop;
+    memmove(framer->buffer, framer->buffer + drop, framer->used);
+}
+
+/// Разбор накопленного буфера, пока в нём есть целые кадры или мусор
+static void rtcm3_framer_process(rtcm3_framer_t *framer) {
+    while (framer->used > 0) {
+        if (framer->buffer[0] != RTCM3_PREAMBLE) {
+            rtcm3_framer_resync(framer);
+            continue;
+        }
+        if (framer->used < RTCM3_HEADER_SIZE) return;
+
+        // 6 зарезервированных бит должны быть нулевыми
+        if ((framer->buffer[1] & 0xFC) != 0) {
+            rtcm3_framer_resync(framer);
+            continue;
+        }
+
+        size_t length = rtcm3_frame_length(framer->buffer);
+        if (framer->used < length) return;
+
+        uint32_t crc = ((uint32_t) framer->buffer[length - 3] << 16) | (framer->buffer[length - 2] << 8) | framer->buffer[length - 1];
+        if (rtcm3_crc24q(framer->buffer, length - RTCM3_CRC_SIZE) != crc) {
+            framer->crc_errors++;
+            rtcm3_framer_resync(framer);
+            continue;
+        }
+
+        framer->frames++;
+        if (framer->handler != NULL) framer->handler(framer->ctx, framer->buffer, length);
+
+        framer->used -= length;
+        memmove(framer->buffer, framer->buffer + length, framer->used);
+    }
+}
+
+void rtcm3_framer_feed(rtcm3_framer_t *framer, const uint8_t *data, size_t length) {
+    while (length > 0) {
+        // Вне кадра мусор пропускается без копирования
+        if (framer->used == 0) {
+            const uint8_t *start = memchr(data, RTCM3_PREAMBLE, length);
+            size_t skip = start != NULL ? start - data : length;
+            framer->skipped += skip;
+            data += skip;
+            length -= skip;
+            if (length == 0) return;
+        }
+
+        // Копируется не больше, чем нужно до конца текущего кадра
+        size_t want = framer->used < RTCM3_HEADER_SIZE ? RTCM3_HEADER_SIZE - framer->used
+                : rtcm3_frame_length(framer->buffer) - framer->used;
+        if (want == 0 || want > length) want = length;
+        if (want > sizeof(framer->buffer) - framer->used) want = sizeof(framer->buffer) - framer->used;
+
+        memcpy(framer->buffer + framer->used, data, want);
+        framer->used += want;
+        data += want;
+        length -= want;
+
+        rtcm3_framer_process(framer);
+    }
+}
+
+uint16_t rtcm3_message_type(const uint8_t *frame) {
+    return (frame[3] << 4) | (frame[4] >> 4);
+}
+
+size_t rtcm3_frame_build(uint8_t *out, const uint8_t *payload, size_t length) {
+    if (length > RTCM3_PAYLOAD_MAX) return 0;
+
+    out[0] = RTCM3_PREAMBLE;
+    out[1] = (length >> 8) & 0x03;
+    out[2] = length & 0xFF;
+    memmove(out + RTCM3_HEADER_SIZE, payload, length);
+
+    uint32_t crc = rtcm3_crc24q(out, RTCM3_HEADER_SIZE + length);
+    out[RTCM3_HEADER_SIZE + length] = crc >> 16;
+    out[RTCM3_HEADER_SIZE + length + 1] = crc >> 8;
+    out[RTCM3_HEADER_SIZE + length + 2] = crc;
+
+    return RTCM3_HEADER_SIZE + length + RTCM3_CRC_SIZE;
+}
+
+uint64_t rtcm3_get_bits(const uint8_t *buffer, size_t position, unsigned bits) {
+    uint64_t value = 0;
+
+    // По байту за шаг: в начале и в конце поля - его часть
+    while (bits > 0) {
+        unsigned available = 8 - (position & 7);
+        unsigned take = bits < available ? bits : available;
+        value = (value << take) | ((buffer[position >> 3] >> (available - take)) & ((1u << take) - 1));
+        position += take;
+        bits -= take;
+    }
+
+    return value;
+}
+
+int64_t rtcm3_get_signed_bits(const uint8_t *buffer, size_t position, unsigned bits) {
+    uint64_t value = rtcm3_get_bits(buffer, position, bits);
+    if (bits < 64 && (value >> (bits - 1)) & 1) value |= ~0ULL << bits;
+
+    return (int64_t) value;
+}
+
+void rtcm3_set_bits(uint8_t *buffer, size_t position, unsigned bits, uint64_t value) {
+    while (bits > 0) {
+        unsigned available = 8 - (position & 7);
+        unsigned take = bits < available ? bits : available;
+        unsigned shift = available - take;
+        uint8_t mask = ((1u << take) - 1) << shift;
+        uint8_t chunk = (value >> (bits - take)) & ((1u << take) - 1);
+        buffer[position >> 3] = (buffer[position >> 3] & ~mask) | (chunk << shift);
+        position += take;
+        bits -= take;
+    }
+}
+
+/// Флаг продолжения эпохи по первым байтам данных, false - не наблюдения или флаг не помещается
+static bool rtcm3_payload_epoch_end(const uint8_t *payload, size_t length) {
+    if (length < 7) return false;
+
+    uint16_t type = rtcm3_get_bits(payload, 0, 12);
+    unsigned msm = type % 10;
+
+    // Номер, станция, время 30 бит и бит Multiple Message (MSM) или синхронности (1001-1004)
+    if ((type >= 1071 && type <= 1137 && msm >= 1 && msm <= 7) || (type >= 1001 && type <= 1004)) {
+        return rtcm3_get_bits(payload, 54, 1) == 0;
+    }
+    // ГЛОНАСС: время эпохи 27 бит
+    if (type >= 1009 && type <= 1012) return rtcm3_get_bits(payload, 51, 1) == 0;
+
+    return false;
+}
+
+bool rtcm3_epoch_end(const uint8_t *frame, size_t length) {
+    if (length < RTCM3_HEADER_SIZE + RTCM3_CRC_SIZE) return false;
+    return rtcm3_payload_epoch_end(frame + RTCM3_HEADER_SIZE, length - RTCM3_HEADER_SIZE - RTCM3_CRC_SIZE);
+}
+
+void rtcm3_scanner_init(rtcm3_scanner_t *scanner) {
+    memset(scanner, 0, sizeof(*scanner));
+}
+
+size_t rtcm3_scanner_feed(rtcm3_scanner_t *scanner, const uint8_t *data, size_t length, rtcm3_scan_event_t *event) {
+    *event = RTCM3_SCAN_NONE;
+
+    for (size_t i = 0; i < length; i++) {
+        if (scanner->used == 0) {
+            const uint8_t *start = memchr(data + i, RTCM3_PREAMBLE, length - i);
+            if (start == NULL) return length;
+            i = start - data;
+            scanner->crc = 0;
+            scanner->received_crc = 0;
+        }
+
+        uint8_t byte = data[i];
+
+        // Ненулевые зарезервированные биты - не кадр, этот байт может быть новой преамбулой
+        if (scanner->used == 1 && (byte & 0xFC) != 0) {
+            scanner->used = 0;
+            if (byte == RTCM3_PREAMBLE) i--;
+            continue;
+        }
+
+        if (scanner->used < sizeof(scanner->head)) scanner->head[scanner->used] = byte;
+        if (scanner->used < RTCM3_HEADER_SIZE || scanner->used < scanner->length - RTCM3_CRC_SIZE) {
+            scanner->crc = ((scanner->crc << 8) & 0xFFFFFF) ^ crc24q_table[(scanner->crc >> 16) ^ byte];
+        } else {
+            scanner->received_crc = ((scanner->received_crc << 8) | byte) & 0xFFFFFF;
+        }
+        scanner->used++;
+
+        if (scanner->used == RTCM3_HEADER_SIZE) scanner->length = rtcm3_frame_length(scanner->head);
+        if (scanner->used < RTCM3_HEADER_SIZE || scanner->used < scanner->length) continue;
+
+        scanner->used = 0;
+        if (scanner->crc != scanner->received_crc) {
+            scanner->crc_errors++;
+            continue;
+        }
+
+        scanner->frames++;
+        size_t payload = scanner->length - RTCM3_HEADER_SIZE - RTCM3_CRC_SIZE;
+        if (payload > sizeof(scanner->head) - RTCM3_HEADER_SIZE) payload = sizeof(scanner->head) - RTCM3_HEADER_SIZE;
+        *event = rtcm3_payload_epoch_end(scanner->head + RTCM3_HEADER_SIZE, payload) ? RTCM3_SCAN_EPOCH_END : RTCM3_SCAN_FRAME;
+        return i + 1;
+    }
+
+    return length;
+}
+
+/// Общая часть 1005 и 1006 (DF002-DF027), возвращает позицию в битах
+static size_t rtcm3_encode_reference(uint8_t *payload, const rtcm3_station_t *station, uint16_t type) {
+    size_t position = 0;
+    rtcm3_set_bits(payload, position, 12, type), position += 12;
+    rtcm3_set_bits(payload, position, 12, station->station_id), position += 12;
+    rtcm3_set_bits(payload, position, 6, station->itrf_year), position += 6;
+    rtcm3_set_bits(payload, position, 1, station->gps), position += 1;
+    rtcm3_set_bits(payload, position, 1, station->glonass), position += 1;
+    rtcm3_set_bits(payload, position, 1, station->galileo), position += 1;
+    rtcm3_set_bits(payload, position, 1, 0), position += 1;                       // Физическая станция
+    rtcm3_set_bits(payload, position, 38, (uint64_t) station->ecef[0]), position += 38;
+    rtcm3_set_bits(payload, position, 1, 0), position += 1;                       // Single receiver oscillator
+    rtcm3_set_bits(payload, position, 1, 0), position += 1;                       // Зарезервировано
+    rtcm3_set_bits(payload, position, 38, (uint64_t) station->ecef[1]), position += 38;
+    rtcm3_set_bits(payload, position, 2, 0), position += 2;                       // Quarter cycle indicator
+    rtcm3_set_bits(payload, position, 38, (uint64_t) station->ecef[2]), position += 38;
+
+    return position;
+}
+
+size_t rtcm3_encode_1005(uint8_t *payload, const rtcm3_station_t *station) {
+    return rtcm3_encode_reference(payload, station, 1005) / 8;
+}
+
+size_t rtcm3_encode_1006(uint8_t *payload, const rtcm3_station_t *station) {
+    size_t position = rtcm3_encode_reference(payload, station, 1006);
+    rtcm3_set_bits(payload, position, 16, station->antenna_height), position += 16;
+
+    return position / 8;
+}
+
+/// Строка со счётчиком длины (8 бит), не длиннее 31 символа
+static size_t rtcm3_encode_string(uint8_t *payload, size_t position, const char *text) {
+    size_t length = strnlen(text, 31);
+    rtcm3_set_bits(payload, position, 8, length), position += 8;
+    for (size_t i = 0; i < length; i++) rtcm3_set_bits(payload, position, 8, (uint8_t) text[i]), position += 8;
+
+    return position;
+}
+
+size_t rtcm3_encode_1033(uint8_t *payload, const rtcm3_station_t *station) {
+    size_t position = 0;
+    rtcm3_set_bits(payload, position, 12, 1033), position += 12;
+    rtcm3_set_bits(payload, position, 12, station->station_id), position += 12;
+    position = rtcm3_encode_string(payload, position, station->antenna_descriptor);
+    rtcm3_set_bits(payload, position, 8, station->antenna_setup), position += 8;
+    position = rtcm3_encode_string(payload, position, station->antenna_serial);
+    position = rtcm3_encode_string(payload, position, station->receiver_type);
+    position = rtcm3_encode_string(payload, position, station->receiver_firmware);
+    position = rtcm3_encode_string(payload, position, station->receiver_serial);
+
+    return position / 8;
+}
+
+// Заголовок MSM до маски ячеек: номер, станция, время, флаги и маски спутников и сигналов
+#define RTCM3_MSM_SATELLITE_MASK 73
+#define RTCM3_MSM_SIGNAL_MASK 137
+#define RTCM3_MSM_CELL_MASK 169
+
+static bool rtcm3_msm7(uint16_t type) {
+    return type >= 1071 && type <= 1137 && type % 10 == 7;
+}
+
+/// DF407 (10 бит) в минимальное время захвата, мс. Участки по 32 значения с шагом 2^k
+static uint32_t rtcm3_lock_time_ms(uint32_t indicator) {
+    if (indicator < 64) return indicator;
+    if (indicator > 704) return 0;                              // зарезервировано
+
+    unsigned k = (indicator - 64) / 32 + 1;
+    return (32u << k) + (indicator - 32 * k - 32) * (1u << k);
+}
+
+/// Минимальное время захвата в DF402 (4 бита): 0 - меньше 32 мс, далее 2^(n+4) мс
+static uint32_t rtcm3_lock_time_indicator(uint32_t ms) {
+    if (ms < 32) return 0;
+
+    unsigned indicator = 31 - __builtin_clz(ms) - 4;
+    return indicator > 15 ? 15 : indicator;
+}
+
+/// Округление fine-поля к меньшей разрядности: деление на 2^shift к ближайшему,
+/// недостоверное значение (только старший бит) остаётся недостоверным
+static int64_t rtcm3_msm_fine(int64_t value, unsigned from_bits, unsigned to_bits, unsigned shift) {
+    int64_t limit = (1LL << (to_bits - 1)) - 1;
+    if (value == -(1LL << (from_bits - 1))) return -limit - 1;
+
+    value = (value + (1LL << (shift - 1))) >> shift;
+    return value > limit ? limit : value < -limit ? -limit : value;
+}
+
+size_t rtcm3_msm7_to_msm4(const uint8_t *frame, size_t length, uint8_t *out) {
+    if (length < RTCM3_HEADER_SIZE + RTCM3_CRC_SIZE) return 0;
+
+    const uint8_t *in = frame + RTCM3_HEADER_SIZE;
+    size_t payload_length = length - RTCM3_HEADER_SIZE - RTCM3_CRC_SIZE;
+    if (payload_length * 8 < RTCM3_MSM_CELL_MASK) return 0;
+    uint16_t type = rtcm3_get_bits(in, 0, 12);
+    if (!rtcm3_msm7(type)) return 0;
+
+    unsigned satellites = __builtin_popcountll(rtcm3_get_bits(in, RTCM3_MSM_SATELLITE_MASK, 64));
+    unsigned signals = __builtin_popcount(rtcm3_get_bits(in, RTCM3_MSM_SIGNAL_MASK, 32));
+    unsigned mask_bits = satellites * signals;
+    if (mask_bits > 64) return 0;
+
+    size_t header = RTCM3_MSM_CELL_MASK + mask_bits;
+    if (payload_length * 8 < header) return 0;
+    unsigned cells = mask_bits > 0 ? __builtin_popcountll(rtcm3_get_bits(in, RTCM3_MSM_CELL_MASK, mask_bits)) : 0;
+
+    // Данные MSM7 должны точно заполнять кадр
+    size_t msm7_bits = header + satellites * 36 + cells * 80;
+    if ((msm7_bits + 7) / 8 != payload_length) return 0;
+
+    uint8_t *payload = out + RTCM3_HEADER_SIZE;
+    if (out != frame) memcpy(payload, in, (header + 7) / 8);
+    rtcm3_set_bits(payload, 0, 12, type - 3);
+
+    // Данные спутников: целые миллисекунды (8) и доли (10); расширенные данные (4)
+    // и грубая скорость изменения фазы (14) отбрасываются. Поля читаются раньше,
+    // чем на их место попадает запись, поэтому преобразование может идти на месте
+    size_t from = header, to = header;
+    for (unsigned i = 0; i < satellites; i++, from += 8, to += 8) {
+        rtcm3_set_bits(payload, to, 8, rtcm3_get_bits(in, from, 8));
+    }
+    from += satellites * 4;
+    for (unsigned i = 0; i < satellites; i++, from += 10, to += 10) {
+        rtcm3_set_bits(payload, to, 10, rtcm3_get_bits(in, from, 10));
+    }
+    from += satellites * 14;
+
+    // Данные сигналов: псевдодальность 20 -> 15 бит (2^-29 -> 2^-24 мс)
+    for (unsigned i = 0; i < cells; i++, from += 20, to += 15) {
+        rtcm3_set_bits(payload, to, 15, rtcm3_msm_fine(rtcm3_get_signed_bits(in, from, 20), 20, 15, 5));
+    }
+    // Фаза 24 -> 22 бита (2^-31 -> 2^-29 мс)
+    for (unsigned i = 0; i < cells; i++, from += 24, to += 22) {
+        rtcm3_set_bits(payload, to, 22, rtcm3_msm_fine(rtcm3_get_signed_bits(in, from, 24), 24, 22, 2));
+    }
+    // Время захвата DF407 -> DF402
+    for (unsigned i = 0; i < cells; i++, from += 10, to += 4) {
+        rtcm3_set_bits(payload, to, 4, rtcm3_lock_time_indicator(rtcm3_lock_time_ms(rtcm3_get_bits(in, from, 10))));
+    }
+    // Неоднозначность полуцикла без изменений
+    for (unsigned i = 0; i < cells; i++, from += 1, to += 1) {
+        rtcm3_set_bits(payload, to, 1, rtcm3_get_bits(in, from, 1));
+    }
+    // C/N0 10 бит по 1/16 дБГц -> 6 бит по 1 дБГц, 0 - не определено
+    for (unsigned i = 0; i < cells; i++, from += 10, to += 6) {
+        uint32_t cnr = rtcm3_get_bits(in, from, 10);
+        uint32_t rounded = (cnr + 8) >> 4;
+        if (rounded > 63) rounded = 63;
+        if (cnr > 0 && rounded == 0) rounded = 1;
+        rtcm3_set_bits(payload, to, 6, rounded);
+    }
+    // Точная скорость изменения фазы (15) отбрасывается
+
+    size_t msm4_length = (to + 7) / 8;
+    if (to & 7) rtcm3_set_bits(payload, to, 8 - (to & 7), 0);
+
+    return rtcm3_frame_build(out, payload, msm4_length);
+}
+
+void rtcm3_msm4_stream_init(rtcm3_msm4_stream_t *stream) {
+    memset(stream, 0, sizeof(*stream));
+}
+
+int rtcm3_msm4_stream_feed(rtcm3_msm4_stream_t *stream, const void *data, size_t length, rtcm3_write_t write, void *ctx) {
+    const uint8_t *bytes = data;
+    size_t i = 0, start = 0;                            // [start, i) - проходящие без изменений байты
+    int written = 0, n;
+
+#define RTCM3_MSM4_WRITE(from, count) do { \
+        if ((count) > 0) { \
+            if ((n = write(ctx, (from), (count))) < 0) return n; \
+            written += n; \
+        } \
+    } while (0)
+
+    while (i < length) {
+        // Остаток другого кадра
+        if (stream->skip > 0) {
+            size_t take = length - i < stream->skip ? length - i : stream->skip;
+            stream->skip -= take;
+            i += take;
+            continue;
+        }
+
+        if (stream->used == 0) {
+            const uint8_t *preamble = memchr(bytes + i, RTCM3_PREAMBLE, length - i);
+            if (preamble == NULL) {
+                i = length;
+                break;
+            }
+            i = preamble - bytes;
+            RTCM3_MSM4_WRITE(bytes + start, i - start);
+        }
+
+        // Заголовок и номер сообщения по байту, тело MSM7 целиком
+        size_t take = 1;
+        if (stream->used >= RTCM3_HEADER_SIZE + 2) {
+            take = stream->length - stream->used;
+            if (take > length - i) take = length - i;
+        }
+        memcpy(stream->buffer + stream->used, bytes + i, take);
+        stream->used += take;
+        i += take;
+        start = i;
+
+        // Ненулевые зарезервированные биты - не кадр, второй байт разбирается заново
+        if (stream->used == 2 && (stream->buffer[1] & 0xFC) != 0) {
+            RTCM3_MSM4_WRITE(stream->buffer, 1);
+            stream->used = 0;
+            start = --i;
+            continue;
+        }
+
+        if (stream->used == RTCM3_HEADER_SIZE + 2) {
+            stream->length = rtcm3_frame_length(stream->buffer);
+            if (stream->length < stream->used || !rtcm3_msm7(rtcm3_get_bits(stream->buffer + RTCM3_HEADER_SIZE, 0, 12))) {
+                // Не MSM7: уже прочитанное и остаток кадра проходят как есть
+                RTCM3_MSM4_WRITE(stream->buffer, stream->used);
+                stream->skip = stream->length - stream->used;
+                stream->used = 0;
+            }
+            continue;
+        }
+
+        if (stream->used < RTCM3_HEADER_SIZE + 2 || stream->used < stream->length) continue;
+
+        size_t frame_length = stream->length;
+        const uint8_t *crc = stream->buffer + frame_length - RTCM3_CRC_SIZE;
+        size_t converted = 0;
+        if (rtcm3_crc24q(stream->buffer, frame_length - RTCM3_CRC_SIZE) != ((uint32_t) crc[0] << 16 | crc[1] << 8 | crc[2])) {
+            stream->crc_errors++;
+        } else {
+            converted = rtcm3_msm7_to_msm4(stream->buffer, frame_length, stream->buffer);
+        }
+
+        if (converted > 0) {
+            stream->converted++;
+            stream->saved += frame_length - converted;
+            RTCM3_MSM4_WRITE(stream->buffer, converted);
+        } else {
+            RTCM3_MSM4_WRITE(stream->buffer, frame_length);
+        }
+        stream->used = 0;
+    }
+
+    if (stream->used == 0) RTCM3_MSM4_WRITE(bytes + start, i - start);
+
+#undef RTCM3_MSM4_WRITE
+
+    return written;
+}
@@ -0,0 +1,329 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <string.h>
+#include <strings.h>
+
+#include "protocol/ubx.h"
+
+const ubx_message_t UBX_MESSAGES[] = {
+        {"GGA", 0x209100BA},
+        {"GLL", 0x209100C9},
+        {"GSA", 0x209100BF},
+        {"GSV", 0x209100C4},
+        {"GST", 0x209100D3},
+        {"RMC", 0x209100AB},
+        {"VTG", 0x209100B0},
+        {"ZDA", 0x209100D8},
+        {"NAV-PVT", 0x20910006},
+        {"NAV-HPPOSLLH", 0x20910033},
+        {"NAV-SAT", 0x20910015},
+        {"NAV-SVIN", 0x20910088},
+        {"MON-HW", 0x209101B4},
+        {"RXM-RAWX", 0x209102A4},
+        {"RTCM1005", 0x209102BD},
+        {"RTCM1074", 0x2091035E},
+        {"RTCM1077", 0x209102CC},
+        {"RTCM1084", 0x20910363},
+        {"RTCM1087", 0x209102D1},
+        {"RTCM1094", 0x20910368},
+        {"RTCM1097", 0x20910318},
+        {"RTCM1124", 0x2091036D},
+        {"RTCM1127", 0x209102D6},
+        {"RTCM1230", 0x20910303},
+        {"RTCM4072", 0x209102FE},
+};
+
+const size_t UBX_MESSAGE_COUNT = sizeof(UBX_MESSAGES) / sizeof(UBX_MESSAGES[0]);
+
+static const char *ubx_port_names[UBX_PORT_COUNT] = {
+        [UBX_PORT_I2C] = "i2c",
+        [UBX_PORT_UART1] = "uart1",
+        [UBX_PORT_UART2] = "uart2",
+        [UBX_PORT_USB] = "usb",
+        [UBX_PORT_SPI] = "spi"
+};
+
+static uint16_t ubx_u2(const uint8_t *p) {
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t ubx_u4(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static int32_t ubx_i4(const uint8_t *p) {
+    return (int32_t) ubx_u4(p);
+}
+
+void ubx_checksum(const uint8_t *data, size_t length, uint8_t checksum[2]) {
+    uint8_t a = 0, b = 0;
+    for (size_t i = 0; i < length; i++) {
+        a += data[i];
+        b += a;
+    }
+
+    checksum[0] = a;
+    checksum[1] = b;
+}
+
+void ubx_framer_init(ubx_framer_t *framer, ubx_frame_handler_t handler, void *ctx) {
+    memset(framer, 0, sizeof(*framer));
+    framer->handler = handler;
+    framer->ctx = ctx;
+}
+
+static size_t ubx_frame_length(const uint8_t *header) {
+    return UBX_HEADER_SIZE + ubx_u2(header + 4) + UBX_CHECKSUM_SIZE;
+}
+
+/// Отбрасывает начало буфера до следующего возможного начала кадра
+static void ubx_framer_resync(ubx_framer_t *framer) {
+    const uint8_t *next = memchr(framer->buffer + 1, UBX_SYNC_1, framer->used - 1);
+    size_t drop = next != NULL ? next - framer->buffer : framer->used;
+
+    framer->used -= drop;
+    memmove(framer->buffer, framer->buffer + drop, framer->used);
+}
+
+/// Разбор накопленного буфера, пока в нём есть целые кадры или мусор
+static void ubx_framer_process(ubx_framer_t *framer) {
+    while (framer->used > 0) {
+        if (framer->buffer[0] != UBX_SYNC_1 || (framer->used > 1 && framer->buffer[1] != UBX_SYNC_2)) {
+            ubx_framer_resync(framer);
+            continue;
+        }
+        if (framer->used < UBX_HEADER_SIZE) return;
+
+        size_t length = ubx_frame_length(framer->buffer);
+        if (length > UBX_FRAME_MAX) {
+            framer->oversized++;
+            ubx_framer_resync(framer);
+            continue;
+        }
+        if (framer->used < length) return;
+
+        uint8_t checksum[2];
+        ubx_checksum(framer->buffer + 2, length - 2 - UBX_CHECKSUM_SIZE, checksum);
+        if (checksum[0] != framer->buffer[length - 2] || checksum[1] != framer->buffer[length - 1]) {
+            framer->checksum_errors++;
+            ubx_framer_resync(framer);
+            continue;
+        }
+
+        framer->frames++;
+        if (framer->handler != NULL) {
+            framer->handler(framer->ctx, framer->buffer[2], framer->buffer[3], framer->buffer + UBX_HEADER_SIZE,
+                    length - UBX_HEADER_SIZE - UBX_CHECKSUM_SIZE);
+        }
+
+        framer->used -= length;
+        memmove(framer->buffer, framer->buffer + length, framer->used);
+    }
+}
+
+void ubx_framer_feed(ubx_framer_t *framer, const uint8_t *data, size_t length) {
+    while (length > 0) {
+        // Вне кадра всё до синхронизации пропускается без копирования
+        if (framer->used == 0) {
+            const uint8_t *start = memchr(data, UBX_SYNC_1, length);
+            if (start == NULL) return;
+            length -= start - data;
+            data = start;
+        }
+
+        // Копируется не больше, чем нужно до конца текущего кадра
+        size_t want = framer->used < UBX_HEADER_SIZE ? UBX_HEADER_SIZE - framer->used
+                : ubx_frame_length(framer->buffer) - framer->used;
+        if (want == 0 || want > length) want = length;
+        if (want > sizeof(framer->buffer) - framer->used) want = sizeof(framer->buffer) - framer->used;
+
+        memcpy(framer->buffer + framer->used, data, want);
+        framer->used += want;
+        data += want;
+        length -= want;
+
+        ubx_framer_process(framer);
+    }
+}
+
+size_t ubx_frame_build(uint8_t *out, size_t size, uint8_t class, uint8_t id, const uint8_t *payload, size_t length) {
+    if (length > UINT16_MAX || size < UBX_HEADER_SIZE + length + UBX_CHECKSUM_SIZE) return 0;
+
+    out[0] = UBX_SYNC_1;
+    out[1] = UBX_SYNC_2;
+    out[2] = class;
+    out[3] = id;
+    out[4] = length & 0xFF;
+    out[5] = length >> 8;
+    if (length > 0) memmove(out + UBX_HEADER_SIZE, payload, length);
+    ubx_checksum(out + 2, length + 4, out + UBX_HEADER_SIZE + length);
+
+    return UBX_HEADER_SIZE + length + UBX_CHECKSUM_SIZE;
+}
+
+bool ubx_nav_pvt_decode(const uint8_t *payload, size_t length, ubx_nav_pvt_t *pvt) {
+    if (length < 92) return false;
+
+    pvt->itow = ubx_u4(payload);
+    pvt->year = ubx_u2(payload + 4);
+    pvt->month = payload[6];
+    pvt->day = payload[7];
+    pvt->hour = payload[8];
+    pvt->minute = payload[9];
+    pvt->second = payload[10];
+    pvt->time_valid = (payload[11] & 0x03) == 0x03;
+    pvt->fix_type = payload[20];
+    pvt->fix_ok = payload[21] & 0x01;
+    pvt->carrier = (payload[21] >> 6) & 0x03;
+    pvt->satellites = payload[23];
+    pvt->longitude = ubx_i4(payload + 24);
+    pvt->latitude = ubx_i4(payload + 28);
+    pvt->height = ubx_i4(payload + 32);
+    pvt->height_msl = ubx_i4(payload + 36);
+    pvt->h_acc = ubx_u4(payload + 40);
+    pvt->v_acc = ubx_u4(payload + 44);
+    pvt->pdop = ubx_u2(payload + 76);
+
+    return true;
+}
+
+bool ubx_nav_svin_decode(const uint8_t *payload, size_t length, ubx_nav_svin_t *svin) {
+    if (length < 40) return false;
+
+    svin->duration = ubx_u4(payload + 8);
+    // Среднее в см и уточнение в 0.1 мм
+    for (int i = 0; i < 3; i++) {
+        svin->mean[i] = (int64_t) ubx_i4(payload + 12 + i * 4) * 100 + (int8_t) payload[24 + i];
+    }
+    svin->mean_acc = ubx_u4(payload + 28);
+    svin->observations = ubx_u4(payload + 32);
+    svin->valid = payload[36] != 0;
+    svin->active = payload[37] != 0;
+
+    return true;
+}
+
+bool ubx_mon_hw_decode(const uint8_t *payload, size_t length, ubx_mon_hw_t *hw) {
+    if (length < 60) return false;
+
+    hw->noise = ubx_u2(payload + 16);
+    hw->agc = ubx_u2(payload + 18);
+    hw->antenna_status = payload[20];
+    hw->antenna_power = payload[21];
+    hw->jamming_state = (payload[22] >> 2) & 0x03;
+    hw->jamming = payload[45];
+
+    return true;
+}
+
+bool ubx_ack_matches(const uint8_t *payload, size_t length, uint8_t class, uint8_t id) {
+    return length >= 2 && payload[0] == class && payload[1] == id;
+}
+
+size_t ubx_key_size(uint32_t key) {
+    switch ((key >> 28) & 0x07) {
+        case 1: // L, один бит в байте
+        case 2:
+            return 1;
+        case 3:
+            return 2;
+        case 4:
+            return 4;
+        case 5:
+            return 8;
+        default:
+            return 0;
+    }
+}
+
+void ubx_valset_init(ubx_valset_t *set, uint8_t layers) {
+    memset(set, 0, sizeof(*set));
+    set->payload[0] = 0;    // версия без транзакций
+    set->payload[1] = layers;
+    set->length = 4;
+}
+
+bool ubx_valset_add(ubx_valset_t *set, uint32_t key, uint64_t value) {
+    size_t size = ubx_key_size(key);
+    if (size == 0 || set->count >= UBX_VALSET_KEYS_MAX) return false;
+
+    uint8_t *p = set->payload + set->length;
+    for (int i = 0; i < 4; i++) p[i] = key >> (i * 8);
+    for (size_t i = 0; i < size; i++) p[4 + i] = value >> (i * 8);
+
+    set->length += 4 + size;
+    set->count++;
+    return true;
+}
+
+size_t ubx_valget_build(uint8_t *payload, size_t size, uint8_t layer, const uint32_t *keys, size_t count) {
+    if (size < 4 + count * 4) return 0;
+
+    payload[0] = 0;
+    payload[1] = layer;
+    payload[2] = 0;
+    payload[3] = 0;
+    for (size_t k = 0; k < count; k++) {
+        for (int i = 0; i < 4; i++) payload[4 + k * 4 + i] = keys[k] >> (i * 8);
+    }
+
+    return 4 + count * 4;
+}
+
+bool ubx_valget_next(const uint8_t **cursor, const uint8_t *end, uint32_t *key, uint64_t *value) {
+    const uint8_t *p = *cursor;
+    if (end - p < 4) return false;
+
+    uint32_t k = ubx_u4(p);
+    size_t size = ubx_key_size(k);
+    if (size == 0 || (size_t) (end - p) < 4 + size) return false;
+
+    uint64_t v = 0;
+    for (size_t i = 0; i < size; i++) v |= (uint64_t) p[4 + i] << (i * 8);
+
+    *key = k;
+    *value = v;
+    *cursor = p + 4 + size;
+    return true;
+}
+
+const ubx_message_t *ubx_message_find(const char *name) {
+    for (size_t i = 0; i < UBX_MESSAGE_COUNT; i++) {
+        if (strcasecmp(UBX_MESSAGES[i].name, name) == 0) return &UBX_MESSAGES[i];
+    }
+
+    return NULL;
+}
+
+uint32_t ubx_message_key(const ubx_message_t *message, ubx_port_t port) {
+    // Ключи портов идут подряд: I2C, UART1, UART2, USB, SPI
+    return message->key + port;
+}
+
+const char *ubx_port_name(ubx_port_t port) {
+    return port < UBX_PORT_COUNT ? ubx_port_names[port] : "unknown";
+}
+
+ubx_port_t ubx_port_find(const char *name) {
+    for (int i = 0; i < UBX_PORT_COUNT; i++) {
+        if (strcasecmp(ubx_port_names[i], name) == 0) return i;
+    }
+
+    return UBX_PORT_COUNT;
+}
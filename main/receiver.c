@@ -0,0 +1,202 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "receiver.h"
+
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <freertos/semphr.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_bit_defs.h>
+#include <uart.h>
+
+static const char *TAG = "RECEIVER";
+
+#define ACK_BIT BIT0
+#define NAK_BIT BIT1
+#define VALGET_BIT BIT2
+
+// Разбор идёт в задаче цикла событий, под блокировкой только копирование решений
+static portMUX_TYPE receiver_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static ubx_framer_t framer;
+static receiver_state_t state;
+
+// Одна транзакция за раз: UBX не нумерует запросы, ответ сопоставляется по классу и номеру
+static SemaphoreHandle_t transaction_mutex;
+static EventGroupHandle_t transaction_events;
+static volatile uint8_t pending_class, pending_id;
+static volatile bool pending = false;
+static uint8_t transaction_frame[UBX_FRAME_MAX];
+static uint8_t valget_response[UBX_PAYLOAD_MAX];
+static size_t valget_length;
+
+static void receiver_frame(void *ctx, uint8_t class, uint8_t id, const uint8_t *payload, size_t length) {
+    int64_t now = esp_timer_get_time();
+
+    if (class == UBX_CLASS_ACK) {
+        if (!pending || !ubx_ack_matches(payload, length, pending_class, pending_id)) return;
+        xEventGroupSetBits(transaction_events, id == UBX_ACK_ACK ? ACK_BIT : NAK_BIT);
+        return;
+    }
+
+    if (class == UBX_CLASS_CFG && id == UBX_CFG_VALGET) {
+        if (!pending || pending_class != UBX_CLASS_CFG || pending_id != UBX_CFG_VALGET) return;
+        memcpy(valget_response, payload, length);
+        valget_length = length;
+        xEventGroupSetBits(transaction_events, VALGET_BIT);
+        return;
+    }
+
+    taskENTER_CRITICAL(&receiver_lock);
+    if (class == UBX_CLASS_NAV && id == UBX_NAV_PVT) {
+        if (ubx_nav_pvt_decode(payload, length, &state.pvt)) state.pvt_updated = now;
+    } else if (class == UBX_CLASS_NAV && id == UBX_NAV_SVIN) {
+        if (ubx_nav_svin_decode(payload, length, &state.svin)) state.svin_updated = now;
+    } else if (class == UBX_CLASS_MON && id == UBX_MON_HW) {
+        if (ubx_mon_hw_decode(payload, length, &state.hw)) state.hw_updated = now;
+    }
+    taskEXIT_CRITICAL(&receiver_lock);
+}
+
+static void receiver_uart_handler(void *handler_args, esp_event_base_t base, int32_t length, void *buffer) {
+    ubx_framer_feed(&framer, buffer, length);
+}
+
+void receiver_init() {
+    transaction_mutex = xSemaphoreCreateMutex();
+    transaction_events = xEventGroupCreate();
+
+    ubx_framer_init(&framer, receiver_frame, NULL);
+    uart_register_read_handler(receiver_uart_handler);
+}
+
+void receiver_state(receiver_state_t *out) {
+    taskENTER_CRITICAL(&receiver_lock);
+    *out = state;
+    taskEXIT_CRITICAL(&receiver_lock);
+
+    out->frames = framer.frames;
+    out->checksum_errors = framer.checksum_errors;
+}
+
+static esp_err_t receiver_transaction(uint8_t class, uint8_t id, const uint8_t *payload, size_t length) {
+    size_t frame_length = ubx_frame_build(transaction_frame, sizeof(transaction_frame), class, id, payload, length);
+    if (frame_length == 0) return ESP_ERR_INVALID_SIZE;
+
+    xEventGroupClearBits(transaction_events, ACK_BIT | NAK_BIT | VALGET_BIT);
+    pending_class = class;
+    pending_id = id;
+    pending = true;
+
+    uart_write((char *) transaction_frame, frame_length);
+
+    EventBits_t bits = xEventGroupWaitBits(transaction_events, ACK_BIT | NAK_BIT, pdFALSE, pdFALSE,
+            pdMS_TO_TICKS(RECEIVER_ACK_TIMEOUT_MS));
+    pending = false;
+
+    esp_err_t err = bits & ACK_BIT ? ESP_OK : bits & NAK_BIT ? ESP_FAIL : ESP_ERR_TIMEOUT;
+    taskENTER_CRITICAL(&receiver_lock);
+    if (err == ESP_OK) state.acks++;
+    else if (err == ESP_FAIL) state.naks++;
+    else state.timeouts++;
+    taskEXIT_CRITICAL(&receiver_lock);
+
+    if (err == ESP_FAIL) ESP_LOGW(TAG, "UBX 0x%02X 0x%02X rejected by receiver", class, id);
+    if (err == ESP_ERR_TIMEOUT) ESP_LOGW(TAG, "No acknowledgement for UBX 0x%02X 0x%02X", class, id);
+    return err;
+}
+
+esp_err_t receiver_valset(const ubx_valset_t *set) {
+    xSemaphoreTake(transaction_mutex, portMAX_DELAY);
+    esp_err_t err = receiver_transaction(UBX_CLASS_CFG, UBX_CFG_VALSET, set->payload, set->length);
+    xSemaphoreGive(transaction_mutex);
+
+    return err;
+}
+
+esp_err_t receiver_valget(uint8_t layer, const uint32_t *keys, size_t count, uint64_t *values) {
+    uint8_t payload[4 + UBX_VALSET_KEYS_MAX * 4];
+    size_t length = ubx_valget_build(payload, sizeof(payload), layer, keys, count);
+    if (length == 0) return ESP_ERR_INVALID_SIZE;
+
+    xSemaphoreTake(transaction_mutex, portMAX_DELAY);
+    esp_err_t err = receiver_transaction(UBX_CLASS_CFG, UBX_CFG_VALGET, payload, length);
+
+    // Ответ с данными приходит перед ACK
+    if (err == ESP_OK && (!(xEventGroupGetBits(transaction_events) & VALGET_BIT) || valget_length < 4)) {
+        err = ESP_ERR_INVALID_RESPONSE;
+    }
+    for (size_t k = 0; err == ESP_OK && k < count; k++) {
+        // Версия, слой и позиция перед парами ключ-значение
+        const uint8_t *cursor = valget_response + 4, *end = valget_response + valget_length;
+        uint32_t key;
+        uint64_t value;
+        err = ESP_ERR_NOT_FOUND;
+        while (ubx_valget_next(&cursor, end, &key, &value)) {
+            if (key == keys[k]) {
+                values[k] = value;
+                err = ESP_OK;
+                break;
+            }
+        }
+    }
+    xSemaphoreGive(transaction_mutex);
+
+    return err;
+}
+
+esp_err_t receiver_survey_start(uint32_t min_duration, uint32_t accuracy, uint8_t layers) {
+    ubx_valset_t set;
+    ubx_valset_init(&set, layers);
+    ubx_valset_add(&set, UBX_KEY_TMODE_SVIN_MIN_DUR, min_duration);
+    ubx_valset_add(&set, UBX_KEY_TMODE_SVIN_ACC_LIMIT, accuracy);
+    ubx_valset_add(&set, UBX_KEY_TMODE_MODE, UBX_TMODE_SURVEY_IN);
+
+    return receiver_valset(&set);
+}
+
+esp_err_t receiver_fixed_position(const int64_t ecef[3], uint32_t accuracy, uint8_t layers) {
+    static const uint32_t position_keys[3] = {UBX_KEY_TMODE_ECEF_X, UBX_KEY_TMODE_ECEF_Y, UBX_KEY_TMODE_ECEF_Z};
+    static const uint32_t hp_keys[3] = {UBX_KEY_TMODE_ECEF_X_HP, UBX_KEY_TMODE_ECEF_Y_HP, UBX_KEY_TMODE_ECEF_Z_HP};
+
+    ubx_valset_t set;
+    ubx_valset_init(&set, layers);
+    ubx_valset_add(&set, UBX_KEY_TMODE_MODE, UBX_TMODE_FIXED);
+    ubx_valset_add(&set, UBX_KEY_TMODE_POS_TYPE, 0);
+    for (int i = 0; i < 3; i++) {
+        // Сантиметры и остаток в 0.1 мм (-99..99) с тем же знаком
+        int64_t cm = ecef[i] / 100;
+        int8_t hp = ecef[i] % 100;
+        ubx_valset_add(&set, position_keys[i], (uint32_t) (int32_t) cm);
+        ubx_valset_add(&set, hp_keys[i], (uint8_t) hp);
+    }
+    ubx_valset_add(&set, UBX_KEY_TMODE_FIXED_POS_ACC, accuracy);
+
+    return receiver_valset(&set);
+}
+
+esp_err_t receiver_survey_stop(uint8_t layers) {
+    ubx_valset_t set;
+    ubx_valset_init(&set, layers);
+    ubx_valset_add(&set, UBX_KEY_TMODE_MODE, UBX_TMODE_DISABLED);
+
+    return receiver_valset(&set);
+}
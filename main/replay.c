@@ -0,0 +1,459 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <platform.h>
+#include <protocol/rtcm3.h>
+#include "replay.h"
+
+#define REPLAY_READ_SIZE 1024
+#define REPLAY_CHUNK_SIZE 1024                  // как UART_BUFFER_SIZE в uart_task
+#define REPLAY_PENDING_SIZE 4096
+#define REPLAY_NMEA_MAX 100
+#define REPLAY_GAP_MAX_MS 10000                 // больший шаг времени - разрыв записи или повтор с начала
+#define REPLAY_INTERVAL_DEFAULT_MS 1000
+#define REPLAY_SLEEP_SLICE_MS 100
+
+#define REPLAY_WEEK_MS 604800000
+#define REPLAY_DAY_MS 86400000
+
+#define REPLAY_SOURCE_NMEA 1
+
+/// Метка времени сообщения: группа сообщений одной шкалы времени и время в мс по модулю
+typedef struct replay_time {
+    int source;
+    uint32_t time_ms;
+    uint32_t modulus;
+} replay_time_t;
+
+typedef struct replay {
+    const replay_config_t *config;
+    replay_sink_t sink;
+    void *ctx;
+    volatile bool *stop;
+    replay_stats_t *stats;
+
+    // Прочитанные, но ещё не переданные байты
+    uint8_t pending[REPLAY_PENDING_SIZE];
+    size_t pending_used;
+
+    // Текущее сообщение: кадр RTCM 3 или строка NMEA
+    uint8_t message[RTCM3_FRAME_MAX];
+    size_t message_used;
+    size_t message_length;
+    size_t message_start;       // позиция начала в pending
+
+    // Шкала времени записи, по первому найденному источнику меток
+    int source;
+    bool time_valid;
+    uint32_t time_ms;
+    uint32_t interval_ms;
+    uint64_t virtual_ms;        // время записи от первой эпохи
+
+    uint64_t start_us;
+    uint64_t epoch_due_us;
+    uint64_t byte_due_us;
+} replay_t;
+
+static uint32_t replay_bits(const uint8_t *data, size_t position, size_t length) {
+    uint32_t value = 0;
+    for (size_t i = position; i < position + length; i++) {
+        value = (value << 1) | ((data[i / 8] >> (7 - i % 8)) & 1);
+    }
+
+    return value;
+}
+
+/// Время эпохи наблюдений: 1001-1004 (GPS), 1009-1012 (ГЛОНАСС), MSM1-7 всех систем.
+/// У ГЛОНАСС время суток, у остальных время недели своей системы
+static bool replay_rtcm3_time(const uint8_t *frame, size_t length, replay_time_t *time) {
+    const uint8_t *payload = frame + RTCM3_HEADER_SIZE;
+    if (length < RTCM3_HEADER_SIZE + 7 + RTCM3_CRC_SIZE) return false;
+
+    uint16_t type = replay_bits(payload, 0, 12);
+    if (type >= 1001 && type <= 1004) {
+        *time = (replay_time_t) {1001, replay_bits(payload, 24, 30), REPLAY_WEEK_MS};
+    } else if (type >= 1009 && type <= 1012) {
+        *time = (replay_time_t) {1009, replay_bits(payload, 24, 27), REPLAY_DAY_MS};
+    } else if (type >= 1071 && type <= 1137 && type % 10 >= 1 && type % 10 <= 7) {
+        if (type / 10 == 108) {
+            // 3 бита дня недели, затем время суток
+            *time = (replay_time_t) {type / 10, replay_bits(payload, 27, 27), REPLAY_DAY_MS};
+        } else {
+            *time = (replay_time_t) {type / 10, replay_bits(payload, 24, 30), REPLAY_WEEK_MS};
+        }
+    } else {
+        return false;
+    }
+
+    return time->time_ms < time->modulus;
+}
+
+static int replay_hex(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+/// Проверка контрольной суммы строки NMEA "$...*hh\r\n"
+static bool replay_nmea_valid(const char *sentence, size_t length) {
+    const char *end = memchr(sentence, '*', length);
+    if (end == NULL || end + 3 > sentence + length) return false;
+
+    uint8_t checksum = 0;
+    for (const char *c = sentence + 1; c < end; c++) checksum ^= *c;
+
+    int high = replay_hex(end[1]), low = replay_hex(end[2]);
+    return high >= 0 && low >= 0 && checksum == (high << 4 | low);
+}
+
+/// Время суток из GGA, RMC, GNS и ZDA: hhmmss с необязательной дробной частью
+static bool replay_nmea_time(const char *sentence, size_t length, replay_time_t *time) {
+    if (length < 14 || sentence[6] != ',') return false;
+    if (strncmp(sentence + 3, "GGA", 3) != 0 && strncmp(sentence + 3, "RMC", 3) != 0
+            && strncmp(sentence + 3, "GNS", 3) != 0 && strncmp(sentence + 3, "ZDA", 3) != 0) return false;
+
+    const char *field = sentence + 7;
+    for (int i = 0; i < 6; i++) {
+        if (field[i] < '0' || field[i] > '9') return false;
+    }
+
+    uint32_t hours = (field[0] - '0') * 10 + field[1] - '0';
+    uint32_t minutes = (field[2] - '0') * 10 + field[3] - '0';
+    uint32_t seconds = (field[4] - '0') * 10 + field[5] - '0';
+    uint32_t milliseconds = 0;
+    if (field[6] == '.') {
+        uint32_t scale = 100;
+        for (const char *c = field + 7; c < sentence + length && *c >= '0' && *c <= '9' && scale > 0; c++) {
+            milliseconds += (*c - '0') * scale;
+            scale /= 10;
+        }
+    }
+
+    *time = (replay_time_t) {
+            REPLAY_SOURCE_NMEA,
+            ((hours * 60 + minutes) * 60 + seconds) * 1000 + milliseconds,
+            REPLAY_DAY_MS
+    };
+    return time->time_ms < time->modulus;
+}
+
+/// Ожидание момента доставки, false при остановке
+static bool replay_sleep_until(replay_t *replay, uint64_t due_us) {
+    while (!*replay->stop) {
+        uint64_t now = platform_time_us();
+        if (now >= due_us) return true;
+        platform_sleep_ms(MIN(REPLAY_SLEEP_SLICE_MS, (due_us - now + 999) / 1000));
+    }
+
+    return false;
+}
+
+/// Передача первых length байт ожидающего буфера кусками до REPLAY_CHUNK_SIZE,
+/// не раньше начала текущей эпохи и не быстрее скорости UART
+static void replay_flush(replay_t *replay, size_t length) {
+    const replay_config_t *config = replay->config;
+
+    for (size_t offset = 0; offset < length && !*replay->stop;) {
+        size_t n = MIN(length - offset, REPLAY_CHUNK_SIZE);
+
+        if (config->speed > 0) {
+            uint64_t due = MAX(replay->epoch_due_us, replay->byte_due_us);
+            if (config->baud > 0) due += (uint64_t) n * 10 * 1000000 / ((uint64_t) config->baud * config->speed);
+            replay->byte_due_us = due;
+            if (!replay_sleep_until(replay, due)) break;
+
+            uint32_t lag_ms = (platform_time_us() - due) / 1000;
+            if (lag_ms > replay->stats->lag_max_ms) replay->stats->lag_max_ms = lag_ms;
+        }
+
+        replay->sink(replay->ctx, replay->pending + offset, n);
+        replay->stats->bytes += n;
+        offset += n;
+    }
+
+    memmove(replay->pending, replay->pending + length, replay->pending_used - length);
+    replay->pending_used -= length;
+    replay->message_start = replay->message_start >= length ? replay->message_start - length : 0;
+}
+
+static void replay_time(replay_t *replay, const replay_time_t *time) {
+    if (replay->source < 0) {
+        replay->source = time->source;
+        replay->stats->timed = true;
+    }
+    if (time->source != replay->source) return;
+
+    if (!replay->time_valid) {
+        replay->time_valid = true;
+        replay->time_ms = time->time_ms;
+        replay->stats->epochs++;
+        return;
+    }
+    if (time->time_ms == replay->time_ms) return;
+
+    uint32_t delta = (time->time_ms + time->modulus - replay->time_ms) % time->modulus;
+    if (delta > REPLAY_GAP_MAX_MS) delta = replay->interval_ms;
+    else replay->interval_ms = delta;
+
+    replay->time_ms = time->time_ms;
+    replay->virtual_ms += delta;
+    replay->stats->epochs++;
+
+    // Байты до начала этого сообщения относятся к предыдущей эпохе
+    replay_flush(replay, replay->message_start);
+    if (replay->config->speed > 0) {
+        replay->epoch_due_us = replay->start_us + replay->virtual_ms * 1000 / replay->config->speed;
+    }
+}
+
+static void replay_message(replay_t *replay) {
+    const uint8_t *message = replay->message;
+    size_t length = replay->message_used;
+    replay_time_t time;
+
+    if (message[0] == RTCM3_PREAMBLE) {
+        uint32_t crc = (uint32_t) message[length - 3] << 16 | (uint32_t) message[length - 2] << 8 | message[length - 1];
+        if (rtcm3_crc24q(message, length - RTCM3_CRC_SIZE) != crc) return;
+
+        replay->stats->frames++;
+        if (replay_rtcm3_time(message, length, &time)) replay_time(replay, &time);
+    } else {
+        if (!replay_nmea_valid((const char *) message, length)) return;
+
+        replay->stats->sentences++;
+        if (replay_nmea_time((const char *) message, length, &time)) replay_time(replay, &time);
+    }
+}
+
+static void replay_byte(replay_t *replay, uint8_t byte) {
+    if (replay->pending_used == REPLAY_PENDING_SIZE) replay_flush(replay, replay->pending_used);
+    replay->pending[replay->pending_used++] = byte;
+
+    // Оборванная строка NMEA не должна поглощать следующую
+    bool start = (replay->message_used == 0 && (byte == RTCM3_PREAMBLE || byte == '$'))
+            || (replay->message_used > 0 && replay->message[0] == '$' && byte == '$');
+    if (start) replay->message_used = 0;
+    if (start) {
+        replay->message_start = replay->pending_used - 1;
+        replay->message_length = 0;
+    }
+
+    if (replay->message_used > 0 || start) {
+        replay->message[replay->message_used++] = byte;
+
+        if (replay->message[0] == RTCM3_PREAMBLE) {
+            if (replay->message_used == RTCM3_HEADER_SIZE) {
+                // Старшие 6 бит длины зарезервированы и равны нулю
+                if (replay->message[1] & 0xFC) replay->message_used = 0;
+                replay->message_length = RTCM3_HEADER_SIZE + ((replay->message[1] & 0x03) << 8 | replay->message[2]) + RTCM3_CRC_SIZE;
+            } else if (replay->message_used == replay->message_length) {
+                replay_message(replay);
+                replay->message_used = 0;
+            }
+        } else if (byte == '\n') {
+            replay_message(replay);
+            replay->message_used = 0;
+        } else if (replay->message_used == REPLAY_NMEA_MAX) {
+            replay->message_used = 0;
+        }
+    }
+
+    // Между сообщениями передача кусками как у uart_task
+    if (replay->message_used == 0 && replay->pending_used >= REPLAY_CHUNK_SIZE) {
+        replay_flush(replay, replay->pending_used);
+    }
+}
+
+int replay_run(const replay_config_t *config, replay_sink_t sink, void *ctx, volatile bool *stop, replay_stats_t *stats) {
+    FILE *file = fopen(config->path, "rb");
+    if (file == NULL) return -1;
+
+    uint8_t *buffer = malloc(REPLAY_READ_SIZE);
+    replay_t *replay = calloc(1, sizeof(replay_t));
+    if (buffer == NULL || replay == NULL) {
+        free(buffer);
+        free(replay);
+        fclose(file);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    *replay = (replay_t) {
+            .config = config,
+            .sink = sink,
+            .ctx = ctx,
+            .stop = stop,
+            .stats = stats,
+            .source = -1,
+            .interval_ms = REPLAY_INTERVAL_DEFAULT_MS
+    };
+    replay->start_us = replay->epoch_due_us = replay->byte_due_us = platform_time_us();
+
+    int err = 0;
+    uint64_t pass_bytes = 0;
+    while (!*stop) {
+        size_t n = fread(buffer, 1, REPLAY_READ_SIZE, file);
+        if (n == 0) {
+            if (ferror(file)) {
+                err = errno != 0 ? errno : EIO;
+                break;
+            }
+
+            replay_flush(replay, replay->pending_used);
+            replay->message_used = 0;
+
+            // Пустой файл не повторяется
+            if (!config->loop || pass_bytes == 0 || *stop) break;
+            rewind(file);
+            pass_bytes = 0;
+            stats->loops++;
+            continue;
+        }
+
+        pass_bytes += n;
+        for (size_t i = 0; i < n && !*stop; i++) replay_byte(replay, buffer[i]);
+    }
+
+    fclose(file);
+    free(buffer);
+    free(replay);
+
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+
+    return 0;
+}
+
+#ifdef ESP_PLATFORM
+
+#include <sys/stat.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_log.h>
+#include <config.h>
+#include <sd_logger.h>
+#include <tasks.h>
+#include <uart.h>
+
+static const char *TAG = "REPLAY";
+
+static replay_state_t replay_current = {0};
+static portMUX_TYPE replay_lock = portMUX_INITIALIZER_UNLOCKED;    // running, error и stats в replay_current
+static volatile bool replay_stop_requested = false;
+static char replay_path[sizeof(MOUNT_POINT "/logs/") + REPLAY_FILE_MAX];
+
+/// Передача в UART и публикация счётчиков для replay_state: replay_run ведёт их в стеке задачи
+static void replay_uart_sink(void *ctx, const uint8_t *data, size_t length) {
+    uart_inject((void *) data, length);
+
+    const replay_stats_t *stats = ctx;
+    taskENTER_CRITICAL(&replay_lock);
+    replay_current.stats = *stats;
+    taskEXIT_CRITICAL(&replay_lock);
+}
+
+static bool replay_running() {
+    taskENTER_CRITICAL(&replay_lock);
+    bool running = replay_current.running;
+    taskEXIT_CRITICAL(&replay_lock);
+    return running;
+}
+
+static void replay_task(void *ctx) {
+    replay_config_t config = {
+            .path = replay_path,
+            .speed = replay_current.speed,
+            .loop = replay_current.loop,
+            .baud = config_get_u32(CONF_ITEM(KEY_CONFIG_UART_BAUD_RATE))
+    };
+
+    // file, speed и loop не меняются до снятия running
+    ESP_LOGI(TAG, "Replaying %s at %ux%s", replay_current.file, config.speed, config.loop ? ", looped" : "");
+    replay_stats_t stats = {0};
+    int error = 0;
+    if (replay_run(&config, replay_uart_sink, &stats, &replay_stop_requested, &stats) < 0) {
+        error = errno;
+        ESP_LOGE(TAG, "Could not replay %s: %d %s", replay_path, errno, strerror(errno));
+    } else {
+        ESP_LOGI(TAG, "Replay of %s finished: %llu bytes, %lu epochs, %lu loops, max lag %lu ms", replay_current.file,
+                (unsigned long long) stats.bytes, stats.epochs, stats.loops, stats.lag_max_ms);
+    }
+
+    taskENTER_CRITICAL(&replay_lock);
+    replay_current.stats = stats;
+    replay_current.error = error;
+    replay_current.running = false;
+    taskEXIT_CRITICAL(&replay_lock);
+    vTaskDelete(NULL);
+}
+
+esp_err_t replay_start(const char *file, uint16_t speed, bool loop) {
+    if (replay_running() || !sd_logger_is_mounted()) return ESP_ERR_INVALID_STATE;
+
+    // Только имя файла в каталоге записей SD
+    if (file[0] == '\0' || strlen(file) >= REPLAY_FILE_MAX || strchr(file, '/') != NULL
+            || strstr(file, "..") != NULL) return ESP_ERR_INVALID_ARG;
+
+    snprintf(replay_path, sizeof(replay_path), MOUNT_POINT "/logs/%s", file);
+    struct stat st;
+    if (stat(replay_path, &st) != 0) return ESP_ERR_NOT_FOUND;
+
+    replay_state_t state = {
+            .running = true,
+            .speed = speed,
+            .loop = loop
+    };
+    snprintf(state.file, sizeof(state.file), "%s", file);
+    taskENTER_CRITICAL(&replay_lock);
+    replay_current = state;
+    taskEXIT_CRITICAL(&replay_lock);
+    replay_stop_requested = false;
+
+    esp_err_t err = task_create(TASK_REPLAY, replay_task, NULL, NULL);
+    if (err != ESP_OK) {
+        taskENTER_CRITICAL(&replay_lock);
+        replay_current.running = false;
+        taskEXIT_CRITICAL(&replay_lock);
+        return err;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t replay_stop() {
+    if (!replay_running()) return ESP_ERR_INVALID_STATE;
+
+    replay_stop_requested = true;
+    return ESP_OK;
+}
+
+void replay_state(replay_state_t *state) {
+    taskENTER_CRITICAL(&replay_lock);
+    *state = replay_current;
+    taskEXIT_CRITICAL(&replay_lock);
+}
+
+#endif
@@ -15,10 +15,9 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <freertos/FreeRTOS.h>
-#include <freertos/task.h>
+#include <stdlib.h>
 #include <esp_log.h>
-#include <uart.h>
+#include <platform.h>
 #include "retry.h"
 
 struct retry_delay {
@@ -86,7 +85,7 @@ int retry_delay(retry_delay_handle_t handle) {
 
     handle->attempts++;
 
-    if (delay > 0) vTaskDelay(pdMS_TO_TICKS(delay));
+    if (delay > 0) platform_sleep_ms(delay);
 
     return handle->attempts;
 }
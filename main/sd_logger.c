@@ -6,19 +6,45 @@
 #include "driver/spi_common.h"
 #include "esp_log.h"
 #include "config.h"
+#include "trace.h"
 #include <time.h>
 #include <sys/stat.h>
 #include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 
 static const char *TAG = "SD_LOGGER";
 
 static FILE *log_file = NULL;
+static FILE *text_file = NULL;
 static char current_date[16] = {0};
 static bool logging_enabled = false;
 static sdmmc_card_t *card = NULL;
 
+// RTCM data is written by the UART task, text log lines by the log task
+static SemaphoreHandle_t sd_mutex = NULL;
+
+static void sd_logger_close(void) {
+    if (log_file) {
+        fclose(log_file);
+        log_file = NULL;
+    }
+    if (text_file) {
+        fclose(text_file);
+        text_file = NULL;
+    }
+}
+
+static esp_err_t sd_logger_rotate(void);
+
+static void sd_logger_config_changed(const config_change_t *change, void *arg) {
+    sd_logger_enable(config_get_bool1(CONF_ITEM(KEY_CONFIG_SD_LOGGING_ACTIVE)));
+}
+
 esp_err_t sd_logger_init(void) {
     esp_err_t ret;
+
+    sd_mutex = xSemaphoreCreateMutex();
     
     // Options for mounting the filesystem
     esp_vfs_fat_sdmmc_mount_config_t mount_config = {
@@ -68,30 +94,51 @@ esp_err_t sd_logger_init(void) {
         mkdir(MOUNT_POINT "/logs", 0700);
     }
 
+    // Toggling logging is applied live, without a restart
+    config_subscribe(CONFIG_GROUP_SD_LOGGING, sd_logger_config_changed, NULL);
+
     return ESP_OK;
 }
 
 esp_err_t sd_logger_enable(bool enable) {
+    if (sd_mutex == NULL) return ESP_ERR_INVALID_STATE;
+
+    xSemaphoreTake(sd_mutex, portMAX_DELAY);
     logging_enabled = enable;
-    
+
+    esp_err_t err = ESP_OK;
     if (enable) {
         ESP_LOGI(TAG, "SD logging enabled");
-        return sd_logger_check_date();
+        err = sd_logger_rotate();
     } else {
         ESP_LOGI(TAG, "SD logging disabled");
-        if (log_file) {
-            fclose(log_file);
-            log_file = NULL;
-        }
-        return ESP_OK;
+        sd_logger_close();
+        current_date[0] = '\0';
     }
+    xSemaphoreGive(sd_mutex);
+
+    return err;
 }
 
 bool sd_logger_is_enabled(void) {
     return logging_enabled;
 }
 
+bool sd_logger_is_mounted(void) {
+    return card != NULL;
+}
+
 esp_err_t sd_logger_check_date(void) {
+    if (sd_mutex == NULL) return ESP_ERR_INVALID_STATE;
+
+    xSemaphoreTake(sd_mutex, portMAX_DELAY);
+    esp_err_t err = sd_logger_rotate();
+    xSemaphoreGive(sd_mutex);
+
+    return err;
+}
+
+static esp_err_t sd_logger_rotate(void) {
     if (!logging_enabled) return ESP_OK;
 
     time_t now;
@@ -104,11 +151,8 @@ esp_err_t sd_logger_check_date(void) {
 
     // Check if we need to open a new file
     if (strcmp(current_date, new_date) != 0) {
-        // Close current file if open
-        if (log_file) {
-            fclose(log_file);
-            log_file = NULL;
-        }
+        // Close current files if open
+        sd_logger_close();
 
         // Update current date
         strcpy(current_date, new_date);
@@ -124,6 +168,13 @@ esp_err_t sd_logger_check_date(void) {
         }
 
         ESP_LOGI(TAG, "Opened log file: %s", filename);
+
+        // Text log next to the RTCM log, a failure here does not stop RTCM logging
+        snprintf(filename, sizeof(filename), MOUNT_POINT "/logs/%s.log", current_date);
+        text_file = fopen(filename, "a");
+        if (!text_file) {
+            ESP_LOGW(TAG, "Failed to open text log file: %s", filename);
+        }
     }
 
     return ESP_OK;
@@ -134,28 +185,56 @@ esp_err_t sd_logger_write(const uint8_t *data, size_t len) {
         return ESP_OK;
     }
 
+    xSemaphoreTake(sd_mutex, portMAX_DELAY);
+
     // Check if we need to rotate file (new day)
-    sd_logger_check_date();
+    sd_logger_rotate();
 
+    esp_err_t err = ESP_FAIL;
     if (log_file) {
+        TRACE_BEGIN(write_start);
         size_t written = fwrite(data, 1, len, log_file);
-        if (written != len) {
-            ESP_LOGE(TAG, "Failed to write all data to SD card");
-            return ESP_FAIL;
+        if (written == len) {
+            fflush(log_file);
+            err = ESP_OK;
         }
-        fflush(log_file);
+        TRACE_END(TRACE_SD_WRITE, write_start, len);
+    }
+
+    xSemaphoreGive(sd_mutex);
+
+    if (err != ESP_OK) ESP_LOGE(TAG, "Failed to write all data to SD card");
+
+    return err;
+}
+
+esp_err_t sd_logger_write_text(const char *text, size_t len) {
+    if (!logging_enabled || !text_file) {
         return ESP_OK;
     }
 
-    return ESP_FAIL;
+    // Never wait on a slow card from the log task, the line is dropped instead
+    if (xSemaphoreTake(sd_mutex, 0) != pdTRUE) return ESP_ERR_TIMEOUT;
+
+    esp_err_t err = ESP_OK;
+    if (text_file) {
+        TRACE_BEGIN(write_start);
+        if (fwrite(text, 1, len, text_file) != len) err = ESP_FAIL;
+        fflush(text_file);
+        TRACE_END(TRACE_SD_WRITE_TEXT, write_start, len);
+    }
+
+    xSemaphoreGive(sd_mutex);
+
+    return err;
 }
 
 void sd_logger_deinit(void) {
-    if (log_file) {
-        fclose(log_file);
-        log_file = NULL;
-    }
+    xSemaphoreTake(sd_mutex, portMAX_DELAY);
+    sd_logger_close();
+    xSemaphoreGive(sd_mutex);
     
     esp_vfs_fat_sdcard_unmount(MOUNT_POINT, card);
+    card = NULL;
     ESP_LOGI(TAG, "SD card unmounted");
 }
\ No newline at end of file
@@ -0,0 +1,193 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "station.h"
+
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <config.h>
+
+static const char *TAG = "STATION";
+
+static portMUX_TYPE station_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Два буфера: сборка идёт в свободный, отправка читает текущий без копирования на стек
+// задачи цикла событий. Пересборка ждёт, пока свободный буфер не отпустят все отправки
+// (send может блокироваться до SO_SNDTIMEO)
+static uint8_t station_frames[2][STATION_FRAMES_MAX];
+static size_t station_lengths[2];
+static int station_sending[2];
+static int station_current = 0;
+
+static station_status_t status;
+static int64_t station_interval_us;
+
+static void station_string(const config_item_t *item, char *out, size_t size) {
+    size_t length = size;
+    if (config_get_str_blob(item, out, &length) != ESP_OK) out[0] = '\0';
+}
+
+static void station_encode() {
+    bool active = config_get_bool1(CONF_ITEM(KEY_CONFIG_STATION_ACTIVE));
+    bool valid = config_get_bool1(CONF_ITEM(KEY_CONFIG_BASE_VALID));
+    uint16_t interval = config_get_u16(CONF_ITEM(KEY_CONFIG_STATION_INTERVAL));
+    if (interval == 0) interval = 1;
+
+    rtcm3_station_t station = {
+            .station_id = config_get_u16(CONF_ITEM(KEY_CONFIG_STATION_ID)) & 0x0FFF,
+            .ecef = {
+                    config_get_i64(CONF_ITEM(KEY_CONFIG_BASE_ECEF_X)),
+                    config_get_i64(CONF_ITEM(KEY_CONFIG_BASE_ECEF_Y)),
+                    config_get_i64(CONF_ITEM(KEY_CONFIG_BASE_ECEF_Z))
+            },
+            .gps = true,
+            .glonass = true,
+            .galileo = true,
+            .antenna_setup = config_get_u8(CONF_ITEM(KEY_CONFIG_STATION_ANTENNA_SETUP))
+    };
+
+    // Высота в мм, в 1006 - 0.1 мм до 6.5535 м
+    uint32_t height = config_get_u16(CONF_ITEM(KEY_CONFIG_STATION_ANTENNA_HEIGHT)) * 10;
+    station.antenna_height = height > UINT16_MAX ? UINT16_MAX : height;
+
+    station_string(CONF_ITEM(KEY_CONFIG_STATION_ANTENNA_DESCRIPTOR), station.antenna_descriptor, sizeof(station.antenna_descriptor));
+    station_string(CONF_ITEM(KEY_CONFIG_STATION_ANTENNA_SERIAL), station.antenna_serial, sizeof(station.antenna_serial));
+    station_string(CONF_ITEM(KEY_CONFIG_STATION_RECEIVER_TYPE), station.receiver_type, sizeof(station.receiver_type));
+    station_string(CONF_ITEM(KEY_CONFIG_STATION_RECEIVER_FIRMWARE), station.receiver_firmware, sizeof(station.receiver_firmware));
+    station_string(CONF_ITEM(KEY_CONFIG_STATION_RECEIVER_SERIAL), station.receiver_serial, sizeof(station.receiver_serial));
+
+    // Новые отправки берут только текущий буфер, поэтому свободный не займут до подмены
+    int next;
+    while (true) {
+        taskENTER_CRITICAL(&station_lock);
+        next = !station_current;
+        int sending = station_sending[next];
+        taskEXIT_CRITICAL(&station_lock);
+        if (sending == 0) break;
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+
+    size_t length = 0;
+    uint16_t type = station.antenna_height > 0 ? 1006 : 1005;
+    if (active && valid) {
+        uint8_t payload[RTCM3_1033_SIZE_MAX];
+        size_t payload_length = type == 1006 ? rtcm3_encode_1006(payload, &station) : rtcm3_encode_1005(payload, &station);
+        length += rtcm3_frame_build(station_frames[next] + length, payload, payload_length);
+        payload_length = rtcm3_encode_1033(payload, &station);
+        length += rtcm3_frame_build(station_frames[next] + length, payload, payload_length);
+    }
+
+    taskENTER_CRITICAL(&station_lock);
+    station_lengths[next] = length;
+    station_current = next;
+    station_interval_us = interval * 1000000LL;
+    status.active = length > 0;
+    status.type = type;
+    status.station_id = station.station_id;
+    status.interval = interval;
+    status.length = length;
+    taskEXIT_CRITICAL(&station_lock);
+
+    if (active && !valid) ESP_LOGW(TAG, "No base position saved, station messages are not sent");
+    if (length > 0) {
+        ESP_LOGI(TAG, "Station messages %u and 1033 (%u bytes) every %u s", type, (unsigned) length, interval);
+    }
+}
+
+static void station_config_changed(const config_change_t *change, void *arg) {
+    station_encode();
+}
+
+void station_init() {
+    station_encode();
+    config_subscribe(CONFIG_GROUP_STATION | CONFIG_GROUP_SURVEY, station_config_changed, NULL);
+}
+
+void station_sink_init(station_sink_t *sink, rtcm3_msm4_stream_t *msm4) {
+    memset(sink, 0, sizeof(*sink));
+    rtcm3_scanner_init(&sink->scanner);
+    sink->msm4 = msm4;
+    if (msm4 != NULL) rtcm3_msm4_stream_init(msm4);
+}
+
+static int station_write(station_sink_t *sink, const void *data, size_t length, station_send_t send, void *ctx) {
+    return sink->msm4 != NULL ? rtcm3_msm4_stream_feed(sink->msm4, data, length, send, ctx) : send(ctx, data, length);
+}
+
+int station_forward(station_sink_t *sink, const void *data, size_t length, station_send_t send, void *ctx) {
+    // Выключено: поток без разбора
+    if (!status.active) return station_write(sink, data, length, send, ctx);
+
+    const uint8_t *bytes = data;
+    size_t start = 0, offset = 0;
+    int sent = 0;
+
+    while (offset < length) {
+        rtcm3_scan_event_t event;
+        offset += rtcm3_scanner_feed(&sink->scanner, bytes + offset, length - offset, &event);
+        if (event != RTCM3_SCAN_EPOCH_END) continue;
+
+        int64_t now = esp_timer_get_time();
+
+        taskENTER_CRITICAL(&station_lock);
+        bool due = sink->injected_at == 0 || now - sink->injected_at >= station_interval_us;
+        int current = station_current;
+        size_t frames_length = due ? station_lengths[current] : 0;
+        if (frames_length > 0) {
+            station_sending[current]++;
+            status.injections++;
+        }
+        taskEXIT_CRITICAL(&station_lock);
+        if (frames_length == 0) continue;
+
+        // Поток до конца эпохи, затем кадры станции
+        int n = station_write(sink, bytes + start, offset - start, send, ctx);
+        if (n >= 0) {
+            sent += n;
+            n = station_write(sink, station_frames[current], frames_length, send, ctx);
+        }
+
+        taskENTER_CRITICAL(&station_lock);
+        station_sending[current]--;
+        taskEXIT_CRITICAL(&station_lock);
+
+        if (n < 0) return n;
+        sent += n;
+
+        start = offset;
+        sink->injected_at = now;
+        sink->injections++;
+    }
+
+    if (start < length) {
+        int n = station_write(sink, bytes + start, length - start, send, ctx);
+        if (n < 0) return n;
+        sent += n;
+    }
+
+    return sent;
+}
+
+void station_status(station_status_t *out) {
+    taskENTER_CRITICAL(&station_lock);
+    *out = status;
+    taskEXIT_CRITICAL(&station_lock);
+}
@@ -262,7 +262,7 @@ void status_led_init() {
 
     ledc_fade_func_install(0);
 
-    xTaskCreate(status_led_task, "status_led", 2048, NULL, TASK_PRIORITY_STATUS_LED, &led_task);
+    task_create(TASK_STATUS_LED, status_led_task, NULL, &led_task);
 }
 
 void rssi_led_set(uint8_t value) {
@@ -0,0 +1,219 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "include/stream_history.h"
+
+#include <freertos/FreeRTOS.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/queue.h>
+#include <freertos/task.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <sd_logger.h>
+#include <tasks.h>
+
+// Время считается установленным после синхронизации SNTP (позже 2020 года)
+#define STREAM_HISTORY_TIME_VALID 1577836800
+
+static const char *TAG = "STREAM_HISTORY";
+
+typedef struct stream_history_ring {
+    stream_history_sample_t *samples;
+    uint32_t seq;
+    uint32_t end_uptime;
+
+    // Накопление текущего интервала, только задача статистики
+    uint64_t sum_in;
+    uint64_t sum_out;
+    uint16_t seconds;
+} stream_history_ring_t;
+
+struct stream_history {
+    const char *name;
+
+    stream_history_ring_t rings[STREAM_HISTORY_RESOLUTION_COUNT];
+
+    // Последний сохранённый на SD поминутный отсчёт, только задача сохранения
+    uint32_t persisted;
+
+    SLIST_ENTRY(stream_history) next;
+
+    stream_history_sample_t storage[STREAM_HISTORY_FINE_LENGTH + STREAM_HISTORY_COARSE_LENGTH];
+};
+
+static SLIST_HEAD(stream_history_list_t, stream_history) stream_history_list;
+static portMUX_TYPE stream_history_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static const uint16_t resolutions[] = {
+        [STREAM_HISTORY_FINE] = STREAM_HISTORY_FINE_RESOLUTION,
+        [STREAM_HISTORY_COARSE] = STREAM_HISTORY_COARSE_RESOLUTION,
+};
+
+static const size_t lengths[] = {
+        [STREAM_HISTORY_FINE] = STREAM_HISTORY_FINE_LENGTH,
+        [STREAM_HISTORY_COARSE] = STREAM_HISTORY_COARSE_LENGTH,
+};
+
+uint16_t stream_history_resolution(stream_history_resolution_t resolution) {
+    return resolutions[resolution];
+}
+
+size_t stream_history_length(stream_history_resolution_t resolution) {
+    return lengths[resolution];
+}
+
+uint16_t stream_history_encode(uint32_t rate) {
+    uint16_t exponent = 0;
+    while (rate > 0xFFF && exponent < 0xF) {
+        rate >>= 1u;
+        exponent++;
+    }
+    if (rate > 0xFFF) rate = 0xFFF;
+
+    return (exponent << 12u) | rate;
+}
+
+uint32_t stream_history_decode(uint16_t value) {
+    return (uint32_t) (value & 0xFFFu) << (value >> 12u);
+}
+
+static uint32_t stream_history_uptime() {
+    return esp_timer_get_time() / 1000000;
+}
+
+static void stream_history_persist(stream_history_sample_t *samples) {
+    time_t now = time(NULL);
+    if (now < STREAM_HISTORY_TIME_VALID) return;
+
+    struct tm timeinfo;
+    localtime_r(&now, &timeinfo);
+    char filename[64];
+    strftime(filename, sizeof(filename), MOUNT_POINT "/logs/history_%Y%m%d.csv", &timeinfo);
+
+    FILE *file = fopen(filename, "a");
+    if (file == NULL) {
+        ESP_LOGE(TAG, "Failed to open history file: %s", filename);
+        return;
+    }
+    if (ftell(file) == 0) fputs("time,stream,in,out\n", file);
+
+    uint32_t uptime = stream_history_uptime();
+    stream_history_t *history;
+    SLIST_FOREACH(history, &stream_history_list, next) {
+        uint32_t end_seq, end_uptime;
+        size_t count = stream_history_read(history, STREAM_HISTORY_COARSE, history->persisted,
+                samples, STREAM_HISTORY_COARSE_LENGTH, &end_seq, &end_uptime);
+
+        time_t end_time = now - (uptime - end_uptime);
+        for (size_t i = 0; i < count; i++) {
+            fprintf(file, "%lld,%s,%lu,%lu\n",
+                    (long long) (end_time - (time_t) (count - 1 - i) * STREAM_HISTORY_COARSE_RESOLUTION), history->name,
+                    (unsigned long) stream_history_decode(samples[i].in),
+                    (unsigned long) stream_history_decode(samples[i].out));
+        }
+
+        history->persisted = end_seq;
+    }
+
+    fclose(file);
+}
+
+static void stream_history_persist_task(void *ctx) {
+    stream_history_sample_t *samples = malloc(STREAM_HISTORY_COARSE_LENGTH * sizeof(stream_history_sample_t));
+
+    while (true) {
+        vTaskDelay(pdMS_TO_TICKS(STREAM_HISTORY_PERSIST_PERIOD_MS));
+
+        if (samples != NULL && sd_logger_is_mounted() && sd_logger_is_enabled()) {
+            stream_history_persist(samples);
+        }
+    }
+}
+
+void stream_history_init() {
+    SLIST_INIT(&stream_history_list);
+    task_create(TASK_STREAM_HISTORY, stream_history_persist_task, NULL, NULL);
+}
+
+stream_history_t *stream_history_new(const char *name) {
+    stream_history_t *history = calloc(1, sizeof(stream_history_t));
+    if (history == NULL) {
+        ESP_LOGE(TAG, "Could not allocate history for %s", name);
+        return NULL;
+    }
+
+    history->name = name;
+    history->rings[STREAM_HISTORY_FINE].samples = history->storage;
+    history->rings[STREAM_HISTORY_COARSE].samples = history->storage + STREAM_HISTORY_FINE_LENGTH;
+
+    taskENTER_CRITICAL(&stream_history_lock);
+    SLIST_INSERT_HEAD(&stream_history_list, history, next);
+    taskEXIT_CRITICAL(&stream_history_lock);
+
+    return history;
+}
+
+void stream_history_record(stream_history_t *history, uint32_t rate_in, uint32_t rate_out) {
+    if (history == NULL) return;
+
+    for (int r = 0; r < STREAM_HISTORY_RESOLUTION_COUNT; r++) {
+        stream_history_ring_t *ring = &history->rings[r];
+        ring->sum_in += rate_in;
+        ring->sum_out += rate_out;
+        if (++ring->seconds < resolutions[r]) continue;
+
+        stream_history_sample_t sample = {
+                .in = stream_history_encode(ring->sum_in / ring->seconds),
+                .out = stream_history_encode(ring->sum_out / ring->seconds)
+        };
+        ring->sum_in = 0;
+        ring->sum_out = 0;
+        ring->seconds = 0;
+
+        taskENTER_CRITICAL(&stream_history_lock);
+        ring->samples[ring->seq % lengths[r]] = sample;
+        ring->seq++;
+        ring->end_uptime = stream_history_uptime();
+        taskEXIT_CRITICAL(&stream_history_lock);
+    }
+}
+
+size_t stream_history_read(stream_history_t *history, stream_history_resolution_t resolution, uint32_t since,
+        stream_history_sample_t *samples, size_t length, uint32_t *end_seq, uint32_t *end_uptime) {
+    const stream_history_ring_t *ring = &history->rings[resolution];
+
+    taskENTER_CRITICAL(&stream_history_lock);
+    uint32_t seq = ring->seq;
+    size_t count = seq > since ? seq - since : 0;
+    if (count > lengths[resolution]) count = lengths[resolution];
+    if (count > length) count = length;
+
+    for (size_t i = 0; i < count; i++) {
+        samples[i] = ring->samples[(seq - count + i) % lengths[resolution]];
+    }
+
+    *end_seq = seq;
+    *end_uptime = ring->end_uptime;
+    taskEXIT_CRITICAL(&stream_history_lock);
+
+    return count;
+}
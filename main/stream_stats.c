@@ -19,75 +19,262 @@
 
 #include <freertos/FreeRTOS.h>
 
+#include <stdbool.h>
+#include <string.h>
 #include <sys/queue.h>
 #include <freertos/task.h>
 #include <tasks.h>
+#include <stream_history.h>
 
 #define RUNNING_AVERAGE_PERIOD 1000
 #define RUNNING_AVERAGE_ALPHA 0.8
 #define RUNNING_AVERAGE_PERIOD_CORRECTION (1000.0 / RUNNING_AVERAGE_PERIOD)
 
+#define STREAM_STATS_SECONDS 60
+#define STREAM_STATS_MINUTES 15
+
+/// Счётчики одного ядра. Задачи пишут в шард своего ядра, поэтому ядра не
+/// конкурируют за одну линию памяти; атомарное сложение защищает от
+/// вытеснения и миграции задачи между ядрами. Счётчики 32-битные: 64-битное
+/// __atomic на ESP32 и ESP32-C3 уходит в libatomic под общей блокировкой.
+/// Переполнение допустимо, задача статистики раз в секунду переносит
+/// прирост в 64-битные суммы
+typedef struct stream_stats_shard {
+    uint32_t in;
+    uint32_t out;
+} stream_stats_shard_t;
+
+/// Посекундные скорости за последнюю минуту
+typedef struct stream_stats_seconds {
+    uint32_t rate[STREAM_STATS_SECONDS];
+} stream_stats_seconds_t;
+
+/// Поминутные агрегаты за последние 15 минут, текущая минута заполняется на месте
+typedef struct stream_stats_minute {
+    uint64_t sum;
+    uint32_t min;
+    uint32_t max;
+    uint16_t seconds;
+} stream_stats_minute_t;
+
+typedef struct stream_stats_direction {
+    uint64_t last_total;
+    double rate;
+    uint32_t peak;
+
+    stream_stats_seconds_t seconds;
+    stream_stats_minute_t minutes[STREAM_STATS_MINUTES];
+
+    stream_stats_rate_t window[STREAM_STATS_WINDOW_COUNT];
+} stream_stats_direction_t;
+
 struct stream_stats {
     const char *name;
 
-    uint32_t total_in;
-    uint32_t total_out;
+    stream_stats_shard_t shards[portNUM_PROCESSORS];
 
-    double rate_in;
-    double rate_out;
+    // Изменяются только задачей статистики, читаются под stream_stats_lock
+    stream_stats_shard_t folded[portNUM_PROCESSORS];   // значения шардов, уже учтённые в суммах
+    uint64_t total_in;
+    uint64_t total_out;
+    stream_stats_direction_t in;
+    stream_stats_direction_t out;
 
-    uint32_t rate_in_period_count;
-    uint32_t rate_out_period_count;
+    stream_history_t *history;
 
     SLIST_ENTRY(stream_stats) next;
 };
 
 static SLIST_HEAD(stream_stats_list_t, stream_stats) stream_stats_list;
+static portMUX_TYPE stream_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Заполненность колец, общая для всех потоков
+static unsigned int seconds_index = 0, seconds_count = 0;
+static unsigned int minutes_index = 0, minutes_count = 0;
+
+static const unsigned int window_seconds[] = {
+        [STREAM_STATS_WINDOW_1S] = 1,
+        [STREAM_STATS_WINDOW_10S] = 10,
+        [STREAM_STATS_WINDOW_60S] = 60,
+};
+
+/// Перенос прироста шардов в 64-битные суммы, под stream_stats_lock
+static void stream_stats_fold(stream_stats_handle_t stats) {
+    for (int i = 0; i < portNUM_PROCESSORS; i++) {
+        uint32_t in = __atomic_load_n(&stats->shards[i].in, __ATOMIC_RELAXED);
+        uint32_t out = __atomic_load_n(&stats->shards[i].out, __ATOMIC_RELAXED);
+        stats->total_in += (uint32_t) (in - stats->folded[i].in);
+        stats->total_out += (uint32_t) (out - stats->folded[i].out);
+        stats->folded[i] = (stream_stats_shard_t) {.in = in, .out = out};
+    }
+}
+
+/// Сумма с приростом после последнего переноса, под stream_stats_lock
+static uint64_t stream_stats_total(stream_stats_handle_t stats, bool in) {
+    uint64_t total = in ? stats->total_in : stats->total_out;
+    for (int i = 0; i < portNUM_PROCESSORS; i++) {
+        uint32_t value = __atomic_load_n(in ? &stats->shards[i].in : &stats->shards[i].out, __ATOMIC_RELAXED);
+        total += (uint32_t) (value - (in ? stats->folded[i].in : stats->folded[i].out));
+    }
+
+    return total;
+}
+
+static void stream_stats_window_seconds(const stream_stats_direction_t *direction, unsigned int length, stream_stats_rate_t *window) {
+    if (length > seconds_count) length = seconds_count;
+    if (length == 0) {
+        *window = (stream_stats_rate_t) {0};
+        return;
+    }
+
+    uint64_t sum = 0;
+    uint32_t min = UINT32_MAX, max = 0;
+    for (unsigned int i = 0; i < length; i++) {
+        uint32_t rate = direction->seconds.rate[(seconds_index + STREAM_STATS_SECONDS - 1 - i) % STREAM_STATS_SECONDS];
+        sum += rate;
+        if (rate < min) min = rate;
+        if (rate > max) max = rate;
+    }
+
+    *window = (stream_stats_rate_t) {.avg = sum / length, .min = min, .max = max};
+}
+
+static void stream_stats_window_minutes(const stream_stats_direction_t *direction, stream_stats_rate_t *window) {
+    uint64_t sum = 0, seconds = 0;
+    uint32_t min = UINT32_MAX, max = 0;
+    for (unsigned int i = 0; i < minutes_count; i++) {
+        const stream_stats_minute_t *minute = &direction->minutes[i];
+        sum += minute->sum;
+        seconds += minute->seconds;
+        if (minute->min < min) min = minute->min;
+        if (minute->max > max) max = minute->max;
+    }
+
+    if (seconds == 0) {
+        *window = (stream_stats_rate_t) {0};
+        return;
+    }
+
+    *window = (stream_stats_rate_t) {.avg = sum / seconds, .min = min, .max = max};
+}
+
+/// Учёт одной секунды: скорость считается по разнице 64-битных сумм,
+/// поэтому счётчики никогда не сбрасываются и не конкурируют с писателями
+static uint32_t stream_stats_direction_update(stream_stats_direction_t *direction, uint64_t total) {
+    uint64_t delta = total - direction->last_total;
+    uint32_t rate = delta > UINT32_MAX ? UINT32_MAX : delta;
+    direction->last_total = total;
+
+    direction->rate = direction->rate * RUNNING_AVERAGE_ALPHA +
+            (double) rate * (1.0 - RUNNING_AVERAGE_ALPHA) * RUNNING_AVERAGE_PERIOD_CORRECTION;
+    if (rate > direction->peak) direction->peak = rate;
+
+    direction->seconds.rate[seconds_index] = rate;
+
+    stream_stats_minute_t *minute = &direction->minutes[minutes_index];
+    if (minute->seconds == 0 || rate < minute->min) minute->min = rate;
+    if (minute->seconds == 0 || rate > minute->max) minute->max = rate;
+    minute->sum += rate;
+    minute->seconds++;
+
+    return rate;
+}
+
+static void stream_stats_direction_windows(stream_stats_direction_t *direction, stream_stats_rate_t *window) {
+    for (int w = STREAM_STATS_WINDOW_1S; w <= STREAM_STATS_WINDOW_60S; w++) {
+        stream_stats_window_seconds(direction, window_seconds[w], &window[w]);
+    }
+    stream_stats_window_minutes(direction, &window[STREAM_STATS_WINDOW_15M]);
+}
 
 static void stream_stats_task(void *ctx) {
+    TickType_t wake_time = xTaskGetTickCount();
+    unsigned int minute_seconds = 0;
+
     while (true) {
-        vTaskDelay(pdMS_TO_TICKS(RUNNING_AVERAGE_PERIOD));
+        vTaskDelayUntil(&wake_time, pdMS_TO_TICKS(RUNNING_AVERAGE_PERIOD));
+
+        if (seconds_count < STREAM_STATS_SECONDS) seconds_count++;
+        if (minutes_count == 0) minutes_count = 1;
+
         stream_stats_handle_t stats;
         SLIST_FOREACH(stats, &stream_stats_list, next) {
-            stats->rate_in = stats->rate_in * RUNNING_AVERAGE_ALPHA +
-                    (double) stats->rate_in_period_count * (1.0 - RUNNING_AVERAGE_ALPHA) * RUNNING_AVERAGE_PERIOD_CORRECTION;
-            stats->rate_out = stats->rate_out * RUNNING_AVERAGE_ALPHA +
-                    (double) stats->rate_out_period_count * (1.0 - RUNNING_AVERAGE_ALPHA) * RUNNING_AVERAGE_PERIOD_CORRECTION;
+            // Окна считаются вне критической секции, копируются под ней
+            stream_stats_rate_t window_in[STREAM_STATS_WINDOW_COUNT], window_out[STREAM_STATS_WINDOW_COUNT];
 
-            stats->rate_in_period_count = 0;
-            stats->rate_out_period_count = 0;
+            taskENTER_CRITICAL(&stream_stats_lock);
+            stream_stats_fold(stats);
+            uint32_t rate_in = stream_stats_direction_update(&stats->in, stats->total_in);
+            uint32_t rate_out = stream_stats_direction_update(&stats->out, stats->total_out);
+            taskEXIT_CRITICAL(&stream_stats_lock);
+
+            stream_history_record(stats->history, rate_in, rate_out);
+
+            stream_stats_direction_windows(&stats->in, window_in);
+            stream_stats_direction_windows(&stats->out, window_out);
+
+            taskENTER_CRITICAL(&stream_stats_lock);
+            memcpy(stats->in.window, window_in, sizeof(window_in));
+            memcpy(stats->out.window, window_out, sizeof(window_out));
+            taskEXIT_CRITICAL(&stream_stats_lock);
+        }
+
+        seconds_index = (seconds_index + 1) % STREAM_STATS_SECONDS;
+
+        // Начало новой минуты: самый старый агрегат перезаписывается
+        if (++minute_seconds == 60) {
+            minute_seconds = 0;
+            minutes_index = (minutes_index + 1) % STREAM_STATS_MINUTES;
+            if (minutes_count < STREAM_STATS_MINUTES) minutes_count++;
+
+            taskENTER_CRITICAL(&stream_stats_lock);
+            SLIST_FOREACH(stats, &stream_stats_list, next) {
+                stats->in.minutes[minutes_index] = (stream_stats_minute_t) {0};
+                stats->out.minutes[minutes_index] = (stream_stats_minute_t) {0};
+            }
+            taskEXIT_CRITICAL(&stream_stats_lock);
         }
     }
 }
 
 void stream_stats_init() {
     SLIST_INIT(&stream_stats_list);
-    xTaskCreate(stream_stats_task, "stream_stats_task", 2048, NULL, TASK_PRIORITY_STATS, NULL);
+    stream_history_init();
+    task_create(TASK_STREAM_STATS, stream_stats_task, NULL, NULL);
 }
 
 stream_stats_handle_t stream_stats_new(const char *name) {
     stream_stats_handle_t new = calloc(1, sizeof(struct stream_stats));
     new->name = name;
+    new->history = stream_history_new(name);
+
+    taskENTER_CRITICAL(&stream_stats_lock);
     SLIST_INSERT_HEAD(&stream_stats_list, new, next);
+    taskEXIT_CRITICAL(&stream_stats_lock);
 
     return new;
 }
 
 void stream_stats_increment(stream_stats_handle_t stats, uint32_t in, uint32_t out) {
-    stats->total_in += in;
-    stats->total_out += out;
-    stats->rate_in_period_count += in;
-    stats->rate_out_period_count += out;
+    stream_stats_shard_t *shard = &stats->shards[xPortGetCoreID()];
+    if (in > 0) __atomic_fetch_add(&shard->in, in, __ATOMIC_RELAXED);
+    if (out > 0) __atomic_fetch_add(&shard->out, out, __ATOMIC_RELAXED);
 }
 
 void stream_stats_values(stream_stats_handle_t stats, stream_stats_values_t *values) {
+    taskENTER_CRITICAL(&stream_stats_lock);
     *values = (stream_stats_values_t) {
             .name = stats->name,
-            .total_in = stats->total_in,
-            .total_out = stats->total_out,
-            .rate_in = stats->rate_in,
-            .rate_out = stats->rate_out
+            .total_in = stream_stats_total(stats, true),
+            .total_out = stream_stats_total(stats, false),
+            .rate_in = stats->in.rate,
+            .rate_out = stats->out.rate,
+            .peak_in = stats->in.peak,
+            .peak_out = stats->out.peak
     };
+    memcpy(values->window_in, stats->in.window, sizeof(values->window_in));
+    memcpy(values->window_out, stats->out.window, sizeof(values->window_out));
+    taskEXIT_CRITICAL(&stream_stats_lock);
 }
 
 stream_stats_handle_t stream_stats_first() {
@@ -98,13 +285,27 @@ stream_stats_handle_t stream_stats_next(stream_stats_handle_t stats) {
     return SLIST_NEXT(stats, next);
 }
 
+stream_history_t *stream_stats_history(stream_stats_handle_t stats) {
+    return stats->history;
+}
+
 stream_stats_handle_t stream_stats_get(const char *name) {
     stream_stats_handle_t stats;
     SLIST_FOREACH(stats, &stream_stats_list, next) {
-        if (stats->name == name) {
+        if (strcmp(stats->name, name) == 0) {
             return stats;
         }
     }
 
     return NULL;
+}
+
+const char *stream_stats_window_name(stream_stats_window_t window) {
+    switch (window) {
+        case STREAM_STATS_WINDOW_1S: return "1s";
+        case STREAM_STATS_WINDOW_10S: return "10s";
+        case STREAM_STATS_WINDOW_60S: return "60s";
+        case STREAM_STATS_WINDOW_15M: return "15m";
+        default: return "";
+    }
 }
\ No newline at end of file
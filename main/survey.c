@@ -0,0 +1,279 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "survey.h"
+
+#include <math.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <config.h>
+#include <gnss.h>
+#include <receiver.h>
+#include <tasks.h>
+
+static const char *TAG = "SURVEY";
+
+// Решение приходит с частотой навигации, опрос чаще самой быстрой (20 Гц)
+#define SURVEY_POLL_MS 50
+
+// Повтор передачи позиции приёмнику: без u-blox на порту не засорять журнал
+#define SURVEY_RETRY_MIN_US (30 * 1000000LL)
+#define SURVEY_RETRY_MAX_US (30 * 60 * 1000000LL)
+
+static portMUX_TYPE survey_lock = portMUX_INITIALIZER_UNLOCKED;
+static survey_status_t status;
+static uint32_t survey_generation = 0;  // Меняется при каждом запуске: результат прерванной съёмки не публикуется
+static int64_t survey_started;
+
+static TaskHandle_t survey_task_handle;
+
+// Состояние задачи: последняя переданная приёмнику позиция и расписание повтора
+static bool programmed = false;
+static int64_t programmed_base[3];
+static int64_t retry_at = 0, retry_delay = SURVEY_RETRY_MIN_US;
+
+static void survey_load_base() {
+    bool valid = config_get_bool1(CONF_ITEM(KEY_CONFIG_BASE_VALID));
+    int64_t base[3] = {
+            config_get_i64(CONF_ITEM(KEY_CONFIG_BASE_ECEF_X)),
+            config_get_i64(CONF_ITEM(KEY_CONFIG_BASE_ECEF_Y)),
+            config_get_i64(CONF_ITEM(KEY_CONFIG_BASE_ECEF_Z))
+    };
+    uint32_t accuracy = config_get_u32(CONF_ITEM(KEY_CONFIG_BASE_ACCURACY));
+
+    taskENTER_CRITICAL(&survey_lock);
+    status.base_valid = valid;
+    memcpy(status.base, base, sizeof(status.base));
+    status.base_accuracy = accuracy;
+    taskEXIT_CRITICAL(&survey_lock);
+}
+
+static void survey_finish(const survey_stats_t *stats, double accuracy, double duration) {
+    double mean[3];
+    survey_stats_mean(stats, mean);
+
+    int64_t base[3];
+    for (int i = 0; i < 3; i++) base[i] = llround(mean[i] * 10000);
+    uint32_t base_accuracy = (uint32_t) ceil(accuracy * 10000);
+
+    double latitude, longitude, height;
+    survey_geodetic_from_ecef(mean, &latitude, &longitude, &height);
+    ESP_LOGI(TAG, "Survey complete: %.7f, %.7f, %.3f m (ECEF %.4f, %.4f, %.4f), accuracy %.3f m, %u samples in %.0f s",
+            latitude, longitude, height, mean[0], mean[1], mean[2], accuracy, (unsigned) stats->count, duration);
+
+    config_write_begin();
+    config_set_i64(KEY_CONFIG_BASE_ECEF_X, base[0]);
+    config_set_i64(KEY_CONFIG_BASE_ECEF_Y, base[1]);
+    config_set_i64(KEY_CONFIG_BASE_ECEF_Z, base[2]);
+    config_set_u32(KEY_CONFIG_BASE_ACCURACY, base_accuracy);
+    config_set_bool1(KEY_CONFIG_BASE_VALID, true);
+    esp_err_t err = config_commit();
+    config_write_end();
+    if (err != ESP_OK) ESP_LOGE(TAG, "Could not save base position: %s", esp_err_to_name(err));
+
+    // Наблюдатель перечитает настройки, но позиция нужна сразу
+    survey_load_base();
+}
+
+static void survey_sample(const nmea_fix_t *fix, int64_t now) {
+    // Автономное, дифференциальное и RTK решения; счисление, ручной ввод и симуляция - нет
+    bool usable = fix->position_valid && fix->quality >= 1 && fix->quality <= 5;
+
+    double ecef[3];
+    if (usable) {
+        survey_ecef_from_geodetic(fix->latitude / 1e7, fix->longitude / 1e7,
+                (fix->altitude + fix->geoid_separation) / 1000.0, ecef);
+    }
+
+    taskENTER_CRITICAL(&survey_lock);
+    if (status.phase != SURVEY_RUNNING) {
+        taskEXIT_CRITICAL(&survey_lock);
+        return;
+    }
+    if (!usable) {
+        status.rejected++;
+        taskEXIT_CRITICAL(&survey_lock);
+        return;
+    }
+    survey_stats_t stats = status.stats;
+    uint32_t generation = survey_generation;
+    uint32_t min_duration = status.min_duration;
+    uint32_t accuracy_limit = status.accuracy_limit;
+    taskEXIT_CRITICAL(&survey_lock);
+
+    // Деление и sqrt в double программные, вне критической секции.
+    // Статистику меняет только эта задача, survey_start/stop лишь сбрасывают её
+    if (stats.count == 0) survey_started = now;
+    survey_stats_add(&stats, ecef);
+    double duration = (now - survey_started) / 1e6;
+
+    double accuracy = survey_stats_accuracy(&stats, duration);
+    bool done = stats.count >= SURVEY_SAMPLES_MIN && duration >= min_duration && accuracy * 1000 <= accuracy_limit;
+
+    taskENTER_CRITICAL(&survey_lock);
+    bool current = status.phase == SURVEY_RUNNING && survey_generation == generation;
+    if (current) {
+        status.stats = stats;
+        status.duration = duration;
+        if (done) status.phase = SURVEY_DONE;
+    }
+    taskEXIT_CRITICAL(&survey_lock);
+
+    if (current && done) survey_finish(&stats, accuracy, duration);
+}
+
+static void survey_program_receiver() {
+    if (!config_get_bool1(CONF_ITEM(KEY_CONFIG_SURVEY_PROGRAM_RECEIVER))) return;
+
+    int64_t base[3];
+    uint32_t accuracy;
+    if (!survey_base_position(base, &accuracy)) return;
+    if (programmed && memcmp(base, programmed_base, sizeof(base)) == 0) return;
+
+    int64_t now = esp_timer_get_time();
+    if (now < retry_at) return;
+
+    // RAM и BBR: позиция переживает сброс приёмника, флеш не изнашивается
+    esp_err_t err = receiver_fixed_position(base, accuracy, UBX_LAYER_RAM | UBX_LAYER_BBR);
+
+    taskENTER_CRITICAL(&survey_lock);
+    status.receiver_result = err;
+    taskEXIT_CRITICAL(&survey_lock);
+
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Receiver set to fixed base position");
+        programmed = true;
+        memcpy(programmed_base, base, sizeof(base));
+        retry_delay = SURVEY_RETRY_MIN_US;
+    } else {
+        ESP_LOGW(TAG, "Could not set receiver base position: %s, retrying in %d s", esp_err_to_name(err),
+                (int) (retry_delay / 1000000));
+        retry_at = now + retry_delay;
+        retry_delay = retry_delay * 2 > SURVEY_RETRY_MAX_US ? SURVEY_RETRY_MAX_US : retry_delay * 2;
+    }
+}
+
+static void survey_reload() {
+    survey_load_base();
+
+    // Изменённые настройки - повод сразу повторить передачу позиции
+    retry_at = 0;
+    retry_delay = SURVEY_RETRY_MIN_US;
+
+    survey_status_t current;
+    survey_status(&current);
+    if (current.phase == SURVEY_IDLE && !current.base_valid && config_get_bool1(CONF_ITEM(KEY_CONFIG_SURVEY_AUTO))) {
+        survey_start(0, 0);
+    }
+}
+
+static void survey_task(void *ctx) {
+    gnss_state_t gnss;
+    int64_t last_updated = 0;
+    uint32_t last_epoch = UINT32_MAX;
+
+    survey_reload();
+
+    while (true) {
+        // Уведомление - изменились настройки съёмки
+        if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(SURVEY_POLL_MS)) > 0) survey_reload();
+
+        survey_program_receiver();
+
+        gnss_state(&gnss);
+        if (gnss.updated == last_updated) continue;
+        last_updated = gnss.updated;
+
+        // GGA и RMC одной эпохи - одно измерение
+        const nmea_fix_t *fix = &gnss.fix;
+        uint32_t epoch = fix->time_valid
+                ? ((fix->hour * 60 + fix->minute) * 60 + fix->second) * 1000 + fix->millisecond
+                : (uint32_t) (gnss.updated / 1000);
+        if (epoch == last_epoch) continue;
+        last_epoch = epoch;
+
+        survey_sample(fix, gnss.updated);
+    }
+}
+
+static void survey_config_changed(const config_change_t *change, void *arg) {
+    xTaskNotifyGive(survey_task_handle);
+}
+
+void survey_init() {
+    status.receiver_result = ESP_ERR_NOT_FINISHED;
+
+    if (task_create(TASK_SURVEY, survey_task, NULL, &survey_task_handle) != ESP_OK) {
+        ESP_LOGE(TAG, "Could not start survey task");
+        return;
+    }
+    config_subscribe(CONFIG_GROUP_SURVEY, survey_config_changed, NULL);
+}
+
+esp_err_t survey_start(uint32_t min_duration, uint32_t accuracy_mm) {
+    if (survey_task_handle == NULL) return ESP_ERR_INVALID_STATE;
+
+    if (min_duration == 0) min_duration = config_get_u32(CONF_ITEM(KEY_CONFIG_SURVEY_MIN_DURATION));
+    if (accuracy_mm == 0) accuracy_mm = config_get_u32(CONF_ITEM(KEY_CONFIG_SURVEY_ACCURACY));
+    if (accuracy_mm == 0) return ESP_ERR_INVALID_ARG;
+
+    taskENTER_CRITICAL(&survey_lock);
+    survey_stats_reset(&status.stats);
+    survey_generation++;
+    status.phase = SURVEY_RUNNING;
+    status.duration = 0;
+    status.rejected = 0;
+    status.min_duration = min_duration;
+    status.accuracy_limit = accuracy_mm;
+    taskEXIT_CRITICAL(&survey_lock);
+
+    ESP_LOGI(TAG, "Survey started: at least %u s, accuracy %u mm", (unsigned) min_duration, (unsigned) accuracy_mm);
+    return ESP_OK;
+}
+
+void survey_stop() {
+    bool stopped = false;
+
+    taskENTER_CRITICAL(&survey_lock);
+    if (status.phase == SURVEY_RUNNING) {
+        status.phase = SURVEY_IDLE;
+        stopped = true;
+    }
+    taskEXIT_CRITICAL(&survey_lock);
+
+    if (stopped) ESP_LOGI(TAG, "Survey stopped");
+}
+
+void survey_status(survey_status_t *out) {
+    taskENTER_CRITICAL(&survey_lock);
+    *out = status;
+    taskEXIT_CRITICAL(&survey_lock);
+}
+
+bool survey_base_position(int64_t ecef[3], uint32_t *accuracy) {
+    taskENTER_CRITICAL(&survey_lock);
+    bool valid = status.base_valid;
+    memcpy(ecef, status.base, sizeof(status.base));
+    *accuracy = status.base_accuracy;
+    taskEXIT_CRITICAL(&survey_lock);
+
+    return valid;
+}
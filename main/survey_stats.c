@@ -0,0 +1,87 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "survey_stats.h"
+
+#include <math.h>
+#include <string.h>
+
+#define WGS84_E2 (SURVEY_WGS84_F * (2 - SURVEY_WGS84_F))
+#define DEGREES (M_PI / 180)
+
+void survey_ecef_from_geodetic(double latitude, double longitude, double height, double ecef[3]) {
+    double sin_lat = sin(latitude * DEGREES), cos_lat = cos(latitude * DEGREES);
+    double n = SURVEY_WGS84_A / sqrt(1 - WGS84_E2 * sin_lat * sin_lat);
+
+    ecef[0] = (n + height) * cos_lat * cos(longitude * DEGREES);
+    ecef[1] = (n + height) * cos_lat * sin(longitude * DEGREES);
+    ecef[2] = (n * (1 - WGS84_E2) + height) * sin_lat;
+}
+
+void survey_geodetic_from_ecef(const double ecef[3], double *latitude, double *longitude, double *height) {
+    double p = sqrt(ecef[0] * ecef[0] + ecef[1] * ecef[1]);
+    double lat = atan2(ecef[2], p * (1 - WGS84_E2));
+    double h = 0;
+
+    // Итерации по широте сходятся до долей миллиметра за несколько шагов вне полюсов
+    for (int i = 0; i < 6; i++) {
+        double sin_lat = sin(lat);
+        double n = SURVEY_WGS84_A / sqrt(1 - WGS84_E2 * sin_lat * sin_lat);
+        h = p > 1 ? p / cos(lat) - n : fabs(ecef[2]) - n * (1 - WGS84_E2);
+        lat = atan2(ecef[2], p * (1 - WGS84_E2 * n / (n + h)));
+    }
+
+    *latitude = lat / DEGREES;
+    *longitude = atan2(ecef[1], ecef[0]) / DEGREES;
+    *height = h;
+}
+
+void survey_stats_reset(survey_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+}
+
+void survey_stats_add(survey_stats_t *stats, const double ecef[3]) {
+    if (stats->count == 0) memcpy(stats->origin, ecef, sizeof(stats->origin));
+    stats->count++;
+
+    for (int i = 0; i < 3; i++) {
+        double x = ecef[i] - stats->origin[i];
+        double delta = x - stats->mean[i];
+        stats->mean[i] += delta / stats->count;
+        stats->m2[i] += delta * (x - stats->mean[i]);
+    }
+}
+
+void survey_stats_mean(const survey_stats_t *stats, double ecef[3]) {
+    for (int i = 0; i < 3; i++) ecef[i] = stats->origin[i] + stats->mean[i];
+}
+
+double survey_stats_spread(const survey_stats_t *stats) {
+    if (stats->count < 2) return 0;
+    return sqrt((stats->m2[0] + stats->m2[1] + stats->m2[2]) / (stats->count - 1));
+}
+
+double survey_stats_accuracy(const survey_stats_t *stats, double duration) {
+    if (stats->count < 2) return INFINITY;
+
+    double independent = duration / SURVEY_STATS_CORRELATION_S;
+    if (independent > stats->count) independent = stats->count;
+    if (independent < 1) independent = 1;
+
+    return survey_stats_spread(stats) / sqrt(independent);
+}
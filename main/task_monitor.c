@@ -0,0 +1,227 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "include/task_monitor.h"
+
+#include <freertos/FreeRTOS.h>
+
+#include <string.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <esp_log.h>
+#include <tasks.h>
+
+static const char *TAG = "TASK_MONITOR";
+
+const char *task_monitor_state_name(uint8_t state) {
+    switch (state) {
+        case eRunning: return "running";
+        case eReady: return "ready";
+        case eBlocked: return "blocked";
+        case eSuspended: return "suspended";
+        case eDeleted: return "deleted";
+        default: return "invalid";
+    }
+}
+
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+
+#define TASK_MONITOR_RING (TASK_MONITOR_WINDOW + 1)
+
+typedef struct task_monitor_entry {
+    TaskHandle_t handle;
+    bool seen;
+    uint32_t runtime[TASK_MONITOR_RING];
+    task_monitor_info_t info;
+} task_monitor_entry_t;
+
+static task_monitor_entry_t entries[TASK_MONITOR_MAX_TASKS];
+static size_t entry_count = 0;
+
+// Кольцо счётчиков времени работы: текущий замер и TASK_MONITOR_WINDOW предыдущих
+static uint32_t total_runtime[TASK_MONITOR_RING];
+static unsigned int sample_index = 0, sample_count = 0;
+
+static task_monitor_summary_t summary;
+static SemaphoreHandle_t monitor_mutex;
+
+// Используется только задачей мониторинга
+static TaskStatus_t status[TASK_MONITOR_MAX_TASKS];
+
+/// Бюджет CPU, % одного ядра: из реестра задач, остальным TASK_MONITOR_CPU_BUDGET
+static uint8_t task_monitor_budget(const task_definition_t *definition, TaskHandle_t handle) {
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        if (handle == xTaskGetIdleTaskHandleForCore(core)) return 100;
+    }
+
+    if (definition != NULL && definition->budget > 0) return definition->budget;
+    return TASK_MONITOR_CPU_BUDGET;
+}
+
+static task_monitor_entry_t *task_monitor_entry(const TaskStatus_t *task) {
+    for (size_t i = 0; i < entry_count; i++) {
+        if (entries[i].handle == task->xHandle) return &entries[i];
+    }
+
+    if (entry_count == TASK_MONITOR_MAX_TASKS) return NULL;
+
+    // Новая задача: история заполняется текущим значением, загрузка растёт с окном
+    task_monitor_entry_t *entry = &entries[entry_count++];
+    memset(entry, 0, sizeof(*entry));
+    entry->handle = task->xHandle;
+    for (int i = 0; i < TASK_MONITOR_RING; i++) entry->runtime[i] = task->ulRunTimeCounter;
+    strlcpy(entry->info.name, task->pcTaskName, sizeof(entry->info.name));
+
+    const task_definition_t *definition = task_find(task->pcTaskName);
+    entry->info.budget = task_monitor_budget(definition, task->xHandle);
+    entry->info.stack_size = definition != NULL ? definition->stack : 0;
+
+    return entry;
+}
+
+static void task_monitor_check(task_monitor_info_t *info) {
+    bool cpu_overload = info->cpu > info->budget;
+    bool stack_low = info->stack_free < TASK_MONITOR_STACK_MIN;
+
+    // Предупреждения только при переходе в состояние перегрузки
+    if (cpu_overload && !info->cpu_overload) {
+        ESP_LOGW(TAG, "Task %s is using %d%% CPU, budget %d%%", info->name, (int) info->cpu, info->budget);
+    }
+    if (stack_low && !info->stack_low) {
+        ESP_LOGW(TAG, "Task %s has only %lu bytes of stack left", info->name, (unsigned long) info->stack_free);
+    }
+
+    info->cpu_overload = cpu_overload;
+    info->stack_low = stack_low;
+}
+
+static void task_monitor_sample() {
+    uint32_t total;
+    UBaseType_t count = uxTaskGetSystemState(status, TASK_MONITOR_MAX_TASKS, &total);
+    if (count == 0) {
+        ESP_LOGW(TAG, "More than %d tasks, not sampled", TASK_MONITOR_MAX_TASKS);
+        return;
+    }
+
+    xSemaphoreTake(monitor_mutex, portMAX_DELAY);
+
+    unsigned int current = sample_index;
+    unsigned int oldest = (current + TASK_MONITOR_RING - sample_count) % TASK_MONITOR_RING;
+    total_runtime[current] = total;
+    uint32_t total_delta = total - total_runtime[oldest];
+
+    for (size_t i = 0; i < entry_count; i++) entries[i].seen = false;
+
+    for (UBaseType_t t = 0; t < count; t++) {
+        task_monitor_entry_t *entry = task_monitor_entry(&status[t]);
+        if (entry == NULL) continue;
+
+        entry->seen = true;
+        entry->runtime[current] = status[t].ulRunTimeCounter;
+
+        task_monitor_info_t *info = &entry->info;
+        info->number = status[t].xTaskNumber;
+        info->state = status[t].eCurrentState;
+        info->priority = status[t].uxCurrentPriority;
+        info->stack_free = status[t].usStackHighWaterMark;
+#if CONFIG_FREERTOS_VTASKLIST_INCLUDE_COREID
+        info->core = status[t].xCoreID == tskNO_AFFINITY ? -1 : status[t].xCoreID;
+#else
+        info->core = -1;
+#endif
+
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+        // Счётчики 32-битные, беззнаковая разность корректна при переполнении
+        uint32_t delta = entry->runtime[current] - entry->runtime[oldest];
+        info->cpu = total_delta > 0 ? 100.0f * delta / total_delta : 0;
+#else
+        info->cpu = -1;
+#endif
+
+        task_monitor_check(info);
+    }
+
+    // Удалённые задачи
+    size_t kept = 0;
+    for (size_t i = 0; i < entry_count; i++) {
+        if (!entries[i].seen) continue;
+        if (kept != i) entries[kept] = entries[i];
+        kept++;
+    }
+    entry_count = kept;
+
+    summary.window_ms = (sample_count > 0 ? sample_count : 1) * TASK_MONITOR_PERIOD_MS;
+    for (int core = 0; core < portNUM_PROCESSORS && core < 2; core++) {
+        TaskHandle_t idle = xTaskGetIdleTaskHandleForCore(core);
+        for (size_t i = 0; i < entry_count; i++) {
+            if (entries[i].handle == idle) summary.core_load[core] = 100.0f - entries[i].info.cpu;
+        }
+    }
+
+    sample_index = (current + 1) % TASK_MONITOR_RING;
+    if (sample_count < TASK_MONITOR_WINDOW) sample_count++;
+
+    xSemaphoreGive(monitor_mutex);
+}
+
+static void task_monitor_task(void *ctx) {
+    TickType_t wake_time = xTaskGetTickCount();
+
+    while (true) {
+        task_monitor_sample();
+        vTaskDelayUntil(&wake_time, pdMS_TO_TICKS(TASK_MONITOR_PERIOD_MS));
+    }
+}
+
+void task_monitor_init() {
+    monitor_mutex = xSemaphoreCreateMutex();
+
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    summary.cpu_available = true;
+#endif
+    summary.cores = portNUM_PROCESSORS;
+
+    // Приоритет выше uart_task, чтобы замеры продолжались под нагрузкой
+    task_create(TASK_TASK_MONITOR, task_monitor_task, NULL, NULL);
+}
+
+size_t task_monitor_snapshot(task_monitor_info_t *tasks, size_t length, task_monitor_summary_t *summary_out) {
+    xSemaphoreTake(monitor_mutex, portMAX_DELAY);
+
+    size_t count = entry_count < length ? entry_count : length;
+    for (size_t i = 0; i < count; i++) tasks[i] = entries[i].info;
+    if (summary_out != NULL) *summary_out = summary;
+
+    xSemaphoreGive(monitor_mutex);
+
+    return count;
+}
+
+#else
+
+void task_monitor_init() {
+    ESP_LOGW(TAG, "CONFIG_FREERTOS_USE_TRACE_FACILITY is disabled, task monitor unavailable");
+}
+
+size_t task_monitor_snapshot(task_monitor_info_t *tasks, size_t length, task_monitor_summary_t *summary_out) {
+    if (summary_out != NULL) *summary_out = (task_monitor_summary_t) {0};
+
+    return 0;
+}
+
+#endif
@@ -0,0 +1,77 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <string.h>
+#include <esp_log.h>
+#include <esp_task.h>
+#include "tasks.h"
+
+static const char *TAG = "TASKS";
+
+const task_definition_t TASKS[TASK_COUNT] = {
+#define TASK_ENTRY(_id, _name, _stack, _priority, _core, _budget) \
+        [TASK_##_id] = { \
+                .name = _name, \
+                .stack = _stack, \
+                .priority = _priority, \
+                .core = _core, \
+                .budget = _budget \
+        },
+        TASKS_SCHEMA(TASK_ENTRY)
+#undef TASK_ENTRY
+};
+
+// Параметры esp_event_loop_create_default
+static const task_definition_t TASK_EVENT_LOOP = {
+        .name = TASK_EVENT_LOOP_NAME,
+        .stack = TASK_EVENT_LOOP_STACK,
+        .priority = ESP_TASKD_EVENT_PRIO,
+        .core = 0,
+        .budget = 0
+};
+
+// Превышение бюджета стеков для цели останавливает сборку
+_Static_assert(TASK_STACK_TOTAL <= TASK_STACK_BUDGET, "Task stacks exceed TASK_STACK_BUDGET for this target");
+
+#define TASK_NAME_CHECK(id, name, stack, priority, core, budget) \
+        _Static_assert(sizeof(name) <= configMAX_TASK_NAME_LEN, "Task name " name " is truncated by FreeRTOS");
+TASKS_SCHEMA(TASK_NAME_CHECK)
+#undef TASK_NAME_CHECK
+
+esp_err_t task_create(task_id_t id, TaskFunction_t function, void *arg, TaskHandle_t *handle) {
+    const task_definition_t *task = &TASKS[id];
+
+    // Привязка к отсутствующему ядру (одноядерные C3, C6) заменяется на любое
+    BaseType_t core = task->core >= 0 && task->core < portNUM_PROCESSORS ? task->core : tskNO_AFFINITY;
+    if (xTaskCreatePinnedToCore(function, task->name, task->stack, arg, task->priority, handle, core) != pdPASS) {
+        ESP_LOGE(TAG, "Could not create task %s with %lu bytes of stack", task->name, (unsigned long) task->stack);
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+const task_definition_t *task_find(const char *name) {
+    for (int i = 0; i < TASK_COUNT; i++) {
+        if (strncmp(TASKS[i].name, name, configMAX_TASK_NAME_LEN - 1) == 0) return &TASKS[i];
+    }
+    if (strncmp(TASK_EVENT_LOOP.name, name, configMAX_TASK_NAME_LEN - 1) == 0) return &TASK_EVENT_LOOP;
+
+    return NULL;
+}
@@ -0,0 +1,154 @@
+/* 
+ * This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+ * Copyright (c) 2020 Nebojsa Cvetkovic.
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "include/trace.h"
+
+#if CONFIG_PIPELINE_TRACE
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <platform.h>
+
+#ifdef ESP_PLATFORM
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#endif
+
+#define TRACE_SIZE CONFIG_PIPELINE_TRACE_EVENTS
+
+typedef struct trace_event_info {
+    const char *name;
+    const char *category;
+    const char *arg;        // имя аргумента, NULL - строка (указатель на константу)
+} trace_event_info_t;
+
+static const trace_event_info_t trace_events[TRACE_EVENT_COUNT] = {
+        [TRACE_UART_READ] = {"uart_read", "uart", "bytes"},
+        [TRACE_UART_DISPATCH] = {"uart_dispatch", "uart", "bytes"},
+        [TRACE_RTCM3_FRAMING] = {"rtcm3_framing", "framing", "bytes"},
+        [TRACE_NTRIP_SERVER_SEND] = {"ntrip_server_send", "sink", "bytes"},
+        [TRACE_NTRIP_SERVER_2_SEND] = {"ntrip_server_2_send", "sink", "bytes"},
+        [TRACE_SOCKET_SERVER_SEND] = {"socket_server_send", "sink", "bytes"},
+        [TRACE_SOCKET_CLIENT_SEND] = {"socket_client_send", "sink", "bytes"},
+        [TRACE_SD_WRITE] = {"sd_write", "sd", "bytes"},
+        [TRACE_SD_WRITE_TEXT] = {"sd_write_text", "sd", "bytes"},
+        [TRACE_LOG_FORMAT] = {"log_format", "log", "bytes"},
+        [TRACE_HTTP_HANDLER] = {"http", "http", NULL}
+};
+
+static trace_record_t trace_ring[TRACE_SIZE];
+static uint32_t trace_head = 0;        // всего записей, позиция head % TRACE_SIZE
+
+uint32_t trace_now() {
+    return platform_time_us();
+}
+
+void trace_record(trace_event_t event, uint32_t start, uintptr_t arg) {
+    uint32_t now = trace_now();
+
+    // Запись без блокировок: при выгрузке во время записи возможна одна неполная запись
+    uint32_t index = __atomic_fetch_add(&trace_head, 1, __ATOMIC_RELAXED) % TRACE_SIZE;
+    trace_ring[index] = (trace_record_t) {
+            .start = start,
+            .duration = now - start,
+            .event = event,
+            .task = platform_task_id(),
+            .arg = arg
+    };
+}
+
+static int trace_write(trace_writer_t writer, void *ctx, char *buffer, size_t size, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buffer, size, format, args);
+    va_end(args);
+    if (length < 0) return length;
+    if (length >= size) length = size - 1;
+
+    return writer(ctx, buffer, length);
+}
+
+int trace_dump(trace_writer_t writer, void *ctx) {
+    // Снимок кольца, чтобы запись продолжалась во время медленной выгрузки
+    trace_record_t *records = malloc(sizeof(trace_ring));
+    if (records == NULL) return -1;
+
+    uint32_t head = __atomic_load_n(&trace_head, __ATOMIC_RELAXED);
+    memcpy(records, trace_ring, sizeof(trace_ring));
+    uint64_t now_full = platform_time_us();
+    uint32_t now = now_full;
+
+    size_t count = head < TRACE_SIZE ? head : TRACE_SIZE;
+    char buffer[192];
+    bool first = true;
+    int err = trace_write(writer, ctx, buffer, sizeof(buffer), "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+#ifdef ESP_PLATFORM
+    // Имена задач по номерам; удалённые задачи останутся безымянными
+    UBaseType_t task_count = uxTaskGetNumberOfTasks();
+    TaskStatus_t *tasks = malloc(task_count * sizeof(TaskStatus_t));
+    if (tasks != NULL) {
+        task_count = uxTaskGetSystemState(tasks, task_count, NULL);
+        for (UBaseType_t i = 0; i < task_count && err >= 0; i++) {
+            err = trace_write(writer, ctx, buffer, sizeof(buffer),
+                    "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                    first ? "" : ",", (unsigned) tasks[i].xTaskNumber, tasks[i].pcTaskName);
+            first = false;
+        }
+        free(tasks);
+    }
+#endif
+
+    for (size_t i = 0; i < count && err >= 0; i++) {
+        const trace_record_t *record = &records[(head - count + i) % TRACE_SIZE];
+        if (record->event >= TRACE_EVENT_COUNT) continue;
+        const trace_event_info_t *info = &trace_events[record->event];
+
+        // Восстановление 64-битного времени: события младше ~71 минуты
+        uint64_t start = now_full - (uint32_t) (now - record->start);
+
+        int length = snprintf(buffer, sizeof(buffer),
+                "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%lu,\"pid\":1,\"tid\":%u,\"args\":{",
+                first ? "" : ",", info->name, info->category, (unsigned long long) start,
+                (unsigned long) record->duration, (unsigned) record->task);
+        if (length < 0 || length >= sizeof(buffer)) continue;
+        err = writer(ctx, buffer, length);
+        first = false;
+        if (err < 0) break;
+
+        if (info->arg != NULL) {
+            err = trace_write(writer, ctx, buffer, sizeof(buffer), "\"%s\":%lu}}", info->arg, (unsigned long) record->arg);
+        } else if (sizeof(uintptr_t) == sizeof(record->arg) && record->arg != 0) {
+            err = trace_write(writer, ctx, buffer, sizeof(buffer), "\"uri\":\"%s\"}}", (const char *) (uintptr_t) record->arg);
+        } else {
+            err = trace_write(writer, ctx, buffer, sizeof(buffer), "}}");
+        }
+    }
+
+    if (err >= 0) err = trace_write(writer, ctx, buffer, sizeof(buffer), "]}");
+
+    free(records);
+
+    return err;
+}
+
+#endif
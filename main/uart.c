@@ -26,6 +26,7 @@
 #include <driver/uart.h>
 #include <driver/gpio.h>
 #include <esp_event.h>
+#include <freertos/semphr.h>
 #include <esp_log.h>
 #include <string.h>
 #include <protocol/nmea.h>
@@ -34,6 +35,7 @@
 #include "uart.h"
 #include "config.h"
 #include "tasks.h"
+#include "trace.h"
 
 static const char *TAG = "UART";                   // Тег для логирования UART модуля
 
@@ -66,11 +68,45 @@ void uart_unregister_write_handler(esp_event_handler_t event_handler) {
 static int uart_port = -1;
 static bool uart_log_forward = false;
 
+// Арбитр передачи: запись от разных задач (логи, NMEA, веб-терминал) не перемешивается.
+// Рекурсивный, т.к. драйвер UART может сам писать в лог, который снова форвардится в UART
+static SemaphoreHandle_t uart_tx_mutex;
+
 static stream_stats_handle_t stream_stats;
 
 static void uart_task(void *ctx);
 
+/// Применение параметров линии без перезагрузки (порт и пины меняются только при старте)
+static void uart_config_changed(const config_change_t *change, void *arg) {
+    // Не меняем скорость посреди кадра: дожидаемся окончания текущей передачи
+    xSemaphoreTakeRecursive(uart_tx_mutex, portMAX_DELAY);
+    uart_wait_tx_done(uart_port, pdMS_TO_TICKS(100));
+
+    for (size_t i = 0; i < change->count; i++) {
+        const config_item_t *item = change->items[i].item;
+        const config_item_value_t *value = change->items[i].new_value;
+
+        if (item == CONF_ITEM(KEY_CONFIG_UART_BAUD_RATE)) {
+            uart_set_baudrate(uart_port, value->uint32);
+        } else if (item == CONF_ITEM(KEY_CONFIG_UART_DATA_BITS)) {
+            uart_set_word_length(uart_port, value->int8);
+        } else if (item == CONF_ITEM(KEY_CONFIG_UART_PARITY)) {
+            uart_set_parity(uart_port, value->int8);
+        } else if (item == CONF_ITEM(KEY_CONFIG_UART_STOP_BITS)) {
+            uart_set_stop_bits(uart_port, value->int8);
+        } else if (item == CONF_ITEM(KEY_CONFIG_UART_LOG_FORWARD)) {
+            uart_log_forward = value->bool1;
+        }
+    }
+
+    xSemaphoreGiveRecursive(uart_tx_mutex);
+
+    ESP_LOGI(TAG, "Applied UART line settings: %d baud", (int) config_get_u32(CONF_ITEM(KEY_CONFIG_UART_BAUD_RATE)));
+}
+
 void uart_init() {
+    uart_tx_mutex = xSemaphoreCreateRecursiveMutex();
+
     uart_log_forward = config_get_bool1(CONF_ITEM(KEY_CONFIG_UART_LOG_FORWARD));
 
     uart_port = config_get_u8(CONF_ITEM(KEY_CONFIG_UART_NUM));
@@ -107,13 +143,17 @@ void uart_init() {
 
     stream_stats = stream_stats_new("uart");
 
-    xTaskCreate(uart_task, "uart_task", 8192, NULL, TASK_PRIORITY_UART, NULL);
+    config_subscribe(CONFIG_GROUP_UART_LINE, uart_config_changed, NULL);
+
+    task_create(TASK_UART, uart_task, NULL, NULL);
 }
 
 static void uart_task(void *ctx) {
-    uint8_t buffer[UART_BUFFER_SIZE];
+    // Вне стека: размер стека в реестре задач считается без буфера
+    static uint8_t buffer[UART_BUFFER_SIZE];
 
     while (true) {
+        TRACE_BEGIN(read_start);
         int32_t len = uart_read_bytes(uart_port, buffer, sizeof(buffer), pdMS_TO_TICKS(50));
         if (len < 0) {
             ESP_LOGE(TAG, "Error reading from UART");
@@ -121,9 +161,13 @@ static void uart_task(void *ctx) {
             continue;
         }
 
+        TRACE_END(TRACE_UART_READ, read_start, len);
+
         stream_stats_increment(stream_stats, len, 0);
 
+        TRACE_BEGIN(dispatch_start);
         esp_event_post(UART_EVENT_READ, len, &buffer, len, portMAX_DELAY);
+        TRACE_END(TRACE_UART_DISPATCH, dispatch_start, len);
     }
 }
 
@@ -140,26 +184,65 @@ int uart_nmea(const char *fmt, ...) {
     va_list args;
     va_start(args, fmt);
 
-    char *nmea;
-    nmea_vasprintf(&nmea, fmt, args);
-    int l = uart_write(nmea, strlen(nmea));
-    free(nmea);
+    // Предложение собирается на стеке: статусные сообщения не трогают кучу
+    char nmea[NMEA_EMIT_MAX];
+    int length = nmea_vformat(nmea, sizeof(nmea), fmt, args);
 
     va_end(args);
 
-    return l;
+    return uart_write(nmea, length);
+}
+
+int uart_pesp(nmea_pesp_t family, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+
+    char nmea[NMEA_EMIT_MAX];
+    int length = nmea_vpesp(nmea, sizeof(nmea), family, fmt, args);
+
+    va_end(args);
+
+    return uart_write(nmea, length);
 }
 
 int uart_write(char *buf, size_t len) {
     if (uart_port < 0) return 0;
     if (len == 0) return 0;
 
+    xSemaphoreTakeRecursive(uart_tx_mutex, portMAX_DELAY);
     int written = uart_write_bytes(uart_port, buf, len);
+    xSemaphoreGiveRecursive(uart_tx_mutex);
     if (written < 0) return written;
 
     stream_stats_increment(stream_stats, 0, len);
 
+    // Событие публикуется вне арбитра: обработчики могут сами писать в UART
     esp_event_post(UART_EVENT_WRITE, len, buf, len, portMAX_DELAY);
 
     return written;
 }
+
+/// Отправка команды приёмнику одной транзакцией (команда + CRLF)
+/// @param command Текст команды без завершающего перевода строки
+/// @return Количество записанных байт или отрицательное значение при ошибке
+int uart_write_command(const char *command) {
+    if (uart_port < 0) return 0;
+
+    size_t len = strlen(command);
+
+    xSemaphoreTakeRecursive(uart_tx_mutex, portMAX_DELAY);
+    int written = uart_write_bytes(uart_port, command, len);
+    if (written >= 0) {
+        int crlf = uart_write_bytes(uart_port, "\r\n", 2);
+        written = crlf < 0 ? crlf : written + crlf;
+    }
+    xSemaphoreGiveRecursive(uart_tx_mutex);
+    if (written < 0) return written;
+
+    stream_stats_increment(stream_stats, 0, len + 2);
+
+    if (len > 0) esp_event_post(UART_EVENT_WRITE, len, command, len, portMAX_DELAY);
+    esp_event_post(UART_EVENT_WRITE, 2, "\r\n", 2, portMAX_DELAY);
+
+    return written;
+}
@@ -24,13 +24,6 @@
 
 #include "util.h"
 
-void destroy_socket(int *socket) {
-    if (*socket < 0) return;
-    shutdown(*socket, SHUT_RDWR);
-    close(*socket);
-    *socket = -1;
-}
-
 // Include space for port
 static char addr_str[INET6_ADDRSTRLEN + 2 + 6 + 1];
 
@@ -76,89 +69,6 @@ char *sockaddrtostr(struct sockaddr *a) {
     return addr_str;
 }
 
-char *extract_http_header(const char *buffer, const char *key) {
-    // Need space for key, at least 1 character, and newline
-    if (strlen(key) + 2 > strlen(buffer)) return NULL;
-
-    // Cheap search ignores potential problems where searched key is suffix of another longer key
-    char *start = strcasestr(buffer, key);
-    if (!start) return NULL;
-    start += strlen(key);
-
-    char *end = strstr(start, "\r\n");
-    if (!end) return NULL;
-
-    // Trim whitespace at start and end
-    while (isspace((unsigned char) *start) && start < end) start++;
-    while (isspace((unsigned char) *(end - 1)) && start < end) end--;
-
-    int len = (int) (end - start);
-    if (len == 0) return NULL;
-
-    char *header_value = malloc(len + 1);
-    if (header_value == NULL) return NULL;
-
-    memcpy(header_value, start, len);
-    header_value[len] = '\0';
-    return header_value;
-}
-
-int connect_socket(char *host, int port, int socktype) {
-    int err;
-    struct addrinfo addr_hints;
-    struct addrinfo *addr_results;
-
-    // Obtain address(es) matching host/port
-    memset(&addr_hints, 0, sizeof(struct addrinfo));
-    addr_hints.ai_family = AF_UNSPEC;
-    addr_hints.ai_socktype = socktype;
-    addr_hints.ai_flags = AI_NUMERICSERV;
-    addr_hints.ai_protocol = 0;
-
-    char port_string[6];
-    snprintf(port_string, sizeof(port_string), "%u", port);
-    err = getaddrinfo(host, port_string, &addr_hints, &addr_results);
-    if (err < 0) return CONNECT_SOCKET_ERROR_RESOLVE;
-
-    int sock = -1;
-
-    // Try all resolved hosts
-    for (struct addrinfo *addr_result = addr_results; addr_result != NULL; addr_result = addr_result->ai_next) {
-        sock = socket(addr_result->ai_family, addr_result->ai_socktype, addr_result->ai_protocol);
-        if (sock < 0) continue;
-
-        if (connect(sock, addr_result->ai_addr, addr_result->ai_addrlen) == 0) break;
-
-        close(sock);
-
-        sock = -1;
-    }
-
-    freeaddrinfo(addr_results);
-
-    if (sock < 0) return CONNECT_SOCKET_ERROR_CONNECT;
-
-    // Read/write timeouts
-    struct timeval timeout;
-    timeout.tv_sec = 10;
-    timeout.tv_usec = 0;
-    err = setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (char *)&timeout, sizeof(timeout));
-    if (err != 0) goto _opts_error;
-    err = setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, (char *)&timeout, sizeof(timeout));
-    if (err != 0) goto _opts_error;
-
-    // Reuse address
-    int reuse = 1;
-    err = setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
-    if (err != 0) goto _opts_error;
-
-    return sock;
-
-    _opts_error:
-    close(sock);
-    return CONNECT_SOCKET_ERROR_OPTS;
-}
-
 char *http_auth_basic_header(const char *username, const char *password) {
     int out;
     char *user_info = NULL;
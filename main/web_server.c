@@ -21,19 +21,34 @@
 #include <cJSON.h>
 #include <sys/param.h>
 #include <sys/stat.h>
+#include <time.h>
+#include <math.h>
 #include <dirent.h>
 #include <esp_vfs.h>
 #include <esp_spiffs.h>
 #include <lwip/apps/mdns.h>
 #include <config.h>
+#include <config_form.h>
+#include <config_transfer.h>
 #include <log.h>
+#include <log_persist.h>
 #include <core_dump.h>
 #include <util.h>
 #include <lwip/inet.h>
 #include <driver/uart.h>
 #include <esp_ota_ops.h>
 #include <esp_wifi_ap_get_sta_list.h>
+#include <heap_diag.h>
 #include <stream_stats.h>
+#include <task_monitor.h>
+#include <event_journal.h>
+#include <trace.h>
+#include <replay.h>
+#include <tasks.h>
+#include <gnss.h>
+#include <receiver.h>
+#include <survey.h>
+#include <station.h>
 #ifdef CONFIG_IDF_TARGET_ESP32
 #include <esp32/rom/crc.h>
 #elif defined(CONFIG_IDF_TARGET_ESP32C3)
@@ -47,7 +62,10 @@
 #endif
 #include <lwip/sockets.h>
 #include <esp_timer.h>
+#include <freertos/semphr.h>
 #include "web_server.h"
+#include "web_terminal.h"
+#include "uart.h"
 
 // Max length a file path can have on storage
 #define FILE_PATH_MAX (ESP_VFS_PATH_MAX + CONFIG_SPIFFS_OBJ_NAME_LEN)
@@ -57,6 +75,8 @@
 #define WWW_PARTITION_LABEL "www"
 #define BUFFER_SIZE 2048
 
+#define WIFI_SCAN_CACHE_TTL 30000000 // Возраст результатов сканирования до автоматического обновления (мкс)
+
 static const char *TAG = "WEB";
 
 static char *buffer;
@@ -67,6 +87,8 @@ enum auth_method {
     AUTH_METHOD_BASIC = 2
 };
 
+// Меняются наблюдателем CONFIG_GROUP_ADMIN, заголовок сравнивается под auth_mutex
+static SemaphoreHandle_t auth_mutex;
 static char *basic_authentication;
 static enum auth_method auth_method;
 
@@ -193,23 +215,44 @@ static esp_err_t json_response(httpd_req_t *req, cJSON *root) {
     return ESP_OK;
 }
 
-static esp_err_t basic_auth(httpd_req_t *req) {
+// For responses that may not fit the shared buffer
+static esp_err_t json_response_alloc(httpd_req_t *req, cJSON *root) {
+    char *json = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    if (json == NULL) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    esp_err_t err = httpd_resp_sendstr(req, json);
+    free(json);
+
+    return err;
+}
+
+static bool basic_auth_valid(httpd_req_t *req) {
     int authorization_length = httpd_req_get_hdr_value_len(req, "Authorization") + 1;
-    if (authorization_length == 0) goto _auth_required;
+    if (authorization_length == 1) return false;
 
     char *authorization_header = malloc(authorization_length);
     if (!authorization_header) {
         ESP_LOGE(TAG, "Failed to allocate memory for authorization header");
-        goto _auth_required;
+        return false;
     }
     httpd_req_get_hdr_value_str(req, "Authorization", authorization_header, authorization_length);
 
-    bool authenticated = strcasecmp(basic_authentication, authorization_header) == 0;
+    xSemaphoreTake(auth_mutex, portMAX_DELAY);
+    bool authenticated = basic_authentication != NULL && strcasecmp(basic_authentication, authorization_header) == 0;
+    xSemaphoreGive(auth_mutex);
     free(authorization_header);
 
-    if (authenticated) return ESP_OK;
+    return authenticated;
+}
+
+static esp_err_t basic_auth(httpd_req_t *req) {
+    if (basic_auth_valid(req)) return ESP_OK;
 
-    _auth_required:
     httpd_resp_set_hdr(req, "WWW-Authenticate", "Basic realm=\"ESP32 XBee Config\"");
     httpd_resp_set_status(req, "401"); // Unauthorized
     char *unauthorized = "401 Unauthorized - Incorrect or no password provided";
@@ -217,7 +260,7 @@ static esp_err_t basic_auth(httpd_req_t *req) {
     return ESP_FAIL;
 }
 
-static esp_err_t hotspot_auth(httpd_req_t *req) {
+static bool hotspot_auth_valid(httpd_req_t *req) {
     int sock = httpd_req_to_sockfd(req);
 
     struct sockaddr_in6 client_addr;
@@ -233,10 +276,15 @@ static esp_err_t hotspot_auth(httpd_req_t *req) {
 
     // TODO: Correctly read IPv4?
     for (int i = 0; i < esp_netif_ap_sta_list.num; i++) {
-        if (esp_netif_ap_sta_list.sta[i].ip.addr == client_addr.sin6_addr.un.u32_addr[3]) return ESP_OK;
+        if (esp_netif_ap_sta_list.sta[i].ip.addr == client_addr.sin6_addr.un.u32_addr[3]) return true;
     }
 
-    //_auth_error:
+    return false;
+}
+
+static esp_err_t hotspot_auth(httpd_req_t *req) {
+    if (hotspot_auth_valid(req)) return ESP_OK;
+
     httpd_resp_set_status(req, "401"); // Unauthorized
     char *unauthorized = "401 Unauthorized - Configured to only accept connections from hotspot devices";
     httpd_resp_send(req, unauthorized, strlen(unauthorized));
@@ -249,6 +297,13 @@ static esp_err_t check_auth(httpd_req_t *req) {
     return ESP_OK;
 }
 
+// Проверка без отправки ответа - для WebSocket, где рукопожатие уже выполнено
+static bool check_auth_valid(httpd_req_t *req) {
+    if (auth_method == AUTH_METHOD_HOTSPOT) return hotspot_auth_valid(req);
+    if (auth_method == AUTH_METHOD_BASIC) return basic_auth_valid(req);
+    return true;
+}
+
 static esp_err_t log_get_handler(httpd_req_t *req) {
     if (check_auth(req) == ESP_FAIL) return ESP_FAIL;
 
@@ -269,6 +324,28 @@ static esp_err_t log_get_handler(httpd_req_t *req) {
     return ESP_OK;
 }
 
+static esp_err_t log_previous_get_handler(httpd_req_t *req) {
+    if (check_auth(req) == ESP_FAIL) return ESP_FAIL;
+
+    size_t length;
+    const char *source;
+    const char *previous = log_persist_previous(&length, &source);
+    if (previous == NULL) {
+        httpd_resp_send_404(req);
+        return ESP_OK;
+    }
+
+    httpd_resp_set_type(req, "text/plain");
+
+    char header[96];
+    snprintf(header, sizeof(header), "Reset reason: %s\nSource: %s\n\n", log_persist_reset_reason(), source);
+    httpd_resp_send_chunk(req, header, HTTPD_RESP_USE_STRLEN);
+    httpd_resp_send_chunk(req, previous, length);
+    httpd_resp_send_chunk(req, NULL, 0);
+
+    return ESP_OK;
+}
+
 static esp_err_t core_dump_get_handler(httpd_req_t *req) {
     if (check_auth(req) == ESP_FAIL) return ESP_FAIL;
 
@@ -323,6 +400,113 @@ static esp_err_t heap_info_get_handler(httpd_req_t *req) {
     cJSON_AddNumberToObject(root, "free_blocks", info.free_blocks);
     cJSON_AddNumberToObject(root, "total_blocks", info.total_blocks);
 
+    heap_diag_status_t status;
+    heap_diag_status(&status);
+    cJSON_AddNumberToObject(root, "fragmentation", (int) (status.fragmentation * 1000) / 1000.0);
+    cJSON_AddNumberToObject(root, "fragmentation_trend", (int) (status.fragmentation_trend * 10000) / 10000.0);
+    cJSON_AddNumberToObject(root, "free_trend", status.free_trend);
+
+    // Free and largest block over the last day, oldest first
+    heap_diag_sample_t *samples = malloc(HEAP_DIAG_SAMPLES * sizeof(heap_diag_sample_t));
+    if (samples != NULL) {
+        size_t count = heap_diag_history(samples, HEAP_DIAG_SAMPLES);
+
+        cJSON *history = cJSON_AddObjectToObject(root, "history");
+        cJSON_AddNumberToObject(history, "period", HEAP_DIAG_PERIOD_MS / 1000);
+        cJSON *history_free = cJSON_AddArrayToObject(history, "free");
+        cJSON *history_largest = cJSON_AddArrayToObject(history, "largest");
+        for (size_t i = 0; i < count; i++) {
+            cJSON_AddItemToArray(history_free, cJSON_CreateNumber(samples[i].free * HEAP_DIAG_UNIT));
+            cJSON_AddItemToArray(history_largest, cJSON_CreateNumber(samples[i].largest * HEAP_DIAG_UNIT));
+        }
+
+        free(samples);
+    }
+
+    if (heap_diag_tasks_available()) {
+        heap_diag_task_t *tasks = malloc(HEAP_DIAG_TASKS * sizeof(heap_diag_task_t));
+        if (tasks != NULL) {
+            size_t count = heap_diag_tasks(tasks, HEAP_DIAG_TASKS);
+
+            cJSON *list = cJSON_AddArrayToObject(root, "tasks");
+            for (size_t i = 0; i < count; i++) {
+                cJSON *task = cJSON_CreateObject();
+                cJSON_AddStringToObject(task, "name", tasks[i].name);
+                cJSON_AddNumberToObject(task, "bytes", tasks[i].bytes);
+                cJSON_AddNumberToObject(task, "blocks", tasks[i].blocks);
+                cJSON_AddItemToArray(list, task);
+            }
+
+            free(tasks);
+        }
+    }
+
+    return json_response_alloc(req, root);
+}
+
+static esp_err_t heap_trace_get_handler(httpd_req_t *req) {
+    if (check_auth(req) == ESP_FAIL) return ESP_FAIL;
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddBoolToObject(root, "available", heap_diag_trace_available());
+    cJSON_AddBoolToObject(root, "running", heap_diag_trace_running());
+
+    heap_diag_site_t sites[HEAP_DIAG_TRACE_SITES];
+    size_t records;
+    bool full;
+    size_t count = heap_diag_trace_sites(sites, HEAP_DIAG_TRACE_SITES, &records, &full);
+    cJSON_AddNumberToObject(root, "records", records);
+    cJSON_AddBoolToObject(root, "full", full);
+
+    // Outstanding allocations per call site, resolve with addr2line against the firmware ELF
+    cJSON *list = cJSON_AddArrayToObject(root, "sites");
+    for (size_t i = 0; i < count; i++) {
+        char pc[12];
+        snprintf(pc, sizeof(pc), "0x%08x", (unsigned int) sites[i].pc);
+
+        cJSON *site = cJSON_CreateObject();
+        cJSON_AddStringToObject(site, "pc", sites[i].pc != 0 ? pc : "other");
+        cJSON_AddNumberToObject(site, "count", sites[i].count);
+        cJSON_AddNumberToObject(site, "bytes", sites[i].bytes);
+        cJSON_AddItemToArray(list, site);
+    }
+
+    return json_response_alloc(req, root);
+}
+
+static esp_err_t heap_trace_post_handler(httpd_req_t *req) {
+    if (check_auth(req) == ESP_FAIL) return ESP_FAIL;
+
+    int ret = httpd_req_recv(req, buffer, BUFFER_SIZE - 1);
+    if (ret <= 0) {
+        if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+            httpd_resp_send_408(req);
+        }
+
+        return ESP_FAIL;
+    }
+
+    buffer[ret] = '\0';
+
+    cJSON *root = cJSON_Parse(buffer);
+    cJSON *enable = cJSON_GetObjectItem(root, "enable");
+    if (!cJSON_IsBool(enable)) {
+        cJSON_Delete(root);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid JSON");
+        return ESP_FAIL;
+    }
+
+    esp_err_t err = cJSON_IsTrue(enable) ? heap_diag_trace_start() : heap_diag_trace_stop();
+    cJSON_Delete(root);
+
+    if (err != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, esp_err_to_name(err));
+        return ESP_FAIL;
+    }
+
+    root = cJSON_CreateObject();
+    cJSON_AddBoolToObject(root, "running", heap_diag_trace_running());
+
     return json_response(req, root);
 }
 
@@ -568,240 +752,257 @@ static esp_err_t config_post_handler(httpd_req_t *req) {
 
     int config_item_count;
     const config_item_t *config_items = config_items_get(&config_item_count);
+    config_write_begin();
     for (int i = 0; i < config_item_count; i++) {
         config_item_t item = config_items[i];
 
         if (cJSON_HasObjectItem(root, item.key)) {
             cJSON *entry = cJSON_GetObjectItem(root, item.key);
 
-            size_t length = 0;
-            if (cJSON_IsString(entry)) {
-                length = strlen(entry->valuestring);
-
-                // Ignore empty primitives
-                if (length == 0 && item.type != CONFIG_ITEM_TYPE_BLOB && item.type != CONFIG_ITEM_TYPE_STRING) continue;
-
-                // Ignore unchanged values
-                if (strcmp(entry->valuestring, CONFIG_VALUE_UNCHANGED) == 0) continue;
-            }
-
-            // TODO: Cleanup
-            esp_err_t err;
-            if (item.type > CONFIG_ITEM_TYPE_MAX) {
-                err = ESP_ERR_INVALID_ARG;
-            } else if (item.type == CONFIG_ITEM_TYPE_STRING) {
-                err = config_set_str(item.key, entry->valuestring);
-            } else if (item.type == CONFIG_ITEM_TYPE_BLOB) {
-                err = config_set_blob(item.key, entry->valuestring, length);
-            } else if (item.type == CONFIG_ITEM_TYPE_COLOR) {
-                bool is_black = strcmp(entry->valuestring, "#000000") == 0;
-                config_color_t color;
-                color.rgba = strtoul(entry->valuestring + 1, NULL, 16) << 8u;
-
-                if (!is_black && color.rgba == 0) {
-                    err = ESP_ERR_INVALID_ARG;
-                } else {
-                    // Set alpha to default
-                    if (!is_black) color.values.alpha = item.def.color.values.alpha;
-
-                    err = config_set_color(item.key, color);
-                }
-            } else if (item.type == CONFIG_ITEM_TYPE_IP) {
-                uint8_t a[4];
-
-                if (!cJSON_IsArray(entry) || cJSON_GetArraySize(entry) != 4) {
-                    err = ESP_ERR_INVALID_ARG;
-                } else {
-                    for (int b = 0; b < 4; b++) {
-                        a[b] = (uint8_t) strtoul(cJSON_GetArrayItem(entry, b)->valuestring, NULL, 10);
-                    }
-;
-                    uint32_t ip = esp_netif_htonl(esp_netif_ip4_makeu32(a[0], a[1], a[2], a[3]));
-                    err = config_set_u32(item.key, ip);
-                }
-            } else {
-                bool is_zero = strcmp(entry->valuestring, "0") == 0 || strcmp(entry->valuestring, "0.0") == 0;
-                int64_t int64 = strtol(entry->valuestring, NULL, 10);
-                uint64_t uint64 = strtoul(entry->valuestring, NULL, 10);
-
-                if (!is_zero && (int64 == 0 || uint64 == 0)) {
-                    err = ESP_ERR_INVALID_ARG;
-                } else {
-                    switch (item.type) {
-                        case CONFIG_ITEM_TYPE_BOOL:
-                        case CONFIG_ITEM_TYPE_INT8:
-                        case CONFIG_ITEM_TYPE_INT16:
-                        case CONFIG_ITEM_TYPE_INT32:
-                        case CONFIG_ITEM_TYPE_INT64:
-                            err = config_set(&item, &int64);
-                            break;
-                        case CONFIG_ITEM_TYPE_UINT8:
-                        case CONFIG_ITEM_TYPE_UINT16:
-                        case CONFIG_ITEM_TYPE_UINT32:
-                        case CONFIG_ITEM_TYPE_UINT64:
-                            err = config_set(&item, &uint64);
-                            break;
-                        default:
-                            err = ESP_FAIL;
-                            break;
-                    }
-                }
-            }
+            config_item_value_t value;
+            esp_err_t err = config_form_value(&item, entry, &value);
+            if (err == ESP_ERR_NOT_FOUND) continue;
+            if (err == ESP_OK) err = config_set_value(&item, &value);
 
             if (err != ESP_OK) {
-                ESP_LOGE(TAG, "Error setting %s = %s: %d - %s", item.key, entry->valuestring, err, esp_err_to_name(err));
+                ESP_LOGE(TAG, "Error setting %s: %d - %s", item.key, err, esp_err_to_name(err));
             }
         }
     }
 
     cJSON_Delete(root);
 
-    config_commit();
-    config_restart();
+    // Restart only if a changed group can't be applied live by its subscribers
+    bool restart = true;
+    config_commit_live(&restart);
+    config_write_end();
+    if (restart) config_restart();
 
     root = cJSON_CreateObject();
     cJSON_AddBoolToObject(root, "success", true);
+    cJSON_AddBoolToObject(root, "restart", restart);
 
     return json_response(req, root);
 }
 
-static esp_err_t status_get_handler(httpd_req_t *req) {
-    if (check_auth(req) == ESP_FAIL) return ESP_FAIL;
+#define CONFIG_PASSPHRASE_HEADER "X-Config-Passphrase"
 
-    cJSON *root = cJSON_CreateObject();
+static void config_passphrase_get(httpd_req_t *req, char *passphrase, size_t length) {
+    passphrase[0] = '\0';
+    if (httpd_req_get_hdr_value_len(req, CONFIG_PASSPHRASE_HEADER) == 0) return;
+    httpd_req_get_hdr_value_str(req, CONFIG_PASSPHRASE_HEADER, passphrase, length);
+}
 
-    // Uptime
-    cJSON_AddNumberToObject(root, "uptime", (int) ((double) esp_timer_get_time() / 1000000));
+/// Export or import handed to a worker task through an async request: with a passphrase,
+/// PBKDF2 runs for seconds and would hold up every other client of the httpd task
+typedef struct config_transfer_job {
+    httpd_req_t *req;
+    bool import;
+    bool binary;
+    char *data;
+    size_t length;
+    char passphrase[65];
+} config_transfer_job_t;
 
-    // Heap
-    cJSON *heap = cJSON_AddObjectToObject(root, "heap");
-    cJSON_AddNumberToObject(heap, "total", heap_caps_get_total_size(MALLOC_CAP_8BIT));
-    cJSON_AddNumberToObject(heap, "free", heap_caps_get_free_size(MALLOC_CAP_8BIT));
+static bool config_transfer_busy = false;
 
-    // Streams
-    cJSON *streams = cJSON_AddObjectToObject(root, "streams");
-    stream_stats_values_t values;
-    for (stream_stats_handle_t stats = stream_stats_first(); stats != NULL; stats = stream_stats_next(stats)) {
-        stream_stats_values(stats, &values);
+static void config_transfer_job_free(config_transfer_job_t *job) {
+    memset(job->passphrase, 0, sizeof(job->passphrase));
+    free(job->data);
+    free(job);
+}
 
-        cJSON *stream = cJSON_AddObjectToObject(streams, values.name);
-        cJSON *total = cJSON_AddObjectToObject(stream, "total");
-        cJSON_AddNumberToObject(total, "in", values.total_in);
-        cJSON_AddNumberToObject(total, "out", values.total_out);
-        cJSON *rate = cJSON_AddObjectToObject(stream, "rate");
-        cJSON_AddNumberToObject(rate, "in", values.rate_in);
-        cJSON_AddNumberToObject(rate, "out", values.rate_out);
+static esp_err_t config_export_send(httpd_req_t *req, bool binary, const char *passphrase) {
+    uint8_t *data = NULL;
+    size_t length = 0;
+    if (binary) {
+        if (config_export_binary(passphrase, &data, &length) != ESP_OK) data = NULL;
+    } else {
+        cJSON *root = config_export_json(passphrase);
+        data = root != NULL ? (uint8_t *) cJSON_Print(root) : NULL;
+        length = data != NULL ? strlen((char *) data) : 0;
+        cJSON_Delete(root);
     }
 
-    // Sockets
-    cJSON *sockets = cJSON_AddArrayToObject(root, "sockets");
-    for (int s = LWIP_SOCKET_OFFSET; s < LWIP_SOCKET_OFFSET + CONFIG_LWIP_MAX_SOCKETS; s++) {
-        int err;
+    if (data == NULL) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to export configuration");
+        return ESP_FAIL;
+    }
 
-        int socktype;
-        socklen_t socktype_len = sizeof(socktype);
-        err = getsockopt(s, SOL_SOCKET, SO_TYPE, &socktype, &socktype_len);
-        if (err < 0) continue;
+    httpd_resp_set_type(req, binary ? "application/octet-stream" : "application/json");
+    httpd_resp_set_hdr(req, "Content-Disposition", binary ?
+            "attachment; filename=\"esp32_ntrip_config.bin\"" : "attachment; filename=\"esp32_ntrip_config.json\"");
+    esp_err_t err = httpd_resp_send(req, (const char *) data, length);
 
-        cJSON *socket = cJSON_CreateObject();
+    free(data);
+    return err;
+}
 
-        cJSON_AddStringToObject(socket, "type", SOCKTYPE_NAME(socktype));
+static esp_err_t config_import_apply(httpd_req_t *req, const char *data, size_t length, const char *passphrase) {
+    // Binary and JSON formats are told apart by the magic, not the content type
+    int applied = 0;
+    bool restart = false;
+    esp_err_t err;
+    if (length >= 4 && memcmp(data, CONFIG_TRANSFER_MAGIC, 4) == 0) {
+        err = config_import_binary((const uint8_t *) data, length, passphrase, &applied, &restart);
+    } else {
+        cJSON *root = cJSON_Parse(data);
+        err = root != NULL ? config_import_json(root, passphrase, &applied, &restart) : ESP_ERR_INVALID_ARG;
+        cJSON_Delete(root);
+    }
 
-        struct sockaddr_in6 addr;
-        socklen_t socklen = sizeof(addr);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Configuration import failed: %d - %s", err, esp_err_to_name(err));
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, esp_err_to_name(err));
+        return ESP_FAIL;
+    }
 
-        err = getsockname(s, (struct sockaddr *)&addr, &socklen);
-        if (err == 0) cJSON_AddStringToObject(socket, "local", sockaddrtostr((struct sockaddr *) &addr));
+    if (restart) config_restart();
 
-        err = getpeername(s, (struct sockaddr *)&addr, &socklen);
-        if (err == 0) cJSON_AddStringToObject(socket, "peer", sockaddrtostr((struct sockaddr *) &addr));
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddBoolToObject(root, "success", true);
+    cJSON_AddNumberToObject(root, "applied", applied);
+    cJSON_AddBoolToObject(root, "restart", restart);
 
-        cJSON_AddItemToArray(sockets, socket);
+    // Runs on config_transfer_task: the shared buffer belongs to the httpd task
+    return json_response_alloc(req, root);
+}
+
+static void config_transfer_task(void *ctx) {
+    config_transfer_job_t *job = ctx;
+
+    if (job->import) {
+        config_import_apply(job->req, job->data, job->length, job->passphrase);
+    } else {
+        config_export_send(job->req, job->binary, job->passphrase);
     }
 
-    // WiFi
-    wifi_ap_status_t ap_status;
-    wifi_sta_status_t sta_status;
+    httpd_req_async_handler_complete(job->req);
+    config_transfer_job_free(job);
+    __atomic_store_n(&config_transfer_busy, false, __ATOMIC_RELEASE);
 
-    wifi_ap_status(&ap_status);
-    wifi_sta_status(&sta_status);
+    vTaskDelete(NULL);
+}
 
-    cJSON *wifi = cJSON_AddObjectToObject(root, "wifi");
+/// Takes ownership of the job; one transfer runs at a time
+static esp_err_t config_transfer_start(httpd_req_t *req, config_transfer_job_t *job) {
+    if (__atomic_exchange_n(&config_transfer_busy, true, __ATOMIC_ACQUIRE)) {
+        config_transfer_job_free(job);
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_send(req, "Configuration transfer in progress", HTTPD_RESP_USE_STRLEN);
+        return ESP_FAIL;
+    }
 
-    cJSON *ap = cJSON_AddObjectToObject(wifi, "ap");
-    cJSON_AddBoolToObject(ap, "active", ap_status.active);
-    if (ap_status.active) {
-        cJSON_AddStringToObject(ap, "ssid", (char *) ap_status.ssid);
-        cJSON_AddStringToObject(ap, "authmode", wifi_auth_mode_name(ap_status.authmode));
-        cJSON_AddNumberToObject(ap, "devices", ap_status.devices);
+    if (httpd_req_async_handler_begin(req, &job->req) != ESP_OK) {
+        config_transfer_job_free(job);
+        __atomic_store_n(&config_transfer_busy, false, __ATOMIC_RELEASE);
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
 
-        char ip[40];
-        snprintf(ip, sizeof(ip), IPSTR, IP2STR(&ap_status.ip4_addr));
-        cJSON_AddStringToObject(ap, "ip4", ip);
-        snprintf(ip, sizeof(ip), IPV6STR, IPV62STR(ap_status.ip6_addr));
-        cJSON_AddStringToObject(ap, "ip6", ip);
+    if (task_create(TASK_CONFIG_TRANSFER, config_transfer_task, job, NULL) != ESP_OK) {
+        httpd_resp_send_500(job->req);
+        httpd_req_async_handler_complete(job->req);
+        config_transfer_job_free(job);
+        __atomic_store_n(&config_transfer_busy, false, __ATOMIC_RELEASE);
+        return ESP_FAIL;
     }
 
-    cJSON *sta = cJSON_AddObjectToObject(wifi, "sta");
-    cJSON_AddBoolToObject(sta, "active", sta_status.active);
-    if (sta_status.active) {
-        cJSON_AddBoolToObject(sta, "connected", sta_status.connected);
-        if (sta_status.connected) {
-            cJSON_AddStringToObject(sta, "ssid", (char *) sta_status.ssid);
-            cJSON_AddStringToObject(sta, "authmode", wifi_auth_mode_name(sta_status.authmode));
-            cJSON_AddNumberToObject(sta, "rssi", sta_status.rssi);
+    return ESP_OK;
+}
 
-            char ip[40];
-            snprintf(ip, sizeof(ip), IPSTR, IP2STR(&sta_status.ip4_addr));
-            cJSON_AddStringToObject(sta, "ip4", ip);
-            snprintf(ip, sizeof(ip), IPV6STR, IPV62STR(sta_status.ip6_addr));
-            cJSON_AddStringToObject(sta, "ip6", ip);
-        }
+static esp_err_t config_export_get_handler(httpd_req_t *req) {
+    if (check_auth(req) == ESP_FAIL) return ESP_FAIL;
+
+    config_transfer_job_t *job = calloc(1, sizeof(config_transfer_job_t));
+    if (job == NULL) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
     }
 
-    return json_response(req, root);
+    char query[32];
+    char format[8] = "json";
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        httpd_query_key_value(query, "format", format, sizeof(format));
+    }
+    job->binary = strcmp(format, "bin") == 0;
+
+    // Secrets are only exported when a passphrase to encrypt them is supplied
+    config_passphrase_get(req, job->passphrase, sizeof(job->passphrase));
+
+    return config_transfer_start(req, job);
 }
 
-static esp_err_t wifi_scan_get_handler(httpd_req_t *req) {
+static esp_err_t config_import_post_handler(httpd_req_t *req) {
     if (check_auth(req) == ESP_FAIL) return ESP_FAIL;
 
-    uint16_t ap_count;
-    wifi_ap_record_t *ap_records =  wifi_scan(&ap_count);
+    if (req->content_len == 0 || req->content_len > CONFIG_TRANSFER_MAX_SIZE) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid configuration size");
+        return ESP_FAIL;
+    }
 
-    cJSON *root = cJSON_CreateArray();
-    for (int i = 0; i < ap_count; i++) {
-        wifi_ap_record_t *ap_record = &ap_records[i];
-        cJSON *ap = cJSON_CreateObject();
-        cJSON_AddItemToArray(root, ap);
-        cJSON_AddStringToObject(ap, "ssid", (char *) ap_record->ssid);
-        cJSON_AddNumberToObject(ap, "rssi", ap_record->rssi);
-        cJSON_AddStringToObject(ap, "authmode", wifi_auth_mode_name(ap_record->authmode));
+    config_transfer_job_t *job = calloc(1, sizeof(config_transfer_job_t));
+    char *data = malloc(req->content_len + 1);
+    if (job == NULL || data == NULL) {
+        free(job);
+        free(data);
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    job->import = true;
+    job->data = data;
+
+    size_t received = 0;
+    while (received < req->content_len) {
+        int ret = httpd_req_recv(req, data + received, req->content_len - received);
+        if (ret == HTTPD_SOCK_ERR_TIMEOUT) continue;
+        if (ret <= 0) {
+            config_transfer_job_free(job);
+            return ESP_FAIL;
+        }
+        received += ret;
     }
+    data[received] = '\0';
+    job->length = received;
 
-    free(ap_records);
+    config_passphrase_get(req, job->passphrase, sizeof(job->passphrase));
 
-    return json_response(req, root);
+    return config_transfer_start(req, job);
 }
 
-static esp_err_t sd_log_status_handler(httpd_req_t *req) {
+static esp_err_t profiles_get_handler(httpd_req_t *req) {
     if (check_auth(req) == ESP_FAIL) return ESP_FAIL;
 
     cJSON *root = cJSON_CreateObject();
-    bool enabled = config_get_bool1(CONF_ITEM(KEY_CONFIG_SD_LOGGING_ACTIVE));
-    cJSON_AddBoolToObject(root, "enabled", enabled);
-    
+    cJSON_AddNumberToObject(root, "active", config_profile_active());
+    cJSON_AddNumberToObject(root, "max", CONFIG_PROFILE_MAX);
+
+    cJSON *profiles = cJSON_AddArrayToObject(root, "profiles");
+    for (int i = 0; i < CONFIG_PROFILE_MAX; i++) {
+        char name[CONFIG_PROFILE_NAME_MAX];
+        if (config_profile_name(i, name, sizeof(name)) != ESP_OK) continue;
+
+        cJSON *profile = cJSON_CreateObject();
+        cJSON_AddNumberToObject(profile, "id", i);
+        cJSON_AddStringToObject(profile, "name", name);
+        cJSON_AddItemToArray(profiles, profile);
+    }
+
     return json_response(req, root);
 }
 
-static esp_err_t sd_log_toggle_handler(httpd_req_t *req) {
+static esp_err_t profiles_post_handler(httpd_req_t *req) {
     if (check_auth(req) == ESP_FAIL) return ESP_FAIL;
 
-    char buffer[256];
-    int ret = httpd_req_recv(req, buffer, sizeof(buffer) - 1);
+    int ret = httpd_req_recv(req, buffer, BUFFER_SIZE - 1);
     if (ret <= 0) {
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Failed to receive data");
+        if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+            httpd_resp_send_408(req);
+        }
+
         return ESP_FAIL;
     }
+
     buffer[ret] = '\0';
 
     cJSON *root = cJSON_Parse(buffer);
@@ -810,72 +1011,1049 @@ static esp_err_t sd_log_toggle_handler(httpd_req_t *req) {
         return ESP_FAIL;
     }
 
-    cJSON *enabled_item = cJSON_GetObjectItem(root, "enabled");
-    if (!enabled_item || !cJSON_IsBool(enabled_item)) {
-        cJSON_Delete(root);
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing enabled field");
+    cJSON *action = cJSON_GetObjectItem(root, "action");
+    cJSON *id = cJSON_GetObjectItem(root, "id");
+    cJSON *name = cJSON_GetObjectItem(root, "name");
+    cJSON *source = cJSON_GetObjectItem(root, "source");
+
+    esp_err_t err = ESP_ERR_INVALID_ARG;
+    bool restart = false;
+    if (cJSON_IsString(action) && cJSON_IsNumber(id)) {
+        const char *name_value = cJSON_IsString(name) ? name->valuestring : "";
+
+        if (strcmp(action->valuestring, "activate") == 0) {
+            err = config_profile_activate(id->valueint, &restart);
+        } else if (strcmp(action->valuestring, "create") == 0) {
+            // Copy of the active profile unless another source (or -1 for defaults) is given
+            int source_id = cJSON_IsNumber(source) ? source->valueint : config_profile_active();
+            err = config_profile_create(id->valueint, name_value, source_id);
+        } else if (strcmp(action->valuestring, "rename") == 0) {
+            err = config_profile_rename(id->valueint, name_value);
+        } else if (strcmp(action->valuestring, "delete") == 0) {
+            err = config_profile_delete(id->valueint);
+        }
+    }
+
+    cJSON_Delete(root);
+
+    if (err != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, esp_err_to_name(err));
         return ESP_FAIL;
     }
 
-    bool enabled = cJSON_IsTrue(enabled_item);
-    config_set_bool1(KEY_CONFIG_SD_LOGGING_ACTIVE, enabled);
-    config_commit();
+    if (restart) config_restart();
 
-    cJSON_Delete(root);
+    root = cJSON_CreateObject();
+    cJSON_AddBoolToObject(root, "success", true);
+    cJSON_AddBoolToObject(root, "restart", restart);
 
-    cJSON *resp = cJSON_CreateObject();
-    cJSON_AddStringToObject(resp, "status", "ok");
-    cJSON_AddBoolToObject(resp, "enabled", enabled);
-    
-    return json_response(req, resp);
+    return json_response(req, root);
 }
 
-static esp_err_t serial_command_post_handler(httpd_req_t *req) {
+static esp_err_t profiles_diff_get_handler(httpd_req_t *req) {
     if (check_auth(req) == ESP_FAIL) return ESP_FAIL;
 
-    char buffer[512];
-    int ret = httpd_req_recv(req, buffer, sizeof(buffer) - 1);
-    if (ret <= 0) {
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Failed to receive data");
-        return ESP_FAIL;
+    char query[32];
+    char a_value[4] = "", b_value[4] = "";
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        httpd_query_key_value(query, "a", a_value, sizeof(a_value));
+        httpd_query_key_value(query, "b", b_value, sizeof(b_value));
     }
-    buffer[ret] = '\0';
-
-    cJSON *root = cJSON_Parse(buffer);
-    if (!root) {
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid JSON");
+    int a = strlen(a_value) > 0 ? atoi(a_value) : config_profile_active();
+    int b = atoi(b_value);
+
+    config_snapshot_t *snapshot_a = config_profile_snapshot(a);
+    config_snapshot_t *snapshot_b = config_profile_snapshot(b);
+    if (snapshot_a == NULL || snapshot_b == NULL) {
+        config_snapshot_release(snapshot_a);
+        config_snapshot_release(snapshot_b);
+        httpd_resp_send_404(req);
         return ESP_FAIL;
     }
 
-    cJSON *command = cJSON_GetObjectItem(root, "command");
-    if (!command || !cJSON_IsString(command)) {
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "a", a);
+    cJSON_AddNumberToObject(root, "b", b);
+    cJSON *changes = cJSON_AddArrayToObject(root, "changes");
+
+    for (int i = 0; i < CONFIG_ITEM_COUNT; i++) {
+        const config_item_t *item = &CONFIG_ITEMS[i];
+        const config_item_value_t *value_a = config_snapshot_value(snapshot_a, item);
+        const config_item_value_t *value_b = config_snapshot_value(snapshot_b, item);
+        if (config_value_equal(item, value_a, value_b)) continue;
+
+        cJSON *change = cJSON_CreateObject();
+        cJSON_AddStringToObject(change, "key", item->key);
+        if (item->secret) {
+            // Only report that a secret differs, never its value
+            cJSON_AddBoolToObject(change, "secret", true);
+        } else {
+            cJSON_AddItemToObject(change, "a", config_value_to_json(item, value_a));
+            cJSON_AddItemToObject(change, "b", config_value_to_json(item, value_b));
+        }
+        cJSON_AddItemToArray(changes, change);
+    }
+
+    config_snapshot_release(snapshot_a);
+    config_snapshot_release(snapshot_b);
+
+    // A full diff can exceed the shared response buffer
+    return json_response_alloc(req, root);
+}
+
+static void stream_rate_json(cJSON *parent, const char *name, uint32_t peak, const stream_stats_rate_t *window) {
+    cJSON *direction = cJSON_AddObjectToObject(parent, name);
+    cJSON_AddNumberToObject(direction, "peak", peak);
+    for (int w = 0; w < STREAM_STATS_WINDOW_COUNT; w++) {
+        cJSON *rate = cJSON_AddObjectToObject(direction, stream_stats_window_name(w));
+        cJSON_AddNumberToObject(rate, "avg", window[w].avg);
+        cJSON_AddNumberToObject(rate, "min", window[w].min);
+        cJSON_AddNumberToObject(rate, "max", window[w].max);
+    }
+}
+
+static esp_err_t streams_get_handler(httpd_req_t *req) {
+    if (check_auth(req) == ESP_FAIL) return ESP_FAIL;
+
+    cJSON *root = cJSON_CreateObject();
+    stream_stats_values_t values;
+    for (stream_stats_handle_t stats = stream_stats_first(); stats != NULL; stats = stream_stats_next(stats)) {
+        stream_stats_values(stats, &values);
+
+        cJSON *stream = cJSON_AddObjectToObject(root, values.name);
+        cJSON *total = cJSON_AddObjectToObject(stream, "total");
+        cJSON_AddNumberToObject(total, "in", values.total_in);
+        cJSON_AddNumberToObject(total, "out", values.total_out);
+        stream_rate_json(stream, "in", values.peak_in, values.window_in);
+        stream_rate_json(stream, "out", values.peak_out, values.window_out);
+    }
+
+    // All windows of every stream do not fit the shared response buffer
+    return json_response_alloc(req, root);
+}
+
+static esp_err_t history_get_handler(httpd_req_t *req) {
+    if (check_auth(req) == ESP_FAIL) return ESP_FAIL;
+
+    char query[64];
+    char stream_name[24] = "", resolution_value[8] = "", format[8] = "";
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        httpd_query_key_value(query, "stream", stream_name, sizeof(stream_name));
+        httpd_query_key_value(query, "resolution", resolution_value, sizeof(resolution_value));
+        httpd_query_key_value(query, "format", format, sizeof(format));
+    }
+
+    stream_stats_handle_t stats = stream_stats_get(stream_name);
+    stream_history_t *history = stats != NULL ? stream_stats_history(stats) : NULL;
+    if (history == NULL) {
+        httpd_resp_send_404(req);
+        return ESP_FAIL;
+    }
+
+    stream_history_resolution_t resolution = strcmp(resolution_value, "10s") == 0 ? STREAM_HISTORY_FINE : STREAM_HISTORY_COARSE;
+    size_t length = stream_history_length(resolution);
+    stream_history_sample_t *samples = malloc(length * sizeof(stream_history_sample_t));
+    if (samples == NULL) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+
+    uint32_t end_seq, end_uptime;
+    size_t count = stream_history_read(history, resolution, 0, samples, length, &end_seq, &end_uptime);
+
+    // Wall clock time of the last sample, if SNTP has synced
+    uint32_t uptime = esp_timer_get_time() / 1000000;
+    time_t now = time(NULL);
+    uint32_t end_time = now > 1577836800 ? now - (uptime - end_uptime) : 0;
+    uint16_t step = stream_history_resolution(resolution);
+
+    esp_err_t err;
+    if (strcmp(format, "csv") == 0) {
+        httpd_resp_set_type(req, "text/csv");
+        err = httpd_resp_send_chunk(req, "uptime,time,in,out\n", HTTPD_RESP_USE_STRLEN);
+
+        // Rows are batched through the shared buffer to keep the number of chunks low
+        size_t used = 0;
+        for (size_t i = 0; i < count && err == ESP_OK; i++) {
+            uint32_t age = (count - 1 - i) * step;
+            used += snprintf(buffer + used, BUFFER_SIZE - used, "%lu,%lu,%lu,%lu\n",
+                    (unsigned long) (end_uptime - age), (unsigned long) (end_time ? end_time - age : 0),
+                    (unsigned long) stream_history_decode(samples[i].in),
+                    (unsigned long) stream_history_decode(samples[i].out));
+
+            if (used > BUFFER_SIZE - 64 || i == count - 1) {
+                err = httpd_resp_send_chunk(req, buffer, used);
+                used = 0;
+            }
+        }
+        if (err == ESP_OK) err = httpd_resp_send_chunk(req, NULL, 0);
+    } else {
+        stream_history_header_t header = {
+                .magic = STREAM_HISTORY_MAGIC,
+                .version = STREAM_HISTORY_VERSION,
+                .resolution = step,
+                .end_uptime = end_uptime,
+                .end_time = end_time,
+                .count = count
+        };
+
+        httpd_resp_set_type(req, "application/octet-stream");
+        err = httpd_resp_send_chunk(req, (const char *) &header, sizeof(header));
+        if (err == ESP_OK && count > 0) err = httpd_resp_send_chunk(req, (const char *) samples, count * sizeof(stream_history_sample_t));
+        if (err == ESP_OK) err = httpd_resp_send_chunk(req, NULL, 0);
+    }
+
+    free(samples);
+
+    return err;
+}
+
+#define EVENTS_RESPONSE_MAX 64
+
+static esp_err_t events_get_handler(httpd_req_t *req) {
+    if (check_auth(req) == ESP_FAIL) return ESP_FAIL;
+
+    char query[48], since_value[12] = "", limit_value[8] = "";
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        httpd_query_key_value(query, "since", since_value, sizeof(since_value));
+        httpd_query_key_value(query, "limit", limit_value, sizeof(limit_value));
+    }
+    uint32_t seq = strtoul(since_value, NULL, 10);
+    size_t limit = strlen(limit_value) > 0 ? MIN(strtoul(limit_value, NULL, 10), EVENTS_RESPONSE_MAX) : EVENTS_RESPONSE_MAX;
+
+    event_journal_entry_t *entries = malloc(EVENTS_RESPONSE_MAX * sizeof(event_journal_entry_t));
+    if (entries == NULL) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+
+    uint32_t next;
+    size_t count = event_journal_read(&seq, entries, limit, &next);
+
+    // Записи хранят время с загрузки, абсолютное время только после синхронизации
+    uint32_t uptime = esp_timer_get_time() / 1000000;
+    time_t now = time(NULL);
+    bool time_valid = now > 315360000l;
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "next", next);
+    cJSON_AddNumberToObject(root, "uptime", uptime);
+
+    cJSON *events = cJSON_AddArrayToObject(root, "events");
+    for (size_t i = 0; i < count; i++) {
+        event_journal_entry_t *entry = &entries[i];
+        cJSON *event = cJSON_CreateObject();
+        cJSON_AddNumberToObject(event, "seq", seq + i);
+        cJSON_AddNumberToObject(event, "time", entry->time);
+        if (time_valid) cJSON_AddNumberToObject(event, "unix", (double) (now - (uptime - entry->time)));
+        cJSON_AddStringToObject(event, "subsystem", event_journal_subsystem_name(entry->subsystem));
+        cJSON_AddStringToObject(event, "event", event_journal_type_name(entry->event));
+        cJSON_AddNumberToObject(event, "reason", entry->reason);
+        cJSON_AddNumberToObject(event, "bytes", entry->bytes);
+        cJSON_AddItemToArray(events, event);
+    }
+    free(entries);
+
+    cJSON *links = cJSON_AddObjectToObject(root, "links");
+    event_journal_link_t link;
+    for (event_subsystem_t subsystem = 0; subsystem < EVENT_SUBSYSTEM_COUNT; subsystem++) {
+        event_journal_link(subsystem, &link);
+        if (!link.tracking) continue;
+
+        cJSON *item = cJSON_AddObjectToObject(links, event_journal_subsystem_name(subsystem));
+        cJSON_AddStringToObject(item, "target", link.target);
+        cJSON_AddBoolToObject(item, "connected", link.connected);
+        cJSON_AddNumberToObject(item, "availability", link.availability);
+        cJSON_AddNumberToObject(item, "tracked", link.tracked);
+        cJSON_AddNumberToObject(item, "up", link.up);
+        cJSON_AddNumberToObject(item, "down", link.down);
+        cJSON_AddNumberToObject(item, "connects", link.connects);
+        cJSON_AddNumberToObject(item, "disconnects", link.disconnects);
+        cJSON_AddNumberToObject(item, "failures", link.failures);
+        cJSON_AddNumberToObject(item, "mtbf", link.mtbf);
+        cJSON_AddNumberToObject(item, "reconnects", link.reconnects);
+        cJSON_AddNumberToObject(item, "mean_reconnect", link.mean_reconnect);
+        cJSON_AddNumberToObject(item, "gaps", link.gaps);
+        cJSON_AddNumberToObject(item, "gap_time", link.gap_time);
+        cJSON_AddNumberToObject(item, "bytes", link.bytes);
+    }
+
+    return json_response_alloc(req, root);
+}
+
+static esp_err_t tasks_get_handler(httpd_req_t *req) {
+    if (check_auth(req) == ESP_FAIL) return ESP_FAIL;
+
+    task_monitor_info_t *tasks = malloc(TASK_MONITOR_MAX_TASKS * sizeof(task_monitor_info_t));
+    if (tasks == NULL) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+
+    task_monitor_summary_t summary;
+    size_t count = task_monitor_snapshot(tasks, TASK_MONITOR_MAX_TASKS, &summary);
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "window", summary.window_ms);
+    if (summary.cpu_available) {
+        cJSON *cores = cJSON_AddArrayToObject(root, "cores");
+        for (int core = 0; core < summary.cores && core < 2; core++) {
+            cJSON_AddItemToArray(cores, cJSON_CreateNumber((int) (summary.core_load[core] * 10) / 10.0));
+        }
+    }
+
+    cJSON *warnings = cJSON_AddArrayToObject(root, "warnings");
+    cJSON *list = cJSON_AddArrayToObject(root, "tasks");
+    uint32_t stack_configured = 0, stack_used_total = 0;
+    for (size_t i = 0; i < count; i++) {
+        task_monitor_info_t *info = &tasks[i];
+
+        cJSON *task = cJSON_CreateObject();
+        cJSON_AddStringToObject(task, "name", info->name);
+        cJSON_AddNumberToObject(task, "number", info->number);
+        cJSON_AddStringToObject(task, "state", task_monitor_state_name(info->state));
+        cJSON_AddNumberToObject(task, "priority", info->priority);
+        cJSON_AddNumberToObject(task, "core", info->core);
+        if (summary.cpu_available) {
+            cJSON_AddNumberToObject(task, "cpu", (int) (info->cpu * 10) / 10.0);
+            cJSON_AddNumberToObject(task, "budget", info->budget);
+        }
+        cJSON_AddNumberToObject(task, "stack_free", info->stack_free);
+        if (info->stack_size > 0) {
+            // Registry tasks: configured size against the high-water mark, rounded suggestion with margin
+            uint32_t used = info->stack_size > info->stack_free ? info->stack_size - info->stack_free : 0;
+            uint32_t suggested = (used + TASK_STACK_MARGIN + 255) / 256 * 256;
+            cJSON_AddNumberToObject(task, "stack_size", info->stack_size);
+            cJSON_AddNumberToObject(task, "stack_used", used);
+            cJSON_AddNumberToObject(task, "stack_suggested", suggested);
+            stack_configured += info->stack_size;
+            stack_used_total += used;
+
+            if (suggested * 2 <= info->stack_size) {
+                snprintf(buffer, BUFFER_SIZE, "%s stack oversized (%lu of %lu bytes used)", info->name,
+                        (unsigned long) used, (unsigned long) info->stack_size);
+                cJSON_AddItemToArray(warnings, cJSON_CreateString(buffer));
+            }
+        }
+        cJSON_AddItemToArray(list, task);
+
+        if (info->cpu_overload) {
+            snprintf(buffer, BUFFER_SIZE, "%s exceeds CPU budget (%d%% > %d%%)", info->name, (int) info->cpu, info->budget);
+            cJSON_AddItemToArray(warnings, cJSON_CreateString(buffer));
+        }
+        if (info->stack_low) {
+            snprintf(buffer, BUFFER_SIZE, "%s stack low (%lu bytes free)", info->name, (unsigned long) info->stack_free);
+            cJSON_AddItemToArray(warnings, cJSON_CreateString(buffer));
+        }
+    }
+
+    free(tasks);
+
+    cJSON *stack = cJSON_AddObjectToObject(root, "stack");
+    cJSON_AddNumberToObject(stack, "registry", TASK_STACK_TOTAL);
+    cJSON_AddNumberToObject(stack, "budget", TASK_STACK_BUDGET);
+    cJSON_AddNumberToObject(stack, "configured", stack_configured);
+    cJSON_AddNumberToObject(stack, "used", stack_used_total);
+
+    return json_response_alloc(req, root);
+}
+
+static void survey_position_json(cJSON *object, const double ecef[3]) {
+    double latitude, longitude, height;
+    survey_geodetic_from_ecef(ecef, &latitude, &longitude, &height);
+
+    cJSON_AddNumberToObject(object, "x", ecef[0]);
+    cJSON_AddNumberToObject(object, "y", ecef[1]);
+    cJSON_AddNumberToObject(object, "z", ecef[2]);
+    cJSON_AddNumberToObject(object, "latitude", latitude);
+    cJSON_AddNumberToObject(object, "longitude", longitude);
+    cJSON_AddNumberToObject(object, "height", height);
+}
+
+static cJSON *survey_json() {
+    survey_status_t status;
+    survey_status(&status);
+
+    static const char *phases[] = {"idle", "running", "done"};
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, "phase", phases[status.phase]);
+    cJSON_AddNumberToObject(root, "samples", status.stats.count);
+    cJSON_AddNumberToObject(root, "rejected", status.rejected);
+    cJSON_AddNumberToObject(root, "duration", status.duration);
+    cJSON_AddNumberToObject(root, "min_duration", status.min_duration);
+    cJSON_AddNumberToObject(root, "accuracy_limit", status.accuracy_limit / 1000.0);
+    if (status.stats.count > 0) {
+        double mean[3];
+        survey_stats_mean(&status.stats, mean);
+        survey_position_json(cJSON_AddObjectToObject(root, "mean"), mean);
+        cJSON_AddNumberToObject(root, "spread", survey_stats_spread(&status.stats));
+        double accuracy = survey_stats_accuracy(&status.stats, status.duration);
+        if (isfinite(accuracy)) cJSON_AddNumberToObject(root, "accuracy", accuracy);
+    }
+
+    // Saved base position in metres
+    cJSON *base = cJSON_AddObjectToObject(root, "base");
+    cJSON_AddBoolToObject(base, "valid", status.base_valid);
+    if (status.base_valid) {
+        double ecef[3] = {status.base[0] / 1e4, status.base[1] / 1e4, status.base[2] / 1e4};
+        survey_position_json(base, ecef);
+        cJSON_AddNumberToObject(base, "accuracy", status.base_accuracy / 1e4);
+    }
+    if (status.receiver_result != ESP_ERR_NOT_FINISHED) {
+        cJSON_AddStringToObject(root, "receiver", status.receiver_result == ESP_OK ? "ok" :
+                esp_err_to_name(status.receiver_result));
+    }
+
+    return root;
+}
+
+static cJSON *station_json() {
+    station_status_t status;
+    station_status(&status);
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddBoolToObject(root, "active", status.active);
+    if (status.active) {
+        cJSON_AddNumberToObject(root, "type", status.type);
+        cJSON_AddNumberToObject(root, "station_id", status.station_id);
+        cJSON_AddNumberToObject(root, "interval", status.interval);
+        cJSON_AddNumberToObject(root, "length", status.length);
+    }
+    cJSON_AddNumberToObject(root, "injections", status.injections);
+
+    return root;
+}
+
+static esp_err_t status_get_handler(httpd_req_t *req) {
+    if (check_auth(req) == ESP_FAIL) return ESP_FAIL;
+
+    cJSON *root = cJSON_CreateObject();
+
+    // Uptime
+    cJSON_AddNumberToObject(root, "uptime", (int) ((double) esp_timer_get_time() / 1000000));
+
+    // Heap
+    cJSON *heap = cJSON_AddObjectToObject(root, "heap");
+    cJSON_AddNumberToObject(heap, "total", heap_caps_get_total_size(MALLOC_CAP_8BIT));
+    cJSON_AddNumberToObject(heap, "free", heap_caps_get_free_size(MALLOC_CAP_8BIT));
+
+    // Streams
+    cJSON *streams = cJSON_AddObjectToObject(root, "streams");
+    stream_stats_values_t values;
+    for (stream_stats_handle_t stats = stream_stats_first(); stats != NULL; stats = stream_stats_next(stats)) {
+        stream_stats_values(stats, &values);
+
+        cJSON *stream = cJSON_AddObjectToObject(streams, values.name);
+        cJSON *total = cJSON_AddObjectToObject(stream, "total");
+        cJSON_AddNumberToObject(total, "in", values.total_in);
+        cJSON_AddNumberToObject(total, "out", values.total_out);
+        cJSON *rate = cJSON_AddObjectToObject(stream, "rate");
+        cJSON_AddNumberToObject(rate, "in", values.rate_in);
+        cJSON_AddNumberToObject(rate, "out", values.rate_out);
+    }
+
+    // Sockets
+    cJSON *sockets = cJSON_AddArrayToObject(root, "sockets");
+    for (int s = LWIP_SOCKET_OFFSET; s < LWIP_SOCKET_OFFSET + CONFIG_LWIP_MAX_SOCKETS; s++) {
+        int err;
+
+        int socktype;
+        socklen_t socktype_len = sizeof(socktype);
+        err = getsockopt(s, SOL_SOCKET, SO_TYPE, &socktype, &socktype_len);
+        if (err < 0) continue;
+
+        cJSON *socket = cJSON_CreateObject();
+
+        cJSON_AddStringToObject(socket, "type", SOCKTYPE_NAME(socktype));
+
+        struct sockaddr_in6 addr;
+        socklen_t socklen = sizeof(addr);
+
+        err = getsockname(s, (struct sockaddr *)&addr, &socklen);
+        if (err == 0) cJSON_AddStringToObject(socket, "local", sockaddrtostr((struct sockaddr *) &addr));
+
+        err = getpeername(s, (struct sockaddr *)&addr, &socklen);
+        if (err == 0) cJSON_AddStringToObject(socket, "peer", sockaddrtostr((struct sockaddr *) &addr));
+
+        cJSON_AddItemToArray(sockets, socket);
+    }
+
+    // WiFi
+    wifi_ap_status_t ap_status;
+    wifi_sta_status_t sta_status;
+
+    wifi_ap_status(&ap_status);
+    wifi_sta_status(&sta_status);
+
+    cJSON *wifi = cJSON_AddObjectToObject(root, "wifi");
+
+    cJSON *ap = cJSON_AddObjectToObject(wifi, "ap");
+    cJSON_AddBoolToObject(ap, "active", ap_status.active);
+    if (ap_status.active) {
+        cJSON_AddStringToObject(ap, "ssid", (char *) ap_status.ssid);
+        cJSON_AddStringToObject(ap, "authmode", wifi_auth_mode_name(ap_status.authmode));
+        cJSON_AddNumberToObject(ap, "devices", ap_status.devices);
+
+        char ip[40];
+        snprintf(ip, sizeof(ip), IPSTR, IP2STR(&ap_status.ip4_addr));
+        cJSON_AddStringToObject(ap, "ip4", ip);
+        snprintf(ip, sizeof(ip), IPV6STR, IPV62STR(ap_status.ip6_addr));
+        cJSON_AddStringToObject(ap, "ip6", ip);
+    }
+
+    cJSON *sta = cJSON_AddObjectToObject(wifi, "sta");
+    cJSON_AddBoolToObject(sta, "active", sta_status.active);
+    if (sta_status.active) {
+        cJSON_AddBoolToObject(sta, "connected", sta_status.connected);
+        if (sta_status.connected) {
+            cJSON_AddStringToObject(sta, "ssid", (char *) sta_status.ssid);
+            cJSON_AddStringToObject(sta, "authmode", wifi_auth_mode_name(sta_status.authmode));
+            cJSON_AddNumberToObject(sta, "rssi", sta_status.rssi);
+
+            char ip[40];
+            snprintf(ip, sizeof(ip), IPSTR, IP2STR(&sta_status.ip4_addr));
+            cJSON_AddStringToObject(sta, "ip4", ip);
+            snprintf(ip, sizeof(ip), IPV6STR, IPV62STR(sta_status.ip6_addr));
+            cJSON_AddStringToObject(sta, "ip6", ip);
+        }
+    }
+
+    // GNSS
+    gnss_state_t gnss_status;
+    gnss_state(&gnss_status);
+
+    cJSON *gnss = cJSON_AddObjectToObject(root, "gnss");
+    cJSON_AddNumberToObject(gnss, "sentences", gnss_status.sentences);
+    cJSON_AddNumberToObject(gnss, "checksum_errors", gnss_status.checksum_errors);
+    if (gnss_status.updated > 0) {
+        nmea_fix_t *fix = &gnss_status.fix;
+        cJSON_AddNumberToObject(gnss, "age", (double) (esp_timer_get_time() - gnss_status.updated) / 1000000);
+        cJSON_AddNumberToObject(gnss, "quality", fix->quality);
+        cJSON_AddNumberToObject(gnss, "mode", fix->mode);
+        cJSON_AddNumberToObject(gnss, "satellites", fix->satellites_used);
+        cJSON_AddNumberToObject(gnss, "in_view", fix->satellites_in_view);
+        cJSON_AddNumberToObject(gnss, "hdop", fix->hdop / 100.0);
+        if (fix->position_valid) {
+            cJSON_AddNumberToObject(gnss, "latitude", fix->latitude / 1e7);
+            cJSON_AddNumberToObject(gnss, "longitude", fix->longitude / 1e7);
+            cJSON_AddNumberToObject(gnss, "altitude", fix->altitude / 1000.0);
+        }
+        if (fix->time_valid) {
+            char time[32];
+            if (fix->date_valid) {
+                snprintf(time, sizeof(time), "%04u-%02u-%02uT%02u:%02u:%02u.%03uZ", fix->year, fix->month, fix->day,
+                        fix->hour, fix->minute, fix->second, fix->millisecond);
+            } else {
+                snprintf(time, sizeof(time), "%02u:%02u:%02u.%03u", fix->hour, fix->minute, fix->second,
+                        fix->millisecond);
+            }
+            cJSON_AddStringToObject(gnss, "time", time);
+        }
+    }
+
+    // Base survey
+    cJSON_AddItemToObject(root, "survey", survey_json());
+    cJSON_AddItemToObject(root, "station", station_json());
+
+    return json_response(req, root);
+}
+
+static esp_err_t wifi_scan_get_handler(httpd_req_t *req) {
+    if (check_auth(req) == ESP_FAIL) return ESP_FAIL;
+
+    // Ответ из кэша, сканирование запускается в фоне и не блокирует сервер
+    char query[32];
+    char refresh[4] = "";
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        httpd_query_key_value(query, "refresh", refresh, sizeof(refresh));
+    }
+
+    uint16_t ap_count;
+    wifi_scan_status_t scan_status;
+    wifi_ap_record_t *ap_records = wifi_scan_results(&ap_count, &scan_status);
+
+    int64_t age = esp_timer_get_time() - scan_status.timestamp;
+    if (!scan_status.scanning && (strcmp(refresh, "1") == 0 || scan_status.timestamp == 0 || age > WIFI_SCAN_CACHE_TTL)) {
+        scan_status.scanning = wifi_scan_start() == ESP_OK;
+    }
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddBoolToObject(root, "scanning", scan_status.scanning);
+    if (scan_status.timestamp == 0) {
+        cJSON_AddNullToObject(root, "age");
+    } else {
+        cJSON_AddNumberToObject(root, "age", age / 1000000);
+    }
+
+    cJSON *networks = cJSON_AddArrayToObject(root, "networks");
+    for (int i = 0; i < ap_count; i++) {
+        wifi_ap_record_t *ap_record = &ap_records[i];
+        cJSON *ap = cJSON_CreateObject();
+        cJSON_AddItemToArray(networks, ap);
+        cJSON_AddStringToObject(ap, "ssid", (char *) ap_record->ssid);
+        cJSON_AddNumberToObject(ap, "rssi", ap_record->rssi);
+        cJSON_AddStringToObject(ap, "authmode", wifi_auth_mode_name(ap_record->authmode));
+    }
+
+    free(ap_records);
+
+    return json_response(req, root);
+}
+
+static esp_err_t sd_log_status_handler(httpd_req_t *req) {
+    if (check_auth(req) == ESP_FAIL) return ESP_FAIL;
+
+    cJSON *root = cJSON_CreateObject();
+    bool enabled = config_get_bool1(CONF_ITEM(KEY_CONFIG_SD_LOGGING_ACTIVE));
+    cJSON_AddBoolToObject(root, "enabled", enabled);
+    
+    return json_response(req, root);
+}
+
+static esp_err_t sd_log_toggle_handler(httpd_req_t *req) {
+    if (check_auth(req) == ESP_FAIL) return ESP_FAIL;
+
+    char buffer[256];
+    int ret = httpd_req_recv(req, buffer, sizeof(buffer) - 1);
+    if (ret <= 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Failed to receive data");
+        return ESP_FAIL;
+    }
+    buffer[ret] = '\0';
+
+    cJSON *root = cJSON_Parse(buffer);
+    if (!root) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid JSON");
+        return ESP_FAIL;
+    }
+
+    cJSON *enabled_item = cJSON_GetObjectItem(root, "enabled");
+    if (!enabled_item || !cJSON_IsBool(enabled_item)) {
         cJSON_Delete(root);
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing command field");
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing enabled field");
         return ESP_FAIL;
     }
 
-    // Отправляем команду через UART
-    const char *cmd = cJSON_GetStringValue(command);
-    uart_write_bytes(UART_NUM_0, cmd, strlen(cmd));
-    uart_write_bytes(UART_NUM_0, "\r\n", 2);
+    bool enabled = cJSON_IsTrue(enabled_item);
+    config_write_begin();
+    config_set_bool1(KEY_CONFIG_SD_LOGGING_ACTIVE, enabled);
+    config_commit();
+    config_write_end();
+
+    cJSON_Delete(root);
+
+    cJSON *resp = cJSON_CreateObject();
+    cJSON_AddStringToObject(resp, "status", "ok");
+    cJSON_AddBoolToObject(resp, "enabled", enabled);
+    
+    return json_response(req, resp);
+}
 
+static cJSON *replay_json() {
+    replay_state_t state;
+    replay_state(&state);
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddBoolToObject(root, "running", state.running);
+    cJSON_AddStringToObject(root, "file", state.file);
+    cJSON_AddNumberToObject(root, "speed", state.speed);
+    cJSON_AddBoolToObject(root, "loop", state.loop);
+    cJSON_AddNumberToObject(root, "bytes", state.stats.bytes);
+    cJSON_AddNumberToObject(root, "frames", state.stats.frames);
+    cJSON_AddNumberToObject(root, "sentences", state.stats.sentences);
+    cJSON_AddNumberToObject(root, "epochs", state.stats.epochs);
+    cJSON_AddNumberToObject(root, "loops", state.stats.loops);
+    cJSON_AddNumberToObject(root, "lag_max_ms", state.stats.lag_max_ms);
+    cJSON_AddBoolToObject(root, "timed", state.stats.timed);
+    if (state.error != 0) cJSON_AddStringToObject(root, "error", strerror(state.error));
+
+    return root;
+}
+
+static esp_err_t replay_get_handler(httpd_req_t *req) {
+    if (check_auth(req) == ESP_FAIL) return ESP_FAIL;
+
+    return json_response(req, replay_json());
+}
+
+static esp_err_t replay_post_handler(httpd_req_t *req) {
+    if (check_auth(req) == ESP_FAIL) return ESP_FAIL;
+
+    char buffer[256];
+    int ret = httpd_req_recv(req, buffer, sizeof(buffer) - 1);
+    if (ret <= 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Failed to receive data");
+        return ESP_FAIL;
+    }
+    buffer[ret] = '\0';
+
+    cJSON *root = cJSON_Parse(buffer);
+    if (!root) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid JSON");
+        return ESP_FAIL;
+    }
+
+    // {"file": "20250101.rtcm", "speed": 10, "loop": true} starts, {"stop": true} stops
+    esp_err_t err;
+    cJSON *file = cJSON_GetObjectItem(root, "file");
+    if (cJSON_IsTrue(cJSON_GetObjectItem(root, "stop"))) {
+        err = replay_stop();
+    } else if (cJSON_IsString(file)) {
+        cJSON *speed = cJSON_GetObjectItem(root, "speed");
+        int speed_value = cJSON_IsNumber(speed) ? speed->valueint : 1;
+        err = speed_value >= 0 && speed_value <= UINT16_MAX
+                ? replay_start(file->valuestring, speed_value, cJSON_IsTrue(cJSON_GetObjectItem(root, "loop")))
+                : ESP_ERR_INVALID_ARG;
+    } else {
+        err = ESP_ERR_INVALID_ARG;
+    }
     cJSON_Delete(root);
 
-    // Ждем ответа с таймаутом 2 секунды
-    char response[1024] = {0};
-    int len = uart_read_bytes(UART_NUM_0, response, sizeof(response) - 1, pdMS_TO_TICKS(2000));
-    if (len > 0) {
-        response[len] = '\0';
+    if (err != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, esp_err_to_name(err));
+        return ESP_FAIL;
     }
 
+    return json_response(req, replay_json());
+}
+
+static cJSON *receiver_json() {
+    receiver_state_t state;
+    receiver_state(&state);
+    int64_t now = esp_timer_get_time();
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "frames", state.frames);
+    cJSON_AddNumberToObject(root, "checksum_errors", state.checksum_errors);
+    cJSON_AddNumberToObject(root, "acks", state.acks);
+    cJSON_AddNumberToObject(root, "naks", state.naks);
+    cJSON_AddNumberToObject(root, "timeouts", state.timeouts);
+
+    if (state.pvt_updated > 0) {
+        cJSON *pvt = cJSON_AddObjectToObject(root, "pvt");
+        cJSON_AddNumberToObject(pvt, "age", (double) (now - state.pvt_updated) / 1000000);
+        cJSON_AddNumberToObject(pvt, "fix_type", state.pvt.fix_type);
+        cJSON_AddNumberToObject(pvt, "carrier", state.pvt.carrier);
+        cJSON_AddBoolToObject(pvt, "fix_ok", state.pvt.fix_ok);
+        cJSON_AddNumberToObject(pvt, "satellites", state.pvt.satellites);
+        cJSON_AddNumberToObject(pvt, "latitude", state.pvt.latitude / 1e7);
+        cJSON_AddNumberToObject(pvt, "longitude", state.pvt.longitude / 1e7);
+        cJSON_AddNumberToObject(pvt, "height", state.pvt.height / 1000.0);
+        cJSON_AddNumberToObject(pvt, "h_acc", state.pvt.h_acc / 1000.0);
+        cJSON_AddNumberToObject(pvt, "v_acc", state.pvt.v_acc / 1000.0);
+        cJSON_AddNumberToObject(pvt, "pdop", state.pvt.pdop / 100.0);
+    }
+
+    if (state.svin_updated > 0) {
+        cJSON *svin = cJSON_AddObjectToObject(root, "svin");
+        cJSON_AddNumberToObject(svin, "age", (double) (now - state.svin_updated) / 1000000);
+        cJSON_AddBoolToObject(svin, "active", state.svin.active);
+        cJSON_AddBoolToObject(svin, "valid", state.svin.valid);
+        cJSON_AddNumberToObject(svin, "duration", state.svin.duration);
+        cJSON_AddNumberToObject(svin, "observations", state.svin.observations);
+        cJSON_AddNumberToObject(svin, "accuracy", state.svin.mean_acc / 10000.0);
+        cJSON *mean = cJSON_AddArrayToObject(svin, "ecef");
+        for (int i = 0; i < 3; i++) cJSON_AddItemToArray(mean, cJSON_CreateNumber(state.svin.mean[i] / 10000.0));
+    }
+
+    if (state.hw_updated > 0) {
+        static const char *antenna_status[] = {"init", "unknown", "ok", "short", "open"};
+        cJSON *hw = cJSON_AddObjectToObject(root, "hw");
+        cJSON_AddNumberToObject(hw, "age", (double) (now - state.hw_updated) / 1000000);
+        cJSON_AddStringToObject(hw, "antenna", state.hw.antenna_status < 5 ? antenna_status[state.hw.antenna_status] : "unknown");
+        cJSON_AddNumberToObject(hw, "antenna_power", state.hw.antenna_power);
+        cJSON_AddNumberToObject(hw, "noise", state.hw.noise);
+        cJSON_AddNumberToObject(hw, "agc", state.hw.agc);
+        cJSON_AddNumberToObject(hw, "jamming_state", state.hw.jamming_state);
+        cJSON_AddNumberToObject(hw, "jamming", state.hw.jamming);
+    }
+
+    return root;
+}
+
+// CFG-VALSET layers from ["ram", "bbr", "flash"], RAM only by default; 0 on unknown names
+static uint8_t receiver_layers(const cJSON *layers) {
+    if (!cJSON_IsArray(layers)) return UBX_LAYER_RAM;
+
+    uint8_t mask = 0;
+    const cJSON *layer;
+    cJSON_ArrayForEach(layer, layers) {
+        if (!cJSON_IsString(layer)) return 0;
+        if (strcasecmp(layer->valuestring, "ram") == 0) mask |= UBX_LAYER_RAM;
+        else if (strcasecmp(layer->valuestring, "bbr") == 0) mask |= UBX_LAYER_BBR;
+        else if (strcasecmp(layer->valuestring, "flash") == 0) mask |= UBX_LAYER_FLASH;
+        else return 0;
+    }
+
+    return mask;
+}
+
+static esp_err_t receiver_get_handler(httpd_req_t *req) {
+    if (check_auth(req) == ESP_FAIL) return ESP_FAIL;
+
+    cJSON *root = receiver_json();
+
+    // ?port=uart1 adds the current message rates of that port from the receiver RAM layer
+    char query[32], port_name[8];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK
+            && httpd_query_key_value(query, "port", port_name, sizeof(port_name)) == ESP_OK) {
+        ubx_port_t port = ubx_port_find(port_name);
+        if (port == UBX_PORT_COUNT) {
+            cJSON_Delete(root);
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Unknown port");
+            return ESP_FAIL;
+        }
+
+        uint32_t keys[UBX_VALSET_KEYS_MAX];
+        uint64_t values[UBX_VALSET_KEYS_MAX];
+        size_t count = UBX_MESSAGE_COUNT < UBX_VALSET_KEYS_MAX ? UBX_MESSAGE_COUNT : UBX_VALSET_KEYS_MAX;
+        for (size_t i = 0; i < count; i++) keys[i] = ubx_message_key(&UBX_MESSAGES[i], port);
+
+        esp_err_t err = receiver_valget(0, keys, count, values);
+        if (err == ESP_OK) {
+            cJSON *rates = cJSON_AddObjectToObject(root, "rates");
+            for (size_t i = 0; i < count; i++) cJSON_AddNumberToObject(rates, UBX_MESSAGES[i].name, values[i]);
+        } else {
+            cJSON_AddStringToObject(root, "rates_error", esp_err_to_name(err));
+        }
+    }
+
+    return json_response_alloc(req, root);
+}
+
+static esp_err_t receiver_rates_post_handler(httpd_req_t *req) {
+    if (check_auth(req) == ESP_FAIL) return ESP_FAIL;
+
+    char buffer[512];
+    int ret = httpd_req_recv(req, buffer, sizeof(buffer) - 1);
+    if (ret <= 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Failed to receive data");
+        return ESP_FAIL;
+    }
+    buffer[ret] = '\0';
+
+    cJSON *root = cJSON_Parse(buffer);
+    if (!root) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid JSON");
+        return ESP_FAIL;
+    }
+
+    // {"port": "uart1", "layers": ["ram", "flash"], "rates": {"GSV": 0, "RTCM1077": 1}}
+    cJSON *port_item = cJSON_GetObjectItem(root, "port");
+    ubx_port_t port = cJSON_IsString(port_item) ? ubx_port_find(port_item->valuestring) : UBX_PORT_UART1;
+    uint8_t layers = receiver_layers(cJSON_GetObjectItem(root, "layers"));
+    cJSON *rates = cJSON_GetObjectItem(root, "rates");
+
+    ubx_valset_t set;
+    ubx_valset_init(&set, layers);
+    const char *error = port == UBX_PORT_COUNT ? "Unknown port" : layers == 0 ? "Unknown layer"
+            : !cJSON_IsObject(rates) || cJSON_GetArraySize(rates) == 0 ? "No rates" : NULL;
+    cJSON *rate;
+    cJSON_ArrayForEach(rate, error == NULL ? rates : NULL) {
+        const ubx_message_t *message = ubx_message_find(rate->string);
+        if (message == NULL) {
+            error = "Unknown message";
+        } else if (!cJSON_IsNumber(rate) || rate->valueint < 0 || rate->valueint > UINT8_MAX) {
+            error = "Invalid rate";
+        } else if (!ubx_valset_add(&set, ubx_message_key(message, port), rate->valueint)) {
+            error = "Too many messages";
+        }
+        if (error != NULL) break;
+    }
+    cJSON_Delete(root);
+
+    if (error != NULL) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, error);
+        return ESP_FAIL;
+    }
+
+    esp_err_t err = receiver_valset(&set);
+    if (err != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, err == ESP_FAIL ? "Rejected by receiver" : esp_err_to_name(err));
+        return ESP_FAIL;
+    }
+
+    return json_response_alloc(req, receiver_json());
+}
+
+static esp_err_t receiver_survey_post_handler(httpd_req_t *req) {
+    if (check_auth(req) == ESP_FAIL) return ESP_FAIL;
+
+    char buffer[256];
+    int ret = httpd_req_recv(req, buffer, sizeof(buffer) - 1);
+    if (ret <= 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Failed to receive data");
+        return ESP_FAIL;
+    }
+    buffer[ret] = '\0';
+
+    cJSON *root = cJSON_Parse(buffer);
+    if (!root) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid JSON");
+        return ESP_FAIL;
+    }
+
+    // {"mode": "survey", "min_duration": 300, "accuracy": 2.0}, {"mode": "fixed", "ecef": [x, y, z], "accuracy": 0.02}
+    // or {"mode": "disabled"}; metres and seconds, "layers" as for /receiver/rates
+    cJSON *mode = cJSON_GetObjectItem(root, "mode");
+    cJSON *accuracy = cJSON_GetObjectItem(root, "accuracy");
+    cJSON *ecef = cJSON_GetObjectItem(root, "ecef");
+    cJSON *min_duration = cJSON_GetObjectItem(root, "min_duration");
+    uint8_t layers = receiver_layers(cJSON_GetObjectItem(root, "layers"));
+
+    esp_err_t err = ESP_ERR_INVALID_ARG;
+    if (layers == 0 || !cJSON_IsString(mode)) {
+        err = ESP_ERR_INVALID_ARG;
+    } else if (strcmp(mode->valuestring, "survey") == 0) {
+        double accuracy_m = cJSON_IsNumber(accuracy) ? accuracy->valuedouble : 2.0;
+        int duration = cJSON_IsNumber(min_duration) ? min_duration->valueint : 300;
+        if (accuracy_m > 0 && accuracy_m < 400000 && duration > 0) {
+            err = receiver_survey_start(duration, (uint32_t) (accuracy_m * 10000), layers);
+        }
+    } else if (strcmp(mode->valuestring, "fixed") == 0) {
+        double accuracy_m = cJSON_IsNumber(accuracy) ? accuracy->valuedouble : 0.05;
+        if (cJSON_GetArraySize(ecef) == 3 && accuracy_m > 0 && accuracy_m < 400000) {
+            int64_t position[3];
+            bool valid = true;
+            for (int i = 0; i < 3; i++) {
+                cJSON *axis = cJSON_GetArrayItem(ecef, i);
+                valid = valid && cJSON_IsNumber(axis) && axis->valuedouble > -1e7 && axis->valuedouble < 1e7;
+                if (valid) position[i] = llround(axis->valuedouble * 10000);
+            }
+            if (valid) err = receiver_fixed_position(position, (uint32_t) (accuracy_m * 10000), layers);
+        }
+    } else if (strcmp(mode->valuestring, "disabled") == 0) {
+        err = receiver_survey_stop(layers);
+    }
+    cJSON_Delete(root);
+
+    if (err != ESP_OK) {
+        httpd_resp_send_err(req, err == ESP_ERR_INVALID_ARG ? HTTPD_400_BAD_REQUEST : HTTPD_500_INTERNAL_SERVER_ERROR,
+                err == ESP_FAIL ? "Rejected by receiver" : esp_err_to_name(err));
+        return ESP_FAIL;
+    }
+
+    return json_response_alloc(req, receiver_json());
+}
+
+static esp_err_t survey_get_handler(httpd_req_t *req) {
+    if (check_auth(req) == ESP_FAIL) return ESP_FAIL;
+
+    return json_response(req, survey_json());
+}
+
+static esp_err_t survey_post_handler(httpd_req_t *req) {
+    if (check_auth(req) == ESP_FAIL) return ESP_FAIL;
+
+    char buffer[256];
+    int ret = httpd_req_recv(req, buffer, sizeof(buffer) - 1);
+    if (ret <= 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Failed to receive data");
+        return ESP_FAIL;
+    }
+    buffer[ret] = '\0';
+
+    cJSON *root = cJSON_Parse(buffer);
+    if (!root) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid JSON");
+        return ESP_FAIL;
+    }
+
+    // {"min_duration": 600, "accuracy": 1.5} starts (thresholds default to the settings),
+    // {"stop": true} stops, {"clear": true} forgets the saved base position,
+    // {"ecef": [x, y, z], "accuracy": 0.02} saves a known base position in metres
+    esp_err_t err = ESP_OK;
+    cJSON *min_duration = cJSON_GetObjectItem(root, "min_duration");
+    cJSON *accuracy = cJSON_GetObjectItem(root, "accuracy");
+    cJSON *ecef = cJSON_GetObjectItem(root, "ecef");
+    if (cJSON_IsTrue(cJSON_GetObjectItem(root, "stop"))) {
+        survey_stop();
+    } else if (cJSON_IsTrue(cJSON_GetObjectItem(root, "clear"))) {
+        config_write_begin();
+        config_set_bool1(KEY_CONFIG_BASE_VALID, false);
+        err = config_commit();
+        config_write_end();
+    } else if (ecef != NULL) {
+        static const char *keys[] = {KEY_CONFIG_BASE_ECEF_X, KEY_CONFIG_BASE_ECEF_Y, KEY_CONFIG_BASE_ECEF_Z};
+        double accuracy_value = cJSON_IsNumber(accuracy) ? accuracy->valuedouble : 0;
+        err = cJSON_GetArraySize(ecef) == 3 && accuracy_value >= 0 && accuracy_value < 1000
+                ? ESP_OK : ESP_ERR_INVALID_ARG;
+        config_write_begin();
+        for (int i = 0; i < 3 && err == ESP_OK; i++) {
+            cJSON *axis = cJSON_GetArrayItem(ecef, i);
+            // DF025-DF027: 38 bits of 0.1 mm
+            if (!cJSON_IsNumber(axis) || fabs(axis->valuedouble) > 1.3e7) err = ESP_ERR_INVALID_ARG;
+            else err = config_set_i64(keys[i], llround(axis->valuedouble * 1e4));
+        }
+        if (err == ESP_OK) {
+            survey_stop();
+            config_set_u32(KEY_CONFIG_BASE_ACCURACY, (uint32_t) llround(accuracy_value * 1e4));
+            config_set_bool1(KEY_CONFIG_BASE_VALID, true);
+            err = config_commit();
+        }
+        config_write_end();
+    } else {
+        double duration_value = cJSON_IsNumber(min_duration) ? min_duration->valuedouble : 0;
+        double accuracy_value = cJSON_IsNumber(accuracy) ? accuracy->valuedouble : 0;
+        err = duration_value >= 0 && duration_value <= UINT32_MAX && accuracy_value >= 0 && accuracy_value < 1000
+                ? survey_start((uint32_t) duration_value, (uint32_t) llround(accuracy_value * 1000))
+                : ESP_ERR_INVALID_ARG;
+    }
+    cJSON_Delete(root);
+
+    if (err != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, esp_err_to_name(err));
+        return ESP_FAIL;
+    }
+
+    return json_response(req, survey_json());
+}
+
+static esp_err_t serial_command_post_handler(httpd_req_t *req) {
+    if (check_auth(req) == ESP_FAIL) return ESP_FAIL;
+
+    char buffer[512];
+    int ret = httpd_req_recv(req, buffer, sizeof(buffer) - 1);
+    if (ret <= 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Failed to receive data");
+        return ESP_FAIL;
+    }
+    buffer[ret] = '\0';
+
+    cJSON *root = cJSON_Parse(buffer);
+    if (!root) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid JSON");
+        return ESP_FAIL;
+    }
+
+    cJSON *command = cJSON_GetObjectItem(root, "command");
+    if (!command || !cJSON_IsString(command)) {
+        cJSON_Delete(root);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing command field");
+        return ESP_FAIL;
+    }
+
+    // Отправляем команду через арбитр UART, ответ приёмника приходит в веб-терминал (/serial/ws)
+    const char *cmd = cJSON_GetStringValue(command);
+    int written = uart_write_command(cmd);
+
     cJSON *resp = cJSON_CreateObject();
-    cJSON_AddStringToObject(resp, "status", "ok");
+    cJSON_AddStringToObject(resp, "status", written < 0 ? "error" : "ok");
     cJSON_AddStringToObject(resp, "command", cmd);
-    cJSON_AddStringToObject(resp, "response", response);
+
+    cJSON_Delete(root);
 
     return json_response(req, resp);
 }
 
+static esp_err_t serial_ws_handler(httpd_req_t *req) {
+    // При отказе в доступе соединение просто закрывается
+    if (req->method == HTTP_GET && !check_auth_valid(req)) return ESP_FAIL;
+
+    return web_terminal_ws_handler(req);
+}
+
 static esp_err_t test_spiffs_handler(httpd_req_t *req) {
     httpd_resp_set_type(req, "text/plain");
     
@@ -908,37 +2086,131 @@ static esp_err_t root_redirect_handler(httpd_req_t *req) {
     return ESP_OK;
 }
 
+#if CONFIG_PIPELINE_TRACE
+static int trace_writer(void *ctx, const char *data, size_t length) {
+    return httpd_resp_send_chunk(ctx, data, length) == ESP_OK ? length : -1;
+}
+
+static esp_err_t trace_get_handler(httpd_req_t *req) {
+    if (check_auth(req) == ESP_FAIL) return ESP_FAIL;
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=\"esp32_xbee_trace.json\"");
+
+    if (trace_dump(trace_writer, req) < 0) {
+        // Заголовки уже отправлены, остаётся только оборвать ответ
+        return ESP_FAIL;
+    }
+
+    httpd_resp_send_chunk(req, NULL, 0);
+
+    return ESP_OK;
+}
+
+/// Обёртка для замера каждого обработчика: исходный обработчик передаётся через user_ctx
+static esp_err_t traced_handler(httpd_req_t *req) {
+    const httpd_uri_t *uri = req->user_ctx;
+
+    TRACE_BEGIN(handler_start);
+    esp_err_t err = ((esp_err_t (*)(httpd_req_t *)) uri->user_ctx)(req);
+    TRACE_END(TRACE_HTTP_HANDLER, handler_start, uri->uri);
+
+    return err;
+}
+#endif
+
 static esp_err_t register_uri_handler(httpd_handle_t server, const char *path, httpd_method_t method, esp_err_t (*handler)(httpd_req_t *r)) {
     httpd_uri_t uri_config_get = {
             .uri        = path,
             .method     = method,
             .handler    = handler
     };
+#if CONFIG_PIPELINE_TRACE
+    // httpd копирует описание маршрута, поэтому исходное хранится отдельно
+    httpd_uri_t *traced = malloc(sizeof(httpd_uri_t));
+    if (traced != NULL) {
+        *traced = uri_config_get;
+        traced->user_ctx = handler;
+        uri_config_get.handler = traced_handler;
+        uri_config_get.user_ctx = traced;
+    }
+#endif
     return httpd_register_uri_handler(server, &uri_config_get);
 }
 
-static httpd_handle_t web_server_start(void)
-{
-    config_get_primitive(CONF_ITEM(KEY_CONFIG_ADMIN_AUTH), &auth_method);
-    if (auth_method == AUTH_METHOD_BASIC) {
-        char *username, *password;
-        config_get_str_blob_alloc(CONF_ITEM(KEY_CONFIG_ADMIN_USERNAME), (void **) &username);
-        config_get_str_blob_alloc(CONF_ITEM(KEY_CONFIG_ADMIN_PASSWORD), (void **) &password);
-        basic_authentication = http_auth_basic_header(username, password);
+static esp_err_t register_ws_handler(httpd_handle_t server, const char *path, esp_err_t (*handler)(httpd_req_t *r)) {
+    httpd_uri_t uri_ws = {
+            .uri        = path,
+            .method     = HTTP_GET,
+            .handler    = handler,
+            .is_websocket = true
+    };
+    return httpd_register_uri_handler(server, &uri_ws);
+}
+
+static void web_server_close_fn(httpd_handle_t hd, int sockfd) {
+    web_terminal_close(sockfd);
+    close(sockfd);
+}
+
+/// Способ входа и заголовок Basic из настроек: при старте и после изменения группы ADMIN.
+/// Если заголовок собрать не удалось, Basic отклоняет все запросы до следующего изменения
+static void web_server_auth_load() {
+    enum auth_method method;
+    config_get_primitive(CONF_ITEM(KEY_CONFIG_ADMIN_AUTH), &method);
+
+    char *header = NULL;
+    if (method == AUTH_METHOD_BASIC) {
+        char *username = NULL, *password = NULL;
+        if (config_get_str_blob_alloc(CONF_ITEM(KEY_CONFIG_ADMIN_USERNAME), (void **) &username) == ESP_OK &&
+                config_get_str_blob_alloc(CONF_ITEM(KEY_CONFIG_ADMIN_PASSWORD), (void **) &password) == ESP_OK) {
+            header = http_auth_basic_header(username, password);
+        }
         free(username);
         free(password);
+        if (header == NULL) ESP_LOGE(TAG, "Could not build basic authentication header");
+    }
+
+    xSemaphoreTake(auth_mutex, portMAX_DELAY);
+    char *old = basic_authentication;
+    basic_authentication = header;
+    auth_method = method;
+    xSemaphoreGive(auth_mutex);
+
+    free(old);
+}
+
+static void web_server_auth_changed(const config_change_t *change, void *arg) {
+    web_server_auth_load();
+    ESP_LOGI(TAG, "Admin authentication settings applied");
+}
+
+static httpd_handle_t web_server_start(void)
+{
+    if (auth_mutex == NULL) {
+        auth_mutex = xSemaphoreCreateMutex();
+        web_server_auth_load();
+        config_subscribe(CONFIG_GROUP_ADMIN, web_server_auth_changed, NULL);
     }
 
     httpd_handle_t server = NULL;
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
-    // Увеличиваем число доступных слотов под URI-обработчики: у нас >12 маршрутов
+    // Увеличиваем число доступных слотов под URI-обработчики: у нас >20 маршрутов
     // иначе httpd_register_uri_handler начнёт возвращать "no slots left" и файловый обработчик "/*" не зарегистрируется
-    config.max_uri_handlers = 20;
+    config.max_uri_handlers = 40;
     config.uri_match_fn = httpd_uri_match_wildcard;
+    config.close_fn = web_server_close_fn;
+    config.stack_size = TASKS[TASK_HTTPD].stack;
+    config.task_priority = TASKS[TASK_HTTPD].priority;
+    config.core_id = TASKS[TASK_HTTPD].core >= 0 ? TASKS[TASK_HTTPD].core : tskNO_AFFINITY;
 
     // Start the httpd server
     ESP_LOGI(TAG, "Starting server on port: '%d'", config.server_port);
     if (httpd_start(&server, &config) == ESP_OK) {
+        // Terminal sessions must exist before /serial/ws is registered: a client may connect right away
+        esp_err_t terminal_err = web_terminal_init(server);
+        if (terminal_err != ESP_OK) ESP_LOGE(TAG, "Failed to start web terminal: %s", esp_err_to_name(terminal_err));
+
         // Register test endpoint for SPIFFS debugging
         register_uri_handler(server, "/test", HTTP_GET, test_spiffs_handler);
         
@@ -947,16 +2219,39 @@ static httpd_handle_t web_server_start(void)
         
         register_uri_handler(server, "/config", HTTP_GET, config_get_handler);
         register_uri_handler(server, "/config", HTTP_POST, config_post_handler);
+        register_uri_handler(server, "/config/export", HTTP_GET, config_export_get_handler);
+        register_uri_handler(server, "/config/import", HTTP_POST, config_import_post_handler);
+        register_uri_handler(server, "/profiles", HTTP_GET, profiles_get_handler);
+        register_uri_handler(server, "/profiles", HTTP_POST, profiles_post_handler);
+        register_uri_handler(server, "/profiles/diff", HTTP_GET, profiles_diff_get_handler);
         register_uri_handler(server, "/status", HTTP_GET, status_get_handler);
+        register_uri_handler(server, "/streams", HTTP_GET, streams_get_handler);
+        register_uri_handler(server, "/history", HTTP_GET, history_get_handler);
+        register_uri_handler(server, "/tasks", HTTP_GET, tasks_get_handler);
+        register_uri_handler(server, "/events", HTTP_GET, events_get_handler);
+#if CONFIG_PIPELINE_TRACE
+        register_uri_handler(server, "/trace", HTTP_GET, trace_get_handler);
+#endif
 
         register_uri_handler(server, "/log", HTTP_GET, log_get_handler);
+        register_uri_handler(server, "/log/previous", HTTP_GET, log_previous_get_handler);
         register_uri_handler(server, "/core_dump", HTTP_GET, core_dump_get_handler);
         register_uri_handler(server, "/heap_info", HTTP_GET, heap_info_get_handler);
+        register_uri_handler(server, "/heap_info/trace", HTTP_GET, heap_trace_get_handler);
+        register_uri_handler(server, "/heap_info/trace", HTTP_POST, heap_trace_post_handler);
 
         register_uri_handler(server, "/wifi/scan", HTTP_GET, wifi_scan_get_handler);
         register_uri_handler(server, "/serial/send", HTTP_POST, serial_command_post_handler);
+        if (terminal_err == ESP_OK) register_ws_handler(server, "/serial/ws", serial_ws_handler);
         register_uri_handler(server, "/sdlog/status", HTTP_GET, sd_log_status_handler);
         register_uri_handler(server, "/sdlog/toggle", HTTP_POST, sd_log_toggle_handler);
+        register_uri_handler(server, "/replay", HTTP_GET, replay_get_handler);
+        register_uri_handler(server, "/replay", HTTP_POST, replay_post_handler);
+        register_uri_handler(server, "/receiver", HTTP_GET, receiver_get_handler);
+        register_uri_handler(server, "/receiver/rates", HTTP_POST, receiver_rates_post_handler);
+        register_uri_handler(server, "/receiver/survey", HTTP_POST, receiver_survey_post_handler);
+        register_uri_handler(server, "/survey", HTTP_GET, survey_get_handler);
+        register_uri_handler(server, "/survey", HTTP_POST, survey_post_handler);
 
         // Wildcard handler for all files - MUST be last
         register_uri_handler(server, "/*", HTTP_GET, file_get_handler);
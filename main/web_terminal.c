@@ -0,0 +1,332 @@
+/*
+ * ESP32 NTRIP Duo - Веб-терминал UART через WebSocket
+ * Основан на ESP32-XBee (https://github.com/nebkat/esp32-xbee)
+ * Copyright (c) 2019 Nebojsa Cvetkovic.
+ *
+ * Интерактивный доступ к GNSS приёмнику из браузера:
+ * - Подписка на поток UART через события UART_EVENT_READ (данные не отбираются у uart_task)
+ * - Отправка команд и нажатий клавиш через арбитр передачи UART
+ * - Текстовый режим и двоичный режим (hex просмотр RTCM/UBX в браузере)
+ * - Ограничение скорости отправки на стороне сервера для каждой сессии
+ * - Обработчик UART никогда не блокируется: при переполнении данные отбрасываются и учитываются
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <inttypes.h>
+#include <sys/param.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <cJSON.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/stream_buffer.h>
+
+#include "web_terminal.h"
+#include "uart.h"
+#include "tasks.h"
+
+static const char *TAG = "WEB_TERMINAL";            // Тег для логирования веб-терминала
+
+#define WEB_TERMINAL_FRAME_MAX 512                   // Максимальный размер входящего кадра от браузера
+#define WEB_TERMINAL_CHUNK_SIZE 1024                 // Максимальный размер исходящего кадра
+#define WEB_TERMINAL_FLUSH_INTERVAL 50               // Период отправки накопленных данных, мс
+
+typedef struct web_terminal_session {
+    int fd;                                          // Сокет клиента, -1 если слот свободен
+    web_terminal_mode_t mode;                        // Режим отображения
+    uint32_t rate;                                   // Ограничение скорости, байт/с
+    StreamBufferHandle_t buffer;                     // Данные UART, ожидающие отправки
+
+    uint32_t dropped;                                // Отброшено байт (переполнение буфера)
+    uint32_t dropped_reported;                       // Значение dropped в последнем статусе
+
+    uint32_t tokens;                                 // Доступный объём отправки (token bucket)
+    int64_t refill_time;                             // Время последнего пополнения, мкс
+} web_terminal_session_t;
+
+static httpd_handle_t terminal_server;
+static web_terminal_session_t sessions[WEB_TERMINAL_MAX_SESSIONS];
+static int active_sessions = 0;
+
+static SemaphoreHandle_t sessions_mutex;
+static TaskHandle_t terminal_task;
+
+static const char *mode_name(web_terminal_mode_t mode) {
+    return mode == WEB_TERMINAL_MODE_HEX ? "hex" : "text";
+}
+
+/// Поиск сессии по сокету, вызывается под sessions_mutex
+static web_terminal_session_t *session_find(int fd) {
+    for (int i = 0; i < WEB_TERMINAL_MAX_SESSIONS; i++) {
+        if (sessions[i].fd == fd) return &sessions[i];
+    }
+    return NULL;
+}
+
+/// Обработчик данных UART - копирует данные в буферы активных сессий без блокировки
+static void web_terminal_uart_handler(void* handler_args, esp_event_base_t base, int32_t length, void* buffer) {
+    if (active_sessions == 0) return;
+
+    xSemaphoreTake(sessions_mutex, portMAX_DELAY);
+    for (int i = 0; i < WEB_TERMINAL_MAX_SESSIONS; i++) {
+        web_terminal_session_t *session = &sessions[i];
+        if (session->fd < 0) continue;
+
+        size_t sent = xStreamBufferSend(session->buffer, buffer, length, 0);
+        session->dropped += length - sent;
+    }
+    xSemaphoreGive(sessions_mutex);
+}
+
+/// Удаление непечатаемых символов для текстового режима
+/// @return Новая длина данных
+static size_t filter_printable(uint8_t *data, size_t length) {
+    size_t out = 0;
+    for (size_t i = 0; i < length; i++) {
+        uint8_t c = data[i];
+        if ((c >= 0x20 && c < 0x7F) || c == '\r' || c == '\n' || c == '\t') data[out++] = c;
+    }
+    return out;
+}
+
+static int format_status(web_terminal_session_t *session, char *status, size_t size) {
+    return snprintf(status, size, "{\"type\":\"status\",\"mode\":\"%s\",\"rate\":%" PRIu32 ",\"dropped\":%" PRIu32 "}",
+            mode_name(session->mode), session->rate, session->dropped);
+}
+
+/// Отправка накопленных данных одной сессии с учётом ограничения скорости
+static void web_terminal_flush(web_terminal_session_t *session, uint8_t *chunk) {
+    char status[96];
+    int status_length = 0;
+
+    xSemaphoreTake(sessions_mutex, portMAX_DELAY);
+    int fd = session->fd;
+    if (fd < 0) {
+        xSemaphoreGive(sessions_mutex);
+        return;
+    }
+
+    // Пополнение token bucket, запас не более одной секунды
+    int64_t now = esp_timer_get_time();
+    uint64_t refill = (uint64_t) session->rate * (now - session->refill_time) / 1000000;
+    if (refill > 0) {
+        session->tokens = MIN(session->tokens + refill, session->rate);
+        session->refill_time = now;
+    }
+
+    web_terminal_mode_t mode = session->mode;
+    size_t length = xStreamBufferReceive(session->buffer, chunk, MIN(session->tokens, WEB_TERMINAL_CHUNK_SIZE), 0);
+    session->tokens -= length;
+
+    if (session->dropped != session->dropped_reported) {
+        session->dropped_reported = session->dropped;
+        status_length = format_status(session, status, sizeof(status));
+    }
+    xSemaphoreGive(sessions_mutex);
+
+    esp_err_t err = ESP_OK;
+
+    if (mode == WEB_TERMINAL_MODE_TEXT) length = filter_printable(chunk, length);
+    if (length > 0) {
+        httpd_ws_frame_t frame = {
+                .type = mode == WEB_TERMINAL_MODE_HEX ? HTTPD_WS_TYPE_BINARY : HTTPD_WS_TYPE_TEXT,
+                .payload = chunk,
+                .len = length
+        };
+        err = httpd_ws_send_data(terminal_server, fd, &frame);
+    }
+
+    if (err == ESP_OK && status_length > 0) {
+        httpd_ws_frame_t frame = {
+                .type = HTTPD_WS_TYPE_TEXT,
+                .payload = (uint8_t *) status,
+                .len = status_length
+        };
+        err = httpd_ws_send_data(terminal_server, fd, &frame);
+    }
+
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to send to socket %d: %s", fd, esp_err_to_name(err));
+        httpd_sess_trigger_close(terminal_server, fd);
+    }
+}
+
+static void web_terminal_task(void *ctx) {
+    uint8_t *chunk = malloc(WEB_TERMINAL_CHUNK_SIZE);
+    if (chunk == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate send buffer");
+        vTaskDelete(NULL);
+        return;
+    }
+
+    while (true) {
+        // Без активных сессий задача спит до подключения клиента
+        ulTaskNotifyTake(pdTRUE, active_sessions > 0 ? pdMS_TO_TICKS(WEB_TERMINAL_FLUSH_INTERVAL) : portMAX_DELAY);
+
+        for (int i = 0; i < WEB_TERMINAL_MAX_SESSIONS; i++) {
+            web_terminal_flush(&sessions[i], chunk);
+        }
+    }
+}
+
+static web_terminal_session_t *session_open(int fd) {
+    xSemaphoreTake(sessions_mutex, portMAX_DELAY);
+    web_terminal_session_t *session = session_find(fd);
+    if (session == NULL) session = session_find(-1);
+    if (session != NULL && session->fd != fd) {
+        xStreamBufferReset(session->buffer);
+        session->fd = fd;
+        session->mode = WEB_TERMINAL_MODE_TEXT;
+        session->rate = WEB_TERMINAL_RATE_DEFAULT;
+        session->dropped = 0;
+        session->dropped_reported = 0;
+        session->tokens = WEB_TERMINAL_RATE_DEFAULT;
+        session->refill_time = esp_timer_get_time();
+        active_sessions++;
+    }
+    xSemaphoreGive(sessions_mutex);
+
+    if (session != NULL) xTaskNotifyGive(terminal_task);
+
+    return session;
+}
+
+void web_terminal_close(int sockfd) {
+    if (sessions_mutex == NULL) return;
+
+    xSemaphoreTake(sessions_mutex, portMAX_DELAY);
+    web_terminal_session_t *session = session_find(sockfd);
+    if (session != NULL) {
+        session->fd = -1;
+        active_sessions--;
+        ESP_LOGI(TAG, "Session on socket %d closed", sockfd);
+    }
+    xSemaphoreGive(sessions_mutex);
+}
+
+static esp_err_t send_text(httpd_req_t *req, const char *text, size_t length) {
+    httpd_ws_frame_t frame = {
+            .type = HTTPD_WS_TYPE_TEXT,
+            .payload = (uint8_t *) text,
+            .len = length
+    };
+    return httpd_ws_send_frame(req, &frame);
+}
+
+/// Обработка управляющего сообщения JSON от браузера
+/// {"type":"command","data":"..."} - команда с CRLF
+/// {"type":"input","data":"..."} - сырые нажатия клавиш
+/// {"type":"mode","mode":"text"|"hex"} - режим отображения
+/// {"type":"rate","rate":N} - ограничение скорости, байт/с
+static esp_err_t handle_control(httpd_req_t *req, web_terminal_session_t *session, const char *payload) {
+    cJSON *root = cJSON_Parse(payload);
+    if (root == NULL) return ESP_OK;
+
+    const char *type = cJSON_GetStringValue(cJSON_GetObjectItem(root, "type"));
+    const char *data = cJSON_GetStringValue(cJSON_GetObjectItem(root, "data"));
+
+    if (type == NULL) {
+        // Игнорируем некорректные сообщения
+    } else if (strcmp(type, "command") == 0 && data != NULL) {
+        uart_write_command(data);
+    } else if (strcmp(type, "input") == 0 && data != NULL) {
+        uart_write((char *) data, strlen(data));
+    } else if (strcmp(type, "mode") == 0 || strcmp(type, "rate") == 0) {
+        const char *mode = cJSON_GetStringValue(cJSON_GetObjectItem(root, "mode"));
+        cJSON *rate = cJSON_GetObjectItem(root, "rate");
+
+        xSemaphoreTake(sessions_mutex, portMAX_DELAY);
+        if (mode != NULL) session->mode = strcmp(mode, "hex") == 0 ? WEB_TERMINAL_MODE_HEX : WEB_TERMINAL_MODE_TEXT;
+        if (cJSON_IsNumber(rate)) session->rate = MAX(WEB_TERMINAL_RATE_MIN, MIN(rate->valueint, WEB_TERMINAL_RATE_MAX));
+        session->tokens = MIN(session->tokens, session->rate);
+
+        char status[96];
+        int status_length = format_status(session, status, sizeof(status));
+        xSemaphoreGive(sessions_mutex);
+
+        cJSON_Delete(root);
+        return send_text(req, status, status_length);
+    }
+
+    cJSON_Delete(root);
+    return ESP_OK;
+}
+
+esp_err_t web_terminal_ws_handler(httpd_req_t *req) {
+    int fd = httpd_req_to_sockfd(req);
+
+    // Рукопожатие WebSocket уже выполнено сервером
+    if (req->method == HTTP_GET) {
+        if (session_open(fd) == NULL) {
+            const char *busy = "{\"type\":\"error\",\"message\":\"Too many terminal sessions\"}";
+            send_text(req, busy, strlen(busy));
+            return ESP_FAIL;
+        }
+
+        ESP_LOGI(TAG, "Session on socket %d opened", fd);
+        return ESP_OK;
+    }
+
+    httpd_ws_frame_t frame = {0};
+    esp_err_t err = httpd_ws_recv_frame(req, &frame, 0);
+    if (err != ESP_OK) return err;
+    if (frame.len > WEB_TERMINAL_FRAME_MAX) {
+        ESP_LOGW(TAG, "Frame too large: %zu bytes", frame.len);
+        return ESP_FAIL;
+    }
+
+    uint8_t payload[WEB_TERMINAL_FRAME_MAX + 1];
+    frame.payload = payload;
+    if (frame.len > 0) {
+        err = httpd_ws_recv_frame(req, &frame, frame.len);
+        if (err != ESP_OK) return err;
+    }
+    payload[frame.len] = '\0';
+
+    xSemaphoreTake(sessions_mutex, portMAX_DELAY);
+    web_terminal_session_t *session = session_find(fd);
+    xSemaphoreGive(sessions_mutex);
+    if (session == NULL) return ESP_FAIL;
+
+    switch (frame.type) {
+        case HTTPD_WS_TYPE_BINARY:
+            // Двоичные кадры передаются в приёмник без изменений (UBX, произвольные байты)
+            uart_write((char *) payload, frame.len);
+            return ESP_OK;
+        case HTTPD_WS_TYPE_TEXT:
+            return handle_control(req, session, (char *) payload);
+        default:
+            return ESP_OK;
+    }
+}
+
+esp_err_t web_terminal_init(httpd_handle_t server) {
+    terminal_server = server;
+
+    sessions_mutex = xSemaphoreCreateMutex();
+    if (sessions_mutex == NULL) return ESP_ERR_NO_MEM;
+
+    for (int i = 0; i < WEB_TERMINAL_MAX_SESSIONS; i++) {
+        sessions[i].fd = -1;
+        sessions[i].buffer = xStreamBufferCreate(WEB_TERMINAL_BUFFER_SIZE, 1);
+        if (sessions[i].buffer == NULL) return ESP_ERR_NO_MEM;
+    }
+
+    uart_register_read_handler(web_terminal_uart_handler);
+
+    task_create(TASK_WEB_TERMINAL, web_terminal_task, NULL, &terminal_task);
+
+    return ESP_OK;
+}
@@ -37,8 +37,11 @@
 #include <uart.h>
 #include <status_led.h>
 #include <retry.h>
+#include <event_journal.h>
 #include <freertos/event_groups.h>
 #include <esp_netif_ip_addr.h>
+#include <esp_timer.h>
+#include <freertos/semphr.h>
 #include "wifi.h"
 #include "config.h"
 #include "rom/ets_sys.h"
@@ -77,6 +80,18 @@ static wifi_sta_list_t ap_sta_list;                 // Список клиент
 static esp_netif_t *esp_netif_ap;                   // Сетевой интерфейс для Access Point режима
 static esp_netif_t *esp_netif_sta;                  // Сетевой интерфейс для Station режима
 
+// Кэш результатов фонового сканирования
+#define WIFI_SCAN_MAX_RECORDS 20                    // Хранится только N сетей с лучшим RSSI
+#define WIFI_SCAN_HOME_CHAN_DWELL 60                // Время на домашнем канале между каналами сканирования (мс)
+#define WIFI_SCAN_TIMEOUT 15000000                  // Сканирование без WIFI_EVENT_SCAN_DONE считается зависшим (мкс)
+
+static SemaphoreHandle_t scan_mutex;                // Защита кэша сканирования
+static wifi_ap_record_t *scan_records;              // Результаты последнего сканирования
+static uint16_t scan_count = 0;                     // Количество сетей в кэше
+static int64_t scan_timestamp = 0;                  // Время завершения последнего сканирования (мкс)
+static int64_t scan_started = 0;                    // Время запуска текущего сканирования (мкс)
+static bool scan_running = false;                   // Сканирование выполняется
+
 static void wifi_sta_status_task(void *ctx) {
     uint8_t rssi_duty = 0;
     while (true) {
@@ -101,7 +116,7 @@ static void wifi_sta_reconnect_task(void *ctx) {
         int attempts = retry_delay(delay_handle);
 
         ESP_LOGI(TAG, "Station Reconnecting: %s, attempts: %d", config_sta.sta.ssid, attempts);
-        uart_nmea("$PESP,WIFI,STA,RECONNECTING,%s,%d", config_sta.sta.ssid, attempts);
+        uart_pesp(NMEA_PESP_WIFI_STA, "RECONNECTING,%s,%d", config_sta.sta.ssid, attempts);
 
         esp_wifi_connect();
 
@@ -115,6 +130,11 @@ static void handle_sta_start(void *esp_netif, esp_event_base_t base, int32_t eve
 
     sta_active = true;
 
+    char ssid[sizeof(config_sta.sta.ssid) + 1];
+    snprintf(ssid, sizeof(ssid), "%.*s", (int) sizeof(config_sta.sta.ssid), (const char *) config_sta.sta.ssid);
+    event_journal_target(EVENT_SUBSYSTEM_WIFI, ssid);
+    event_journal_add(EVENT_SUBSYSTEM_WIFI, EVENT_CONNECTING, 0, 0);
+
     esp_wifi_connect();
 }
 
@@ -128,10 +148,12 @@ static void handle_sta_connected(void *esp_netif, esp_event_base_t base, int32_t
     const wifi_event_sta_connected_t *event = (const wifi_event_sta_connected_t *) event_data;
 
     ESP_LOGI(TAG, "WIFI_EVENT_STA_CONNECTED: ssid: %.*s", event->ssid_len, event->ssid);
-    uart_nmea("$PESP,WIFI,STA,CONNECTED,%.*s", event->ssid_len, event->ssid);
+    uart_pesp(NMEA_PESP_WIFI_STA, "CONNECTED,%.*s", event->ssid_len, event->ssid);
 
     sta_connected = true;
 
+    event_journal_add(EVENT_SUBSYSTEM_WIFI, EVENT_CONNECTED, 0, 0);
+
     retry_reset(delay_handle);
 
     // Tracking status
@@ -162,10 +184,12 @@ static void handle_sta_disconnected(void *esp_netif, esp_event_base_t base, int3
     }
 
     ESP_LOGI(TAG, "WIFI_EVENT_STA_DISCONNECTED: ssid: %.*s, reason: %d (%s)", event->ssid_len, event->ssid, event->reason, reason);
-    uart_nmea("$PESP,WIFI,STA,DISCONNECTED,%.*s,%d,%s", event->ssid_len, event->ssid, event->reason, reason);
+    uart_pesp(NMEA_PESP_WIFI_STA, "DISCONNECTED,%.*s,%d,%s", event->ssid_len, event->ssid, event->reason, reason);
 
     sta_connected = false;
 
+    event_journal_add(EVENT_SUBSYSTEM_WIFI, EVENT_DISCONNECTED, event->reason, 0);
+
     // No longer tracking status
     if (sta_status_task != NULL) vTaskSuspend(sta_status_task);
 
@@ -187,7 +211,7 @@ static void handle_sta_auth_mode_change(void *esp_netif, esp_event_base_t base,
     const char *new_auth_mode = wifi_auth_mode_name(event->new_mode);
 
     ESP_LOGI(TAG, "WIFI_EVENT_STA_AUTHMODE_CHANGE: old: %s, new: %s", old_auth_mode, new_auth_mode);
-    uart_nmea("$PESP,WIFI,STA,AUTH_MODE_CHANGED,%s,%s", old_auth_mode, new_auth_mode);
+    uart_pesp(NMEA_PESP_WIFI_STA, "AUTH_MODE_CHANGED,%s,%s", old_auth_mode, new_auth_mode);
 }
 
 static void handle_ap_start(void *esp_netif, esp_event_base_t base, int32_t event_id, void *event_data) {
@@ -206,7 +230,7 @@ static void handle_ap_sta_connected(void *esp_netif, esp_event_base_t base, int3
     const wifi_event_ap_staconnected_t *event = (const wifi_event_ap_staconnected_t *) event_data;
 
     ESP_LOGI(TAG, "WIFI_EVENT_AP_STACONNECTED: mac: " MACSTR, MAC2STR(event->mac));
-    uart_nmea("$PESP,WIFI,AP,STA_CONNECTED," MACSTR, MAC2STR(event->mac));
+    uart_pesp(NMEA_PESP_WIFI_AP, "STA_CONNECTED," MACSTR, MAC2STR(event->mac));
 
     xEventGroupSetBits(wifi_event_group, WIFI_AP_STA_CONNECTED_BIT);
 
@@ -217,7 +241,7 @@ static void handle_ap_sta_disconnected(void *esp_netif, esp_event_base_t base, i
     const wifi_event_ap_stadisconnected_t *event = (const wifi_event_ap_stadisconnected_t *) event_data;
 
     ESP_LOGI(TAG, "WIFI_EVENT_AP_STADISCONNECTED: mac: " MACSTR, MAC2STR(event->mac));
-    uart_nmea("$PESP,WIFI,AP,STA_DISCONNECTED," MACSTR, MAC2STR(event->mac));
+    uart_pesp(NMEA_PESP_WIFI_AP, "STA_DISCONNECTED," MACSTR, MAC2STR(event->mac));
 
     wifi_ap_sta_list();
     if (ap_sta_list.num == 0) {
@@ -234,7 +258,7 @@ static void handle_sta_got_ip(void *esp_netif, esp_event_base_t base, int32_t ev
             IP2STR(&event->ip_info.ip),
             ffs(~event->ip_info.netmask.addr) - 1,
             IP2STR(&event->ip_info.gw));
-    uart_nmea("$PESP,WIFI,STA,IP," IPSTR "/%d," IPSTR,
+    uart_pesp(NMEA_PESP_WIFI_STA, "IP," IPSTR "/%d," IPSTR,
             IP2STR(&event->ip_info.ip),
             ffs(~event->ip_info.netmask.addr) - 1,
             IP2STR(&event->ip_info.gw));
@@ -244,7 +268,7 @@ static void handle_sta_got_ip(void *esp_netif, esp_event_base_t base, int32_t ev
 
 static void handle_sta_lost_ip(void *esp_netif, esp_event_base_t base, int32_t event_id, void *event_data) {
     ESP_LOGI(TAG, "IP_EVENT_STA_LOST_IP");
-    uart_nmea("$PESP,WIFI,STA,IP_LOST");
+    uart_pesp(NMEA_PESP_WIFI_STA, "IP_LOST");
 
     xEventGroupClearBits(wifi_event_group, WIFI_STA_GOT_IPV4_BIT);
 }
@@ -253,7 +277,46 @@ static void handle_ap_sta_ip_assigned(void *esp_netif, esp_event_base_t base, in
     const ip_event_ap_staipassigned_t *event = (const ip_event_ap_staipassigned_t *) event_data;
 
     ESP_LOGI(TAG, "IP_EVENT_AP_STAIPASSIGNED: ip: " IPSTR, IP2STR(&event->ip));
-    uart_nmea("$PESP,WIFI,AP,STA_IP_ASSIGNED," IPSTR, IP2STR(&event->ip));
+    uart_pesp(NMEA_PESP_WIFI_AP, "STA_IP_ASSIGNED," IPSTR, IP2STR(&event->ip));
+}
+
+static int scan_record_compare(const void *a, const void *b) {
+    return ((const wifi_ap_record_t *) b)->rssi - ((const wifi_ap_record_t *) a)->rssi;
+}
+
+/// Завершение фонового сканирования - сохранение лучших сетей в кэш
+static void handle_scan_done(void *esp_netif, esp_event_base_t base, int32_t event_id, void *event_data) {
+    const wifi_event_sta_scan_done_t *event = (const wifi_event_sta_scan_done_t *) event_data;
+
+    uint16_t number = 0;
+    esp_wifi_scan_get_ap_num(&number);
+
+    wifi_ap_record_t *records = NULL;
+    if (event->status == 0 && number > 0) records = malloc(number * sizeof(wifi_ap_record_t));
+    // Без памяти под результаты кэш не обновляется, как и при ошибке сканирования
+    bool update = event->status == 0 && (number == 0 || records != NULL);
+    if (records != NULL) {
+        esp_wifi_scan_get_ap_records(&number, records);
+        qsort(records, number, sizeof(wifi_ap_record_t), scan_record_compare);
+    } else {
+        // Список в драйвере всё равно нужно освободить
+        esp_wifi_clear_ap_list();
+        number = 0;
+    }
+
+    xSemaphoreTake(scan_mutex, portMAX_DELAY);
+    // При ошибке сканирования сохраняются предыдущие результаты
+    if (update && scan_records != NULL) {
+        scan_count = MIN(number, WIFI_SCAN_MAX_RECORDS);
+        if (scan_count > 0) memcpy(scan_records, records, scan_count * sizeof(wifi_ap_record_t));
+        scan_timestamp = esp_timer_get_time();
+    }
+    scan_running = false;
+    xSemaphoreGive(scan_mutex);
+
+    free(records);
+
+    ESP_LOGI(TAG, "WIFI_EVENT_SCAN_DONE: status: %d, found %d networks", (int) event->status, number);
 }
 
 /// Ожидание получения IP адреса в Station режиме
@@ -274,6 +337,10 @@ void wait_for_network() {
 void wifi_init() {
     // Создание группы событий для синхронизации между WiFi задачами
     wifi_event_group = xEventGroupCreate();
+
+    // Кэш фонового сканирования, выделяется один раз
+    scan_mutex = xSemaphoreCreateMutex();
+    scan_records = malloc(WIFI_SCAN_MAX_RECORDS * sizeof(wifi_ap_record_t));
     
     // Инициализация WiFi драйвера с настройками по умолчанию
     wifi_init_config_t wifi_init_config = WIFI_INIT_CONFIG_DEFAULT();
@@ -320,7 +387,7 @@ void wifi_init() {
         ESP_LOGI(TAG, "WIFI_AP_SSID: %s %s(%s)", config_ap.ap.ssid,
                 config_ap.ap.ssid_hidden ? "(hidden) " : "",
                 ap_password_len == 0 ? "open" : "with password");
-        uart_nmea("$PESP,WIFI,AP,SSID,%s,%c,%c", config_ap.ap.ssid,
+        uart_pesp(NMEA_PESP_WIFI_AP, "SSID,%s,%c,%c", config_ap.ap.ssid,
                 config_ap.ap.ssid_hidden ? 'H' : 'V',
                 ap_password_len == 0 ? 'O' : 'P');
 
@@ -328,7 +395,7 @@ void wifi_init() {
                 IP2STR(&ip_info_ap.ip),
                 ffs(~ip_info_ap.netmask.addr) - 1,
                 IP2STR(&ip_info_ap.gw));
-        uart_nmea("$PESP,WIFI,AP,IP," IPSTR "/%d",
+        uart_pesp(NMEA_PESP_WIFI_AP, "IP," IPSTR "/%d",
                 IP2STR(&ip_info_ap.ip),
                 ffs(~ip_info_ap.netmask.addr) - 1);
     }
@@ -369,7 +436,7 @@ void wifi_init() {
 
         ESP_LOGI(TAG, "WIFI_STA_CONNECTING: %s (%s), all channel scan", config_sta.sta.ssid,
                 sta_password_len == 0 ? "open" : "with password");
-        uart_nmea("$PESP,WIFI,STA,CONNECTING,%s,%c,A", config_sta.sta.ssid,
+        uart_pesp(NMEA_PESP_WIFI_STA, "CONNECTING,%s,%c,A", config_sta.sta.ssid,
                 sta_password_len == 0 ? 'O' : 'P');
     }
 
@@ -383,6 +450,7 @@ void wifi_init() {
     ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_AP_STOP, &handle_ap_stop, NULL));
     ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_AP_STACONNECTED, &handle_ap_sta_connected, NULL));
     ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_AP_STADISCONNECTED, &handle_ap_sta_disconnected, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_SCAN_DONE, &handle_scan_done, NULL));
     ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &handle_sta_got_ip, NULL));
     ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_LOST_IP, &handle_sta_lost_ip, NULL));
     ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_AP_STAIPASSIGNED, &handle_ap_sta_ip_assigned, NULL));
@@ -414,11 +482,11 @@ void wifi_init() {
         ESP_ERROR_CHECK(esp_wifi_set_bandwidth(ESP_IF_WIFI_STA, WIFI_BW_HT20));
 
         // Keep track of connection for RSSI indicator, but suspend until connected
-        xTaskCreate(wifi_sta_status_task, "wifi_sta_status", 2048, NULL, TASK_PRIORITY_WIFI_STATUS, &sta_status_task);
+        task_create(TASK_WIFI_STA_STATUS, wifi_sta_status_task, NULL, &sta_status_task);
         vTaskSuspend(sta_status_task);
 
         // Reconnect when disconnected
-        xTaskCreate(wifi_sta_reconnect_task, "wifi_sta_reconnect", 4096, NULL, TASK_PRIORITY_WIFI_STATUS, &sta_reconnect_task);
+        task_create(TASK_WIFI_STA_RECONNECT, wifi_sta_reconnect_task, NULL, &sta_reconnect_task);
         vTaskSuspend(sta_reconnect_task);
 
         config_color_t sta_led_color = config_get_color(CONF_ITEM(KEY_CONFIG_WIFI_STA_COLOR));
@@ -470,7 +538,17 @@ void wifi_sta_status(wifi_sta_status_t *status) {
     esp_netif_get_ip6_linklocal(esp_netif_sta, &status->ip6_addr);
 }
 
-wifi_ap_record_t *wifi_scan(uint16_t *number) {
+/// Запуск фонового сканирования, не блокирует вызывающую задачу
+/// Результаты сохраняются в кэш обработчиком WIFI_EVENT_SCAN_DONE
+esp_err_t wifi_scan_start() {
+    xSemaphoreTake(scan_mutex, portMAX_DELAY);
+
+    // Сканирование уже идёт - повторный запуск не нужен
+    if (scan_running && esp_timer_get_time() - scan_started < WIFI_SCAN_TIMEOUT) {
+        xSemaphoreGive(scan_mutex);
+        return ESP_OK;
+    }
+
     wifi_mode_t wifi_mode;
     esp_wifi_get_mode(&wifi_mode);
 
@@ -479,7 +557,9 @@ wifi_ap_record_t *wifi_scan(uint16_t *number) {
         esp_wifi_set_mode(wifi_mode == WIFI_MODE_AP ? WIFI_MODE_APSTA : WIFI_MODE_STA);
     }
 
-    // Расширенная конфигурация сканирования для обнаружения большего количества сетей
+    // Время на канал ограничено настройкой, чтобы не прерывать потоки к кастерам надолго
+    uint16_t dwell = config_get_u16(CONF_ITEM(KEY_CONFIG_WIFI_STA_SCAN_DWELL));
+    dwell = MAX(20, MIN(dwell, 500));
     wifi_scan_config_t wifi_scan_config = {
             .ssid = NULL,
             .bssid = NULL,
@@ -488,38 +568,53 @@ wifi_ap_record_t *wifi_scan(uint16_t *number) {
             .scan_type = WIFI_SCAN_TYPE_ACTIVE,  // Активное сканирование
             .scan_time = {
                 .active = {
-                    .min = 100,        // Минимальное время на канал (мс)
-                    .max = 300         // Максимальное время на канал (мс)
+                    .min = dwell / 2,  // Минимальное время на канал (мс)
+                    .max = dwell       // Максимальное время на канал (мс)
                 },
-                .passive = 300         // Время пассивного сканирования (мс)
-            }
+                .passive = dwell       // Время пассивного сканирования (мс)
+            },
+            .home_chan_dwell_time = WIFI_SCAN_HOME_CHAN_DWELL  // Возврат на канал AP между каналами
     };
 
-    ESP_LOGI(TAG, "Starting WiFi scan...");
-    esp_err_t scan_result = esp_wifi_scan_start(&wifi_scan_config, true);
-    if (scan_result != ESP_OK) {
-        ESP_LOGE(TAG, "WiFi scan start failed: %s", esp_err_to_name(scan_result));
-        *number = 0;
-        return NULL;
+    ESP_LOGI(TAG, "Starting WiFi scan, dwell %d ms", dwell);
+    esp_err_t err = esp_wifi_scan_start(&wifi_scan_config, false);
+    if (err == ESP_OK) {
+        scan_running = true;
+        scan_started = esp_timer_get_time();
+    } else {
+        ESP_LOGE(TAG, "WiFi scan start failed: %s", esp_err_to_name(err));
     }
 
-    esp_wifi_scan_get_ap_num(number);
-    ESP_LOGI(TAG, "WiFi scan completed, found %d networks", *number);
-    
-    if (*number <= 0) {
-        return NULL;
-    }
+    xSemaphoreGive(scan_mutex);
+
+    return err;
+}
 
-    wifi_ap_record_t *ap_records = (wifi_ap_record_t *) malloc(*number * sizeof(wifi_ap_record_t));
-    if (ap_records == NULL) {
-        ESP_LOGE(TAG, "Failed to allocate memory for scan results");
-        *number = 0;
-        return NULL;
+/// Копия кэша результатов сканирования
+/// @param number Количество сетей в возвращённом массиве
+/// @param status Состояние сканирования и время получения результатов
+/// @return Массив сетей (освобождается вызывающим) или NULL, если кэш пуст
+wifi_ap_record_t *wifi_scan_results(uint16_t *number, wifi_scan_status_t *status) {
+    wifi_ap_record_t *records = NULL;
+
+    xSemaphoreTake(scan_mutex, portMAX_DELAY);
+    // WIFI_EVENT_SCAN_DONE потерян: сканирование считается завершённым, следующий запрос запустит новое
+    if (scan_running && esp_timer_get_time() - scan_started >= WIFI_SCAN_TIMEOUT) scan_running = false;
+    status->scanning = scan_running;
+    status->timestamp = scan_timestamp;
+
+    *number = scan_count;
+    if (scan_count > 0) {
+        records = malloc(scan_count * sizeof(wifi_ap_record_t));
+        if (records != NULL) {
+            memcpy(records, scan_records, scan_count * sizeof(wifi_ap_record_t));
+        } else {
+            *number = 0;
+        }
     }
-    
-    esp_wifi_scan_get_ap_records(number, ap_records);
+    xSemaphoreGive(scan_mutex);
 
-    return ap_records;
+    return records;
 }
 
 const char *wifi_auth_mode_name(wifi_auth_mode_t auth_mode) {
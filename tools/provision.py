@@ -0,0 +1,89 @@
+#!/usr/bin/env python3
+#
+# This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+# Copyright (c) 2019 Nebojsa Cvetkovic.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, version 3.
+#
+# This program is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+# General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+"""Push a configuration file to many devices in parallel.
+
+The file is either a /config/export download (JSON or binary) or a partial
+JSON document such as {"items": {"ntr_srv_host": "caster.example.com"}}.
+
+    tools/provision.py config.json 192.168.1.20 192.168.1.21
+    tools/provision.py config.bin --hosts fleet.txt --passphrase secret -j 16
+"""
+
+import argparse
+import base64
+import concurrent.futures
+import json
+import sys
+import urllib.error
+import urllib.request
+
+
+def push(host, data, args):
+    url = host if host.startswith('http') else 'http://' + host
+    request = urllib.request.Request(url.rstrip('/') + '/config/import', data=data, method='POST')
+    request.add_header('Content-Type', 'application/octet-stream')
+    if args.passphrase:
+        request.add_header('X-Config-Passphrase', args.passphrase)
+    if args.user:
+        token = base64.b64encode(f'{args.user}:{args.password or ""}'.encode()).decode()
+        request.add_header('Authorization', 'Basic ' + token)
+
+    try:
+        with urllib.request.urlopen(request, timeout=args.timeout) as response:
+            result = json.load(response)
+            return host, True, f'{result.get("applied", 0)} settings' + (', restarting' if result.get('restart') else '')
+    except urllib.error.HTTPError as e:
+        return host, False, f'HTTP {e.code}: {e.read().decode(errors="replace").strip()}'
+    except (urllib.error.URLError, OSError, ValueError) as e:
+        return host, False, str(e)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('config', help='configuration file (JSON or NTCF binary)')
+    parser.add_argument('host', nargs='*', help='device address')
+    parser.add_argument('--hosts', help='file with one device address per line')
+    parser.add_argument('--passphrase', help='passphrase for encrypted secrets')
+    parser.add_argument('--user', help='admin username (basic auth)')
+    parser.add_argument('--password', help='admin password (basic auth)')
+    parser.add_argument('-j', '--jobs', type=int, default=8, help='parallel uploads (default: 8)')
+    parser.add_argument('--timeout', type=float, default=30, help='per-device timeout in seconds')
+    args = parser.parse_args()
+
+    hosts = list(args.host)
+    if args.hosts:
+        with open(args.hosts) as f:
+            hosts += [line.strip() for line in f if line.strip() and not line.startswith('#')]
+    if not hosts:
+        parser.error('no devices given')
+
+    with open(args.config, 'rb') as f:
+        data = f.read()
+
+    failed = 0
+    with concurrent.futures.ThreadPoolExecutor(max_workers=args.jobs) as executor:
+        for host, ok, message in executor.map(lambda h: push(h, data, args), hosts):
+            print(f'{"OK  " if ok else "FAIL"} {host}: {message}')
+            failed += not ok
+
+    print(f'{len(hosts) - failed}/{len(hosts)} devices provisioned')
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
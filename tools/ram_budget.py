@@ -0,0 +1,156 @@
+#!/usr/bin/env python3
+#
+# This file is part of the ESP32-XBee distribution (https://github.com/nebkat/esp32-xbee).
+# Copyright (c) 2019 Nebojsa Cvetkovic.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, version 3.
+#
+# This program is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+# General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+"""Check task stacks and static RAM against the per-target budgets in tasks.h.
+
+Stacks come from TASKS_SCHEMA plus the default event loop task (its size from
+sdkconfig), static data (.data, .bss, .noinit in DRAM) from the linker map.
+Exits non-zero when any checked target is over budget.
+
+    tools/ram_budget.py --target esp32c3 --map build/esp32c3-ntrip-duo.map --sdkconfig sdkconfig
+    tools/ram_budget.py --all
+"""
+
+import argparse
+import os
+import re
+import sys
+
+TARGETS = ['esp32', 'esp32s3', 'esp32c3', 'esp32c6']
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..')
+TASKS_H = os.path.join(ROOT, 'main', 'include', 'tasks.h')
+
+# The default event loop task runs the UART read handlers; ESP-IDF's default stack size
+EVENT_LOOP_TASK = 'sys_evt'
+EVENT_LOOP_STACK_DEFAULT = 2304
+
+# Output sections of ESP-IDF linker scripts holding static data in internal DRAM
+STATIC_SECTIONS = ('.dram0.data', '.dram0.bss', '.noinit', '.dram0.noinit')
+
+
+def parse_tasks(path):
+    with open(path) as f:
+        text = f.read()
+
+    tasks = [(name, int(stack)) for name, stack in
+             re.findall(r'X\(\s*\w+\s*,\s*"([^"]+)"\s*,\s*(\d+)\s*,', text)]
+    budgets = {}
+    for kind, target, kb in re.findall(r'#define\s+(TASK_STACK_BUDGET|RAM_BUDGET)_(\w+)\s+\((\d+)\s*\*\s*1024\)', text):
+        budgets[(kind, target.lower())] = int(kb) * 1024
+
+    if not tasks:
+        raise SystemExit(f'No TASKS_SCHEMA entries found in {path}')
+    return tasks, budgets
+
+
+def parse_event_loop_stack(paths):
+    """CONFIG_ESP_SYSTEM_EVENT_TASK_STACK_SIZE from the last sdkconfig file that sets it."""
+    stack = EVENT_LOOP_STACK_DEFAULT
+    for path in paths:
+        if not os.path.exists(path):
+            continue
+        with open(path) as f:
+            for value in re.findall(r'^CONFIG_ESP_SYSTEM_EVENT_TASK_STACK_SIZE=(\d+)', f.read(), re.M):
+                stack = int(value)
+    return stack
+
+
+def parse_map(path):
+    sizes = {}
+    with open(path) as f:
+        lines = f.read().splitlines()
+
+    for i, line in enumerate(lines):
+        fields = line.split()
+        if not fields or line[0].isspace() or fields[0] not in STATIC_SECTIONS:
+            continue
+        # Long section names put address and size on the following line
+        if len(fields) < 3 and i + 1 < len(lines):
+            fields = [fields[0]] + lines[i + 1].split()
+        if len(fields) >= 3 and fields[2].startswith('0x'):
+            sizes[fields[0]] = sizes.get(fields[0], 0) + int(fields[2], 16)
+
+    return sizes
+
+
+def check(target, tasks, budgets, sizes):
+    stack_total = sum(stack for _, stack in tasks)
+    stack_budget = budgets.get(('TASK_STACK_BUDGET', target))
+    ram_budget = budgets.get(('RAM_BUDGET', target))
+    if stack_budget is None or ram_budget is None:
+        print(f'{target}: no budget defined in tasks.h')
+        return False
+
+    ok = stack_total <= stack_budget
+    print(f'{target}: task stacks {stack_total} / {stack_budget} bytes{"" if ok else "  OVER BUDGET"}')
+
+    if sizes is not None:
+        static_total = sum(sizes.values())
+        ram_total = static_total + stack_total
+        detail = ', '.join(f'{name} {size}' for name, size in sorted(sizes.items()))
+        ram_ok = ram_total <= ram_budget
+        print(f'{target}: static {static_total} ({detail}) + stacks = {ram_total} / {ram_budget} bytes'
+              f'{"" if ram_ok else "  OVER BUDGET"}')
+        ok = ok and ram_ok
+
+    return ok
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--target', choices=TARGETS, help='target to check')
+    parser.add_argument('--all', action='store_true', help='check task stacks for every target')
+    parser.add_argument('--map', help='linker map of the --target build')
+    parser.add_argument('--tasks', default=TASKS_H, help='path to tasks.h')
+    parser.add_argument('--sdkconfig', help='sdkconfig of the --target build (default: sdkconfig.defaults '
+                        'and sdkconfig.<target>)')
+    parser.add_argument('-v', '--verbose', action='store_true', help='list registry tasks')
+    args = parser.parse_args()
+
+    if not args.all and not args.target:
+        parser.error('--target or --all is required')
+    if args.map and not args.target:
+        parser.error('--map needs --target')
+
+    if args.sdkconfig and not args.target:
+        parser.error('--sdkconfig needs --target')
+
+    tasks, budgets = parse_tasks(args.tasks)
+
+    sizes = parse_map(args.map) if args.map else None
+    if sizes is not None and not sizes:
+        print(f'No static data sections found in {args.map}', file=sys.stderr)
+        return 1
+
+    ok = True
+    for target in TARGETS if args.all else [args.target]:
+        if args.sdkconfig and target == args.target:
+            sdkconfigs = [args.sdkconfig]
+        else:
+            sdkconfigs = [os.path.join(ROOT, 'sdkconfig.defaults'), os.path.join(ROOT, f'sdkconfig.{target}')]
+        target_tasks = tasks + [(EVENT_LOOP_TASK, parse_event_loop_stack(sdkconfigs))]
+        if args.verbose:
+            for name, stack in target_tasks:
+                print(f'  {name:<16} {stack:>6}')
+
+        ok = check(target, target_tasks, budgets, sizes if target == args.target else None) and ok
+
+    return 0 if ok else 1
+
+
+if __name__ == '__main__':
+    sys.exit(main())